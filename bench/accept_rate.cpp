@@ -0,0 +1,132 @@
+// ---------------------------------------------------------------------------
+// Accept-rate benchmark
+//
+// Opens the server with 1, 2, 4, ... command acceptors and hammers it from
+// client threads that each repeatedly connect, complete one request
+// (INSTRUCTION_SESSION_ID) and disconnect.  Prints completed sessions per
+// second for every acceptor count.
+//
+//   accept_rate_bench [seconds_per_run=3] [client_threads=2*cores] [max_acceptors=cores]
+//
+// POSIX only (raw sockets on the client side).
+// ---------------------------------------------------------------------------
+#include "remote_command_server.hpp"
+#include "protocol/remote_command_protocol.hpp"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+using namespace Bn3Monkey;
+
+static constexpr int DISC_PORT = 19103;
+static constexpr int CMD_PORT  = 19101;
+static constexpr int STR_PORT  = 19102;
+
+static bool oneSession(const sockaddr_in& addr)
+{
+    int sock = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return false;
+
+    // Reset on close: no TIME_WAIT, so the client never runs out of ports.
+    linger lg { 1, 0 };
+    setsockopt(sock, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    int yes = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+    bool ok = false;
+    if (::connect(sock, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0) {
+        RemoteCommandRequestHeader req(RemoteCommandInstruction::INSTRUCTION_SESSION_ID);
+        RemoteCommandResponseHeader resp(RemoteCommandInstruction::INSTRUCTION_EMPTY);
+        char reply[sizeof(uint32_t) + sizeof(RemoteCommandSessionTokenInner)];   // id + token
+        ok = ::send(sock, &req, sizeof(req), MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof(req)) &&
+             ::recv(sock, &resp, sizeof(resp), MSG_WAITALL) == static_cast<ssize_t>(sizeof(resp)) &&
+             ::recv(sock, reply, sizeof(reply), MSG_WAITALL) == static_cast<ssize_t>(sizeof(reply));
+    }
+    ::close(sock);
+    return ok;
+}
+
+static double measure(int acceptors, int clients, int seconds, const char* cwd)
+{
+    RemoteCommandServerOptions options;
+    options.acceptor_threads = acceptors;
+
+    RemoteCommandServer* server = openRemoteCommandServer(DISC_PORT, CMD_PORT, STR_PORT, cwd, options);
+    if (!server) return -1.0;
+
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(CMD_PORT);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+    std::atomic<bool>     running { true };
+    std::atomic<uint64_t> completed { 0 };
+    std::vector<std::thread> threads;
+    for (int i = 0; i < clients; ++i) {
+        threads.emplace_back([&]() {
+            uint64_t local = 0;
+            while (running.load()) {
+                if (oneSession(addr)) ++local;
+            }
+            completed.fetch_add(local);
+        });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    running.store(false);
+    for (auto& t : threads) t.join();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    closeRemoteCommandServer(server);
+    return static_cast<double>(completed.load()) / elapsed;
+}
+
+int main(int argc, char* argv[])
+{
+    int cores     = static_cast<int>(std::thread::hardware_concurrency());
+    if (cores <= 0) cores = 1;
+    int seconds   = argc > 1 ? std::atoi(argv[1]) : 3;
+    int clients   = argc > 2 ? std::atoi(argv[2]) : 2 * cores;
+    int max_accept = argc > 3 ? std::atoi(argv[3]) : cores;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    std::error_code ec;
+    std::string cwd = std::filesystem::temp_directory_path(ec).string();
+
+    std::fprintf(stderr, "accept rate: %d s per run, %d client threads, %d cores\n",
+                 seconds, clients, cores);
+    std::fprintf(stderr, "%10s %16s %10s\n", "acceptors", "sessions/s", "speedup");
+
+    // The server logs every connect / disconnect; keep that out of the numbers.
+    std::fflush(stdout);
+    if (!std::freopen("/dev/null", "w", stdout))
+        std::fprintf(stderr, "(could not silence server log)\n");
+
+    double baseline = 0.0;
+    for (int acceptors = 1; acceptors <= max_accept; acceptors *= 2) {
+        double rate = measure(acceptors, clients, seconds, cwd.c_str());
+        if (rate < 0) {
+            std::fprintf(stderr, "%10d %16s\n", acceptors, "failed to open");
+            continue;
+        }
+        if (baseline == 0.0) baseline = rate;
+        std::fprintf(stderr, "%10d %16.0f %9.2fx\n", acceptors, rate, rate / baseline);
+        if (acceptors < max_accept && acceptors * 2 > max_accept)
+            acceptors = max_accept / 2;     // always finish with max_accept
+    }
+    return 0;
+}
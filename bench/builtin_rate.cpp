@@ -0,0 +1,111 @@
+// ---------------------------------------------------------------------------
+// Built-in command benchmark
+//
+// Runs each hot micro-command repeatedly through runCommand, once with the
+// server's in-process built-ins and once with every command going through
+// /bin/sh, and prints commands per second for both.
+//
+//   builtin_rate_bench [iterations=200]
+//
+// POSIX only (the built-ins replace /bin/sh).
+// ---------------------------------------------------------------------------
+#include "remote_command_server.hpp"
+#include "remote_command_client.hpp"
+
+#include <signal.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+using namespace Bn3Monkey;
+namespace fs = std::filesystem;
+
+static constexpr int DISC_PORT = 19113;
+static constexpr int CMD_PORT  = 19111;
+static constexpr int STR_PORT  = 19112;
+
+static const char* COMMANDS[] = {
+    "cat small.txt",
+    "wc -l small.txt",
+    "head -n 5 small.txt",
+    "test -f small.txt",
+    "touch stamp.txt",
+    "mkdir -p made/deep",
+    "rm -f missing.txt",
+    "echo ready",
+};
+
+static void onOutput(const char*) {}
+
+// Commands per second for each entry of COMMANDS, or -1 if the server failed
+static bool measure(bool builtins, int iterations, const std::string& cwd, double* rates)
+{
+    RemoteCommandServerOptions options;
+    options.builtin_commands = builtins;
+
+    RemoteCommandServer* server = openRemoteCommandServer(DISC_PORT, CMD_PORT, STR_PORT, cwd.c_str(), options);
+    if (!server) return false;
+
+    RemoteCommandClient* client = createRemoteCommandClient(CMD_PORT, STR_PORT);
+    if (!client) {
+        closeRemoteCommandServer(server);
+        return false;
+    }
+    onRemoteOutput(client, onOutput);
+    onRemoteError(client, onOutput);
+
+    size_t index = 0;
+    for (const char* cmd : COMMANDS) {
+        runCommandImpl(client, cmd);        // warm-up
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+            runCommandImpl(client, cmd);
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        rates[index++] = iterations / elapsed;
+    }
+
+    releaseRemoteCommandClient(client);
+    closeRemoteCommandServer(server);
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 200;
+    signal(SIGPIPE, SIG_IGN);
+
+    std::error_code ec;
+    fs::path dir = fs::temp_directory_path(ec) / "rcs_builtin_bench";
+    fs::remove_all(dir, ec);
+    fs::create_directories(dir, ec);
+    {
+        std::ofstream f(dir / "small.txt");
+        for (int i = 0; i < 20; ++i) f << "line " << i << "\n";
+    }
+
+    // The server logs every connect / disconnect; keep that out of the numbers.
+    std::fflush(stdout);
+    if (!std::freopen("/dev/null", "w", stdout))
+        std::fprintf(stderr, "(could not silence server log)\n");
+
+    const size_t count = sizeof(COMMANDS) / sizeof(COMMANDS[0]);
+    double shell[sizeof(COMMANDS) / sizeof(COMMANDS[0])];
+    double native[sizeof(COMMANDS) / sizeof(COMMANDS[0])];
+    if (!measure(false, iterations, dir.string(), shell) ||
+        !measure(true, iterations, dir.string(), native)) {
+        std::fprintf(stderr, "failed to open server / client\n");
+        return 1;
+    }
+
+    std::fprintf(stderr, "builtin rate: %d runs per command\n", iterations);
+    std::fprintf(stderr, "%-22s %12s %12s %9s\n", "command", "shell cmd/s", "builtin cmd/s", "speedup");
+    for (size_t i = 0; i < count; ++i)
+        std::fprintf(stderr, "%-22s %12.0f %12.0f %8.1fx\n", COMMANDS[i], shell[i], native[i], native[i] / shell[i]);
+
+    fs::remove_all(dir, ec);
+    return 0;
+}
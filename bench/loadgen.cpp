@@ -0,0 +1,318 @@
+// ---------------------------------------------------------------------------
+// Load generator
+//
+// Opens N clients against one server and has each of them run a weighted
+// mix of operations, either back to back (closed loop) or on a fixed
+// schedule (open loop, --rate).  Reports throughput, errors and latency
+// percentiles per operation type.
+//
+//   remote_command_loadgen [--local] [--host IP] [--ports CMD,STREAM]
+//                          [--clients 8] [--duration 10] [--rate 0]
+//                          [--mix rpc=70,upload=10,download=10,command=10]
+//                          [--file-size 65536] [--output-lines 100]
+//                          [--json FILE]
+//
+// Operations:
+//   rpc       currentWorkingDirectory, one small request / response
+//   upload    uploadFile of --file-size bytes
+//   download  downloadFile of --file-size bytes
+//   command   runCommand printing --output-lines lines through a real process
+//
+// --local starts a server in-process (in a temporary directory) on the
+// given ports, so nothing else needs to run.  In open-loop mode latency is
+// measured from the moment an operation was due, not from when it started:
+// a server that falls behind shows up as latency instead of a lower rate.
+//
+// POSIX only (the command operation uses yes / head).  Default ports
+// 19131-19133.
+// ---------------------------------------------------------------------------
+#include "remote_command_server.hpp"
+#include "remote_command_client.hpp"
+
+#include <signal.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Bn3Monkey;
+namespace fs = std::filesystem;
+
+enum Operation
+{
+    OP_RPC,
+    OP_UPLOAD,
+    OP_DOWNLOAD,
+    OP_COMMAND,
+    OP_COUNT
+};
+
+static const char* OPERATION_NAMES[OP_COUNT] = { "rpc", "upload", "download", "command" };
+
+struct Options
+{
+    bool        local        { false };
+    std::string host         { "127.0.0.1" };
+    int32_t     command_port { 19131 };
+    int32_t     stream_port  { 19132 };
+    int32_t     clients      { 8 };
+    double      duration_s   { 10.0 };
+    double      rate         { 0.0 };      // operations per second over all clients; 0 = closed loop
+    uint32_t    weights[OP_COUNT] { 70, 10, 10, 10 };
+    size_t      file_size    { 64 * 1024 };
+    uint32_t    output_lines { 100 };
+    std::string json_file;
+};
+
+// One per client thread, merged at the end
+struct Samples
+{
+    std::vector<uint32_t> latencies_us[OP_COUNT];
+    uint64_t              errors[OP_COUNT] {};
+};
+
+static std::atomic<uint64_t> g_output_bytes { 0 };
+
+static void onOutput(const char* text)
+{
+    g_output_bytes.fetch_add(strlen(text), std::memory_order_relaxed);
+}
+
+static void usage()
+{
+    std::fprintf(stderr,
+        "usage: remote_command_loadgen [--local] [--host IP] [--ports CMD,STREAM]\n"
+        "                              [--clients N] [--duration S] [--rate OPS_PER_S]\n"
+        "                              [--mix rpc=W,upload=W,download=W,command=W]\n"
+        "                              [--file-size BYTES] [--output-lines N] [--json FILE]\n");
+}
+
+static bool parseMix(const char* text, uint32_t* weights)
+{
+    std::fill(weights, weights + OP_COUNT, 0u);
+    std::string mix(text);
+    size_t start = 0;
+    while (start < mix.size()) {
+        size_t end = mix.find(',', start);
+        if (end == std::string::npos) end = mix.size();
+        const std::string item = mix.substr(start, end - start);
+        const size_t eq = item.find('=');
+        if (eq == std::string::npos) return false;
+        const std::string name = item.substr(0, eq);
+        size_t op = 0;
+        while (op < OP_COUNT && name != OPERATION_NAMES[op]) ++op;
+        if (op == OP_COUNT) return false;
+        weights[op] = static_cast<uint32_t>(std::strtoul(item.c_str() + eq + 1, nullptr, 10));
+        start = end + 1;
+    }
+    uint32_t total = 0;
+    for (size_t op = 0; op < OP_COUNT; ++op) total += weights[op];
+    return total > 0;
+}
+
+static bool parseOptions(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (arg == "--local") {
+            options.local = true;
+            continue;
+        }
+        if (!value) return false;
+        ++i;
+        if (arg == "--host")
+            options.host = value;
+        else if (arg == "--ports") {
+            if (std::sscanf(value, "%d,%d", &options.command_port, &options.stream_port) != 2) return false;
+        }
+        else if (arg == "--clients")      options.clients      = std::max(1, std::atoi(value));
+        else if (arg == "--duration")     options.duration_s   = std::atof(value);
+        else if (arg == "--rate")         options.rate         = std::atof(value);
+        else if (arg == "--file-size")    options.file_size    = static_cast<size_t>(std::strtoull(value, nullptr, 10));
+        else if (arg == "--output-lines") options.output_lines = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+        else if (arg == "--json")         options.json_file    = value;
+        else if (arg == "--mix") {
+            if (!parseMix(value, options.weights)) return false;
+        }
+        else return false;
+    }
+    return options.duration_s > 0;
+}
+
+static bool writeFile(const fs::path& path, size_t size)
+{
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    std::string block(64 * 1024, 'l');
+    for (size_t written = 0; written < size; written += block.size())
+        f.write(block.data(), static_cast<std::streamsize>(std::min(block.size(), size - written)));
+    return static_cast<bool>(f);
+}
+
+static void runClient(const Options& options, int index, const fs::path& local_dir,
+                      std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point stop,
+                      Samples& samples, std::atomic<int>& failed)
+{
+    RemoteCommandClient* client = createRemoteCommandClient(options.command_port, options.stream_port,
+                                                            options.host.c_str());
+    if (!client) {
+        failed.fetch_add(1);
+        return;
+    }
+    onRemoteOutput(client, onOutput);
+    onRemoteError(client, onOutput);
+
+    // Every client transfers its own file; the download source is uploaded once up front
+    const std::string local  = (local_dir / ("loadgen_" + std::to_string(index) + ".bin")).string();
+    const std::string copy   = local + ".down";
+    const std::string remote = "loadgen_" + std::to_string(index) + ".bin";
+    const std::string command = "yes loadgen | head -n " + std::to_string(options.output_lines);
+    if (!writeFile(local, options.file_size) || !uploadFile(client, local.c_str(), remote.c_str())) {
+        failed.fetch_add(1);
+        releaseRemoteCommandClient(client);
+        return;
+    }
+
+    uint32_t total_weight = 0;
+    for (size_t op = 0; op < OP_COUNT; ++op) total_weight += options.weights[op];
+    std::mt19937 random(static_cast<uint32_t>(index) * 7919u + 1u);
+
+    // Open loop: this client's share of the rate, staggered against the others
+    const bool   open_loop = options.rate > 0;
+    const double interval  = open_loop ? options.clients / options.rate : 0.0;
+    auto due = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                           std::chrono::duration<double>(interval * index / options.clients));
+
+    while (true) {
+        if (open_loop) {
+            if (due >= stop) break;
+            std::this_thread::sleep_until(due);
+        } else {
+            due = std::chrono::steady_clock::now();
+            if (due >= stop) break;
+        }
+
+        uint32_t pick = std::uniform_int_distribution<uint32_t>(0, total_weight - 1)(random);
+        size_t op = 0;
+        while (pick >= options.weights[op]) pick -= options.weights[op++];
+
+        bool ok = false;
+        switch (op) {
+        case OP_RPC:      ok = currentWorkingDirectory(client) != nullptr; break;
+        case OP_UPLOAD:   ok = uploadFile(client, local.c_str(), remote.c_str()); break;
+        case OP_DOWNLOAD: ok = downloadFile(client, copy.c_str(), remote.c_str()); break;
+        case OP_COMMAND:  ok = runCommandImpl(client, command.c_str()) == 0; break;
+        }
+
+        const auto end = std::chrono::steady_clock::now();
+        const auto us  = std::chrono::duration_cast<std::chrono::microseconds>(end - due).count();
+        if (ok)
+            samples.latencies_us[op].push_back(static_cast<uint32_t>(std::min<int64_t>(us, UINT32_MAX)));
+        else
+            samples.errors[op]++;
+
+        if (open_loop)
+            due += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                       std::chrono::duration<double>(interval));
+    }
+    releaseRemoteCommandClient(client);
+}
+
+static uint32_t percentile(const std::vector<uint32_t>& sorted, double q)
+{
+    if (sorted.empty()) return 0;
+    return sorted[std::min(sorted.size() - 1, static_cast<size_t>(q * sorted.size()))];
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage();
+        return 2;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    std::error_code ec;
+    const fs::path dir = fs::temp_directory_path(ec) / ("rcs_loadgen_" + std::to_string(options.command_port));
+    fs::remove_all(dir, ec);
+    fs::create_directories(dir / "local", ec);
+    fs::create_directories(dir / "remote", ec);
+
+    RemoteCommandServer* server = nullptr;
+    if (options.local) {
+        RemoteCommandServerOptions server_options;
+        server_options.acceptor_threads = 0;
+        server = openRemoteCommandServer(options.stream_port + 1, options.command_port, options.stream_port,
+                                         (dir / "remote").string().c_str(), server_options);
+        if (!server) {
+            std::fprintf(stderr, "failed to open the local server on ports %d / %d\n",
+                         options.command_port, options.stream_port);
+            return 1;
+        }
+    }
+
+    std::vector<Samples>     samples(static_cast<size_t>(options.clients));
+    std::vector<std::thread> threads;
+    std::atomic<int>         failed { 0 };
+    const auto start = std::chrono::steady_clock::now() + std::chrono::milliseconds(200);
+    const auto stop  = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                   std::chrono::duration<double>(options.duration_s));
+    for (int i = 0; i < options.clients; ++i)
+        threads.emplace_back(runClient, std::cref(options), i, dir / "local", start, stop,
+                             std::ref(samples[static_cast<size_t>(i)]), std::ref(failed));
+    for (auto& thread : threads) thread.join();
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (server) closeRemoteCommandServer(server);
+    fs::remove_all(dir, ec);
+
+    std::FILE* json = options.json_file.empty() ? nullptr : std::fopen(options.json_file.c_str(), "w");
+    if (json)
+        std::fprintf(json, "{\"clients\":%d,\"duration_s\":%.3f,\"target_rate\":%.1f,\"failed_clients\":%d,\"operations\":[",
+                     options.clients, elapsed, options.rate, failed.load());
+
+    std::printf("loadgen: %d clients, %.1f s, %s, %d failed to connect, %.1f MB of command output\n",
+                options.clients, elapsed, options.rate > 0 ? "open loop" : "closed loop", failed.load(),
+                g_output_bytes.load() / 1e6);
+    std::printf("%-9s %10s %8s %10s %9s %9s %9s %9s\n", "op", "count", "errors", "ops/s", "p50 us", "p90 us", "p99 us", "max us");
+    bool first = true;
+    for (size_t op = 0; op < OP_COUNT; ++op) {
+        std::vector<uint32_t> latencies;
+        uint64_t errors = 0;
+        for (const auto& client : samples) {
+            latencies.insert(latencies.end(), client.latencies_us[op].begin(), client.latencies_us[op].end());
+            errors += client.errors[op];
+        }
+        if (latencies.empty() && errors == 0) continue;
+        std::sort(latencies.begin(), latencies.end());
+        const double rate = latencies.size() / elapsed;
+        const uint32_t p50 = percentile(latencies, 0.50);
+        const uint32_t p90 = percentile(latencies, 0.90);
+        const uint32_t p99 = percentile(latencies, 0.99);
+        const uint32_t max = latencies.empty() ? 0 : latencies.back();
+        std::printf("%-9s %10zu %8llu %10.1f %9u %9u %9u %9u\n", OPERATION_NAMES[op], latencies.size(),
+                    static_cast<unsigned long long>(errors), rate, p50, p90, p99, max);
+        if (json) {
+            std::fprintf(json, "%s{\"op\":\"%s\",\"count\":%zu,\"errors\":%llu,\"ops_per_s\":%.1f,"
+                               "\"p50_us\":%u,\"p90_us\":%u,\"p99_us\":%u,\"max_us\":%u}",
+                         first ? "" : ",", OPERATION_NAMES[op], latencies.size(),
+                         static_cast<unsigned long long>(errors), rate, p50, p90, p99, max);
+            first = false;
+        }
+    }
+    if (json) {
+        std::fprintf(json, "]}\n");
+        std::fclose(json);
+    }
+    return failed.load() == 0 ? 0 : 1;
+}
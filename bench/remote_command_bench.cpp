@@ -0,0 +1,473 @@
+// ---------------------------------------------------------------------------
+// Remote command benchmark suite (Google Benchmark)
+//
+// Starts an in-process server, connects one client and measures:
+//   RoundTrip/*       request-response latency of single instructions
+//   Upload, Download  file transfer throughput by file size
+//   StreamThroughput  stdout bytes per second by total size and line length
+//   StreamLatency     write-to-callback latency of stderr lines while stdout
+//                     carries 0 .. 16 MB of filler
+//   SpawnRate         runCommand of a real process (no built-in, no shell)
+//   ListDirectory     listDirectoryContents on flat trees of 100 .. 10000
+//   Batching/*        N commands as N runCommand calls, one script, one graph
+//   Pipelining/*      N small uploads one by one, or all submitted with
+//                     uploadFileAsync before the first awaitOperation
+//
+// Output is only ever waited for, never slept on: the client's stream
+// callbacks count bytes and the benchmark spins until everything arrived.
+//
+//   remote_command_bench --benchmark_format=json --benchmark_out=bench.json
+//   remote_command_bench --wan=25,20 --benchmark_filter='Batching|Pipelining'
+//
+// --wan=DELAY_MS[,MBIT[,JITTER_MS[,STALL_PROBABILITY[,STALL_MS]]]] puts the
+// client behind an emulated link (wan_proxy.hpp) on ports 19124-19125, so
+// the batching and pipelining numbers show what they save on a real link
+// and not on loopback.  The link is recorded in the report's context.
+//
+// --transport=memory serves the client over in-memory pipes instead
+// (RemoteCommandServerOptions::in_memory): no sockets and no kernel, so
+// RoundTrip and the other request benchmarks show protocol and handler cost
+// alone.  Compare it with the default --transport=tcp.
+//
+// POSIX only (the stream benchmarks use yes / head / date).  Ports
+// 19121-19125.
+// ---------------------------------------------------------------------------
+#include "remote_command_server.hpp"
+#include "remote_command_client.hpp"
+#include "wan_proxy.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <signal.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Bn3Monkey;
+namespace fs = std::filesystem;
+
+static constexpr int DISC_PORT = 19123;
+static constexpr int CMD_PORT  = 19121;
+static constexpr int STR_PORT  = 19122;
+static constexpr int WAN_CMD_PORT = 19124;
+static constexpr int WAN_STR_PORT = 19125;
+
+static constexpr int32_t NOOP_INSTRUCTION = REMOTE_COMMAND_USER_INSTRUCTION_BASE + 1;
+
+static RemoteCommandClient* g_client = nullptr;
+static fs::path             g_local_dir;     // client side of transfers
+static fs::path             g_remote_dir;    // the server's working directory
+
+// ---------------------------------------------------------------------------
+// Stream capture
+//
+// Callbacks run on the client's stream thread only.  stdout is counted;
+// stderr carries CLOCK_REALTIME stamps (date +%s%N) whose age is taken on
+// arrival.  Lines may be split across frames, hence the partial buffer.
+// ---------------------------------------------------------------------------
+static std::atomic<uint64_t> g_stdout_bytes { 0 };
+static std::atomic<uint64_t> g_stderr_lines { 0 };
+static std::string           g_stderr_partial;
+static std::vector<double>   g_latencies_us;   // read after g_stderr_lines settles
+
+static int64_t realtimeNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static void onOutput(const char* text)
+{
+    g_stdout_bytes.fetch_add(strlen(text), std::memory_order_release);
+}
+
+static void onError(const char* text)
+{
+    const int64_t now = realtimeNanoseconds();
+    g_stderr_partial += text;
+    size_t start = 0;
+    for (size_t end; (end = g_stderr_partial.find('\n', start)) != std::string::npos; start = end + 1) {
+        const long long stamp = std::atoll(g_stderr_partial.c_str() + start);
+        if (stamp > 0) g_latencies_us.push_back((now - stamp) / 1000.0);
+        g_stderr_lines.fetch_add(1, std::memory_order_release);
+    }
+    g_stderr_partial.erase(0, start);
+}
+
+// Spins until counter reaches target; false after 10 s
+static bool waitFor(const std::atomic<uint64_t>& counter, uint64_t target)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (counter.load(std::memory_order_acquire) < target) {
+        if (std::chrono::steady_clock::now() > deadline) return false;
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+static bool writeFile(const fs::path& path, size_t size)
+{
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    std::string block(64 * 1024, 'r');
+    for (size_t written = 0; written < size; written += block.size())
+        f.write(block.data(), static_cast<std::streamsize>(std::min(block.size(), size - written)));
+    return static_cast<bool>(f);
+}
+
+// ---------------------------------------------------------------------------
+// Round trips
+// ---------------------------------------------------------------------------
+static void BM_RoundTrip(benchmark::State& state, bool (*call)())
+{
+    for (auto _ : state) {
+        if (!call()) {
+            state.SkipWithError("request failed");
+            break;
+        }
+    }
+}
+
+static bool callNoop()
+{
+    std::vector<char> reply;
+    return invokeRemoteInstruction(g_client, NOOP_INSTRUCTION, {}, reply);
+}
+static bool callCurrentWorkingDirectory() { return currentWorkingDirectory(g_client) != nullptr; }
+static bool callDirectoryExists()         { return directoryExists(g_client, "."); }
+static bool callGetServerStats()
+{
+    RemoteServerStats stats;
+    return getServerStats(g_client, stats);
+}
+static bool callBuiltinCommand()          { return runCommandImpl(g_client, "true") == 0; }
+
+BENCHMARK_CAPTURE(BM_RoundTrip, user_instruction, callNoop)->UseRealTime();
+BENCHMARK_CAPTURE(BM_RoundTrip, current_working_directory, callCurrentWorkingDirectory)->UseRealTime();
+BENCHMARK_CAPTURE(BM_RoundTrip, directory_exists, callDirectoryExists)->UseRealTime();
+BENCHMARK_CAPTURE(BM_RoundTrip, get_stats, callGetServerStats)->UseRealTime();
+BENCHMARK_CAPTURE(BM_RoundTrip, builtin_command, callBuiltinCommand)->UseRealTime();
+
+// ---------------------------------------------------------------------------
+// File transfer
+// ---------------------------------------------------------------------------
+static void BM_Upload(benchmark::State& state)
+{
+    const size_t size = static_cast<size_t>(state.range(0));
+    const std::string local = (g_local_dir / "upload.bin").string();
+    if (!writeFile(local, size)) {
+        state.SkipWithError("could not write the local file");
+        return;
+    }
+    for (auto _ : state) {
+        if (!uploadFile(g_client, local.c_str(), "upload.bin")) {
+            state.SkipWithError("uploadFile failed");
+            break;
+        }
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * size));
+}
+
+static void BM_Download(benchmark::State& state)
+{
+    const size_t size = static_cast<size_t>(state.range(0));
+    const std::string local = (g_local_dir / "download.bin").string();
+    if (!writeFile(g_remote_dir / "download.bin", size)) {
+        state.SkipWithError("could not write the remote file");
+        return;
+    }
+    for (auto _ : state) {
+        if (!downloadFile(g_client, local.c_str(), "download.bin")) {
+            state.SkipWithError("downloadFile failed");
+            break;
+        }
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * size));
+}
+
+BENCHMARK(BM_Upload)->RangeMultiplier(16)->Range(4 << 10, 16 << 20)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Download)->RangeMultiplier(16)->Range(4 << 10, 16 << 20)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// ---------------------------------------------------------------------------
+// Stream
+// ---------------------------------------------------------------------------
+
+// args: total bytes, line length
+static void BM_StreamThroughput(benchmark::State& state)
+{
+    const uint64_t total = static_cast<uint64_t>(state.range(0));
+    const std::string line(static_cast<size_t>(state.range(1)) - 1, 's');
+    const std::string command = "yes " + line + " | head -c " + std::to_string(total);
+
+    for (auto _ : state) {
+        const uint64_t target = g_stdout_bytes.load(std::memory_order_acquire) + total;
+        if (runCommandImpl(g_client, command.c_str()) != 0 || !waitFor(g_stdout_bytes, target)) {
+            state.SkipWithError("output did not arrive");
+            break;
+        }
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * total));
+}
+
+// args: stdout filler bytes running alongside the stamped stderr lines
+static void BM_StreamLatency(benchmark::State& state)
+{
+    static constexpr int STAMPS = 20;
+    const uint64_t filler = static_cast<uint64_t>(state.range(0));
+    std::string command = "i=0; while [ $i -lt " + std::to_string(STAMPS) + " ]; do date +%s%N >&2; i=$((i+1)); done";
+    if (filler > 0)
+        command = "(yes filler | head -c " + std::to_string(filler) + ") & " + command + "; wait";
+
+    g_latencies_us.clear();
+    for (auto _ : state) {
+        const uint64_t bytes = g_stdout_bytes.load(std::memory_order_acquire) + filler;
+        const uint64_t lines = g_stderr_lines.load(std::memory_order_acquire) + STAMPS;
+        if (runCommandImpl(g_client, command.c_str()) != 0 ||
+            !waitFor(g_stdout_bytes, bytes) || !waitFor(g_stderr_lines, lines)) {
+            state.SkipWithError("output did not arrive");
+            break;
+        }
+    }
+    if (g_latencies_us.empty()) {
+        state.SkipWithError("no stamps parsed (needs date +%N)");
+        return;
+    }
+    std::sort(g_latencies_us.begin(), g_latencies_us.end());
+    double sum = 0;
+    for (double us : g_latencies_us) sum += us;
+    state.counters["latency_mean_us"] = sum / g_latencies_us.size();
+    state.counters["latency_p99_us"]  = g_latencies_us[g_latencies_us.size() * 99 / 100];
+    state.counters["latency_max_us"]  = g_latencies_us.back();
+}
+
+BENCHMARK(BM_StreamThroughput)
+    ->ArgsProduct({ { 1 << 20, 16 << 20 }, { 16, 256, 4096 } })
+    ->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_StreamLatency)->Arg(0)->Arg(1 << 20)->Arg(16 << 20)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// ---------------------------------------------------------------------------
+// Spawn and listing
+// ---------------------------------------------------------------------------
+static void BM_SpawnRate(benchmark::State& state)
+{
+    // A path is not a built-in and needs no shell
+    for (auto _ : state) {
+        if (runCommandImpl(g_client, "/bin/true") != 0) {
+            state.SkipWithError("/bin/true failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// args: entries in the directory (files, plus one subdirectory per 100)
+static void BM_ListDirectory(benchmark::State& state)
+{
+    const int64_t entries = state.range(0);
+    const std::string name = "tree_" + std::to_string(entries);
+    const fs::path tree = g_remote_dir / name;
+    std::error_code ec;
+    if (!fs::exists(tree, ec)) {
+        fs::create_directories(tree, ec);
+        for (int64_t i = 0; i < entries; ++i) {
+            if (i % 100 == 99)
+                fs::create_directory(tree / ("dir_" + std::to_string(i)), ec);
+            else
+                std::ofstream(tree / ("file_" + std::to_string(i) + ".txt")) << i;
+        }
+    }
+
+    for (auto _ : state) {
+        std::vector<RemoteDirectoryContent> contents = listDirectoryContents(g_client, name.c_str());
+        if (static_cast<int64_t>(contents.size()) != entries) {
+            state.SkipWithError("listing is incomplete");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * entries);
+}
+
+BENCHMARK(BM_SpawnRate)->UseRealTime();
+BENCHMARK(BM_ListDirectory)->RangeMultiplier(10)->Range(100, 10000)->UseRealTime();
+
+// ---------------------------------------------------------------------------
+// Batching and pipelining
+//
+// The same work with fewer round trips.  On loopback the differences are
+// small; under --wan every saved round trip is worth 2 x the link delay.
+// ---------------------------------------------------------------------------
+enum class Batch
+{
+    SEQUENTIAL,   // one runCommand per command
+    SCRIPT,       // runCommandScript
+    GRAPH         // runCommandGraph, no dependencies
+};
+
+// args: commands per iteration
+static void BM_Batching(benchmark::State& state, Batch batch)
+{
+    const size_t count = static_cast<size_t>(state.range(0));
+    const std::vector<std::string> commands(count, "true");
+    std::vector<RemoteCommandNode> nodes(count);
+    for (auto& node : nodes) node.command = "true";
+    std::vector<RemoteNodeResult> results;
+
+    for (auto _ : state) {
+        bool ok = true;
+        switch (batch) {
+        case Batch::SEQUENTIAL:
+            for (size_t i = 0; i < count && ok; ++i) ok = runCommandImpl(g_client, "true") == 0;
+            break;
+        case Batch::SCRIPT:
+            ok = runCommandScript(g_client, commands, RemoteScriptOptions(), results);
+            break;
+        case Batch::GRAPH:
+            ok = runCommandGraph(g_client, nodes, 0, results);
+            break;
+        }
+        if (!ok) {
+            state.SkipWithError("a command failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(count));
+}
+
+// args: files per iteration, bytes per file
+static void BM_Pipelining(benchmark::State& state, bool pipelined)
+{
+    const size_t count = static_cast<size_t>(state.range(0));
+    const size_t size  = static_cast<size_t>(state.range(1));
+    const std::string local = (g_local_dir / "pipelined.bin").string();
+    if (!writeFile(local, size)) {
+        state.SkipWithError("could not write the local file");
+        return;
+    }
+    std::vector<std::string> remotes;
+    for (size_t i = 0; i < count; ++i) remotes.push_back("pipelined_" + std::to_string(i) + ".bin");
+    std::vector<int32_t> operations(count);
+
+    for (auto _ : state) {
+        bool ok = true;
+        if (pipelined) {
+            for (size_t i = 0; i < count && ok; ++i)
+                ok = (operations[i] = uploadFileAsync(g_client, local.c_str(), remotes[i].c_str())) > 0;
+            for (size_t i = 0; i < count && ok; ++i)
+                ok = awaitOperation(g_client, operations[i]);
+        }
+        else {
+            for (size_t i = 0; i < count && ok; ++i)
+                ok = uploadFile(g_client, local.c_str(), remotes[i].c_str());
+        }
+        if (!ok) {
+            state.SkipWithError("upload failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(count));
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(count * size));
+}
+
+BENCHMARK_CAPTURE(BM_Batching, sequential, Batch::SEQUENTIAL)->Arg(16)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Batching, script, Batch::SCRIPT)->Arg(16)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Batching, graph, Batch::GRAPH)->Arg(16)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Pipelining, sequential, false)
+    ->Args({ 16, 4 << 10 })->Args({ 16, 256 << 10 })->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Pipelining, pipelined, true)
+    ->Args({ 16, 4 << 10 })->Args({ 16, 256 << 10 })->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// Removes --NAME=VALUE from argv before Google Benchmark sees it
+static const char* takeFlag(int& argc, char* argv[], const char* prefix)
+{
+    const size_t length = std::strlen(prefix);
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], prefix, length) != 0) continue;
+        const char* spec = argv[i] + length;
+        for (int j = i; j + 1 < argc; ++j) argv[j] = argv[j + 1];
+        --argc;
+        return spec;
+    }
+    return nullptr;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* wan_spec  = takeFlag(argc, argv, "--wan=");
+    const char* transport = takeFlag(argc, argv, "--transport=");
+    WanLinkOptions wan_options;
+    if (wan_spec && !parseWanLink(wan_spec, wan_options)) {
+        std::fprintf(stderr, "bad --wan (DELAY_MS[,MBIT[,JITTER_MS[,STALL_PROBABILITY[,STALL_MS]]]]): %s\n", wan_spec);
+        return 1;
+    }
+    const bool in_memory = transport && std::strcmp(transport, "memory") == 0;
+    if ((transport && !in_memory && std::strcmp(transport, "tcp") != 0) || (in_memory && wan_spec)) {
+        std::fprintf(stderr, "--transport is tcp or memory, and memory does not go through --wan\n");
+        return 1;
+    }
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    signal(SIGPIPE, SIG_IGN);
+
+    std::error_code ec;
+    const fs::path dir = fs::temp_directory_path(ec) / "rcs_bench";
+    fs::remove_all(dir, ec);
+    g_local_dir  = dir / "local";
+    g_remote_dir = dir / "remote";
+    fs::create_directories(g_local_dir, ec);
+    fs::create_directories(g_remote_dir, ec);
+
+    RemoteCommandServerOptions server_options;
+    server_options.in_memory = in_memory;
+    RemoteCommandServer* server = openRemoteCommandServer(DISC_PORT, CMD_PORT, STR_PORT, g_remote_dir.string().c_str(),
+                                                          server_options);
+    if (!server) {
+        std::fprintf(stderr, "failed to open server\n");
+        return 1;
+    }
+    registerRemoteInstruction(server, NOOP_INSTRUCTION,
+                              [](const RemoteInstructionRequest&, RemoteInstructionResponse&) { return true; });
+
+    WanLink wan_link(wan_options);
+    WanProxy wan_command(wan_link);
+    WanProxy wan_stream(wan_link);
+    if (wan_spec) {
+        if (!wan_command.open(WAN_CMD_PORT, "127.0.0.1", CMD_PORT) ||
+            !wan_stream.open(WAN_STR_PORT, "127.0.0.1", STR_PORT)) {
+            std::fprintf(stderr, "failed to open the WAN proxies\n");
+            closeRemoteCommandServer(server);
+            return 1;
+        }
+        benchmark::AddCustomContext("wan", wan_spec);
+    }
+
+    benchmark::AddCustomContext("transport", in_memory ? "memory" : "tcp");
+
+    g_client = in_memory ? createInMemoryRemoteCommandClient(CMD_PORT, STR_PORT)
+             : wan_spec  ? createRemoteCommandClient(WAN_CMD_PORT, WAN_STR_PORT)
+                         : createRemoteCommandClient(CMD_PORT, STR_PORT);
+    if (!g_client) {
+        std::fprintf(stderr, "failed to connect client\n");
+        closeRemoteCommandServer(server);
+        return 1;
+    }
+    onRemoteOutput(g_client, onOutput);
+    onRemoteError(g_client, onError);
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    releaseRemoteCommandClient(g_client);
+    wan_command.close();
+    wan_stream.close();
+    closeRemoteCommandServer(server);
+    fs::remove_all(dir, ec);
+    return 0;
+}
@@ -0,0 +1,352 @@
+// ---------------------------------------------------------------------------
+// Session replay
+//
+// Re-issues a recording made with RemoteCommandServerOptions::record_file
+// (server --record) against a server: every recorded session gets its own
+// command + stream connection, opened when the session first spoke, and
+// sends its requests at their recorded offsets divided by --speed.  Each
+// session waits for a response before its next request, as clients do.
+// Reports latency per instruction and how long the replay took next to the
+// recorded span.
+//
+//   remote_command_replay RECORDING [--local DIR] [--host IP] [--ports CMD,STREAM]
+//                                   [--speed 1] [--json FILE]
+//
+// --speed 1 keeps the original timing, 10 runs ten times faster, 0 sends
+// every request as soon as the previous response arrived.  --local serves
+// the replay from an in-process server working in DIR (a copy of the
+// recorded tree, say).  Recordings made without --record-payloads are
+// replayed with zero-filled payloads of the recorded sizes, which keeps the
+// traffic shape but not the meaning of the requests.
+//
+// POSIX only (raw sockets).  Default ports 19141-19143.
+// ---------------------------------------------------------------------------
+#include "remote_command_server.hpp"
+#include "protocol/remote_command_protocol.hpp"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Bn3Monkey;
+
+struct Options
+{
+    std::string recording;
+    std::string local_dir;           // empty = connect to --host
+    std::string host         { "127.0.0.1" };
+    int32_t     command_port { 19141 };
+    int32_t     stream_port  { 19142 };
+    double      speed        { 1.0 };
+    std::string json_file;
+};
+
+struct Request
+{
+    RemoteCommandRecordInner record;
+    std::string              payloads[4];
+};
+
+struct ReplaySession
+{
+    uint32_t             recorded_id { 0 };
+    std::vector<Request> requests;     // the last one may be the end marker
+};
+
+struct Result
+{
+    int32_t  instruction;
+    bool     ok;
+    uint32_t latency_us;
+};
+
+static bool sendAll(int sock, const void* data, size_t size)
+{
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = ::send(sock, p, size, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static bool recvAll(int sock, void* data, size_t size)
+{
+    char* p = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t n = ::recv(sock, p, size, 0);
+        if (n <= 0) return false;
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static int connectTo(const Options& options, int32_t port)
+{
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(static_cast<uint16_t>(port));
+    if (inet_pton(AF_INET, options.host.c_str(), &addr.sin_addr) != 1) return -1;
+    int sock = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+    int yes = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    if (::connect(sock, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+        ::close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// Reads a response and keeps only its size
+static bool recvResponse(int sock, RemoteCommandInstruction expected)
+{
+    RemoteCommandResponseHeader header(RemoteCommandInstruction::INSTRUCTION_EMPTY);
+    if (!recvAll(sock, &header, sizeof(header)) || !header.valid()) return false;
+    char buffer[64 * 1024];
+    for (uint32_t left = header.payload_length; left > 0;) {
+        const uint32_t chunk = std::min<uint32_t>(left, sizeof(buffer));
+        if (!recvAll(sock, buffer, chunk)) return false;
+        left -= chunk;
+    }
+    return header.instruction == expected;
+}
+
+// Output is read and dropped; heartbeat pings are answered
+static void drainStream(int sock, std::atomic<uint64_t>& bytes)
+{
+    std::vector<char> payload;
+    while (true) {
+        RemoteCommandStreamHeader header(RemoteCommandStreamType::INVALID, 0);
+        if (!recvAll(sock, &header, sizeof(header)) || !header.valid()) return;
+        payload.resize(header.payload_length);
+        if (header.payload_length > 0 && !recvAll(sock, payload.data(), payload.size())) return;
+        bytes.fetch_add(sizeof(header) + payload.size(), std::memory_order_relaxed);
+        if (header.type == RemoteCommandStreamType::STREAM_PING) {
+            RemoteCommandStreamHeader pong(RemoteCommandStreamType::STREAM_PONG, header.payload_length);
+            if (!sendAll(sock, &pong, sizeof(pong)) || !sendAll(sock, payload.data(), payload.size())) return;
+        }
+    }
+}
+
+static bool loadRecording(const std::string& path, RemoteCommandRecordingHeader& header,
+                          std::vector<ReplaySession>& sessions)
+{
+    std::ifstream f(path, std::ios::binary);
+    if (!f.read(reinterpret_cast<char*>(&header), sizeof(header)) || !header.valid()) return false;
+
+    std::map<uint32_t, size_t> index;
+    Request request;
+    while (f.read(reinterpret_cast<char*>(&request.record), sizeof(request.record))) {
+        for (size_t i = 0; i < 4; ++i) {
+            request.payloads[i].assign(request.record.payload_length[i], '\0');
+            if ((header.flags & RECORDING_PAYLOADS) && !request.payloads[i].empty() &&
+                !f.read(&request.payloads[i][0], static_cast<std::streamsize>(request.payloads[i].size())))
+                return false;
+        }
+        auto it = index.find(request.record.session_id);
+        if (it == index.end()) {
+            it = index.emplace(request.record.session_id, sessions.size()).first;
+            sessions.emplace_back();
+            sessions.back().recorded_id = request.record.session_id;
+        }
+        sessions[it->second].requests.push_back(request);
+    }
+    return true;
+}
+
+static void replaySession(const Options& options, const ReplaySession& session,
+                          std::chrono::steady_clock::time_point start,
+                          std::vector<Result>& results, std::atomic<uint64_t>& stream_bytes,
+                          std::atomic<int>& failed)
+{
+    auto dueAt = [&](uint64_t offset_us) {
+        return start + std::chrono::microseconds(
+                           static_cast<int64_t>(options.speed > 0 ? offset_us / options.speed : 0));
+    };
+    std::this_thread::sleep_until(dueAt(session.requests.front().record.offset_us));
+
+    // Connect as the client library does: SESSION_ID, then attach the stream
+    int command = connectTo(options, options.command_port);
+    RemoteCommandRequestHeader ask(RemoteCommandInstruction::INSTRUCTION_SESSION_ID);
+    RemoteCommandResponseHeader answer(RemoteCommandInstruction::INSTRUCTION_EMPTY);
+    uint32_t id = 0;
+    RemoteCommandSessionTokenInner token;
+    int stream = -1;
+    if (command >= 0 && sendAll(command, &ask, sizeof(ask)) &&
+        recvAll(command, &answer, sizeof(answer)) && answer.payload_length == sizeof(id) + sizeof(token) &&
+        recvAll(command, &id, sizeof(id)) && recvAll(command, &token, sizeof(token)))
+        stream = connectTo(options, options.stream_port);
+    RemoteCommandStreamHeader attach(RemoteCommandStreamType::STREAM_ATTACH, sizeof(token));
+    if (stream < 0 || !sendAll(stream, &attach, sizeof(attach)) || !sendAll(stream, &token, sizeof(token))) {
+        if (command >= 0) ::close(command);
+        if (stream >= 0) ::close(stream);
+        failed.fetch_add(1);
+        return;
+    }
+    std::thread drain(drainStream, stream, std::ref(stream_bytes));
+
+    for (const Request& request : session.requests) {
+        const RemoteCommandRecordInner& record = request.record;
+        if (record.instruction == RemoteCommandInstruction::INSTRUCTION_SESSION_ID) continue;
+        std::this_thread::sleep_until(dueAt(record.offset_us));
+        if (record.instruction == RemoteCommandInstruction::INSTRUCTION_EMPTY) break;   // session ended
+
+        RemoteCommandRequestHeader header(record.instruction, record.payload_length[0], record.payload_length[1],
+                                          record.payload_length[2], record.payload_length[3]);
+        const auto sent = std::chrono::steady_clock::now();
+        bool ok = sendAll(command, &header, sizeof(header));
+        for (size_t i = 0; ok && i < 4; ++i)
+            ok = request.payloads[i].empty() || sendAll(command, request.payloads[i].data(), request.payloads[i].size());
+        ok = ok && recvResponse(command, record.instruction);
+        const auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - sent).count();
+        results.push_back({ static_cast<int32_t>(record.instruction), ok,
+                            static_cast<uint32_t>(std::min<int64_t>(us, UINT32_MAX)) });
+        if (!ok) break;
+    }
+
+    ::shutdown(command, SHUT_RDWR);
+    ::shutdown(stream, SHUT_RDWR);
+    drain.join();
+    ::close(command);
+    ::close(stream);
+}
+
+static void usage()
+{
+    std::fprintf(stderr,
+        "usage: remote_command_replay RECORDING [--local DIR] [--host IP] [--ports CMD,STREAM]\n"
+        "                                       [--speed X] [--json FILE]\n");
+}
+
+static bool parseOptions(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0) {
+            options.recording = arg;
+            continue;
+        }
+        if (i + 1 >= argc) return false;
+        const char* value = argv[++i];
+        if      (arg == "--local") options.local_dir = value;
+        else if (arg == "--host")  options.host      = value;
+        else if (arg == "--speed") options.speed     = std::atof(value);
+        else if (arg == "--json")  options.json_file = value;
+        else if (arg == "--ports") {
+            if (std::sscanf(value, "%d,%d", &options.command_port, &options.stream_port) != 2) return false;
+        }
+        else return false;
+    }
+    return !options.recording.empty() && options.speed >= 0;
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage();
+        return 2;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    RemoteCommandRecordingHeader header;
+    std::vector<ReplaySession> sessions;
+    if (!loadRecording(options.recording, header, sessions)) {
+        std::fprintf(stderr, "%s is not a complete recording\n", options.recording.c_str());
+        return 1;
+    }
+    if (!(header.flags & RECORDING_PAYLOADS))
+        std::fprintf(stderr, "recording has no payloads: sending zero-filled payloads of the recorded sizes\n");
+
+    uint64_t span_us = 0;
+    for (const auto& session : sessions)
+        span_us = std::max<uint64_t>(span_us, session.requests.back().record.offset_us);
+
+    RemoteCommandServer* server = nullptr;
+    if (!options.local_dir.empty()) {
+        server = openRemoteCommandServer(options.stream_port + 1, options.command_port, options.stream_port,
+                                         options.local_dir.c_str());
+        if (!server) {
+            std::fprintf(stderr, "failed to open the local server on ports %d / %d\n",
+                         options.command_port, options.stream_port);
+            return 1;
+        }
+    }
+
+    std::vector<std::vector<Result>> results(sessions.size());
+    std::vector<std::thread>         threads;
+    std::atomic<uint64_t>            stream_bytes { 0 };
+    std::atomic<int>                 failed { 0 };
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < sessions.size(); ++i)
+        threads.emplace_back(replaySession, std::cref(options), std::cref(sessions[i]), start,
+                             std::ref(results[i]), std::ref(stream_bytes), std::ref(failed));
+    for (auto& thread : threads) thread.join();
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (server) closeRemoteCommandServer(server);
+
+    std::map<int32_t, std::vector<uint32_t>> latencies;
+    std::map<int32_t, uint64_t>              errors;
+    for (const auto& session : results) {
+        for (const Result& result : session) {
+            std::vector<uint32_t>& bucket = latencies[result.instruction];
+            if (result.ok) bucket.push_back(result.latency_us);
+            else           errors[result.instruction]++;
+        }
+    }
+
+    std::FILE* json = options.json_file.empty() ? nullptr : std::fopen(options.json_file.c_str(), "w");
+    if (json)
+        std::fprintf(json, "{\"sessions\":%zu,\"failed_sessions\":%d,\"recorded_s\":%.3f,\"replayed_s\":%.3f,"
+                           "\"speed\":%.2f,\"stream_bytes\":%llu,\"instructions\":[",
+                     sessions.size(), failed.load(), span_us / 1e6, elapsed, options.speed,
+                     static_cast<unsigned long long>(stream_bytes.load()));
+
+    std::printf("replay: %zu sessions (%d failed to connect), recorded %.2f s, replayed in %.2f s at speed %.2f\n",
+                sessions.size(), failed.load(), span_us / 1e6, elapsed, options.speed);
+    std::printf("%-26s %8s %7s %9s %9s %9s\n", "instruction", "count", "errors", "p50 us", "p99 us", "max us");
+    bool first = true;
+    for (auto& entry : latencies) {
+        std::vector<uint32_t>& sorted = entry.second;
+        std::sort(sorted.begin(), sorted.end());
+        const char* name = instructionName(static_cast<RemoteCommandInstruction>(entry.first));
+        char label[32];
+        if (name) std::snprintf(label, sizeof(label), "%s", name);
+        else      std::snprintf(label, sizeof(label), "0x%08x", static_cast<unsigned>(entry.first));
+        const uint32_t p50 = sorted.empty() ? 0 : sorted[sorted.size() / 2];
+        const uint32_t p99 = sorted.empty() ? 0 : sorted[std::min(sorted.size() - 1, sorted.size() * 99 / 100)];
+        const uint32_t max = sorted.empty() ? 0 : sorted.back();
+        const unsigned long long errs = errors[entry.first];
+        std::printf("%-26s %8zu %7llu %9u %9u %9u\n", label, sorted.size(), errs, p50, p99, max);
+        if (json) {
+            std::fprintf(json, "%s{\"instruction\":\"%s\",\"count\":%zu,\"errors\":%llu,\"p50_us\":%u,\"p99_us\":%u,\"max_us\":%u}",
+                         first ? "" : ",", label, sorted.size(), errs, p50, p99, max);
+            first = false;
+        }
+    }
+    if (json) {
+        std::fprintf(json, "]}\n");
+        std::fclose(json);
+    }
+    return failed.load() == 0 ? 0 : 1;
+}
@@ -0,0 +1,249 @@
+#include "wan_proxy.hpp"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+using namespace Bn3Monkey;
+
+static constexpr size_t CHUNK_SIZE = 16 * 1024;
+static constexpr size_t QUEUE_LIMIT = 4 * 1024 * 1024;
+
+bool Bn3Monkey::parseWanLink(const char* text, WanLinkOptions& options)
+{
+    double* fields[] = { &options.delay_ms, &options.bandwidth_mbit, &options.jitter_ms,
+                         &options.stall_probability, &options.stall_ms };
+    const char* p = text;
+    for (double* field : fields) {
+        char* end = nullptr;
+        const double value = std::strtod(p, &end);
+        if (end == p || value < 0) return false;
+        *field = value;
+        if (*end == '\0') return options.stall_probability <= 1.0;
+        if (*end != ',') return false;
+        p = end + 1;
+    }
+    return false;
+}
+
+WanLink::Clock::time_point WanLink::schedule(int direction, size_t size, Clock::time_point not_before)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+
+    auto sent = not_before;
+    if (_options.bandwidth_mbit > 0) {
+        const double seconds = static_cast<double>(size) * 8.0 / (_options.bandwidth_mbit * 1e6);
+        sent = std::max(not_before, _free_at[direction]) +
+               std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+        _free_at[direction] = sent;
+    }
+
+    double delay_ms = _options.delay_ms;
+    if (_options.jitter_ms > 0)
+        delay_ms += std::uniform_real_distribution<double>(-_options.jitter_ms, _options.jitter_ms)(_random);
+    if (_options.stall_probability > 0 &&
+        std::uniform_real_distribution<double>(0.0, 1.0)(_random) < _options.stall_probability)
+        delay_ms += _options.stall_ms;
+    delay_ms = std::max(delay_ms, 0.0);
+
+    return sent + std::chrono::duration_cast<Clock::duration>(
+                      std::chrono::duration<double, std::milli>(delay_ms));
+}
+
+// ---------------------------------------------------------------------------
+// WanProxy
+// ---------------------------------------------------------------------------
+bool WanProxy::open(int32_t listen_port, const std::string& target_host, int32_t target_port)
+{
+    if (_running) return false;
+    _target_host = target_host;
+    _target_port = target_port;
+
+    _listen = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (_listen < 0) return false;
+    int yes = 1;
+    setsockopt(_listen, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    sockaddr_in addr {};
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(static_cast<uint16_t>(listen_port));
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (::bind(_listen, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        ::listen(_listen, 64) != 0) {
+        ::close(_listen);
+        _listen = -1;
+        return false;
+    }
+
+    _running = true;
+    _accept_thread = std::thread(&WanProxy::acceptLoop, this);
+    return true;
+}
+
+void WanProxy::close()
+{
+    if (!_running.exchange(false)) return;
+    if (_accept_thread.joinable()) _accept_thread.join();
+    ::close(_listen);
+    _listen = -1;
+
+    std::lock_guard<std::mutex> lock(_connections_mtx);
+    for (auto& connection : _connections) {
+        ::shutdown(connection->client, SHUT_RDWR);
+        ::shutdown(connection->server, SHUT_RDWR);
+        for (Pipe* pipe : { &connection->up, &connection->down }) {
+            std::lock_guard<std::mutex> pipe_lock(pipe->mtx);
+            pipe->closed = true;
+            pipe->cv.notify_all();
+        }
+        for (auto& thread : connection->threads) thread.join();
+        ::close(connection->client);
+        ::close(connection->server);
+    }
+    _connections.clear();
+}
+
+void WanProxy::acceptLoop()
+{
+    while (_running) {
+        reapFinished();
+
+        pollfd pfd { _listen, POLLIN, 0 };
+        if (::poll(&pfd, 1, 100) <= 0) continue;
+        int client = ::accept(_listen, nullptr, nullptr);
+        if (client < 0) continue;
+
+        sockaddr_in addr {};
+        addr.sin_family = AF_INET;
+        addr.sin_port   = htons(static_cast<uint16_t>(_target_port));
+        int server = -1;
+        if (inet_pton(AF_INET, _target_host.c_str(), &addr.sin_addr) == 1)
+            server = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (server < 0 || ::connect(server, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+            if (server >= 0) ::close(server);
+            ::close(client);
+            continue;
+        }
+        // The link adds the delay; the proxy itself should not
+        int yes = 1;
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        setsockopt(server, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+        std::unique_ptr<Connection> connection(new Connection());
+        connection->client = client;
+        connection->server = server;
+        connection->up.from   = client;
+        connection->up.to     = server;
+        connection->up.direction = 0;
+        connection->down.from = server;
+        connection->down.to   = client;
+        connection->down.direction = 1;
+
+        Connection& c = *connection;
+        c.threads.emplace_back(&WanProxy::readLoop, this, std::ref(c), std::ref(c.up));
+        c.threads.emplace_back(&WanProxy::writeLoop, this, std::ref(c), std::ref(c.up));
+        c.threads.emplace_back(&WanProxy::readLoop, this, std::ref(c), std::ref(c.down));
+        c.threads.emplace_back(&WanProxy::writeLoop, this, std::ref(c), std::ref(c.down));
+
+        std::lock_guard<std::mutex> lock(_connections_mtx);
+        _connections.push_back(std::move(connection));
+    }
+}
+
+void WanProxy::readLoop(Connection& connection, Pipe& pipe)
+{
+    std::string buffer(CHUNK_SIZE, '\0');
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(pipe.mtx);
+            pipe.cv.wait(lock, [&] { return pipe.closed || pipe.queued < QUEUE_LIMIT; });
+            if (pipe.closed) break;
+        }
+
+        ssize_t n = ::recv(pipe.from, &buffer[0], buffer.size(), 0);
+        const auto now = WanLink::Clock::now();
+
+        std::lock_guard<std::mutex> lock(pipe.mtx);
+        Chunk chunk;
+        if (n > 0) {
+            chunk.deliver_at = std::max(_link.schedule(pipe.direction, static_cast<size_t>(n), now),
+                                        pipe.last_delivery);
+            chunk.data.assign(buffer.data(), static_cast<size_t>(n));
+        }
+        else {
+            // End of stream travels the link too, after the bytes before it
+            chunk.deliver_at = std::max(now, pipe.last_delivery);
+        }
+        pipe.last_delivery = chunk.deliver_at;
+        pipe.queued += chunk.data.size();
+        pipe.queue.push_back(std::move(chunk));
+        pipe.cv.notify_all();
+        if (n <= 0) break;
+    }
+    connection.finished.fetch_add(1);
+}
+
+void WanProxy::writeLoop(Connection& connection, Pipe& pipe)
+{
+    while (true) {
+        Chunk chunk;
+        {
+            std::unique_lock<std::mutex> lock(pipe.mtx);
+            pipe.cv.wait(lock, [&] { return pipe.closed || !pipe.queue.empty(); });
+            if (pipe.closed) break;
+            const auto deliver_at = pipe.queue.front().deliver_at;
+            if (pipe.cv.wait_until(lock, deliver_at, [&] { return pipe.closed; })) break;
+            chunk = std::move(pipe.queue.front());
+            pipe.queue.pop_front();
+            pipe.queued -= chunk.data.size();
+            pipe.cv.notify_all();
+        }
+
+        if (chunk.data.empty()) {
+            ::shutdown(pipe.to, SHUT_WR);
+            break;
+        }
+
+        const char* p = chunk.data.data();
+        size_t left = chunk.data.size();
+        while (left > 0) {
+            ssize_t n = ::send(pipe.to, p, left, MSG_NOSIGNAL);
+            if (n <= 0) break;
+            p += n;
+            left -= static_cast<size_t>(n);
+        }
+        if (left > 0) {
+            // The peer is gone: tear the whole connection down
+            ::shutdown(connection.client, SHUT_RDWR);
+            ::shutdown(connection.server, SHUT_RDWR);
+            std::lock_guard<std::mutex> lock(pipe.mtx);
+            pipe.closed = true;
+            pipe.cv.notify_all();
+            break;
+        }
+    }
+    connection.finished.fetch_add(1);
+}
+
+void WanProxy::reapFinished()
+{
+    std::lock_guard<std::mutex> lock(_connections_mtx);
+    for (auto it = _connections.begin(); it != _connections.end();) {
+        Connection& connection = **it;
+        if (connection.finished.load() < 4) {
+            ++it;
+            continue;
+        }
+        for (auto& thread : connection.threads) thread.join();
+        ::close(connection.client);
+        ::close(connection.server);
+        it = _connections.erase(it);
+    }
+}
@@ -0,0 +1,125 @@
+#if !defined(__REMOTE_COMMAND_WAN_PROXY__)
+#define __REMOTE_COMMAND_WAN_PROXY__
+
+#include <cstdint>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace Bn3Monkey
+{
+    // -------------------------------------------------------------------------
+    // WAN emulation (remote_command_wan_proxy, remote_command_bench --wan)
+    //
+    // A user-space TCP relay that delays what it forwards the way a slow link
+    // would, without root or netem.  Every chunk read (up to 16 KB) is
+    //   - serialised at bandwidth_mbit, sharing one budget per direction
+    //     between all connections of the link,
+    //   - held for delay_ms +- jitter_ms (one way, so RTT = 2 x delay_ms),
+    //   - held another stall_ms with probability stall_probability, which
+    //     looks like a lost segment waiting for its retransmission.
+    // Order within a connection is kept: jitter never reorders bytes.  Each
+    // direction buffers at most 4 MB before it stops reading, so a slow link
+    // pushes back on the sender as TCP would.
+    //
+    // POSIX only.
+    // -------------------------------------------------------------------------
+    struct WanLinkOptions
+    {
+        double   delay_ms          { 0.0 };
+        double   jitter_ms         { 0.0 };
+        double   bandwidth_mbit    { 0.0 };    // 0 = unlimited
+        double   stall_probability { 0.0 };
+        double   stall_ms          { 200.0 };
+        uint32_t seed              { 1 };
+    };
+
+    // Parses "DELAY_MS[,MBIT[,JITTER_MS[,STALL_PROBABILITY[,STALL_MS]]]]"
+    bool parseWanLink(const char* text, WanLinkOptions& options);
+
+    // State shared by every proxy on one emulated link
+    class WanLink
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        explicit WanLink(const WanLinkOptions& options) : _options(options), _random(options.seed) {}
+
+        // When a chunk of size bytes read now in direction (0 = to the
+        // server, 1 = back) may be written out, not before not_before
+        Clock::time_point schedule(int direction, size_t size, Clock::time_point not_before);
+
+    private:
+        WanLinkOptions    _options;
+        std::mutex        _mtx;
+        std::mt19937      _random;
+        Clock::time_point _free_at[2] {};
+    };
+
+    class WanProxy
+    {
+    public:
+        explicit WanProxy(WanLink& link) : _link(link) {}
+        ~WanProxy() { close(); }
+
+        // Accepts on listen_port (all interfaces) and relays every
+        // connection to target_host:target_port.  False if the port cannot
+        // be bound.
+        bool open(int32_t listen_port, const std::string& target_host, int32_t target_port);
+        void close();
+
+    private:
+        struct Chunk
+        {
+            WanLink::Clock::time_point deliver_at;
+            std::string                data;      // empty = end of stream
+        };
+
+        struct Pipe
+        {
+            int                     from { -1 };
+            int                     to   { -1 };
+            int                     direction { 0 };
+            std::mutex              mtx;
+            std::condition_variable cv;
+            std::deque<Chunk>       queue;
+            size_t                  queued { 0 };
+            bool                    closed { false };
+            WanLink::Clock::time_point last_delivery {};
+        };
+
+        struct Connection
+        {
+            int                      client { -1 };
+            int                      server { -1 };
+            Pipe                     up;      // client -> server
+            Pipe                     down;    // server -> client
+            std::vector<std::thread> threads;
+            std::atomic<int>         finished { 0 };
+        };
+
+        void acceptLoop();
+        void readLoop(Connection& connection, Pipe& pipe);
+        void writeLoop(Connection& connection, Pipe& pipe);
+        void reapFinished();
+
+        WanLink&                               _link;
+        std::string                            _target_host;
+        int32_t                                _target_port { 0 };
+        int                                    _listen { -1 };
+        std::atomic<bool>                      _running { false };
+        std::thread                            _accept_thread;
+        std::mutex                             _connections_mtx;
+        std::list<std::unique_ptr<Connection>> _connections;
+    };
+}
+
+#endif // __REMOTE_COMMAND_WAN_PROXY__
@@ -0,0 +1,132 @@
+// ---------------------------------------------------------------------------
+// WAN emulation proxy
+//
+// Sits between clients and a server and forwards each mapped port through
+// an emulated link (see wan_proxy.hpp): one-way delay, jitter, a bandwidth
+// cap shared by all mapped ports, and occasional stalls.  Needs no root and
+// no netem, so benchmarks and manual tests can run against "a 50 ms, 20
+// Mbit/s link" on any machine.
+//
+//   remote_command_wan_proxy --map LISTEN=HOST:PORT [--map ...]
+//                            [--delay MS] [--jitter MS] [--mbit N]
+//                            [--stall-prob P] [--stall-ms MS] [--seed N]
+//
+// A client needs both server ports behind the same link, e.g.
+//
+//   remote_command_wan_proxy --map 29000=127.0.0.1:19000 --map 29001=127.0.0.1:19001 --delay 25 --mbit 20
+//
+// and then connects to 29000 / 29001.  --delay is one way: the round trip
+// grows by twice its value.  Runs until interrupted.
+//
+// POSIX only.
+// ---------------------------------------------------------------------------
+#include "wan_proxy.hpp"
+
+#include <signal.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Bn3Monkey;
+
+struct Mapping
+{
+    int32_t     listen_port;
+    std::string host;
+    int32_t     port;
+};
+
+static std::atomic<bool> g_interrupted { false };
+
+static void onSignal(int)
+{
+    g_interrupted = true;
+}
+
+static void usage()
+{
+    std::fprintf(stderr,
+        "usage: remote_command_wan_proxy --map LISTEN=HOST:PORT [--map ...]\n"
+        "                                [--delay MS] [--jitter MS] [--mbit N]\n"
+        "                                [--stall-prob P] [--stall-ms MS] [--seed N]\n");
+}
+
+static bool parseMapping(const char* text, Mapping& mapping)
+{
+    const std::string value(text);
+    const size_t eq = value.find('=');
+    const size_t colon = value.rfind(':');
+    if (eq == std::string::npos || colon == std::string::npos || colon < eq) return false;
+    mapping.listen_port = std::atoi(value.substr(0, eq).c_str());
+    mapping.host        = value.substr(eq + 1, colon - eq - 1);
+    mapping.port        = std::atoi(value.substr(colon + 1).c_str());
+    return mapping.listen_port > 0 && mapping.port > 0 && !mapping.host.empty();
+}
+
+static bool parseOptions(int argc, char* argv[], std::vector<Mapping>& mappings, WanLinkOptions& link)
+{
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!value) return false;
+        ++i;
+        if (arg == "--map") {
+            Mapping mapping;
+            if (!parseMapping(value, mapping)) return false;
+            mappings.push_back(mapping);
+        }
+        else if (arg == "--delay")      link.delay_ms          = std::atof(value);
+        else if (arg == "--jitter")     link.jitter_ms         = std::atof(value);
+        else if (arg == "--mbit")       link.bandwidth_mbit    = std::atof(value);
+        else if (arg == "--stall-prob") link.stall_probability = std::atof(value);
+        else if (arg == "--stall-ms")   link.stall_ms          = std::atof(value);
+        else if (arg == "--seed")       link.seed              = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+        else return false;
+    }
+    return !mappings.empty() && link.delay_ms >= 0 && link.jitter_ms >= 0 && link.bandwidth_mbit >= 0 &&
+           link.stall_probability >= 0 && link.stall_probability <= 1.0;
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<Mapping> mappings;
+    WanLinkOptions link_options;
+    if (!parseOptions(argc, argv, mappings, link_options)) {
+        usage();
+        return 2;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    WanLink link(link_options);
+    std::vector<std::unique_ptr<WanProxy>> proxies;
+    for (const auto& mapping : mappings) {
+        std::unique_ptr<WanProxy> proxy(new WanProxy(link));
+        if (!proxy->open(mapping.listen_port, mapping.host, mapping.port)) {
+            std::fprintf(stderr, "failed to listen on port %d\n", mapping.listen_port);
+            return 1;
+        }
+        std::printf("%d -> %s:%d\n", mapping.listen_port, mapping.host.c_str(), mapping.port);
+        proxies.push_back(std::move(proxy));
+    }
+    char bandwidth[32] = "unlimited";
+    if (link_options.bandwidth_mbit > 0)
+        std::snprintf(bandwidth, sizeof(bandwidth), "%.1f Mbit/s", link_options.bandwidth_mbit);
+    std::printf("delay %.1f ms +- %.1f ms, %s, stalls %.3f x %.0f ms\n",
+                link_options.delay_ms, link_options.jitter_ms, bandwidth,
+                link_options.stall_probability, link_options.stall_ms);
+    std::fflush(stdout);
+
+    while (!g_interrupted)
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    for (auto& proxy : proxies) proxy->close();
+    return 0;
+}
@@ -4,6 +4,7 @@
 #include <cstdio>
 #include <cstdint>
 #include <vector>
+#include <string>
 #include <cstdarg>
 // ---------------------------------------------------------------------------
 // Portable printf-format checking macros
@@ -63,6 +64,10 @@ namespace Bn3Monkey
 
     RemoteCommandClient* discoverRemoteCommandClient(int32_t discovery_port);
     RemoteCommandClient* createRemoteCommandClient(int32_t command_port, int32_t stream_port, const char* ip = "127.0.0.1");
+    // Connects to a server opened in this process with
+    // RemoteCommandServerOptions::in_memory on the same ports, over
+    // in-memory pipes instead of TCP.  nullptr if there is none.
+    RemoteCommandClient* createInMemoryRemoteCommandClient(int32_t command_port, int32_t stream_port);
     void releaseRemoteCommandClient(RemoteCommandClient* client);
 
     const char* getRemoteCommandServerAddress(RemoteCommandClient* client);
@@ -85,18 +90,208 @@ namespace Bn3Monkey
     bool uploadFile(RemoteCommandClient* client, const char* local_file, const char* remote_file);
     bool downloadFile(RemoteCommandClient* client, const char* local_file, const char* remote_file);
 
-    void runCommandImpl(RemoteCommandClient* client, const char* cmd);
+    // Asynchronous variants: the server runs them on its worker pool, so the
+    // session keeps answering other requests meanwhile.  Each returns an
+    // operation id (> 0), or -1 if it could not be submitted.  Finish with
+    // awaitOperation() or an OnRemoteOperationComplete callback.
+    // uploadFileAsync still sends the file before returning; only the
+    // server-side write is asynchronous.
+    int32_t copyDirectoryAsync(RemoteCommandClient* client, const char* from_path, const char* to_path);
+    int32_t removeDirectoryAsync(RemoteCommandClient* client, const char* path);
+    int32_t uploadFileAsync(RemoteCommandClient* client, const char* local_file, const char* remote_file);
+    int32_t downloadFileAsync(RemoteCommandClient* client, const char* local_file, const char* remote_file);
+
+    // Blocks until the operation finishes and returns its result.  Returns
+    // false at once for an unknown id (or one already reported through the
+    // callback).
+    bool awaitOperation(RemoteCommandClient* client, int32_t operation_id);
+
+    // Fired from the stream thread when an operation finishes.
+    using OnRemoteOperationComplete = void (*)(int32_t operation_id, bool result);
+    void onRemoteOperationComplete(RemoteCommandClient* client, OnRemoteOperationComplete on_complete);
+
+    // Progress of a running asynchronous operation.  Totals are known from
+    // the first report; bytes_per_second is the average since the start.
+    struct RemoteOperationProgress
+    {
+        int32_t  operation_id     { 0 };
+        uint64_t bytes_done       { 0 };
+        uint64_t bytes_total      { 0 };
+        uint64_t items_done       { 0 };
+        uint64_t items_total      { 0 };
+        uint64_t bytes_per_second { 0 };
+    };
+
+    // Fired from the stream thread, at most once per the server's
+    // progress_interval_ms for each operation.
+    using OnRemoteProgress = void (*)(const RemoteOperationProgress& progress);
+    void onRemoteProgress(RemoteCommandClient* client, OnRemoteProgress on_progress);
+
+    // Resource use of one process group on the server: a command and
+    // everything it started.  Linux servers only.
+    struct RemoteProcessResources
+    {
+        uint32_t session_id    { 0 };
+        int32_t  process_group { -1 };   // pid of the command the server started
+        uint32_t processes     { 0 };
+        uint32_t threads       { 0 };
+        uint32_t open_files    { 0 };
+        double   cpu_percent   { 0.0 };  // of one core, since the previous sample
+        uint64_t rss_bytes     { 0 };
+        uint64_t read_bytes    { 0 };    // from storage, whole lifetime
+        uint64_t write_bytes   { 0 };
+    };
+
+    // Fired from the stream thread with every group of this session that is
+    // running when a sample is taken.
+    using OnRemoteResources = void (*)(const RemoteProcessResources* groups, size_t count);
+    void onRemoteResources(RemoteCommandClient* client, OnRemoteResources on_resources);
+
+    // Samples this session's running commands every interval_ms (at least
+    // 50) and reports them through onRemoteResources; 0 stops.
+    bool watchResources(RemoteCommandClient* client, uint32_t interval_ms);
+
+    // Samples every process group the server runs, for all sessions.
+    bool listProcesses(RemoteCommandClient* client, std::vector<RemoteProcessResources>& groups);
+
+    // Server metrics.  Latencies are in microseconds, taken from histograms
+    // that are exact to within 1/8.
+    struct RemoteLatency
+    {
+        uint64_t count    { 0 };
+        uint64_t total_us { 0 };
+        uint32_t p50_us   { 0 };
+        uint32_t p90_us   { 0 };
+        uint32_t p99_us   { 0 };
+        uint32_t max_us   { 0 };
+    };
+
+    struct RemoteInstructionStats
+    {
+        int32_t       instruction { 0 };   // protocol code, e.g. 0x10002000 for runCommand
+        RemoteLatency receive;             // request payload transfer after the header
+        RemoteLatency execute;             // until the first response byte
+        RemoteLatency send;                // writing the response
+    };
+
+    // Mutex contention, from servers built with -DREMOTE_COMMAND_LOCK_STATS=ON
+    struct RemoteLockStats
+    {
+        std::string   name;               // "stream": the stdout/stderr frame mutex of every session
+        uint64_t      acquisitions { 0 };
+        uint64_t      contended    { 0 }; // had to wait for another holder
+        RemoteLatency wait;               // every acquisition, 0 when uncontended
+        RemoteLatency hold;
+    };
+
+    struct RemoteServerStats
+    {
+        uint64_t uptime_ms              { 0 };
+        uint64_t command_bytes_received { 0 };
+        uint64_t command_bytes_sent     { 0 };
+        uint64_t stream_bytes_sent      { 0 };
+        uint64_t sessions_accepted      { 0 };
+        uint32_t sessions_active        { 0 };
+        uint32_t jobs_running           { 0 };   // holding a job slot (0 without job_slots)
+        uint32_t jobs_waiting           { 0 };
+        uint32_t operations_queued      { 0 };   // async operations not started yet
+        RemoteLatency spawn;                     // fork / CreateProcess on the server
+        RemoteLatency job_queue;                 // waits for a job slot
+        std::vector<RemoteInstructionStats> instructions;   // every code served so far
+        std::vector<RemoteLockStats>        locks;          // empty unless the server counts them
+    };
+
+    // Counters since the server started, for every session.
+    bool getServerStats(RemoteCommandClient* client, RemoteServerStats& stats);
+
+    // Event trace of the server's hot paths (requests, socket I/O, spawns,
+    // stream frames, file transfers, stream lock waits), for
+    // chrome://tracing or ui.perfetto.dev.  The trace is server-wide: any
+    // client may start or stop it.  start drops what was recorded before.
+    bool startServerTrace(RemoteCommandClient* client);
+    bool stopServerTrace(RemoteCommandClient* client);
+
+    // Chrome trace-event JSON of what was recorded so far (the last few
+    // thousand events per server thread).  Works while recording.
+    bool fetchServerTrace(RemoteCommandClient* client, std::string& json);
+
+    // Client-side call statistics.  Every request on the command socket is
+    // timed from the caller's side: send (writing the request), wait (until
+    // the response header arrives) and receive (reading the response).
+    // Asynchronous operations count their submission only.
+    struct RemoteCallTiming
+    {
+        int32_t     instruction    { 0 };
+        const char* name           { nullptr };   // e.g. "upload_file"; nullptr for custom instructions
+        uint64_t    send_us        { 0 };
+        uint64_t    wait_us        { 0 };
+        uint64_t    receive_us     { 0 };
+        uint64_t    bytes_sent     { 0 };         // request header + payloads
+        uint64_t    bytes_received { 0 };         // response header + payload
+        bool        ok             { false };     // false if the connection failed
+    };
+
+    struct RemoteCallStats
+    {
+        int32_t       instruction    { 0 };
+        const char*   name           { nullptr };
+        uint64_t      failures       { 0 };       // calls whose connection failed (not in the latencies)
+        uint64_t      bytes_sent     { 0 };
+        uint64_t      bytes_received { 0 };
+        RemoteLatency send;
+        RemoteLatency wait;
+        RemoteLatency receive;
+        RemoteLatency total;
+    };
+
+    struct RemoteClientStats
+    {
+        uint64_t                     stream_bytes_received { 0 };   // output, progress, ... frames
+        std::vector<RemoteCallStats> calls;                         // every code called so far
+    };
+
+    // Since the client was created (or last reset).  Safe from any thread.
+    bool getClientStats(RemoteCommandClient* client, RemoteClientStats& stats);
+    void resetClientStats(RemoteCommandClient* client);
+
+    // Span hooks, for forwarding calls to an application tracer.  begin runs
+    // before the request is sent and end after the response was read (or
+    // the call failed), both on the calling thread and with the context
+    // passed here.  Either may be nullptr.  Set them while no call is
+    // running.
+    using OnRemoteCallBegin = void (*)(void* context, int32_t instruction, const char* name);
+    using OnRemoteCallEnd   = void (*)(void* context, const RemoteCallTiming& timing);
+    void setRemoteCallHooks(RemoteCommandClient* client, OnRemoteCallBegin begin, OnRemoteCallEnd end,
+                            void* context);
+
+    // Custom instructions served by handlers the server embedder registered
+    // (REMOTE_COMMAND_USER_INSTRUCTION_BASE + n).  Up to four payloads are
+    // passed through as-is; the handler's reply is stored in reply.
+    // Returns the handler's result, or false if the instruction is not
+    // registered or the connection failed.
+#if !defined(__BN3MONKEY_REMOTE_COMMAND_USER_INSTRUCTION__)
+#define __BN3MONKEY_REMOTE_COMMAND_USER_INSTRUCTION__
+    // Shared with remote_command_server.hpp
+    static constexpr int32_t REMOTE_COMMAND_USER_INSTRUCTION_BASE  = 0x20000000;
+    static constexpr int32_t REMOTE_COMMAND_USER_INSTRUCTION_COUNT = 4096;
+#endif
+    bool invokeRemoteInstruction(RemoteCommandClient* client, int32_t instruction,
+                                 const std::vector<std::string>& payloads, std::vector<char>& reply);
+
+    // Returns the command's exit code (128 + signal if it was killed), or -1
+    // if it could not be run.
+    int32_t runCommandImpl(RemoteCommandClient* client, const char* cmd);
     int32_t openProcessImpl(RemoteCommandClient* client, const char* cmd);
 
     RC_PRINTF_FUNC(2, 3)
-    inline void runCommand(RemoteCommandClient* client, RC_PRINTF_STR const char* fmt, ...)
+    inline int32_t runCommand(RemoteCommandClient* client, RC_PRINTF_STR const char* fmt, ...)
     {
         char buffer[4096]{ 0 };
         va_list ap;
         va_start(ap, fmt);
         vsnprintf(buffer, sizeof(buffer), fmt, ap);
         va_end(ap);
-        runCommandImpl(client, buffer);
+        return runCommandImpl(client, buffer);
     }
 
     RC_PRINTF_FUNC(2, 3)
@@ -111,6 +306,177 @@ namespace Bn3Monkey
     }
 
     void closeProcess(RemoteCommandClient* client, int32_t process_id);
+
+    // Job queue.  A server opened with job_slots runs only that many
+    // runCommand / openProcess jobs at once; the rest wait for a slot, HIGH
+    // sessions before NORMAL before LOW, sessions of one class in turn.
+    enum class RemoteJobPriority : int32_t
+    {
+        NORMAL = 0,
+        HIGH   = 1,    // e.g. smoke tests that should jump the line
+        LOW    = 2,    // runs only when nothing else is waiting
+    };
+
+    // Applies to this session's later jobs.  False if the server refused.
+    bool setJobPriority(RemoteCommandClient* client, RemoteJobPriority priority);
+
+    // Milliseconds the last runCommand / openProcess waited for a slot
+    // (0 without a limit, or from a server that does not report it).
+    uint32_t lastQueueTime(RemoteCommandClient* client);
+
+    // Where the time of a runCommand went, in microseconds from the moment
+    // the server read its request header (server-side monotonic clock).
+    // -1 for a phase the run did not go through: built-in commands are not
+    // spawned, a command may print nothing, a job refused a slot stops early.
+    struct RemoteRunTiming
+    {
+        int64_t received_us     { -1 };   // request payloads read
+        int64_t scheduled_us    { -1 };   // job slot granted
+        int64_t spawned_us      { -1 };   // process started
+        int64_t first_output_us { -1 };   // first output byte read on the server
+        int64_t exited_us       { -1 };   // process exited
+        int64_t drained_us      { -1 };   // all output forwarded to the stream socket
+        int64_t replied_us      { -1 };   // response written
+        int64_t round_trip_us   { -1 };   // request sent -> response read, on this client
+    };
+
+    // Asks the server for a RemoteRunTiming with every later runCommand.
+    // Off by default; servers that do not know the flag ignore it.
+    void enableRunTiming(RemoteCommandClient* client, bool enable);
+
+    // Timing of the last runCommand; false if it was not enabled or the
+    // server did not report it.
+    bool lastRunTiming(RemoteCommandClient* client, RemoteRunTiming& timing);
+
+    // Cached commands, for expensive deterministic steps (code generators,
+    // asset converters).  The server keys the result on the command, the
+    // working directory, environment, declared outputs and the content of
+    // every input.  On a hit it restores the outputs and replays the output
+    // without running anything; only successful runs are stored.
+    struct RemoteCachedCommand
+    {
+        std::string              command;
+        std::vector<std::string> environment;   // "NAME=value", added to the server's environment
+        std::vector<std::string> inputs;        // files the result depends on; globs allowed
+        std::vector<std::string> outputs;       // files the command writes, restored on a hit
+    };
+
+    // Blocks like runCommand.  Output arrives through onRemoteOutput /
+    // onRemoteError once the command has finished.  Returns the exit code,
+    // -1 if it could not run; *hit tells whether it came from the cache.
+    int32_t runCachedCommand(RemoteCommandClient* client, const RemoteCachedCommand& command,
+                             bool* hit = nullptr);
+
+    // Launch options: where and how the processes this session starts from
+    // now on run (runCommand, openProcess, graphs, scripts, maps, cached
+    // commands).  Affinity, I/O priority and cgroup limits are Linux only;
+    // nice works on every POSIX server.  Without cpus, processes stay off
+    // the server's reserved cores.  cpu_max / memory_max take cgroup v2
+    // syntax ("50000 100000", "512M") and need a server opened with
+    // cgroup_root; the session's processes share that one cgroup.
+    enum class RemoteIoClass : int32_t
+    {
+        DEFAULT     = 0,    // inherit the server's
+        REALTIME    = 1,
+        BEST_EFFORT = 2,
+        IDLE        = 3,
+    };
+
+    struct RemoteLaunchOptions
+    {
+        std::vector<int32_t> cpus;                  // empty = any unreserved core
+        int32_t              nice     { 0 };        // -20 ... 19; below 0 needs privileges
+        RemoteIoClass        io_class { RemoteIoClass::DEFAULT };
+        int32_t              io_level { 4 };        // 0 (highest) ... 7
+        std::string          cpu_max;               // empty = unlimited
+        std::string          memory_max;            // empty = unlimited
+    };
+
+    // False if the server refused them (out of range, unsupported on its
+    // platform, or limits without a cgroup_root); the previous options then
+    // stay in force.  Default-constructed options restore the server's.
+    bool setLaunchOptions(RemoteCommandClient* client, const RemoteLaunchOptions& options);
+
+    // Command graphs: the server runs every node once all of its
+    // dependencies have succeeded, up to max_parallel at a time (0 = one per
+    // server core), so a whole build-and-test pipeline costs one round trip.
+    struct RemoteCommandNode
+    {
+        std::string              command;
+        std::string              cwd;            // relative to the working directory; empty = it
+        std::vector<std::string> environment;    // "NAME=value", added to the server's environment
+        std::vector<int32_t>     dependencies;   // indices of nodes that must succeed first
+    };
+
+    enum class RemoteNodeState
+    {
+        SUCCEEDED,
+        FAILED,         // non-zero exit code, or could not be started
+        SKIPPED         // a dependency failed
+    };
+    struct RemoteNodeResult
+    {
+        RemoteNodeState state      { RemoteNodeState::SKIPPED };
+        int32_t         exit_code  { -1 };
+        uint32_t        elapsed_ms { 0 };
+    };
+
+    // Blocks until the graph is done.  Returns true if every node succeeded.
+    // results gets one entry per node, or stays empty if the server rejected
+    // the graph (a dependency out of range or a cycle) or the connection failed.
+    bool runCommandGraph(RemoteCommandClient* client, const std::vector<RemoteCommandNode>& nodes,
+                         int32_t max_parallel, std::vector<RemoteNodeResult>& results);
+
+    // Output of graph nodes, fired from the stream thread.  Without this
+    // callback it goes to onRemoteOutput / onRemoteError untagged.
+    using OnRemoteNodeOutput = void (*)(int32_t node, const char* text, bool is_error);
+    void onRemoteNodeOutput(RemoteCommandClient* client, OnRemoteNodeOutput on_node_output);
+
+    // Parallel map over files, like `xargs -P`: the server runs
+    // command_template over every input on up to max_parallel processes
+    // (0 = one per server core).  Inputs containing '*', '?' or '[' are
+    // expanded as globs on the server ("**" spans directories).
+    //   "{}" in the template  -> one file per invocation
+    //   "{+}" in the template -> up to batch_size files per invocation
+    //   neither               -> batches appended at the end of the command
+    // batch_size 0 picks one from the number of files and workers.
+    struct RemoteMapItem
+    {
+        std::string file;
+        int32_t     invocation { -1 };   // index into invocations; shared by a batch
+    };
+    struct RemoteMapInvocation
+    {
+        RemoteNodeState state      { RemoteNodeState::SKIPPED };
+        int32_t         exit_code  { -1 };
+        uint32_t        elapsed_ms { 0 };
+        std::string     output;
+        std::string     error;
+    };
+
+    // Blocks until every invocation has finished.  Returns true if all of
+    // them succeeded.  items / invocations stay empty if the request was
+    // rejected (both "{}" and "{+}" in the template) or the connection failed.
+    bool mapFiles(RemoteCommandClient* client, const char* command_template,
+                  const std::vector<std::string>& inputs, int32_t max_parallel, int32_t batch_size,
+                  std::vector<RemoteMapItem>& items, std::vector<RemoteMapInvocation>& invocations);
+
+    // Scripts: an ordered list of commands in one request.  Each command
+    // starts after the previous one has finished; output arrives through
+    // onRemoteNodeOutput tagged with the command's index.
+    struct RemoteScriptOptions
+    {
+        bool stop_on_error { true };    // skip the rest after a failed command
+        bool shared_shell  { false };   // one shell for all commands, so cd and
+                                        // variables carry over (POSIX servers)
+    };
+
+    // Blocks until the script is done.  Returns true if every command
+    // succeeded.  results gets one entry per command, or stays empty if the
+    // server rejected the script (an empty command, a shared shell on
+    // Windows or a script too long for one shell) or the connection failed.
+    bool runCommandScript(RemoteCommandClient* client, const std::vector<std::string>& commands,
+                          const RemoteScriptOptions& options, std::vector<RemoteNodeResult>& results);
 }
 
 #endif // __BN3MONKEY_REMOTE_COMMAND_CLIENT__
\ No newline at end of file
@@ -3,13 +3,220 @@
 
 #include <cstdio>
 #include <cstdint>
+#include <cstring>
+#include <string>
+#include <functional>
+#include <type_traits>
 
 namespace Bn3Monkey
 {
     struct RemoteCommandServer;
 
+    struct RemoteCommandServerOptions
+    {
+        // Application-level heartbeat on the stream socket (0 = disabled).
+        // An idle client is pinged every heartbeat_interval_ms; after
+        // heartbeat_miss_count unanswered pings the session is dropped and
+        // its processes are killed.
+        int32_t heartbeat_interval_ms { 0 };
+        int32_t heartbeat_miss_count  { 3 };
+
+        // Kernel-level liveness on accepted sockets (0 = leave the OS default).
+        // tcp_keepalive_idle_s > 0 enables SO_KEEPALIVE.
+        int32_t tcp_keepalive_idle_s     { 0 };
+        int32_t tcp_keepalive_interval_s { 0 };
+        int32_t tcp_keepalive_count      { 0 };
+        int32_t tcp_user_timeout_ms      { 0 };   // Linux only
+
+        // Zero-downtime restart (POSIX only).
+        // socket_activation: adopt systemd-style $LISTEN_FDS listeners bound
+        //   to the command / stream ports instead of binding them.
+        // handoff_path: Unix socket path.  On open, take over the listeners of
+        //   a server already serving this path (it stops accepting, drains its
+        //   client and retires), then serve the path for the next upgrade.
+        bool        socket_activation { false };
+        const char* handoff_path      { nullptr };
+
+        // Serve only clients in this process (createInMemoryRemoteCommandClient)
+        // over in-memory pipes: no TCP listeners, no discovery, and the
+        // command / stream ports merely name this server among the in-memory
+        // ones.  For benchmarks and tests of protocol and handler cost
+        // without the kernel.  Ignores socket_activation, handoff_path and
+        // acceptor_threads; the metrics port, if any, is still TCP.
+        bool in_memory { false };
+
+        // Command-port acceptor threads (0 = one per core).  With more than
+        // one, each gets its own SO_REUSEPORT listener (Linux / BSD) and the
+        // kernel spreads new clients across them.  pin_acceptors pins
+        // acceptor i, and every session it accepts, to core i.
+        int32_t acceptor_threads { 1 };
+        bool    pin_acceptors    { true };
+
+        // Cores kept for the server itself, as a list like "0-1" or "0,4"
+        // (nullptr = none).  Acceptors, session handlers and the stream
+        // acceptor run there (acceptor i on the i-th reserved core, whatever
+        // pin_acceptors says), and spawned processes run everywhere else
+        // unless a session sets their affinity.  Linux / Windows threads only;
+        // processes are kept off the reserved cores on Linux.
+        const char* server_cores { nullptr };
+
+        // Delegated cgroup v2 directory the server may create children in
+        // (Linux only; nullptr = none).  Needed for setLaunchOptions with
+        // cpu_max / memory_max: each such session gets rc-<pid>-<session>
+        // under it, removed again when the session ends.
+        const char* cgroup_root { nullptr };
+
+        // Threads shared by all sessions for asynchronous filesystem
+        // operations (copyDirectoryAsync etc.; 0 = one per core).
+        int32_t worker_threads { 0 };
+
+        // Minimum gap between two progress frames of one asynchronous
+        // operation (0 = send none).
+        int32_t progress_interval_ms { 250 };
+
+        // Run plain cat / rm / touch / mkdir / test / wc / head / echo
+        // commands in-process instead of through /bin/sh (POSIX only).
+        bool builtin_commands { true };
+
+        // Jobs that may run at once across all sessions; 0 = no limit,
+        // -1 = one per core.  A job is a runCommand, an openProcess, a graph,
+        // a script, a file map or a cached-command miss; parallel graph nodes
+        // take extra slots only when they are free.  Jobs beyond it wait:
+        // high-priority sessions first, the others in turn.  An openProcess
+        // holds its slot until closeProcess.  Built-in commands never wait.
+        int32_t job_slots { 0 };
+
+        // Prometheus text dump of the server's metrics (the same numbers
+        // getServerStats returns).  metrics_file is rewritten every
+        // metrics_interval_ms; metrics_port serves it over plain HTTP on
+        // metrics_address (an IPv4 address, "0.0.0.0" for all interfaces;
+        // nullptr = loopback only).  nullptr / 0 = off.
+        const char* metrics_file        { nullptr };
+        int32_t     metrics_port        { 0 };
+        const char* metrics_address     { nullptr };
+        int32_t     metrics_interval_ms { 10000 };
+
+        // Chrome trace-event JSON of the server's hot paths (requests,
+        // socket I/O, spawns, stream frames, file transfers, stream lock
+        // waits).  Recording starts on open and the file is written on close
+        // (nullptr = off).  Clients can also start, stop and fetch a trace at
+        // runtime.  The trace is shared by every server in the process.
+        const char* trace_file { nullptr };
+
+        // Binary log of every request (session, instruction, arrival time,
+        // payload sizes) for remote_command_replay (nullptr = off).
+        // record_payloads also stores the payloads, uploaded files included,
+        // which replay needs to re-issue requests faithfully.
+        const char* record_file     { nullptr };
+        bool        record_payloads { false };
+
+        // Store for runCachedCommand results, shared by all sessions and
+        // safe to share between servers (nullptr = <temp>/remote-command-cache-<uid>,
+        // created 0700; the cache is off if that exists and is not ours alone).
+        const char* cache_directory { nullptr };
+
+        // Warm interpreter pool (POSIX only).  python_workers > 0 keeps that
+        // many python3 processes running with python_preload (comma-separated
+        // module names) imported.  `python3 -c CODE`, `python3 -m MODULE` and
+        // `python3 SCRIPT` commands without other shell syntax are forked from
+        // an idle one instead of starting a new interpreter; when all of them
+        // are busy the command goes through the shell as usual.
+        int32_t     python_workers    { 0 };
+        const char* python_preload    { nullptr };
+        const char* python_executable { nullptr };   // nullptr = "python3"
+    };
+
     RemoteCommandServer* openRemoteCommandServer(int32_t discovery_port, int32_t command_port, int32_t stream_port, const char* current_working_directory = ".");
+    RemoteCommandServer* openRemoteCommandServer(int32_t discovery_port, int32_t command_port, int32_t stream_port, const char* current_working_directory, const RemoteCommandServerOptions& options);
     void closeRemoteCommandServer(RemoteCommandServer* server);
+
+    // True once this server handed its listeners to a successor and its last
+    // client has disconnected.  The owner should then close it and exit.
+    bool isRemoteCommandServerRetired(RemoteCommandServer* server);
+
+    // -------------------------------------------------------------------------
+    // Custom instructions
+    //
+    // Embedders can serve their own instruction codes in-process instead of
+    // going through runCommand.  Codes are REMOTE_COMMAND_USER_INSTRUCTION_BASE
+    // + n for n < REMOTE_COMMAND_USER_INSTRUCTION_COUNT; clients call them with
+    // invokeRemoteInstruction.  A handler runs on the thread of the session
+    // that called it, so calls from different sessions may run concurrently
+    // and a slow handler only holds up its own session.
+    // -------------------------------------------------------------------------
+#if !defined(__BN3MONKEY_REMOTE_COMMAND_USER_INSTRUCTION__)
+#define __BN3MONKEY_REMOTE_COMMAND_USER_INSTRUCTION__
+    // Shared with remote_command_client.hpp
+    static constexpr int32_t REMOTE_COMMAND_USER_INSTRUCTION_BASE  = 0x20000000;
+    static constexpr int32_t REMOTE_COMMAND_USER_INSTRUCTION_COUNT = 4096;
+#endif
+
+    class RemoteInstructionRequest
+    {
+    public:
+        static constexpr size_t MAX_PAYLOADS = 4;
+
+        RemoteInstructionRequest(int32_t instruction, uint32_t session_id, const std::string* payloads)
+            : _instruction(instruction), _session_id(session_id), _payloads(payloads) {}
+
+        inline int32_t  instruction() const { return _instruction; }
+        inline uint32_t sessionId() const   { return _session_id; }
+
+        // Raw payload; empty when the client sent fewer than index + 1.
+        inline const std::string& payload(size_t index) const
+        {
+            static const std::string empty;
+            return index < MAX_PAYLOADS ? _payloads[index] : empty;
+        }
+
+        // Copies a fixed-size payload into value; false on a size mismatch.
+        template <typename T>
+        bool read(size_t index, T& value) const
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "payload type must be trivially copyable");
+            const std::string& data = payload(index);
+            if (data.size() != sizeof(T)) return false;
+            memcpy(&value, data.data(), sizeof(T));
+            return true;
+        }
+
+    private:
+        int32_t            _instruction;
+        uint32_t           _session_id;
+        const std::string* _payloads;
+    };
+
+    class RemoteInstructionResponse
+    {
+    public:
+        inline void append(const void* data, size_t size)
+        {
+            _data.append(static_cast<const char*>(data), size);
+        }
+        inline void append(const std::string& text) { _data.append(text); }
+
+        template <typename T>
+        void write(const T& value)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "reply type must be trivially copyable");
+            append(&value, sizeof(T));
+        }
+
+        inline const std::string& data() const { return _data; }
+
+    private:
+        std::string _data;
+    };
+
+    // Returns the result the client sees; the response data is sent either way.
+    using RemoteInstructionHandler =
+        std::function<bool(const RemoteInstructionRequest& request, RemoteInstructionResponse& response)>;
+
+    // False if instruction is outside the user range or already registered.
+    // Both may be called while the server is serving; a call already
+    // dispatched finishes with the handler it started with.
+    bool registerRemoteInstruction(RemoteCommandServer* server, int32_t instruction, RemoteInstructionHandler handler);
+    bool unregisterRemoteInstruction(RemoteCommandServer* server, int32_t instruction);
 }
 
-#endif // __BN3MONKEY_REMOTE_COMMAND_SERVER__
\ No newline at end of file
+#endif // __BN3MONKEY_REMOTE_COMMAND_SERVER__
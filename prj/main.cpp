@@ -2,6 +2,7 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <csignal>
 #include <atomic>
 #include <thread>
@@ -15,12 +16,112 @@ static void on_signal(int)
     g_stop.store(true);
 }
 
+static void print_usage(const char* program)
+{
+    std::printf("Usage: %s [options] [discovery_port] [command_port] [stream_port] [working_directory]\n", program);
+    std::printf("Options:\n");
+    std::printf("  --heartbeat-interval <ms>  ping an idle client every <ms> (default: off)\n");
+    std::printf("  --heartbeat-misses <n>     drop the client after <n> unanswered pings (default: 3)\n");
+    std::printf("  --keepalive <s>            enable TCP keepalive after <s> idle seconds\n");
+    std::printf("  --keepalive-interval <s>   seconds between keepalive probes\n");
+    std::printf("  --keepalive-count <n>      unanswered probes before the connection drops\n");
+    std::printf("  --user-timeout <ms>        TCP_USER_TIMEOUT for unacknowledged data (Linux)\n");
+    std::printf("  --socket-activation        adopt systemd LISTEN_FDS listeners for the ports\n");
+    std::printf("  --handoff <path>           take over from / hand over to a server on this Unix socket\n");
+    std::printf("  --acceptors <n>            command-port acceptor threads, 0 = one per core (default: 1)\n");
+    std::printf("  --no-pin                   do not pin acceptors and their sessions to cores\n");
+    std::printf("  --workers <n>              threads for asynchronous file operations, 0 = one per core (default: 0)\n");
+    std::printf("  --progress-interval <ms>   minimum gap between progress reports, 0 = none (default: 250)\n");
+    std::printf("  --no-builtins              run every command through the shell\n");
+    std::printf("  --job-slots <n>            jobs running at once, 0 = no limit, -1 = one per core (default: 0)\n");
+    std::printf("  --cache-dir <path>         store for cached command results (default: <temp>/remote-command-cache-<uid>)\n");
+    std::printf("  --python-workers <n>       warm python3 interpreters for python3 commands (default: 0)\n");
+    std::printf("  --python-preload <list>    comma-separated modules the warm interpreters import\n");
+    std::printf("  --server-cores <list>      cores reserved for the server's own threads, e.g. 0-1\n");
+    std::printf("  --cgroup-root <path>       delegated cgroup v2 directory for per-session limits\n");
+    std::printf("  --metrics-file <path>      rewrite Prometheus metrics to <path> periodically\n");
+    std::printf("  --metrics-port <port>      serve Prometheus metrics over HTTP on <port>\n");
+    std::printf("  --metrics-address <ip>     address --metrics-port listens on (default: 127.0.0.1)\n");
+    std::printf("  --metrics-interval <ms>    how often --metrics-file is rewritten (default: 10000)\n");
+    std::printf("  --trace <path>             record a Chrome trace from start-up and write it to <path> on exit\n");
+    std::printf("  --record <path>            log every request to <path> for remote_command_replay\n");
+    std::printf("  --record-payloads          also log request payloads (needed for a faithful replay)\n");
+}
+
 int main(int argc, char* argv[])
 {
-    int         discovery_port = (argc > 1) ? std::atoi(argv[1]) : 9000;
-    int         command_port   = (argc > 2) ? std::atoi(argv[2]) : 9001;
-    int         stream_port    = (argc > 3) ? std::atoi(argv[3]) : 9002;
-    const char* cwd            = (argc > 4) ? argv[4]            : ".";
+    Bn3Monkey::RemoteCommandServerOptions options;
+    const char* positional[4] { nullptr, nullptr, nullptr, nullptr };
+    int         num_positional = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* arg   = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+        if (std::strncmp(arg, "--", 2) != 0) {
+            if (num_positional < 4) positional[num_positional++] = arg;
+            continue;
+        }
+        if (std::strcmp(arg, "--help") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        }
+        if (std::strcmp(arg, "--socket-activation") == 0) {
+            options.socket_activation = true;
+            continue;
+        }
+        if (std::strcmp(arg, "--no-pin") == 0) {
+            options.pin_acceptors = false;
+            continue;
+        }
+        if (std::strcmp(arg, "--no-builtins") == 0) {
+            options.builtin_commands = false;
+            continue;
+        }
+        if (std::strcmp(arg, "--record-payloads") == 0) {
+            options.record_payloads = true;
+            continue;
+        }
+        if (!value) {
+            std::fprintf(stderr, "Missing value for %s\n", arg);
+            print_usage(argv[0]);
+            return 1;
+        }
+
+        if      (std::strcmp(arg, "--heartbeat-interval") == 0) options.heartbeat_interval_ms    = std::atoi(value);
+        else if (std::strcmp(arg, "--heartbeat-misses")   == 0) options.heartbeat_miss_count     = std::atoi(value);
+        else if (std::strcmp(arg, "--keepalive")          == 0) options.tcp_keepalive_idle_s     = std::atoi(value);
+        else if (std::strcmp(arg, "--keepalive-interval") == 0) options.tcp_keepalive_interval_s = std::atoi(value);
+        else if (std::strcmp(arg, "--keepalive-count")    == 0) options.tcp_keepalive_count      = std::atoi(value);
+        else if (std::strcmp(arg, "--user-timeout")       == 0) options.tcp_user_timeout_ms      = std::atoi(value);
+        else if (std::strcmp(arg, "--handoff")            == 0) options.handoff_path             = value;
+        else if (std::strcmp(arg, "--acceptors")          == 0) options.acceptor_threads         = std::atoi(value);
+        else if (std::strcmp(arg, "--workers")            == 0) options.worker_threads           = std::atoi(value);
+        else if (std::strcmp(arg, "--progress-interval")  == 0) options.progress_interval_ms     = std::atoi(value);
+        else if (std::strcmp(arg, "--job-slots")          == 0) options.job_slots                = std::atoi(value);
+        else if (std::strcmp(arg, "--cache-dir")          == 0) options.cache_directory          = value;
+        else if (std::strcmp(arg, "--python-workers")     == 0) options.python_workers           = std::atoi(value);
+        else if (std::strcmp(arg, "--python-preload")     == 0) options.python_preload           = value;
+        else if (std::strcmp(arg, "--server-cores")       == 0) options.server_cores             = value;
+        else if (std::strcmp(arg, "--cgroup-root")        == 0) options.cgroup_root              = value;
+        else if (std::strcmp(arg, "--metrics-file")       == 0) options.metrics_file             = value;
+        else if (std::strcmp(arg, "--metrics-port")       == 0) options.metrics_port             = std::atoi(value);
+        else if (std::strcmp(arg, "--metrics-address")    == 0) options.metrics_address          = value;
+        else if (std::strcmp(arg, "--metrics-interval")   == 0) options.metrics_interval_ms      = std::atoi(value);
+        else if (std::strcmp(arg, "--trace")              == 0) options.trace_file               = value;
+        else if (std::strcmp(arg, "--record")             == 0) options.record_file              = value;
+        else {
+            std::fprintf(stderr, "Unknown option: %s\n", arg);
+            print_usage(argv[0]);
+            return 1;
+        }
+        ++i;
+    }
+
+    int         discovery_port = positional[0] ? std::atoi(positional[0]) : 9000;
+    int         command_port   = positional[1] ? std::atoi(positional[1]) : 9001;
+    int         stream_port    = positional[2] ? std::atoi(positional[2]) : 9002;
+    const char* cwd            = positional[3] ? positional[3]            : ".";
 
     std::signal(SIGINT,  on_signal);
     std::signal(SIGTERM, on_signal);
@@ -35,11 +136,18 @@ int main(int argc, char* argv[])
     std::printf("  Command port   : %d\n", command_port);
     std::printf("  Stream  port   : %d\n", stream_port);
     std::printf("  Working dir    : %s\n", cwd);
+    if (options.heartbeat_interval_ms > 0)
+        std::printf("  Heartbeat      : %d ms x %d\n", options.heartbeat_interval_ms, options.heartbeat_miss_count);
+    if (options.handoff_path)
+        std::printf("  Handoff path   : %s\n", options.handoff_path);
+    if (options.acceptor_threads != 1)
+        std::printf("  Acceptors      : %d%s\n", options.acceptor_threads,
+                    options.pin_acceptors ? " (pinned)" : "");
     std::printf("Press Ctrl+C to stop.\n\n");
 
     // openRemoteCommandServer returns immediately.
     // Client accept / serve / reconnect loop runs in the background thread.
-    g_server = Bn3Monkey::openRemoteCommandServer(discovery_port, command_port, stream_port, cwd);
+    g_server = Bn3Monkey::openRemoteCommandServer(discovery_port, command_port, stream_port, cwd, options);
     if (!g_server) {
         std::fprintf(stderr, "Failed to start server.\n");
         return 1;
@@ -47,9 +155,15 @@ int main(int argc, char* argv[])
 
     std::printf("Server started. Waiting for connections...\n");
 
-    // Sleep until Ctrl+C / SIGTERM
-    while (!g_stop.load())
+    // Sleep until Ctrl+C / SIGTERM, or until a newer binary took over our
+    // listeners (--handoff) and the last client has gone.
+    while (!g_stop.load()) {
+        if (Bn3Monkey::isRemoteCommandServerRetired(g_server)) {
+            std::printf("\nHanded off to a new server and drained.\n");
+            break;
+        }
         std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
 
     std::printf("\nStopping server...\n");
     Bn3Monkey::closeRemoteCommandServer(g_server);
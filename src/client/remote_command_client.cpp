@@ -1,12 +1,19 @@
 #include "../../include/remote_command_client.hpp"
 #include "../protocol/remote_command_protocol.hpp"
+#include "../protocol/remote_command_transport.hpp"
+#include "../protocol/remote_command_histogram.hpp"
 
 #include <kiotty_discovery_client.hpp>
 
 #include <cstring>
 #include <vector>
+#include <map>
+#include <string>
 #include <thread>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 #include <fstream>
 
 #ifdef _WIN32
@@ -18,17 +25,36 @@
    typedef SOCKET sock_t;
    static const sock_t INVALID_SOCK = INVALID_SOCKET;
    // shutdown() wakes up any thread blocked in recv() before releasing the fd
-   static void closeSocket(sock_t s) { shutdown(s, SD_BOTH); closesocket(s); }
+   static void closeSocket(sock_t s)
+   {
+       if (Bn3Monkey::isMemorySocket(static_cast<int64_t>(s))) Bn3Monkey::MemoryTransport::instance().close(static_cast<int64_t>(s));
+       else { shutdown(s, SD_BOTH); closesocket(s); }
+   }
 #else
 #  include <sys/socket.h>
 #  include <netinet/in.h>
+#  include <netinet/tcp.h>
 #  include <arpa/inet.h>
 #  include <unistd.h>
+#  include <fcntl.h>
+#  include <poll.h>
    typedef int sock_t;
    static const sock_t INVALID_SOCK = -1;
    // POSIX: close() alone does NOT interrupt a blocked recv() in another thread.
    // shutdown(SHUT_RDWR) marks the socket unreadable so recv() returns 0 immediately.
-   static void closeSocket(sock_t s) { shutdown(s, SHUT_RDWR); close(s); }
+   static void closeSocket(sock_t s)
+   {
+       if (Bn3Monkey::isMemorySocket(s)) Bn3Monkey::MemoryTransport::instance().close(s);
+       else { shutdown(s, SHUT_RDWR); close(s); }
+   }
+#endif
+
+// A server that vanished mid-send must surface as a send() error, not as a
+// SIGPIPE that kills the caller's process.
+#if defined(MSG_NOSIGNAL)
+static const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+static const int SEND_FLAGS = 0;
 #endif
 
 namespace Bn3Monkey
@@ -36,6 +62,36 @@ namespace Bn3Monkey
     // -------------------------------------------------------------------------
     // Internal struct (opaque from the header)
     // -------------------------------------------------------------------------
+    struct PendingOperation
+    {
+        RemoteCommandInstruction instruction { RemoteCommandInstruction::INSTRUCTION_EMPTY };
+        std::string local_file;         // downloadFileAsync destination
+        bool        done    { false };
+        bool        result  { false };
+        int32_t     waiters { 0 };      // threads inside awaitOperation
+    };
+
+    struct CallStats
+    {
+        uint64_t         failures       { 0 };
+        uint64_t         bytes_sent     { 0 };
+        uint64_t         bytes_received { 0 };
+        // Same buckets as the server's; recorded under stats_mtx
+        LatencyHistogram send;
+        LatencyHistogram wait;
+        LatencyHistogram receive;
+        LatencyHistogram total;
+    };
+
+    // The request in flight on the command socket (one at a time)
+    struct PendingCall
+    {
+        bool                                  open { false };
+        RemoteCallTiming                      timing;
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::time_point sent;
+    };
+
     struct RemoteCommandClient
     {
         char ip[32] {0};
@@ -43,11 +99,35 @@ namespace Bn3Monkey
         sock_t          stream_sock   { INVALID_SOCK };
         OnRemoteOutput  on_remote_output { nullptr };
         OnRemoteError   on_remote_error  { nullptr };
+        OnRemoteNodeOutput on_node_output { nullptr };
         std::thread     stream_thread;
         std::atomic<bool> running;
         char            cwd_buffer[4096] { 0 };
-
-        RemoteCommandClient() : running(false) {}
+        uint32_t        last_queued_ms { 0 };   // of the last runCommand / openProcess
+        bool            run_timing { false };   // enableRunTiming
+        bool            session_reply_pending { false };   // SESSION_ID timed out; drop a late reply
+        bool            has_timing { false };
+        RemoteRunTiming last_timing;
+
+        // Asynchronous operations, keyed by the id this client assigned
+        std::mutex                          operation_mtx;
+        std::condition_variable             operation_cv;
+        std::map<int32_t, PendingOperation> operations;
+        int32_t                             next_operation_id { 1 };
+        OnRemoteOperationComplete           on_operation_complete { nullptr };
+        OnRemoteProgress                    on_progress { nullptr };
+        OnRemoteResources                   on_resources { nullptr };
+
+        // Client-side call statistics (getClientStats) and span hooks
+        PendingCall                         call;
+        std::mutex                          stats_mtx;
+        std::map<int32_t, CallStats>        call_stats;
+        std::atomic<uint64_t>               stream_bytes_received;
+        OnRemoteCallBegin                   on_call_begin { nullptr };
+        OnRemoteCallEnd                     on_call_end   { nullptr };
+        void*                               call_context  { nullptr };
+
+        RemoteCommandClient() : running(false), stream_bytes_received(0) {}
     };
 
     // -------------------------------------------------------------------------
@@ -55,6 +135,8 @@ namespace Bn3Monkey
     // -------------------------------------------------------------------------
     static bool sendAll(sock_t sock, const void* data, size_t size)
     {
+        if (isMemorySocket(static_cast<int64_t>(sock)))
+            return MemoryTransport::instance().send(static_cast<int64_t>(sock), data, size);
         const char* ptr = static_cast<const char*>(data);
         size_t remaining = size;
         while (remaining > 0) {
@@ -62,7 +144,7 @@ namespace Bn3Monkey
             int chunk = static_cast<int>(remaining > 65536 ? 65536 : remaining);
             int sent  = ::send(sock, ptr, chunk, 0);
 #else
-            ssize_t sent = ::send(sock, ptr, remaining, 0);
+            ssize_t sent = ::send(sock, ptr, remaining, SEND_FLAGS);
 #endif
             if (sent <= 0) return false;
             ptr       += sent;
@@ -73,6 +155,8 @@ namespace Bn3Monkey
 
     static bool recvAll(sock_t sock, void* data, size_t size)
     {
+        if (isMemorySocket(static_cast<int64_t>(sock)))
+            return MemoryTransport::instance().recv(static_cast<int64_t>(sock), data, size);
         char* ptr = static_cast<char*>(data);
         size_t remaining = size;
         while (remaining > 0) {
@@ -89,83 +173,300 @@ namespace Bn3Monkey
         return true;
     }
 
+    static bool waitReadable(sock_t sock, int timeout_ms)
+    {
+        if (isMemorySocket(static_cast<int64_t>(sock)))
+            return MemoryTransport::instance().waitReadable(static_cast<int64_t>(sock), timeout_ms);
+#ifdef _WIN32
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(sock, &read_fds);
+        timeval tv {};
+        tv.tv_sec  = timeout_ms / 1000;
+        tv.tv_usec = (timeout_ms % 1000) * 1000;
+        return ::select(0, &read_fds, nullptr, nullptr, &tv) > 0;
+#else
+        pollfd pfd {};
+        pfd.fd     = sock;
+        pfd.events = POLLIN;
+        return ::poll(&pfd, 1, timeout_ms) > 0;
+#endif
+    }
+
+    // -------------------------------------------------------------------------
+    // Timed command-socket I/O: a call opens with its request header and
+    // closes when recvResponse has read the reply or anything failed.
+    // -------------------------------------------------------------------------
+    static uint64_t microsecondsBetween(std::chrono::steady_clock::time_point from,
+                                        std::chrono::steady_clock::time_point to)
+    {
+        long long us = std::chrono::duration_cast<std::chrono::microseconds>(to - from).count();
+        return us > 0 ? static_cast<uint64_t>(us) : 0;
+    }
+
+    static void endCall(RemoteCommandClient* client, bool ok)
+    {
+        PendingCall& call = client->call;
+        if (!call.open) return;
+        call.open      = false;
+        call.timing.ok = ok;
+        {
+            std::lock_guard<std::mutex> lk(client->stats_mtx);
+            CallStats& stats = client->call_stats[call.timing.instruction];
+            stats.bytes_sent     += call.timing.bytes_sent;
+            stats.bytes_received += call.timing.bytes_received;
+            if (!ok) {
+                ++stats.failures;
+            } else {
+                stats.send.record(call.timing.send_us);
+                stats.wait.record(call.timing.wait_us);
+                stats.receive.record(call.timing.receive_us);
+                stats.total.record(call.timing.send_us + call.timing.wait_us + call.timing.receive_us);
+            }
+        }
+        if (client->on_call_end)
+            client->on_call_end(client->call_context, call.timing);
+    }
+
+    static bool sendPayload(RemoteCommandClient* client, const void* data, size_t size)
+    {
+        PendingCall& call = client->call;
+        bool ok = sendAll(client->command_sock, data, size);
+        call.sent = std::chrono::steady_clock::now();
+        call.timing.bytes_sent += size;
+        call.timing.send_us     = microsecondsBetween(call.start, call.sent);
+        if (!ok) endCall(client, false);
+        return ok;
+    }
+
+    static bool sendHeader(RemoteCommandClient* client, const RemoteCommandRequestHeader& header)
+    {
+        endCall(client, false);     // a previous call that never got its reply
+
+        PendingCall& call = client->call;
+        call.open   = true;
+        call.timing = RemoteCallTiming();
+        call.timing.instruction = static_cast<int32_t>(header.instruction);
+        call.timing.name        = instructionName(header.instruction);
+        if (client->on_call_begin)
+            client->on_call_begin(client->call_context, call.timing.instruction, call.timing.name);
+        call.start = std::chrono::steady_clock::now();
+        return sendPayload(client, &header, sizeof(header));
+    }
+
     // -------------------------------------------------------------------------
     // Send a request with 0 / 1 / 2 payloads
     // -------------------------------------------------------------------------
-    static bool sendRequest(sock_t sock,
+    static bool sendRequest(RemoteCommandClient* client,
                             RemoteCommandInstruction instruction)
     {
         RemoteCommandRequestHeader header(instruction);
-        return sendAll(sock, &header, sizeof(header));
+        return sendHeader(client, header);
     }
 
-    static bool sendRequest(sock_t sock,
+    static bool sendRequest(RemoteCommandClient* client,
                             RemoteCommandInstruction instruction,
                             const char* p0)
     {
         uint32_t len0 = static_cast<uint32_t>(strlen(p0));
         RemoteCommandRequestHeader header(instruction, len0);
-        if (!sendAll(sock, &header, sizeof(header))) return false;
-        return sendAll(sock, p0, len0);
+        if (!sendHeader(client, header)) return false;
+        return sendPayload(client, p0, len0);
     }
 
-    static bool sendRequest(sock_t sock,
+    static bool sendRequest(RemoteCommandClient* client,
                             RemoteCommandInstruction instruction,
                             const char* p0, const char* p1)
     {
         uint32_t len0 = static_cast<uint32_t>(strlen(p0));
         uint32_t len1 = static_cast<uint32_t>(strlen(p1));
         RemoteCommandRequestHeader header(instruction, len0, len1);
-        if (!sendAll(sock, &header, sizeof(header))) return false;
-        if (!sendAll(sock, p0, len0))                return false;
-        return sendAll(sock, p1, len1);
+        if (!sendHeader(client, header))    return false;
+        if (!sendPayload(client, p0, len0)) return false;
+        return sendPayload(client, p1, len1);
     }
 
     // raw binary payload_0 only (used by closeProcess)
-    static bool sendRequest(sock_t sock,
+    static bool sendRequest(RemoteCommandClient* client,
                             RemoteCommandInstruction instruction,
                             const void* p0_data, uint32_t p0_len)
     {
         RemoteCommandRequestHeader header(instruction, p0_len);
-        if (!sendAll(sock, &header, sizeof(header))) return false;
-        if (p0_len > 0 && !sendAll(sock, p0_data, p0_len)) return false;
+        if (!sendHeader(client, header)) return false;
+        if (p0_len > 0 && !sendPayload(client, p0_data, p0_len)) return false;
         return true;
     }
 
     // string path + raw binary payload (used by uploadFile)
-    static bool sendRequest(sock_t sock,
+    static bool sendRequest(RemoteCommandClient* client,
                             RemoteCommandInstruction instruction,
                             const char* p0,
                             const void* p1_data, uint32_t p1_len)
     {
         uint32_t len0 = static_cast<uint32_t>(strlen(p0));
         RemoteCommandRequestHeader header(instruction, len0, p1_len);
-        if (!sendAll(sock, &header, sizeof(header))) return false;
-        if (!sendAll(sock, p0, len0))                return false;
-        if (p1_len > 0 && !sendAll(sock, p1_data, p1_len)) return false;
+        if (!sendHeader(client, header))    return false;
+        if (!sendPayload(client, p0, len0)) return false;
+        if (p1_len > 0 && !sendPayload(client, p1_data, p1_len)) return false;
         return true;
     }
 
     // -------------------------------------------------------------------------
     // Receive a response header + optional payload into a vector
     // -------------------------------------------------------------------------
-    static bool recvResponse(sock_t sock,
+    static bool recvResponse(RemoteCommandClient* client,
                              RemoteCommandInstruction expected,
                              std::vector<char>& payload_out)
     {
         RemoteCommandResponseHeader header(RemoteCommandInstruction::INSTRUCTION_EMPTY);
-        if (!recvAll(sock, &header, sizeof(header))) return false;
-        if (!header.valid())                          return false;
-        if (header.instruction != expected)           return false;
+        bool ok = recvAll(client->command_sock, &header, sizeof(header)) && header.valid();
+        if (ok && client->session_reply_pending &&
+            header.instruction == RemoteCommandInstruction::INSTRUCTION_SESSION_ID) {
+            // The server did answer SESSION_ID after all, only too late
+            client->session_reply_pending = false;
+            std::vector<char> late(header.payload_length);
+            ok = (late.empty() || recvAll(client->command_sock, late.data(), late.size())) &&
+                 recvAll(client->command_sock, &header, sizeof(header)) && header.valid();
+        }
+        ok = ok && header.instruction == expected;
+        const auto arrived = std::chrono::steady_clock::now();
+        if (ok) {
+            payload_out.assign(header.payload_length, '\0');
+            if (header.payload_length > 0)
+                ok = recvAll(client->command_sock, payload_out.data(), header.payload_length);
+        }
 
-        payload_out.assign(header.payload_length, '\0');
-        if (header.payload_length > 0)
-            return recvAll(sock, payload_out.data(), header.payload_length);
-        return true;
+        PendingCall& call = client->call;
+        if (call.open) {
+            call.timing.wait_us    = microsecondsBetween(call.sent, arrived);
+            call.timing.receive_us = microsecondsBetween(arrived, std::chrono::steady_clock::now());
+            if (ok) call.timing.bytes_received = sizeof(header) + header.payload_length;
+            endCall(client, ok);
+        }
+        return ok;
     }
 
     // -------------------------------------------------------------------------
-    // Stream thread: reads output/error packets and fires callbacks
+    // Asynchronous operation completion (stream thread)
+    // -------------------------------------------------------------------------
+    static void completeOperation(RemoteCommandClient* client, const char* data, uint32_t len)
+    {
+        RemoteCommandOperationInner inner;
+        if (len < sizeof(inner) + 1) return;
+        memcpy(&inner, data, sizeof(inner));
+        bool result = data[sizeof(inner)] != 0;
+
+        OnRemoteOperationComplete callback = nullptr;
+        {
+            std::lock_guard<std::mutex> lk(client->operation_mtx);
+            auto it = client->operations.find(static_cast<int32_t>(inner.operation_id));
+            if (it == client->operations.end()) return;
+            PendingOperation& op = it->second;
+
+            if (result && op.instruction == RemoteCommandInstruction::INSTRUCTION_DOWNLOAD_FILE) {
+                std::ofstream f(op.local_file.c_str(), std::ios::binary);
+                result = f.is_open();
+                if (result && len > sizeof(inner) + 1)
+                    f.write(data + sizeof(inner) + 1,
+                            static_cast<std::streamsize>(len - sizeof(inner) - 1));
+            }
+            op.done   = true;
+            op.result = result;
+
+            // Nobody will await a result that the callback already reported
+            callback = client->on_operation_complete;
+            if (callback && op.waiters == 0)
+                client->operations.erase(it);
+        }
+        client->operation_cv.notify_all();
+
+        if (callback)
+            callback(static_cast<int32_t>(inner.operation_id), result);
+    }
+
+    static void reportProgress(RemoteCommandClient* client, const char* data, uint32_t len)
+    {
+        OnRemoteProgress callback = client->on_progress;
+        RemoteCommandProgressInner inner;
+        if (!callback || len < sizeof(inner)) return;
+        memcpy(&inner, data, sizeof(inner));
+
+        RemoteOperationProgress progress;
+        progress.operation_id     = static_cast<int32_t>(inner.operation_id);
+        progress.bytes_done       = inner.bytes_done;
+        progress.bytes_total      = inner.bytes_total;
+        progress.items_done       = inner.items_done;
+        progress.items_total      = inner.items_total;
+        progress.bytes_per_second = inner.bytes_per_second;
+        callback(progress);
+    }
+
+    static RemoteProcessResources toResources(const RemoteCommandResourceInner& inner)
+    {
+        RemoteProcessResources resources;
+        resources.session_id    = inner.session_id;
+        resources.process_group = inner.process_group;
+        resources.processes     = inner.processes;
+        resources.threads       = inner.threads;
+        resources.open_files    = inner.open_files;
+        resources.cpu_percent   = inner.cpu_milli / 10.0;
+        resources.rss_bytes     = inner.rss_bytes;
+        resources.read_bytes    = inner.read_bytes;
+        resources.write_bytes   = inner.write_bytes;
+        return resources;
+    }
+
+    static void decodeResources(const char* data, size_t len, std::vector<RemoteProcessResources>& groups)
+    {
+        groups.clear();
+        for (size_t pos = 0; pos + sizeof(RemoteCommandResourceInner) <= len; pos += sizeof(RemoteCommandResourceInner)) {
+            RemoteCommandResourceInner inner;
+            memcpy(&inner, data + pos, sizeof(inner));
+            groups.push_back(toResources(inner));
+        }
+    }
+
+    static void reportResources(RemoteCommandClient* client, const char* data, uint32_t len)
+    {
+        OnRemoteResources callback = client->on_resources;
+        if (!callback) return;
+        std::vector<RemoteProcessResources> groups;
+        decodeResources(data, len, groups);
+        if (!groups.empty())
+            callback(groups.data(), groups.size());
+    }
+
+    // Output of a RUN_GRAPH node; data is NUL-terminated past len
+    static void reportNodeOutput(RemoteCommandClient* client, RemoteCommandStreamType type,
+                                 const char* data, uint32_t len)
+    {
+        uint32_t node = 0;
+        if (len < sizeof(node)) return;
+        memcpy(&node, data, sizeof(node));
+
+        bool is_error = type == RemoteCommandStreamType::STREAM_NODE_ERROR;
+        if (client->on_node_output)
+            client->on_node_output(static_cast<int32_t>(node), data + sizeof(node), is_error);
+        else if (is_error && client->on_remote_error)
+            client->on_remote_error(data + sizeof(node));
+        else if (!is_error && client->on_remote_output)
+            client->on_remote_output(data + sizeof(node));
+    }
+
+    // The stream is gone: nothing more will complete
+    static void failPendingOperations(RemoteCommandClient* client)
+    {
+        {
+            std::lock_guard<std::mutex> lk(client->operation_mtx);
+            for (auto& entry : client->operations)
+                entry.second.done = true;
+        }
+        client->operation_cv.notify_all();
+    }
+
+    // -------------------------------------------------------------------------
+    // Stream thread: reads output/error packets and fires callbacks,
+    // and answers heartbeat pings
     // -------------------------------------------------------------------------
     static void streamThreadFunc(RemoteCommandClient* client)
     {
@@ -173,29 +474,58 @@ namespace Bn3Monkey
             RemoteCommandStreamHeader header(RemoteCommandStreamType::INVALID, 0);
             if (!recvAll(client->stream_sock, &header, sizeof(header))) break;
             if (!header.valid()) break;
+            client->stream_bytes_received.fetch_add(sizeof(header) + header.payload_length,
+                                                    std::memory_order_relaxed);
 
             if (header.payload_length == 0) continue;
 
             std::vector<char> buf(header.payload_length + 1, '\0');
             if (!recvAll(client->stream_sock, buf.data(), header.payload_length)) break;
 
-            if (header.type == RemoteCommandStreamType::STREAM_OUTPUT) {
+            if (header.type == RemoteCommandStreamType::STREAM_PING) {
+                // Echo the sequence back so the server knows we are alive.
+                // Only this thread writes to the stream socket.
+                RemoteCommandStreamHeader pong(RemoteCommandStreamType::STREAM_PONG,
+                                               header.payload_length);
+                if (!sendAll(client->stream_sock, &pong, sizeof(pong))) break;
+                if (!sendAll(client->stream_sock, buf.data(), header.payload_length)) break;
+            } else if (header.type == RemoteCommandStreamType::STREAM_OUTPUT) {
                 if (client->on_remote_output)
                     client->on_remote_output(buf.data());
             } else if (header.type == RemoteCommandStreamType::STREAM_ERROR) {
                 if (client->on_remote_error)
                     client->on_remote_error(buf.data());
+            } else if (header.type == RemoteCommandStreamType::STREAM_NODE_OUTPUT ||
+                       header.type == RemoteCommandStreamType::STREAM_NODE_ERROR) {
+                reportNodeOutput(client, header.type, buf.data(), header.payload_length);
+            } else if (header.type == RemoteCommandStreamType::STREAM_OPERATION) {
+                completeOperation(client, buf.data(), header.payload_length);
+            } else if (header.type == RemoteCommandStreamType::STREAM_PROGRESS) {
+                reportProgress(client, buf.data(), header.payload_length);
+            } else if (header.type == RemoteCommandStreamType::STREAM_RESOURCES) {
+                reportResources(client, buf.data(), header.payload_length);
             }
         }
+        failPendingOperations(client);
     }
 
     // -------------------------------------------------------------------------
     // Connect helper
     // -------------------------------------------------------------------------
-    static sock_t connectToServer(const char* host, int port)
+    static sock_t connectToServer(const char* host, int port, bool in_memory)
     {
+        if (in_memory) {
+            int64_t sock = MemoryTransport::instance().connect(port);
+            return sock < 0 ? INVALID_SOCK : static_cast<sock_t>(sock);
+        }
+
         sock_t sock = ::socket(AF_INET, SOCK_STREAM, 0);
         if (sock == INVALID_SOCK) return INVALID_SOCK;
+#ifndef _WIN32
+        // Programs the embedding application starts must not hold the
+        // session open after the client is released.
+        fcntl(sock, F_SETFD, FD_CLOEXEC);
+#endif
 
         sockaddr_in addr {};
         addr.sin_family = AF_INET;
@@ -210,6 +540,11 @@ namespace Bn3Monkey
             closeSocket(sock);
             return INVALID_SOCK;
         }
+
+        // Requests go out as header + payload sends; without this each one
+        // waits for the server's delayed ACK.
+        int yes = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&yes), sizeof(yes));
         return sock;
     }
 
@@ -244,17 +579,21 @@ namespace Bn3Monkey
 		return createRemoteCommandClient(command_port, stream_port, ip);
     }
 
-    RemoteCommandClient* createRemoteCommandClient(int32_t command_port, int32_t stream_port, const char* ip)
+    // How long connectClient waits for the SESSION_ID reply before taking
+    // the server for one that predates it.
+    static const int SESSION_ID_TIMEOUT_MS = 2000;
+
+    static RemoteCommandClient* connectClient(const char* host, int32_t command_port, int32_t stream_port,
+                                              bool in_memory)
     {
 #ifdef _WIN32
         WSADATA wsa;
         if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) return nullptr;
 #endif
-        const char* host = (ip && ip[0] != '\0') ? ip : "127.0.0.1";
         auto* client = new RemoteCommandClient();
         snprintf(client->ip, sizeof(client->ip), "%s", host);
 
-        client->command_sock = connectToServer(host, command_port);
+        client->command_sock = connectToServer(host, command_port, in_memory);
         if (client->command_sock == INVALID_SOCK) {
             delete client;
 #ifdef _WIN32
@@ -263,8 +602,40 @@ namespace Bn3Monkey
             return nullptr;
         }
 
-        client->stream_sock = connectToServer(host, stream_port);
-        if (client->stream_sock == INVALID_SOCK) {
+        // The server serves many clients; ask for this command connection's
+        // session token so the stream connection can be bound to it.
+        // Servers from before INSTRUCTION_SESSION_ID skip it without a
+        // reply; after SESSION_ID_TIMEOUT_MS the stream connects unnamed
+        // and such a server pairs it in arrival order.
+        RemoteCommandSessionTokenInner token;
+        bool named = false;
+        std::vector<char> payload;
+        bool ok = sendRequest(client, RemoteCommandInstruction::INSTRUCTION_SESSION_ID);
+        if (ok && waitReadable(client->command_sock, SESSION_ID_TIMEOUT_MS)) {
+            ok = recvResponse(client, RemoteCommandInstruction::INSTRUCTION_SESSION_ID, payload) &&
+                 payload.size() >= sizeof(uint32_t) + sizeof(token);
+            if (ok) memcpy(&token, payload.data() + sizeof(uint32_t), sizeof(token));   // after the session id
+            named = ok;
+        } else if (ok) {
+            endCall(client, false);
+            client->session_reply_pending = true;
+        }
+        if (!ok) {
+            closeSocket(client->command_sock);
+            delete client;
+#ifdef _WIN32
+            WSACleanup();
+#endif
+            return nullptr;
+        }
+
+        client->stream_sock = connectToServer(host, stream_port, in_memory);
+        RemoteCommandStreamHeader attach(RemoteCommandStreamType::STREAM_ATTACH, sizeof(token));
+        if (client->stream_sock == INVALID_SOCK ||
+            (named && (!sendAll(client->stream_sock, &attach, sizeof(attach)) ||
+                       !sendAll(client->stream_sock, &token, sizeof(token))))) {
+            if (client->stream_sock != INVALID_SOCK)
+                closeSocket(client->stream_sock);
             closeSocket(client->command_sock);
             delete client;
 #ifdef _WIN32
@@ -278,6 +649,16 @@ namespace Bn3Monkey
         return client;
     }
 
+    RemoteCommandClient* createRemoteCommandClient(int32_t command_port, int32_t stream_port, const char* ip)
+    {
+        return connectClient((ip && ip[0] != '\0') ? ip : "127.0.0.1", command_port, stream_port, false);
+    }
+
+    RemoteCommandClient* createInMemoryRemoteCommandClient(int32_t command_port, int32_t stream_port)
+    {
+        return connectClient("memory", command_port, stream_port, true);
+    }
+
     const char* getRemoteCommandServerAddress(RemoteCommandClient* client)
     {
         return client->ip;
@@ -320,12 +701,12 @@ namespace Bn3Monkey
     {
         if (!client) return nullptr;
 
-        if (!sendRequest(client->command_sock,
+        if (!sendRequest(client,
                          RemoteCommandInstruction::INSTRUCTION_CURRENT_WORKING_DIRECTORY))
             return nullptr;
 
         std::vector<char> payload;
-        if (!recvResponse(client->command_sock,
+        if (!recvResponse(client,
                           RemoteCommandInstruction::INSTRUCTION_CURRENT_WORKING_DIRECTORY,
                           payload))
             return nullptr;
@@ -342,13 +723,13 @@ namespace Bn3Monkey
     {
         if (!client || !path) return false;
 
-        if (!sendRequest(client->command_sock,
+        if (!sendRequest(client,
                          RemoteCommandInstruction::INSTRUCTION_MOVE_CURRENT_WORKING_DIRECTORY,
                          path))
             return false;
 
         std::vector<char> payload;
-        if (!recvResponse(client->command_sock,
+        if (!recvResponse(client,
                           RemoteCommandInstruction::INSTRUCTION_MOVE_CURRENT_WORKING_DIRECTORY,
                           payload))
             return false;
@@ -363,13 +744,13 @@ namespace Bn3Monkey
     {
         if (!client || !path) return false;
 
-        if (!sendRequest(client->command_sock,
+        if (!sendRequest(client,
                          RemoteCommandInstruction::INSTRUCTION_DIRECTORY_EXISTS,
                          path))
             return false;
 
         std::vector<char> payload;
-        if (!recvResponse(client->command_sock,
+        if (!recvResponse(client,
                           RemoteCommandInstruction::INSTRUCTION_DIRECTORY_EXISTS,
                           payload))
             return false;
@@ -387,13 +768,13 @@ namespace Bn3Monkey
         if (!client) return result;
 
         const char* p = path ? path : ".";
-        if (!sendRequest(client->command_sock,
+        if (!sendRequest(client,
                          RemoteCommandInstruction::INSTRUCTION_LIST_DIRECTORY_CONTENTS,
                          p))
             return result;
 
         std::vector<char> payload;
-        if (!recvResponse(client->command_sock,
+        if (!recvResponse(client,
                           RemoteCommandInstruction::INSTRUCTION_LIST_DIRECTORY_CONTENTS,
                           payload))
             return result;
@@ -428,13 +809,13 @@ namespace Bn3Monkey
     {
         if (!client || !path) return false;
 
-        if (!sendRequest(client->command_sock,
+        if (!sendRequest(client,
                          RemoteCommandInstruction::INSTRUCTION_CREATE_DIRECTORY,
                          path))
             return false;
 
         std::vector<char> payload;
-        if (!recvResponse(client->command_sock,
+        if (!recvResponse(client,
                           RemoteCommandInstruction::INSTRUCTION_CREATE_DIRECTORY,
                           payload))
             return false;
@@ -449,13 +830,13 @@ namespace Bn3Monkey
     {
         if (!client || !path) return false;
 
-        if (!sendRequest(client->command_sock,
+        if (!sendRequest(client,
                          RemoteCommandInstruction::INSTRUCTION_REMOVE_DIRECTORY,
                          path))
             return false;
 
         std::vector<char> payload;
-        if (!recvResponse(client->command_sock,
+        if (!recvResponse(client,
                           RemoteCommandInstruction::INSTRUCTION_REMOVE_DIRECTORY,
                           payload))
             return false;
@@ -471,13 +852,13 @@ namespace Bn3Monkey
     {
         if (!client || !from_path || !to_path) return false;
 
-        if (!sendRequest(client->command_sock,
+        if (!sendRequest(client,
                          RemoteCommandInstruction::INSTRUCTION_COPY_DIRECTORY,
                          from_path, to_path))
             return false;
 
         std::vector<char> payload;
-        if (!recvResponse(client->command_sock,
+        if (!recvResponse(client,
                           RemoteCommandInstruction::INSTRUCTION_COPY_DIRECTORY,
                           payload))
             return false;
@@ -493,13 +874,13 @@ namespace Bn3Monkey
     {
         if (!client || !from_path || !to_path) return false;
 
-        if (!sendRequest(client->command_sock,
+        if (!sendRequest(client,
                          RemoteCommandInstruction::INSTRUCTION_MOVE_DIRECTORY,
                          from_path, to_path))
             return false;
 
         std::vector<char> payload;
-        if (!recvResponse(client->command_sock,
+        if (!recvResponse(client,
                           RemoteCommandInstruction::INSTRUCTION_MOVE_DIRECTORY,
                           payload))
             return false;
@@ -517,34 +898,37 @@ namespace Bn3Monkey
     {
         if (!client || !cmd) return -1;
 
-        if (!sendRequest(client->command_sock,
+        if (!sendRequest(client,
                          RemoteCommandInstruction::INSTRUCTION_OPEN_PROCESS,
                          cmd))
             return -1;
 
         std::vector<char> payload;
-        if (!recvResponse(client->command_sock,
+        if (!recvResponse(client,
                           RemoteCommandInstruction::INSTRUCTION_OPEN_PROCESS,
                           payload))
             return -1;
 
-        int32_t proc_id = -1;
-        if (payload.size() >= sizeof(int32_t))
-            memcpy(&proc_id, payload.data(), sizeof(int32_t));
-        return proc_id;
+        RemoteCommandJobReplyInner reply;
+        if (payload.size() >= sizeof(reply.value))
+            memcpy(&reply.value, payload.data(), sizeof(reply.value));
+        if (payload.size() >= sizeof(reply))
+            memcpy(&reply, payload.data(), sizeof(reply));
+        client->last_queued_ms = reply.queued_ms;
+        return reply.value;
     }
 
     void closeProcess(RemoteCommandClient* client, int32_t process_id)
     {
         if (!client) return;
 
-        if (!sendRequest(client->command_sock,
+        if (!sendRequest(client,
                          RemoteCommandInstruction::INSTRUCTION_CLOSE_PROCESS,
                          &process_id, static_cast<uint32_t>(sizeof(process_id))))
             return;
 
         std::vector<char> payload;
-        recvResponse(client->command_sock,
+        recvResponse(client,
                      RemoteCommandInstruction::INSTRUCTION_CLOSE_PROCESS,
                      payload);
         // void return — just wait for the server's acknowledgement
@@ -564,7 +948,7 @@ namespace Bn3Monkey
         std::vector<char> data((std::istreambuf_iterator<char>(f)),
                                 std::istreambuf_iterator<char>());
 
-        if (!sendRequest(client->command_sock,
+        if (!sendRequest(client,
                          RemoteCommandInstruction::INSTRUCTION_UPLOAD_FILE,
                          remote_file,
                          data.empty() ? nullptr : data.data(),
@@ -572,7 +956,7 @@ namespace Bn3Monkey
             return false;
 
         std::vector<char> payload;
-        if (!recvResponse(client->command_sock,
+        if (!recvResponse(client,
                           RemoteCommandInstruction::INSTRUCTION_UPLOAD_FILE,
                           payload))
             return false;
@@ -588,13 +972,13 @@ namespace Bn3Monkey
     {
         if (!client || !local_file || !remote_file) return false;
 
-        if (!sendRequest(client->command_sock,
+        if (!sendRequest(client,
                          RemoteCommandInstruction::INSTRUCTION_DOWNLOAD_FILE,
                          remote_file))
             return false;
 
         std::vector<char> payload;
-        if (!recvResponse(client->command_sock,
+        if (!recvResponse(client,
                           RemoteCommandInstruction::INSTRUCTION_DOWNLOAD_FILE,
                           payload))
             return false;
@@ -611,26 +995,738 @@ namespace Bn3Monkey
         return true;
     }
 
+    // -------------------------------------------------------------------------
+    // Asynchronous filesystem operations
+    //  - The id is registered before the request is sent, so a completion
+    //    that overtakes the response on the stream socket is never lost
+    // -------------------------------------------------------------------------
+    static int32_t submitOperation(RemoteCommandClient* client,
+                                   RemoteCommandInstruction instruction,
+                                   const void* p0, uint32_t p0_len,
+                                   const void* p1, uint32_t p1_len,
+                                   const char* local_file = nullptr)
+    {
+        RemoteCommandOperationInner inner;
+        inner.instruction = instruction;
+        {
+            std::lock_guard<std::mutex> lk(client->operation_mtx);
+            int32_t id = client->next_operation_id++;
+            if (client->next_operation_id <= 0) client->next_operation_id = 1;
+            PendingOperation& op = client->operations[id];
+            op.instruction = instruction;
+            if (local_file) op.local_file = local_file;
+            inner.operation_id = static_cast<uint32_t>(id);
+        }
+
+        RemoteCommandRequestHeader header(RemoteCommandInstruction::INSTRUCTION_SUBMIT_OPERATION,
+                                          sizeof(inner), p0_len, p1_len);
+        std::vector<char> payload;
+        bool accepted = false;
+        if (sendHeader(client, header) &&
+            sendPayload(client, &inner, sizeof(inner)) &&
+            (p0_len == 0 || sendPayload(client, p0, p0_len)) &&
+            (p1_len == 0 || sendPayload(client, p1, p1_len)) &&
+            recvResponse(client,
+                         RemoteCommandInstruction::INSTRUCTION_SUBMIT_OPERATION, payload) &&
+            payload.size() >= sizeof(bool))
+            memcpy(&accepted, payload.data(), sizeof(bool));
+
+        int32_t id = static_cast<int32_t>(inner.operation_id);
+        if (!accepted) {
+            std::lock_guard<std::mutex> lk(client->operation_mtx);
+            client->operations.erase(id);
+            return -1;
+        }
+        return id;
+    }
+
+    int32_t copyDirectoryAsync(RemoteCommandClient* client,
+                               const char* from_path, const char* to_path)
+    {
+        if (!client || !from_path || !to_path) return -1;
+        return submitOperation(client, RemoteCommandInstruction::INSTRUCTION_COPY_DIRECTORY,
+                               from_path, static_cast<uint32_t>(strlen(from_path)),
+                               to_path,   static_cast<uint32_t>(strlen(to_path)));
+    }
+
+    int32_t removeDirectoryAsync(RemoteCommandClient* client, const char* path)
+    {
+        if (!client || !path) return -1;
+        return submitOperation(client, RemoteCommandInstruction::INSTRUCTION_REMOVE_DIRECTORY,
+                               path, static_cast<uint32_t>(strlen(path)), nullptr, 0);
+    }
+
+    int32_t uploadFileAsync(RemoteCommandClient* client,
+                            const char* local_file, const char* remote_file)
+    {
+        if (!client || !local_file || !remote_file) return -1;
+
+        std::ifstream f(local_file, std::ios::binary);
+        if (!f.is_open()) return -1;
+
+        std::vector<char> data((std::istreambuf_iterator<char>(f)),
+                                std::istreambuf_iterator<char>());
+
+        return submitOperation(client, RemoteCommandInstruction::INSTRUCTION_UPLOAD_FILE,
+                               remote_file, static_cast<uint32_t>(strlen(remote_file)),
+                               data.empty() ? nullptr : data.data(),
+                               static_cast<uint32_t>(data.size()));
+    }
+
+    int32_t downloadFileAsync(RemoteCommandClient* client,
+                              const char* local_file, const char* remote_file)
+    {
+        if (!client || !local_file || !remote_file) return -1;
+        return submitOperation(client, RemoteCommandInstruction::INSTRUCTION_DOWNLOAD_FILE,
+                               remote_file, static_cast<uint32_t>(strlen(remote_file)),
+                               nullptr, 0, local_file);
+    }
+
+    bool awaitOperation(RemoteCommandClient* client, int32_t operation_id)
+    {
+        if (!client) return false;
+
+        std::unique_lock<std::mutex> lk(client->operation_mtx);
+        auto it = client->operations.find(operation_id);
+        if (it == client->operations.end()) return false;
+
+        PendingOperation& op = it->second;
+        ++op.waiters;
+        client->operation_cv.wait(lk, [&op]() { return op.done; });
+        bool result = op.result;
+        if (--op.waiters == 0)
+            client->operations.erase(it);
+        return result;
+    }
+
+    void onRemoteOperationComplete(RemoteCommandClient* client, OnRemoteOperationComplete handler)
+    {
+        if (!client) return;
+        std::lock_guard<std::mutex> lk(client->operation_mtx);
+        client->on_operation_complete = handler;
+    }
+
+    void onRemoteProgress(RemoteCommandClient* client, OnRemoteProgress handler)
+    {
+        if (!client) return;
+        client->on_progress = handler;
+    }
+
+    // -------------------------------------------------------------------------
+    // Resource sampling
+    // -------------------------------------------------------------------------
+    void onRemoteResources(RemoteCommandClient* client, OnRemoteResources on_resources)
+    {
+        if (!client) return;
+        client->on_resources = on_resources;
+    }
+
+    bool watchResources(RemoteCommandClient* client, uint32_t interval_ms)
+    {
+        if (!client) return false;
+        if (!sendRequest(client, RemoteCommandInstruction::INSTRUCTION_WATCH_RESOURCES,
+                         &interval_ms, static_cast<uint32_t>(sizeof(interval_ms))))
+            return false;
+
+        std::vector<char> payload;
+        if (!recvResponse(client, RemoteCommandInstruction::INSTRUCTION_WATCH_RESOURCES, payload))
+            return false;
+        bool result = false;
+        if (payload.size() >= sizeof(bool))
+            memcpy(&result, payload.data(), sizeof(bool));
+        return result;
+    }
+
+    bool listProcesses(RemoteCommandClient* client, std::vector<RemoteProcessResources>& groups)
+    {
+        groups.clear();
+        if (!client) return false;
+        if (!sendRequest(client, RemoteCommandInstruction::INSTRUCTION_LIST_PROCESSES))
+            return false;
+
+        std::vector<char> payload;
+        if (!recvResponse(client, RemoteCommandInstruction::INSTRUCTION_LIST_PROCESSES, payload))
+            return false;
+        decodeResources(payload.data(), payload.size(), groups);
+        return true;
+    }
+
+    // -------------------------------------------------------------------------
+    // Server metrics
+    // -------------------------------------------------------------------------
+    static RemoteLatency toLatency(const RemoteCommandLatencyInner& inner)
+    {
+        RemoteLatency latency;
+        latency.count    = inner.count;
+        latency.total_us = inner.sum_us;
+        latency.p50_us   = inner.p50_us;
+        latency.p90_us   = inner.p90_us;
+        latency.p99_us   = inner.p99_us;
+        latency.max_us   = inner.max_us;
+        return latency;
+    }
+
+    bool getServerStats(RemoteCommandClient* client, RemoteServerStats& stats)
+    {
+        stats = RemoteServerStats();
+        if (!client) return false;
+        if (!sendRequest(client, RemoteCommandInstruction::INSTRUCTION_GET_STATS))
+            return false;
+
+        std::vector<char> payload;
+        if (!recvResponse(client, RemoteCommandInstruction::INSTRUCTION_GET_STATS, payload))
+            return false;
+        RemoteCommandStatsInner inner;
+        if (payload.size() < sizeof(inner)) return false;
+        memcpy(&inner, payload.data(), sizeof(inner));
+        if (payload.size() < sizeof(inner) + inner.instruction_count * sizeof(RemoteCommandInstructionStatsInner))
+            return false;
+
+        stats.uptime_ms              = inner.uptime_ms;
+        stats.command_bytes_received = inner.command_bytes_received;
+        stats.command_bytes_sent     = inner.command_bytes_sent;
+        stats.stream_bytes_sent      = inner.stream_bytes_sent;
+        stats.sessions_accepted      = inner.sessions_accepted;
+        stats.sessions_active        = inner.sessions_active;
+        stats.jobs_running           = inner.jobs_running;
+        stats.jobs_waiting           = inner.jobs_waiting;
+        stats.operations_queued      = inner.operations_queued;
+        stats.spawn                  = toLatency(inner.spawn);
+        stats.job_queue              = toLatency(inner.job_queue);
+
+        const char* entries = payload.data() + sizeof(inner);
+        const char* locks   = entries + inner.instruction_count * sizeof(RemoteCommandInstructionStatsInner);
+        if (payload.size() < static_cast<size_t>(locks - payload.data()) + inner.lock_count * sizeof(RemoteCommandLockStatsInner))
+            return false;
+        for (uint32_t i = 0; i < inner.instruction_count; ++i) {
+            RemoteCommandInstructionStatsInner entry;
+            memcpy(&entry, entries + i * sizeof(entry), sizeof(entry));
+            RemoteInstructionStats instruction;
+            instruction.instruction = static_cast<int32_t>(entry.instruction);
+            instruction.receive     = toLatency(entry.receive);
+            instruction.execute     = toLatency(entry.execute);
+            instruction.send        = toLatency(entry.send);
+            stats.instructions.push_back(instruction);
+        }
+        for (uint32_t i = 0; i < inner.lock_count; ++i) {
+            RemoteCommandLockStatsInner entry;
+            memcpy(&entry, locks + i * sizeof(entry), sizeof(entry));
+            RemoteLockStats lock;
+            lock.name         = std::string(entry.name, strnlen(entry.name, sizeof(entry.name)));
+            lock.acquisitions = entry.acquisitions;
+            lock.contended    = entry.contended;
+            lock.wait         = toLatency(entry.wait);
+            lock.hold         = toLatency(entry.hold);
+            stats.locks.push_back(lock);
+        }
+        return true;
+    }
+
+    static bool traceRequest(RemoteCommandClient* client, RemoteCommandTraceAction action, std::string* json)
+    {
+        if (!client) return false;
+        int32_t value = static_cast<int32_t>(action);
+        if (!sendRequest(client, RemoteCommandInstruction::INSTRUCTION_TRACE,
+                         &value, static_cast<uint32_t>(sizeof(value))))
+            return false;
+
+        std::vector<char> payload;
+        if (!recvResponse(client, RemoteCommandInstruction::INSTRUCTION_TRACE, payload))
+            return false;
+        bool ok = false;
+        if (payload.size() >= sizeof(ok))
+            memcpy(&ok, payload.data(), sizeof(ok));
+        if (ok && json)
+            json->assign(payload.begin() + sizeof(ok), payload.end());
+        return ok;
+    }
+
+    bool startServerTrace(RemoteCommandClient* client)
+    {
+        return traceRequest(client, RemoteCommandTraceAction::TRACE_START, nullptr);
+    }
+
+    bool stopServerTrace(RemoteCommandClient* client)
+    {
+        return traceRequest(client, RemoteCommandTraceAction::TRACE_STOP, nullptr);
+    }
+
+    bool fetchServerTrace(RemoteCommandClient* client, std::string& json)
+    {
+        json.clear();
+        return traceRequest(client, RemoteCommandTraceAction::TRACE_FETCH, &json);
+    }
+
+    // -------------------------------------------------------------------------
+    // Client-side call statistics
+    // -------------------------------------------------------------------------
+    bool getClientStats(RemoteCommandClient* client, RemoteClientStats& stats)
+    {
+        stats = RemoteClientStats();
+        if (!client) return false;
+
+        stats.stream_bytes_received = client->stream_bytes_received.load(std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lk(client->stats_mtx);
+        for (const auto& entry : client->call_stats) {
+            RemoteCallStats call;
+            call.instruction    = entry.first;
+            call.name           = instructionName(static_cast<RemoteCommandInstruction>(entry.first));
+            call.failures       = entry.second.failures;
+            call.bytes_sent     = entry.second.bytes_sent;
+            call.bytes_received = entry.second.bytes_received;
+            call.send           = toLatency(entry.second.send.summary());
+            call.wait           = toLatency(entry.second.wait.summary());
+            call.receive        = toLatency(entry.second.receive.summary());
+            call.total          = toLatency(entry.second.total.summary());
+            stats.calls.push_back(call);
+        }
+        return true;
+    }
+
+    void resetClientStats(RemoteCommandClient* client)
+    {
+        if (!client) return;
+        std::lock_guard<std::mutex> lk(client->stats_mtx);
+        client->call_stats.clear();
+        client->stream_bytes_received.store(0, std::memory_order_relaxed);
+    }
+
+    void setRemoteCallHooks(RemoteCommandClient* client, OnRemoteCallBegin begin, OnRemoteCallEnd end,
+                            void* context)
+    {
+        if (!client) return;
+        client->on_call_begin = begin;
+        client->on_call_end   = end;
+        client->call_context  = context;
+    }
+
+    // -------------------------------------------------------------------------
+    // Custom instructions
+    // -------------------------------------------------------------------------
+    bool invokeRemoteInstruction(RemoteCommandClient* client, int32_t instruction,
+                                 const std::vector<std::string>& payloads, std::vector<char>& reply)
+    {
+        reply.clear();
+        if (!client || payloads.size() > 4 ||
+            instruction <  REMOTE_COMMAND_USER_INSTRUCTION_BASE ||
+            instruction >= REMOTE_COMMAND_USER_INSTRUCTION_BASE + REMOTE_COMMAND_USER_INSTRUCTION_COUNT)
+            return false;
+
+        uint32_t lengths[4] { 0, 0, 0, 0 };
+        for (size_t i = 0; i < payloads.size(); ++i)
+            lengths[i] = static_cast<uint32_t>(payloads[i].size());
+
+        RemoteCommandInstruction code = static_cast<RemoteCommandInstruction>(instruction);
+        RemoteCommandRequestHeader header(code, lengths[0], lengths[1], lengths[2], lengths[3]);
+        if (!sendHeader(client, header)) return false;
+        for (size_t i = 0; i < payloads.size(); ++i) {
+            if (lengths[i] > 0 && !sendPayload(client, payloads[i].data(), lengths[i]))
+                return false;
+        }
+
+        std::vector<char> payload;
+        if (!recvResponse(client, code, payload)) return false;
+        if (payload.size() < sizeof(bool)) return false;
+
+        bool result = false;
+        memcpy(&result, payload.data(), sizeof(bool));
+        reply.assign(payload.begin() + sizeof(bool), payload.end());
+        return result;
+    }
+
     // -------------------------------------------------------------------------
     // Command execution
     //  - Sends request on command_sock
     //  - Blocks until empty response (server finished streaming)
     //  - Stream callbacks fire from the stream thread during execution
     // -------------------------------------------------------------------------
-    void runCommandImpl(RemoteCommandClient* client, const char* cmd)
+    int32_t runCommandImpl(RemoteCommandClient* client, const char* cmd)
     {
-        if (!client || !cmd) return;
+        if (!client || !cmd) return -1;
 
-        if (!sendRequest(client->command_sock,
-                         RemoteCommandInstruction::INSTRUCTION_RUN_COMMAND,
-                         cmd))
-            return;
+        client->has_timing = false;
+        const auto start = std::chrono::steady_clock::now();
+        const uint32_t flags = RUN_COMMAND_TIMING;
+        bool sent = client->run_timing
+            ? sendRequest(client, RemoteCommandInstruction::INSTRUCTION_RUN_COMMAND,
+                          cmd, &flags, static_cast<uint32_t>(sizeof(flags)))
+            : sendRequest(client, RemoteCommandInstruction::INSTRUCTION_RUN_COMMAND,
+                          cmd);
+        if (!sent)
+            return -1;
 
         std::vector<char> payload;
-        recvResponse(client->command_sock,
-                     RemoteCommandInstruction::INSTRUCTION_RUN_COMMAND,
-                     payload);
-        // payload is empty for RUN_COMMAND — just waiting for completion signal
+        if (!recvResponse(client,
+                          RemoteCommandInstruction::INSTRUCTION_RUN_COMMAND,
+                          payload))
+            return -1;
+
+        // The response doubles as the completion signal; older servers
+        // send it without the exit code, or without the queue time.
+        RemoteCommandJobReplyInner reply;
+        if (payload.size() >= sizeof(reply.value))
+            memcpy(&reply.value, payload.data(), sizeof(reply.value));
+        if (payload.size() >= sizeof(reply))
+            memcpy(&reply, payload.data(), sizeof(reply));
+        client->last_queued_ms = reply.queued_ms;
+
+        RemoteCommandRunTimingInner timing;
+        if (client->run_timing && payload.size() >= sizeof(reply) + sizeof(timing)) {
+            memcpy(&timing, payload.data() + sizeof(reply), sizeof(timing));
+            RemoteRunTiming& last = client->last_timing;
+            last.received_us     = timing.received_us;
+            last.scheduled_us    = timing.scheduled_us;
+            last.spawned_us      = timing.spawned_us;
+            last.first_output_us = timing.first_output_us;
+            last.exited_us       = timing.exited_us;
+            last.drained_us      = timing.drained_us;
+            last.replied_us      = timing.replied_us;
+            last.round_trip_us   = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            client->has_timing = true;
+        }
+        return reply.value;
+    }
+
+    uint32_t lastQueueTime(RemoteCommandClient* client)
+    {
+        return client ? client->last_queued_ms : 0;
+    }
+
+    void enableRunTiming(RemoteCommandClient* client, bool enable)
+    {
+        if (client) client->run_timing = enable;
+    }
+
+    bool lastRunTiming(RemoteCommandClient* client, RemoteRunTiming& timing)
+    {
+        if (!client || !client->has_timing) return false;
+        timing = client->last_timing;
+        return true;
+    }
+
+    bool setJobPriority(RemoteCommandClient* client, RemoteJobPriority priority)
+    {
+        if (!client) return false;
+
+        int32_t value = static_cast<int32_t>(priority);
+        if (!sendRequest(client, RemoteCommandInstruction::INSTRUCTION_SET_JOB_PRIORITY,
+                         &value, static_cast<uint32_t>(sizeof(value))))
+            return false;
+
+        std::vector<char> payload;
+        if (!recvResponse(client, RemoteCommandInstruction::INSTRUCTION_SET_JOB_PRIORITY, payload))
+            return false;
+        bool result = false;
+        if (payload.size() >= sizeof(bool))
+            memcpy(&result, payload.data(), sizeof(bool));
+        return result;
+    }
+
+    // -------------------------------------------------------------------------
+    // Cached commands
+    //  - The server decides between a hit and a run
+    //  - Output is replayed on the stream socket before the response
+    // -------------------------------------------------------------------------
+    int32_t runCachedCommand(RemoteCommandClient* client, const RemoteCachedCommand& command, bool* hit)
+    {
+        if (hit) *hit = false;
+        if (!client) return -1;
+
+        std::string lists[3];
+        const std::vector<std::string>* entries[3] { &command.environment, &command.inputs, &command.outputs };
+        for (size_t i = 0; i < 3; ++i) {
+            for (size_t j = 0; j < entries[i]->size(); ++j) {
+                lists[i] += (*entries[i])[j];
+                lists[i].push_back('\0');
+            }
+        }
+
+        RemoteCommandRequestHeader header(RemoteCommandInstruction::INSTRUCTION_RUN_CACHED,
+                                          static_cast<uint32_t>(command.command.size()),
+                                          static_cast<uint32_t>(lists[0].size()),
+                                          static_cast<uint32_t>(lists[1].size()),
+                                          static_cast<uint32_t>(lists[2].size()));
+        if (!sendHeader(client, header)) return -1;
+        if (!command.command.empty() &&
+            !sendPayload(client, command.command.data(), command.command.size()))
+            return -1;
+        for (size_t i = 0; i < 3; ++i) {
+            if (!lists[i].empty() && !sendPayload(client, lists[i].data(), lists[i].size()))
+                return -1;
+        }
+
+        std::vector<char> payload;
+        if (!recvResponse(client, RemoteCommandInstruction::INSTRUCTION_RUN_CACHED, payload))
+            return -1;
+        RemoteCommandCachedReplyInner reply;
+        if (payload.size() != sizeof(reply)) return -1;
+        memcpy(&reply, payload.data(), sizeof(reply));
+        if (hit) *hit = reply.hit != 0;
+        return reply.exit_code;
+    }
+
+    // -------------------------------------------------------------------------
+    // Launch options
+    //  - Stored per session on the server, applied at every later spawn
+    // -------------------------------------------------------------------------
+    bool setLaunchOptions(RemoteCommandClient* client, const RemoteLaunchOptions& options)
+    {
+        if (!client) return false;
+
+        RemoteCommandLaunchInner inner;
+        inner.nice     = options.nice;
+        inner.io_class = static_cast<int32_t>(options.io_class);
+        inner.io_level = options.io_class == RemoteIoClass::DEFAULT ? 0 : options.io_level;
+
+        std::vector<uint32_t> cpus;
+        for (size_t i = 0; i < options.cpus.size(); ++i) {
+            if (options.cpus[i] < 0) return false;
+            cpus.push_back(static_cast<uint32_t>(options.cpus[i]));
+        }
+
+        std::string limits;
+        if (!options.cpu_max.empty())
+            limits += "cpu.max=" + options.cpu_max + '\0';
+        if (!options.memory_max.empty())
+            limits += "memory.max=" + options.memory_max + '\0';
+
+        const uint32_t cpus_len = static_cast<uint32_t>(cpus.size() * sizeof(uint32_t));
+        RemoteCommandRequestHeader header(RemoteCommandInstruction::INSTRUCTION_SET_LAUNCH_OPTIONS,
+                                          static_cast<uint32_t>(sizeof(inner)), cpus_len,
+                                          static_cast<uint32_t>(limits.size()), 0);
+        if (!sendHeader(client, header)) return false;
+        if (!sendPayload(client, &inner, sizeof(inner))) return false;
+        if (cpus_len > 0 && !sendPayload(client, cpus.data(), cpus_len)) return false;
+        if (!limits.empty() && !sendPayload(client, limits.data(), limits.size())) return false;
+
+        std::vector<char> payload;
+        if (!recvResponse(client, RemoteCommandInstruction::INSTRUCTION_SET_LAUNCH_OPTIONS, payload))
+            return false;
+        bool result = false;
+        if (payload.size() >= sizeof(bool))
+            memcpy(&result, payload.data(), sizeof(bool));
+        return result;
+    }
+
+    // -------------------------------------------------------------------------
+    // Command graphs
+    //  - One request carries every node; the server schedules them
+    //  - Node output arrives tagged on the stream socket meanwhile
+    // -------------------------------------------------------------------------
+    static RemoteNodeState toNodeState(RemoteCommandNodeStateInner state)
+    {
+        switch (state) {
+        case RemoteCommandNodeStateInner::SUCCEEDED: return RemoteNodeState::SUCCEEDED;
+        case RemoteCommandNodeStateInner::FAILED:    return RemoteNodeState::FAILED;
+        default:                                     return RemoteNodeState::SKIPPED;
+        }
+    }
+
+    bool runCommandGraph(RemoteCommandClient* client, const std::vector<RemoteCommandNode>& nodes,
+                         int32_t max_parallel, std::vector<RemoteNodeResult>& results)
+    {
+        results.clear();
+        if (!client) return false;
+
+        RemoteCommandGraphInner graph;
+        graph.node_count   = static_cast<uint32_t>(nodes.size());
+        graph.max_parallel = max_parallel;
+
+        std::vector<RemoteCommandNodeInner> inners(nodes.size());
+        std::string strings;
+        std::vector<uint32_t> dependencies;
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            const RemoteCommandNode& node = nodes[i];
+            inners[i].command_length = static_cast<uint32_t>(node.command.size());
+            inners[i].cwd_length     = static_cast<uint32_t>(node.cwd.size());
+            strings += node.command;
+            strings += node.cwd;
+
+            size_t environment_start = strings.size();
+            for (size_t j = 0; j < node.environment.size(); ++j) {
+                strings += node.environment[j];
+                strings.push_back('\0');
+            }
+            inners[i].environment_length = static_cast<uint32_t>(strings.size() - environment_start);
+
+            inners[i].dependency_count = static_cast<uint32_t>(node.dependencies.size());
+            for (size_t j = 0; j < node.dependencies.size(); ++j)
+                dependencies.push_back(static_cast<uint32_t>(node.dependencies[j]));
+        }
+
+        uint32_t lengths[4] {
+            static_cast<uint32_t>(sizeof(graph)),
+            static_cast<uint32_t>(inners.size() * sizeof(RemoteCommandNodeInner)),
+            static_cast<uint32_t>(strings.size()),
+            static_cast<uint32_t>(dependencies.size() * sizeof(uint32_t)),
+        };
+        const void* payloads[4] { &graph, inners.data(), strings.data(), dependencies.data() };
+
+        RemoteCommandRequestHeader header(RemoteCommandInstruction::INSTRUCTION_RUN_GRAPH,
+                                          lengths[0], lengths[1], lengths[2], lengths[3]);
+        if (!sendHeader(client, header)) return false;
+        for (size_t i = 0; i < 4; ++i) {
+            if (lengths[i] > 0 && !sendPayload(client, payloads[i], lengths[i]))
+                return false;
+        }
+
+        std::vector<char> payload;
+        if (!recvResponse(client, RemoteCommandInstruction::INSTRUCTION_RUN_GRAPH, payload))
+            return false;
+        // An empty reply to a non-empty graph means it was rejected
+        if (payload.size() != nodes.size() * sizeof(RemoteCommandNodeResultInner))
+            return false;
+
+        bool all_succeeded = true;
+        results.resize(nodes.size());
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            RemoteCommandNodeResultInner inner;
+            memcpy(&inner, payload.data() + i * sizeof(inner), sizeof(inner));
+            results[i].state      = toNodeState(inner.state);
+            results[i].exit_code  = inner.exit_code;
+            results[i].elapsed_ms = inner.elapsed_ms;
+            all_succeeded = all_succeeded && results[i].state == RemoteNodeState::SUCCEEDED;
+        }
+        return all_succeeded;
+    }
+
+    void onRemoteNodeOutput(RemoteCommandClient* client, OnRemoteNodeOutput handler)
+    {
+        if (client) client->on_node_output = handler;
+    }
+
+    // -------------------------------------------------------------------------
+    // Scripts
+    //  - The commands run in order on the server, in one request
+    //  - Output arrives tagged like graph node output
+    // -------------------------------------------------------------------------
+    bool runCommandScript(RemoteCommandClient* client, const std::vector<std::string>& commands,
+                          const RemoteScriptOptions& options, std::vector<RemoteNodeResult>& results)
+    {
+        results.clear();
+        if (!client) return false;
+
+        RemoteCommandScriptInner script;
+        if (options.stop_on_error) script.flags |= SCRIPT_STOP_ON_ERROR;
+        if (options.shared_shell)  script.flags |= SCRIPT_SHARED_SHELL;
+
+        std::string list;
+        for (size_t i = 0; i < commands.size(); ++i) {
+            list += commands[i];
+            list.push_back('\0');
+        }
+
+        RemoteCommandRequestHeader header(RemoteCommandInstruction::INSTRUCTION_RUN_SCRIPT,
+                                          sizeof(script), static_cast<uint32_t>(list.size()));
+        if (!sendHeader(client, header))   return false;
+        if (!sendPayload(client, &script, sizeof(script)))   return false;
+        if (!list.empty() && !sendPayload(client, list.data(), list.size())) return false;
+
+        std::vector<char> payload;
+        if (!recvResponse(client, RemoteCommandInstruction::INSTRUCTION_RUN_SCRIPT, payload))
+            return false;
+        if (payload.size() != commands.size() * sizeof(RemoteCommandNodeResultInner))
+            return false;
+
+        bool all_succeeded = true;
+        results.resize(commands.size());
+        for (size_t i = 0; i < commands.size(); ++i) {
+            RemoteCommandNodeResultInner inner;
+            memcpy(&inner, payload.data() + i * sizeof(inner), sizeof(inner));
+            results[i].state      = toNodeState(inner.state);
+            results[i].exit_code  = inner.exit_code;
+            results[i].elapsed_ms = inner.elapsed_ms;
+            all_succeeded = all_succeeded && results[i].state == RemoteNodeState::SUCCEEDED;
+        }
+        return all_succeeded;
+    }
+
+    // -------------------------------------------------------------------------
+    // Parallel map over files
+    //  - The server expands globs, batches and runs the invocations
+    //  - Output comes back in the response, one block per invocation
+    // -------------------------------------------------------------------------
+    bool mapFiles(RemoteCommandClient* client, const char* command_template,
+                  const std::vector<std::string>& inputs, int32_t max_parallel, int32_t batch_size,
+                  std::vector<RemoteMapItem>& items, std::vector<RemoteMapInvocation>& invocations)
+    {
+        items.clear();
+        invocations.clear();
+        if (!client || !command_template) return false;
+
+        RemoteCommandMapInner map;
+        map.max_parallel = max_parallel;
+        map.batch_size   = batch_size;
+
+        std::string list;
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            list += inputs[i];
+            list.push_back('\0');
+        }
+
+        uint32_t template_length = static_cast<uint32_t>(strlen(command_template));
+        RemoteCommandRequestHeader header(RemoteCommandInstruction::INSTRUCTION_MAP_FILES,
+                                          sizeof(map), template_length, static_cast<uint32_t>(list.size()));
+        if (!sendHeader(client, header))   return false;
+        if (!sendPayload(client, &map, sizeof(map)))         return false;
+        if (!sendPayload(client, command_template, template_length)) return false;
+        if (!list.empty() && !sendPayload(client, list.data(), list.size())) return false;
+
+        std::vector<char> payload;
+        if (!recvResponse(client, RemoteCommandInstruction::INSTRUCTION_MAP_FILES, payload))
+            return false;
+
+        // Walks the reply; any inconsistency discards all of it
+        RemoteCommandMapReplyInner reply;
+        if (payload.size() < sizeof(reply)) return false;
+        memcpy(&reply, payload.data(), sizeof(reply));
+        size_t offset = sizeof(reply);
+
+        uint64_t fixed = static_cast<uint64_t>(reply.item_count) * sizeof(RemoteCommandMapItemInner) +
+                         static_cast<uint64_t>(reply.invocation_count) * sizeof(RemoteCommandMapInvocationInner);
+        if (fixed > payload.size() - offset) return false;
+
+        std::vector<RemoteCommandMapItemInner> item_inners(reply.item_count);
+        std::vector<RemoteCommandMapInvocationInner> invocation_inners(reply.invocation_count);
+        if (reply.item_count > 0)
+            memcpy(item_inners.data(), payload.data() + offset, item_inners.size() * sizeof(RemoteCommandMapItemInner));
+        offset += item_inners.size() * sizeof(RemoteCommandMapItemInner);
+        if (reply.invocation_count > 0)
+            memcpy(invocation_inners.data(), payload.data() + offset,
+                   invocation_inners.size() * sizeof(RemoteCommandMapInvocationInner));
+        offset += invocation_inners.size() * sizeof(RemoteCommandMapInvocationInner);
+
+        auto take = [&payload, &offset](uint32_t length, std::string& out) -> bool {
+            if (length > payload.size() - offset) return false;
+            out.assign(payload.data() + offset, length);
+            offset += length;
+            return true;
+        };
+
+        std::vector<RemoteMapItem> parsed_items(item_inners.size());
+        for (size_t i = 0; i < item_inners.size(); ++i) {
+            if (item_inners[i].invocation >= reply.invocation_count) return false;
+            if (!take(item_inners[i].path_length, parsed_items[i].file)) return false;
+            parsed_items[i].invocation = static_cast<int32_t>(item_inners[i].invocation);
+        }
+
+        bool all_succeeded = true;
+        std::vector<RemoteMapInvocation> parsed_invocations(invocation_inners.size());
+        for (size_t i = 0; i < invocation_inners.size(); ++i) {
+            const RemoteCommandMapInvocationInner& inner = invocation_inners[i];
+            RemoteMapInvocation& invocation = parsed_invocations[i];
+            invocation.state      = toNodeState(inner.result.state);
+            invocation.exit_code  = inner.result.exit_code;
+            invocation.elapsed_ms = inner.result.elapsed_ms;
+            if (!take(inner.output_length, invocation.output)) return false;
+            if (!take(inner.error_length, invocation.error))   return false;
+            all_succeeded = all_succeeded && invocation.state == RemoteNodeState::SUCCEEDED;
+        }
+
+        items.swap(parsed_items);
+        invocations.swap(parsed_invocations);
+        return all_succeeded;
     }
 
 } // namespace Bn3Monkey
@@ -0,0 +1,111 @@
+#if !defined(__BN3MONKEY_REMOTE_COMMAND_HISTOGRAM__)
+#define __BN3MONKEY_REMOTE_COMMAND_HISTOGRAM__
+
+#include "remote_command_protocol.hpp"
+
+#include <cstdint>
+#include <cmath>
+#include <atomic>
+
+namespace Bn3Monkey
+{
+    // -------------------------------------------------------------------------
+    // LatencyHistogram
+    //
+    // HDR-style histogram of microsecond latencies: 8 linear sub-buckets per
+    // power of two, so any reported quantile is within 1/8 of the recorded
+    // value.  Values beyond ~9.5 hours land in the last bucket.
+    //
+    // Recording uses relaxed atomics and never takes a lock; a summary reads
+    // the buckets one by one and may be a few events apart between fields.
+    // Header-only and C++11 so that the server's metrics and the client's
+    // call statistics bucket the same way.
+    // -------------------------------------------------------------------------
+    class LatencyHistogram
+    {
+    public:
+        void record(uint64_t us) noexcept
+        {
+            _buckets[bucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+            _count.fetch_add(1, std::memory_order_relaxed);
+            _sum.fetch_add(us, std::memory_order_relaxed);
+
+            uint64_t max = _max.load(std::memory_order_relaxed);
+            while (us > max && !_max.compare_exchange_weak(max, us, std::memory_order_relaxed)) {}
+        }
+
+        RemoteCommandLatencyInner summary() const noexcept
+        {
+            RemoteCommandLatencyInner inner;
+            inner.count  = count();
+            inner.sum_us = sum();
+            inner.p50_us = clamp(quantile(0.50, inner.count));
+            inner.p90_us = clamp(quantile(0.90, inner.count));
+            inner.p99_us = clamp(quantile(0.99, inner.count));
+            inner.max_us = clamp(_max.load(std::memory_order_relaxed));
+            return inner;
+        }
+
+        inline uint64_t count() const noexcept { return _count.load(std::memory_order_relaxed); }
+        inline uint64_t sum() const noexcept   { return _sum.load(std::memory_order_relaxed); }
+
+        // Upper bound of the bucket holding the q-th value out of count,
+        // never above the largest value recorded; 0 when empty.
+        uint64_t quantile(double q, uint64_t count) const noexcept
+        {
+            if (count == 0) return 0;
+            uint64_t rank = static_cast<uint64_t>(std::ceil(q * static_cast<double>(count)));
+            if (rank < 1) rank = 1;
+
+            const uint64_t max = _max.load(std::memory_order_relaxed);
+            uint64_t seen = 0;
+            for (uint32_t bucket = 0; bucket < BUCKETS; ++bucket) {
+                seen += _buckets[bucket].load(std::memory_order_relaxed);
+                if (seen >= rank) {
+                    uint64_t bound = bucketUpperBound(bucket);
+                    return bound < max ? bound : max;
+                }
+            }
+            return max;
+        }
+
+    private:
+        static constexpr uint32_t SUB_BUCKET_BITS = 3;
+        static constexpr uint32_t SUB_BUCKETS     = 1u << SUB_BUCKET_BITS;
+        static constexpr uint32_t BUCKETS         = 33 * SUB_BUCKETS;
+
+        static uint32_t clamp(uint64_t us) noexcept
+        {
+            return us > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(us);
+        }
+
+        static uint32_t bucketOf(uint64_t us) noexcept
+        {
+            if (us < SUB_BUCKETS) return static_cast<uint32_t>(us);
+
+            uint32_t exponent = 0;
+            for (uint64_t v = us; v > 1; v >>= 1)
+                ++exponent;
+            uint32_t sub    = static_cast<uint32_t>(us >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+            uint32_t bucket = ((exponent - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS) + sub;
+            return bucket < BUCKETS ? bucket : BUCKETS - 1;
+        }
+
+        static uint64_t bucketUpperBound(uint32_t bucket) noexcept
+        {
+            if (bucket < SUB_BUCKETS) return bucket;
+
+            uint32_t exponent = (bucket >> SUB_BUCKET_BITS) + SUB_BUCKET_BITS - 1;
+            uint64_t sub      = bucket & (SUB_BUCKETS - 1);
+            uint64_t width    = static_cast<uint64_t>(1) << (exponent - SUB_BUCKET_BITS);
+            return ((SUB_BUCKETS + sub) << (exponent - SUB_BUCKET_BITS)) + width - 1;
+        }
+
+        std::atomic<uint64_t> _buckets[BUCKETS] {};
+        std::atomic<uint64_t> _count { 0 };
+        std::atomic<uint64_t> _sum   { 0 };
+        std::atomic<uint64_t> _max   { 0 };
+    };
+}
+
+#endif // __BN3MONKEY_REMOTE_COMMAND_HISTOGRAM__
@@ -23,11 +23,63 @@ namespace Bn3Monkey
         INSTRUCTION_RUN_COMMAND   = 0x10002000,
         INSTRUCTION_OPEN_PROCESS  = 0x10002001,
         INSTRUCTION_CLOSE_PROCESS = 0x10002002,
+        INSTRUCTION_RUN_GRAPH     = 0x10002003,
+        INSTRUCTION_MAP_FILES     = 0x10002004,
+        INSTRUCTION_RUN_SCRIPT    = 0x10002005,
+        INSTRUCTION_RUN_CACHED    = 0x10002006,
+        INSTRUCTION_SET_LAUNCH_OPTIONS = 0x10002007,
+        INSTRUCTION_SET_JOB_PRIORITY   = 0x10002008,
+        INSTRUCTION_WATCH_RESOURCES    = 0x10002009,
+        INSTRUCTION_LIST_PROCESSES     = 0x1000200A,
 
         INSTRUCTION_UPLOAD_FILE   = 0x10003000,
         INSTRUCTION_DOWNLOAD_FILE = 0x10003001,
+
+        INSTRUCTION_SESSION_ID    = 0x10004000,
+        INSTRUCTION_GET_STATS     = 0x10004001,
+        INSTRUCTION_TRACE         = 0x10004002,
+
+        INSTRUCTION_SUBMIT_OPERATION = 0x10005000,
+
+        // 0x20000000 ... 0x20000FFF: embedder-defined instructions served by
+        // handlers registered with registerRemoteInstruction.
+        INSTRUCTION_USER_BASE = 0x20000000,
     };
 
+    // snake_case name of a built-in instruction (metric labels, client call
+    // stats); nullptr for user codes and unknown ones.
+    inline const char* instructionName(RemoteCommandInstruction instruction)
+    {
+        switch (instruction) {
+        case RemoteCommandInstruction::INSTRUCTION_CURRENT_WORKING_DIRECTORY:      return "current_working_directory";
+        case RemoteCommandInstruction::INSTRUCTION_MOVE_CURRENT_WORKING_DIRECTORY: return "move_current_working_directory";
+        case RemoteCommandInstruction::INSTRUCTION_DIRECTORY_EXISTS:               return "directory_exists";
+        case RemoteCommandInstruction::INSTRUCTION_LIST_DIRECTORY_CONTENTS:        return "list_directory_contents";
+        case RemoteCommandInstruction::INSTRUCTION_CREATE_DIRECTORY:               return "create_directory";
+        case RemoteCommandInstruction::INSTRUCTION_REMOVE_DIRECTORY:               return "remove_directory";
+        case RemoteCommandInstruction::INSTRUCTION_COPY_DIRECTORY:                 return "copy_directory";
+        case RemoteCommandInstruction::INSTRUCTION_MOVE_DIRECTORY:                 return "move_directory";
+        case RemoteCommandInstruction::INSTRUCTION_RUN_COMMAND:                    return "run_command";
+        case RemoteCommandInstruction::INSTRUCTION_OPEN_PROCESS:                   return "open_process";
+        case RemoteCommandInstruction::INSTRUCTION_CLOSE_PROCESS:                  return "close_process";
+        case RemoteCommandInstruction::INSTRUCTION_RUN_GRAPH:                      return "run_graph";
+        case RemoteCommandInstruction::INSTRUCTION_MAP_FILES:                      return "map_files";
+        case RemoteCommandInstruction::INSTRUCTION_RUN_SCRIPT:                     return "run_script";
+        case RemoteCommandInstruction::INSTRUCTION_RUN_CACHED:                     return "run_cached";
+        case RemoteCommandInstruction::INSTRUCTION_SET_LAUNCH_OPTIONS:             return "set_launch_options";
+        case RemoteCommandInstruction::INSTRUCTION_SET_JOB_PRIORITY:               return "set_job_priority";
+        case RemoteCommandInstruction::INSTRUCTION_WATCH_RESOURCES:                return "watch_resources";
+        case RemoteCommandInstruction::INSTRUCTION_LIST_PROCESSES:                 return "list_processes";
+        case RemoteCommandInstruction::INSTRUCTION_UPLOAD_FILE:                    return "upload_file";
+        case RemoteCommandInstruction::INSTRUCTION_DOWNLOAD_FILE:                  return "download_file";
+        case RemoteCommandInstruction::INSTRUCTION_SESSION_ID:                     return "session_id";
+        case RemoteCommandInstruction::INSTRUCTION_GET_STATS:                      return "get_stats";
+        case RemoteCommandInstruction::INSTRUCTION_TRACE:                          return "trace";
+        case RemoteCommandInstruction::INSTRUCTION_SUBMIT_OPERATION:               return "submit_operation";
+        default:                                                                   return nullptr;
+        }
+    }
+
     constexpr static const char REMOTE_COMMAND_MAGIC[] {'R', 'M', 'T', '_' };
     
     struct RemoteCommandRequestHeader
@@ -102,10 +154,308 @@ namespace Bn3Monkey
     //      - num_of_directory_contents (4byte)
     //      - directory_contents (num_of_directory_contents * sizeof(RemoteDirectoryContentInner))
     //   else if (header.instruction == INSTRUCTION_RUN_COMMAND)
-    //      - Empty
+    //      - RemoteCommandJobReplyInner (8byte), exit code -1 if the command
+    //        could not be started
+    //      - RemoteCommandRunTimingInner (56byte) if RUN_COMMAND_TIMING was set
+    //   else if (header.instruction == INSTRUCTION_RUN_GRAPH)
+    //      - node_count * RemoteCommandNodeResultInner, nothing if the graph was rejected
+    //   else if (header.instruction == INSTRUCTION_RUN_SCRIPT)
+    //      - command_count * RemoteCommandNodeResultInner, nothing if the script was rejected
+    //   else if (header.instruction == INSTRUCTION_RUN_CACHED)
+    //      - RemoteCommandCachedReplyInner
+    //   else if (header.instruction == INSTRUCTION_MAP_FILES)
+    //      - see INSTRUCTION_MAP_FILES below, nothing if the request was rejected
+    //   else if (header.instruction == INSTRUCTION_SESSION_ID)
+    //      - session_id (4byte)
+    //      - RemoteCommandSessionTokenInner (16byte)
+    //   else if (header.instruction == INSTRUCTION_GET_STATS)
+    //      - RemoteCommandStatsInner (128byte)
+    //      - RemoteCommandInstructionStatsInner (104byte) * instruction_count
+    //      - RemoteCommandLockStatsInner (96byte) * lock_count
+    //   else if (header.instruction == INSTRUCTION_TRACE)
+    //      - accepted (sizeof(bool) byte)
+    //      - Chrome trace JSON (payload_size - sizeof(bool) byte) for TRACE_FETCH
+    //   else if (header.instruction == INSTRUCTION_SUBMIT_OPERATION)
+    //      - accepted (sizeof(bool) byte)
+    //   else if (header.instruction >= INSTRUCTION_USER_BASE)
+    //      - handler result (sizeof(bool) byte), false if none is registered
+    //      - handler reply (payload_size - sizeof(bool) byte)
     //   else
     //      - true, false (sizeof(bool) byte)
 
+    // Random per-session secret returned by INSTRUCTION_SESSION_ID.  The
+    // client presents it in STREAM_ATTACH; session ids are sequential and
+    // would let any connection claim another session's output.
+    struct RemoteCommandSessionTokenInner {
+        uint8_t bytes[16] {0};
+    };
+
+    // INSTRUCTION_SUBMIT_OPERATION runs a slow filesystem instruction
+    // (COPY_DIRECTORY, REMOVE_DIRECTORY, UPLOAD_FILE, DOWNLOAD_FILE) on the
+    // server's worker pool instead of inline:
+    //   request  payload_0 : RemoteCommandOperationInner (id chosen by the client)
+    //            payload_1 : the instruction's own payload_0
+    //            payload_2 : the instruction's own payload_1
+    //   response           : accepted (sizeof(bool) byte)
+    //   completion         : STREAM_OPERATION frame on the stream socket
+    //                        - RemoteCommandOperationInner (8byte)
+    //                        - the instruction's normal response payload
+    //   progress           : STREAM_PROGRESS frames while it runs
+    struct RemoteCommandOperationInner {
+        uint32_t operation_id {0};
+        RemoteCommandInstruction instruction {RemoteCommandInstruction::INSTRUCTION_EMPTY};
+    };
+
+    // INSTRUCTION_GET_STATS reports the server's counters since it started.
+    // Latencies are in microseconds, read from log-linear histograms (within
+    // 1/8 of the true value).
+    struct RemoteCommandLatencyInner {
+        uint64_t count {0};
+        uint64_t sum_us {0};
+        uint32_t p50_us {0};
+        uint32_t p90_us {0};
+        uint32_t p99_us {0};
+        uint32_t max_us {0};
+    };
+
+    struct RemoteCommandStatsInner {
+        uint64_t uptime_ms {0};
+        uint64_t command_bytes_received {0};
+        uint64_t command_bytes_sent {0};
+        uint64_t stream_bytes_sent {0};
+        uint64_t sessions_accepted {0};
+        uint32_t sessions_active {0};
+        uint32_t jobs_running {0};      // holding a job slot (0 without a limit)
+        uint32_t jobs_waiting {0};      // queued for one
+        uint32_t operations_queued {0}; // submitted, not picked up by a worker yet
+        RemoteCommandLatencyInner spawn;        // fork / CreateProcess in the server
+        RemoteCommandLatencyInner job_queue;    // time waiting for a job slot
+        uint32_t instruction_count {0};
+        uint32_t lock_count {0};        // 0 unless built with REMOTE_COMMAND_LOCK_STATS
+    };
+
+    // INSTRUCTION_TRACE controls the server's event trace, which is shared
+    // by every session (and every server in the process):
+    //   request  payload_0 : int32 RemoteCommandTraceAction
+    enum class RemoteCommandTraceAction : int32_t
+    {
+        TRACE_STOP  = 0,    // stop recording; what was recorded stays
+        TRACE_START = 1,    // drop the old events and start recording
+        TRACE_FETCH = 2,    // reply with the events recorded so far
+    };
+
+    // Per instruction code: receive = payload transfer after the header,
+    // execute = until the first response byte, send = writing the response.
+    struct RemoteCommandInstructionStatsInner {
+        RemoteCommandInstruction instruction {RemoteCommandInstruction::INSTRUCTION_EMPTY};
+        uint32_t reserved {0};
+        RemoteCommandLatencyInner receive;
+        RemoteCommandLatencyInner execute;
+        RemoteCommandLatencyInner send;
+    };
+
+    // Mutex contention (servers built with REMOTE_COMMAND_LOCK_STATS).
+    // Wait and hold times in microseconds.
+    struct RemoteCommandLockStatsInner {
+        char     name[16] {0};          // "stream" = every session's stream mutex
+        uint64_t acquisitions {0};
+        uint64_t contended {0};         // had to wait for another holder
+        RemoteCommandLatencyInner wait;
+        RemoteCommandLatencyInner hold;
+    };
+
+    // INSTRUCTION_RUN_GRAPH runs a dependency graph of commands on the server
+    // and answers once every node has finished or been skipped:
+    //   request  payload_0 : RemoteCommandGraphInner
+    //            payload_1 : node_count * RemoteCommandNodeInner
+    //            payload_2 : per node, in order: command, cwd, environment
+    //                        (NUL-terminated "NAME=value" entries)
+    //            payload_3 : per node, dependency_count uint32_t node indices
+    //   output             : STREAM_NODE_OUTPUT / STREAM_NODE_ERROR frames
+    //   response           : node_count * RemoteCommandNodeResultInner
+    // A node starts once all of its dependencies succeeded; a failed node
+    // skips everything that depends on it.  Out-of-range or cyclic
+    // dependencies reject the whole graph before anything runs.
+    struct RemoteCommandGraphInner {
+        uint32_t node_count {0};
+        int32_t  max_parallel {0};      // 0 = one per core
+    };
+
+    struct RemoteCommandNodeInner {
+        uint32_t command_length {0};
+        uint32_t cwd_length {0};        // 0 = the session's working directory
+        uint32_t environment_length {0};
+        uint32_t dependency_count {0};
+    };
+
+    enum class RemoteCommandNodeStateInner : int32_t {
+        SUCCEEDED = 0x1000,
+        FAILED = 0x2000,                // non-zero exit code, or could not start
+        SKIPPED = 0x3000,               // a dependency failed, or the graph was cancelled
+    };
+
+    struct RemoteCommandNodeResultInner {
+        RemoteCommandNodeStateInner state {RemoteCommandNodeStateInner::SKIPPED};
+        int32_t  exit_code {-1};
+        uint32_t elapsed_ms {0};
+        uint32_t padding {0};
+    };
+
+    // INSTRUCTION_RUN_SCRIPT runs an ordered list of commands one after the
+    // other and answers once they are done:
+    //   request  payload_0 : RemoteCommandScriptInner
+    //            payload_1 : commands, NUL-terminated, in order
+    //   output             : STREAM_NODE_OUTPUT / STREAM_NODE_ERROR frames
+    //                        tagged with the command index
+    //   response           : command_count * RemoteCommandNodeResultInner
+    // SCRIPT_SHARED_SHELL runs every command in one /bin/sh, so cd, variables
+    // and functions carry over (POSIX only).
+    enum RemoteCommandScriptFlagInner : uint32_t {
+        SCRIPT_STOP_ON_ERROR = 0x1,     // skip the rest after a failed command
+        SCRIPT_SHARED_SHELL  = 0x2,
+    };
+
+    struct RemoteCommandScriptInner {
+        uint32_t flags {0};
+        uint32_t padding {0};
+    };
+
+    // INSTRUCTION_RUN_CACHED runs a deterministic command through the
+    // server's result cache:
+    //   request  payload_0 : command
+    //            payload_1 : environment, "NAME=value" entries, NUL-terminated
+    //            payload_2 : input files (globs allowed), NUL-terminated
+    //            payload_3 : output files, NUL-terminated
+    //   output             : STREAM_OUTPUT / STREAM_ERROR frames, sent once
+    //                        the command has finished (or been replayed)
+    //   response           : RemoteCommandCachedReplyInner
+    // The key covers the command, cwd, environment, declared outputs and the
+    // content of every input.  A hit restores the outputs without running.
+    struct RemoteCommandCachedReplyInner {
+        int32_t  exit_code {-1};
+        uint32_t hit {0};               // 1 if replayed from the cache
+    };
+
+    // INSTRUCTION_SET_LAUNCH_OPTIONS sets how the session's processes are
+    // started from now on:
+    //   request  payload_0 : RemoteCommandLaunchInner
+    //            payload_1 : uint32 CPU indices (empty = any core)
+    //            payload_2 : cgroup limits, "cpu.max=..." / "memory.max=...",
+    //                        NUL-terminated (empty = no cgroup)
+    //   response           : accepted (sizeof(bool) byte); the previous
+    //                        options stay in force if it is false
+    struct RemoteCommandLaunchInner {
+        int32_t  nice {0};              // 0 = inherit the server's
+        int32_t  io_class {0};          // 0 = inherit, 1 realtime, 2 best-effort, 3 idle
+        int32_t  io_level {0};          // 0 (highest) ... 7
+        uint32_t padding {0};
+    };
+
+    // RUN_COMMAND and OPEN_PROCESS answer with RemoteCommandJobReplyInner.
+    // Older clients read only its first field.  When the server limits
+    // concurrent jobs, queued_ms is how long the job waited for a slot.
+    struct RemoteCommandJobReplyInner {
+        int32_t  value {-1};            // exit code / process id
+        uint32_t queued_ms {0};
+    };
+
+    // RUN_COMMAND payload_1 (optional): uint32 flags.
+    //   RUN_COMMAND_TIMING appends a RemoteCommandRunTimingInner to the reply.
+    static constexpr uint32_t RUN_COMMAND_TIMING = 0x1;
+
+    // Where the time of one RUN_COMMAND went.  Microseconds on the server's
+    // monotonic clock, counted from the moment its request header was read;
+    // -1 for a phase the run did not go through (built-in commands are not
+    // spawned, a command may print nothing).
+    struct RemoteCommandRunTimingInner {
+        int64_t received_us {-1};       // payloads read
+        int64_t scheduled_us {-1};      // job slot granted
+        int64_t spawned_us {-1};        // fork / CreateProcess returned, or the warm interpreter forked
+        int64_t first_output_us {-1};   // first stdout / stderr byte read from the pipes
+        int64_t exited_us {-1};         // process exited (or the built-in returned)
+        int64_t drained_us {-1};        // every byte of output forwarded, reader threads joined
+        int64_t replied_us {-1};        // response about to be written
+    };
+
+    // INSTRUCTION_SET_JOB_PRIORITY sets the queue class of the session's
+    // later RUN_COMMAND / OPEN_PROCESS jobs:
+    //   request  payload_0 : int32 priority, RemoteCommandJobPriority
+    //   response           : accepted (sizeof(bool) byte)
+    enum class RemoteCommandJobPriority : int32_t {
+        NORMAL = 0,
+        HIGH   = 1,                     // runs before every waiting NORMAL / LOW job
+        LOW    = 2,                     // runs only when nothing else waits
+    };
+
+    // INSTRUCTION_WATCH_RESOURCES samples the session's running process
+    // groups periodically:
+    //   request  payload_0 : uint32 interval in ms (0 = stop)
+    //   output             : STREAM_RESOURCES frames, one per interval while
+    //                        something runs, RemoteCommandResourceInner[]
+    //   response           : accepted (sizeof(bool) byte)
+    // INSTRUCTION_LIST_PROCESSES samples every process group the server runs
+    // for any session, once:
+    //   response           : RemoteCommandResourceInner[]
+    // Linux only; elsewhere the list is always empty.
+    struct RemoteCommandResourceInner {
+        uint32_t session_id {0};
+        int32_t  process_group {-1};    // pid of the group leader
+        uint32_t processes {0};
+        uint32_t threads {0};
+        uint32_t open_files {0};
+        uint32_t cpu_milli {0};         // 1000 = one core fully busy
+        uint64_t rss_bytes {0};
+        uint64_t read_bytes {0};        // from storage, whole lifetime
+        uint64_t write_bytes {0};
+    };
+
+    // INSTRUCTION_MAP_FILES runs a command template over many files, like
+    // `xargs -P`, and answers with every invocation's output kept apart:
+    //   request  payload_0 : RemoteCommandMapInner
+    //            payload_1 : command template
+    //                        "{}"  -> one file per invocation
+    //                        "{+}" -> a batch of files per invocation
+    //                        none  -> a batch of files appended at the end
+    //            payload_2 : inputs, NUL-terminated; entries with '*', '?' or
+    //                        '[' are expanded as globs on the server
+    //   response           : RemoteCommandMapReplyInner
+    //                        item_count * RemoteCommandMapItemInner
+    //                        invocation_count * RemoteCommandMapInvocationInner
+    //                        item paths, in order
+    //                        per invocation: output, then error
+    struct RemoteCommandMapInner {
+        int32_t max_parallel {0};       // 0 = one per core
+        int32_t batch_size {0};         // files per batched invocation, 0 = automatic
+    };
+
+    struct RemoteCommandMapReplyInner {
+        uint32_t item_count {0};
+        uint32_t invocation_count {0};
+    };
+
+    struct RemoteCommandMapItemInner {
+        uint32_t invocation {0};
+        uint32_t path_length {0};
+    };
+
+    struct RemoteCommandMapInvocationInner {
+        RemoteCommandNodeResultInner result;
+        uint32_t output_length {0};
+        uint32_t error_length {0};
+    };
+
+    // Payload of STREAM_PROGRESS.  Totals are measured before the work
+    // starts; bytes_per_second is the average since then.
+    struct RemoteCommandProgressInner {
+        uint32_t operation_id {0};
+        uint32_t padding {0};
+        uint64_t bytes_done {0};
+        uint64_t bytes_total {0};
+        uint64_t items_done {0};
+        uint64_t items_total {0};
+        uint64_t bytes_per_second {0};
+    };
+
     enum class RemoteDirectoryContentTypeInner : int32_t {
         INVALID = 0x0000,
         FILE = 0x1000,
@@ -126,6 +476,29 @@ namespace Bn3Monkey
         INVALID = 0x0000,
         STREAM_OUTPUT = 0x3000,
         STREAM_ERROR = 0x4000,
+
+        // Output of one INSTRUCTION_RUN_GRAPH node.
+        STREAM_NODE_OUTPUT = 0x3001,
+        STREAM_NODE_ERROR = 0x4001,
+
+        // Heartbeat: the server sends PING on an idle connection and the
+        // client echoes the payload back as PONG on the same stream socket.
+        STREAM_PING = 0x5000,
+        STREAM_PONG = 0x5001,
+
+        // Sent once by the client right after connecting the stream socket:
+        // binds it to the session whose token INSTRUCTION_SESSION_ID returned.
+        STREAM_ATTACH = 0x6000,
+
+        // Completion of an INSTRUCTION_SUBMIT_OPERATION.
+        STREAM_OPERATION = 0x7000,
+
+        // Progress of a running INSTRUCTION_SUBMIT_OPERATION, sent at most
+        // once per RemoteCommandServerOptions::progress_interval_ms.
+        STREAM_PROGRESS = 0x7001,
+
+        // Samples requested with INSTRUCTION_WATCH_RESOURCES.
+        STREAM_RESOURCES = 0x7002,
     };
     struct RemoteCommandStreamHeader
     {
@@ -151,6 +524,60 @@ namespace Bn3Monkey
     //    - payload_size (4byte)
     //    - padding (4byte)
     // - payload (payload_size byte)
+    //   if (header.type == STREAM_NODE_OUTPUT || header.type == STREAM_NODE_ERROR)
+    //      - node index (4byte)
+    //      - output (payload_size - 4 byte)
+    //   else if (header.type == STREAM_PING || header.type == STREAM_PONG)
+    //      - sequence (4byte)
+    //   else if (header.type == STREAM_ATTACH)
+    //      - RemoteCommandSessionTokenInner (16byte)
+    //   else if (header.type == STREAM_OPERATION)
+    //      - RemoteCommandOperationInner (8byte)
+    //      - result payload (see INSTRUCTION_SUBMIT_OPERATION)
+    //   else if (header.type == STREAM_PROGRESS)
+    //      - RemoteCommandProgressInner (48byte)
+    //   else if (header.type == STREAM_RESOURCES)
+    //      - RemoteCommandResourceInner (48byte) per process group
+
+    // -------------------------------------------------------------------------
+    // Session recording (RemoteCommandServerOptions::record_file)
+    //
+    // - RemoteCommandRecordingHeader (32byte)
+    // - per request, in arrival order across all sessions:
+    //    - RemoteCommandRecordInner (40byte)
+    //    - payload_0 .. payload_3 (payload_N_length byte each) if
+    //      RECORDING_PAYLOADS is set
+    // A record whose instruction is INSTRUCTION_EMPTY marks the end of its
+    // session.
+    // -------------------------------------------------------------------------
+    static constexpr const char REMOTE_COMMAND_RECORDING_MAGIC[8] {"RCREC01"};
+    static constexpr uint32_t   RECORDING_PAYLOADS = 0x1;
+
+    struct RemoteCommandRecordingHeader
+    {
+        char     magic[sizeof(REMOTE_COMMAND_RECORDING_MAGIC)] {0};
+        uint32_t version {1};
+        uint32_t flags {0};
+        int64_t  started_unix_us {0};   // wall clock when recording started
+        int64_t  reserved {0};
+
+        RemoteCommandRecordingHeader() {
+            memcpy(magic, REMOTE_COMMAND_RECORDING_MAGIC, sizeof(magic));
+        }
+        inline bool valid() const {
+            return memcmp(magic, REMOTE_COMMAND_RECORDING_MAGIC, sizeof(magic)) == 0 && version == 1;
+        }
+    };
+
+    struct RemoteCommandRecordInner
+    {
+        uint32_t session_id {0};
+        RemoteCommandInstruction instruction {RemoteCommandInstruction::INSTRUCTION_EMPTY};
+        uint64_t offset_us {0};         // header arrival, since recording started
+        uint32_t receive_us {0};        // payload transfer after the header
+        uint32_t payload_length[4] {0, 0, 0, 0};
+        uint32_t padding {0};
+    };
 
     static constexpr const char PORT_COMMAND[] {"RC_CMD"};
     static constexpr const char PORT_STREAM [] {"RC_STREAM"};
@@ -0,0 +1,300 @@
+#if !defined(__BN3MONKEY_REMOTE_COMMAND_TRANSPORT__)
+#define __BN3MONKEY_REMOTE_COMMAND_TRANSPORT__
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace Bn3Monkey
+{
+    // -------------------------------------------------------------------------
+    // In-memory transport
+    //
+    // Connections between a client and a server in the same process, without
+    // the kernel: an in_memory server (RemoteCommandServerOptions) listens on
+    // its ports here instead of on TCP, and createInMemoryRemoteCommandClient
+    // connects to it.  Ports are only names; nothing is bound.
+    //
+    // Endpoints are plain descriptors from a range real sockets never reach,
+    // so sock_t flows through the code unchanged and sendAll / recvAll /
+    // closeSocket / shutdownSocket check isMemorySocket() first.  Each
+    // direction buffers up to MEMORY_PIPE_CAPACITY bytes; a writer past that
+    // blocks until the reader catches up, as with a full socket buffer.
+    //
+    // Header-only and C++11 so that both libraries share one registry.
+    // -------------------------------------------------------------------------
+    static constexpr int64_t MEMORY_SOCKET_BASE   = 0x40000000;
+    static constexpr int64_t MEMORY_SOCKET_END    = 0x7FFFFFFF;
+    static constexpr size_t  MEMORY_PIPE_CAPACITY = 4 * 1024 * 1024;
+
+    inline bool isMemorySocket(int64_t sock)
+    {
+        return sock >= MEMORY_SOCKET_BASE && sock < MEMORY_SOCKET_END;
+    }
+
+    // One direction of a connection
+    class MemoryPipe
+    {
+    public:
+        bool write(const void* data, size_t size)
+        {
+            const char* ptr = static_cast<const char*>(data);
+            std::unique_lock<std::mutex> lk(_mtx);
+            while (size > 0) {
+                _cv.wait(lk, [&] { return _reader_closed || _writer_closed || buffered() < MEMORY_PIPE_CAPACITY; });
+                if (_reader_closed || _writer_closed) return false;
+                size_t chunk = std::min(size, MEMORY_PIPE_CAPACITY - buffered());
+                _buffer.append(ptr, chunk);
+                ptr  += chunk;
+                size -= chunk;
+                _cv.notify_all();
+            }
+            return true;
+        }
+
+        bool read(void* data, size_t size)
+        {
+            char* ptr = static_cast<char*>(data);
+            std::unique_lock<std::mutex> lk(_mtx);
+            while (size > 0) {
+                _cv.wait(lk, [&] { return _reader_closed || _writer_closed || buffered() > 0; });
+                if (_reader_closed) return false;
+                if (buffered() == 0) return false;      // writer gone, drained
+                size_t chunk = std::min(size, buffered());
+                memcpy(ptr, _buffer.data() + _offset, chunk);
+                ptr     += chunk;
+                size    -= chunk;
+                _offset += chunk;
+                if (_offset == _buffer.size()) {
+                    _buffer.clear();
+                    _offset = 0;
+                }
+                else if (_offset > MEMORY_PIPE_CAPACITY / 2) {
+                    _buffer.erase(0, _offset);
+                    _offset = 0;
+                }
+                _cv.notify_all();
+            }
+            return true;
+        }
+
+        // Data or end of stream is waiting
+        bool waitReadable(int timeout_ms)
+        {
+            std::unique_lock<std::mutex> lk(_mtx);
+            return _cv.wait_for(lk, std::chrono::milliseconds(timeout_ms),
+                                [&] { return _reader_closed || _writer_closed || buffered() > 0; });
+        }
+
+        void closeReader()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            _reader_closed = true;
+            _cv.notify_all();
+        }
+
+        void closeWriter()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            _writer_closed = true;
+            _cv.notify_all();
+        }
+
+    private:
+        size_t buffered() const { return _buffer.size() - _offset; }
+
+        std::mutex              _mtx;
+        std::condition_variable _cv;
+        std::string             _buffer;
+        size_t                  _offset        { 0 };
+        bool                    _reader_closed { false };
+        bool                    _writer_closed { false };
+    };
+
+    struct MemoryConnection
+    {
+        MemoryPipe pipes[2];      // [0]: connector -> acceptor, [1]: back
+    };
+
+    struct MemoryListener
+    {
+        int32_t                 port { 0 };
+        std::mutex              mtx;
+        std::condition_variable cv;
+        std::deque<int64_t>     pending;
+        bool                    closed { false };
+    };
+
+    // -------------------------------------------------------------------------
+    // Registry of open endpoints and listeners
+    // -------------------------------------------------------------------------
+    class MemoryTransport
+    {
+    public:
+        static MemoryTransport& instance()
+        {
+            static MemoryTransport transport;
+            return transport;
+        }
+
+        // -1 if port is already taken
+        int64_t listen(int32_t port)
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            if (_ports.count(port)) return -1;
+            auto listener = std::make_shared<MemoryListener>();
+            listener->port = port;
+            int64_t sock = allocate();
+            _listeners[sock] = listener;
+            _ports[port] = listener;
+            return sock;
+        }
+
+        // -1 if nothing listens on port
+        int64_t connect(int32_t port)
+        {
+            std::shared_ptr<MemoryListener> listener;
+            int64_t local, remote;
+            {
+                std::lock_guard<std::mutex> lk(_mtx);
+                auto it = _ports.find(port);
+                if (it == _ports.end()) return -1;
+                listener = it->second;
+                auto connection = std::make_shared<MemoryConnection>();
+                local  = allocate();
+                remote = allocate();
+                _endpoints[local]  = Endpoint { connection, 0 };
+                _endpoints[remote] = Endpoint { connection, 1 };
+            }
+            std::lock_guard<std::mutex> lk(listener->mtx);
+            if (listener->closed) {
+                close(local);
+                close(remote);
+                return -1;
+            }
+            listener->pending.push_back(remote);
+            listener->cv.notify_all();
+            return local;
+        }
+
+        // -1 on timeout or once the listener is shut down
+        int64_t accept(int64_t listen_sock, int timeout_ms)
+        {
+            std::shared_ptr<MemoryListener> listener = findListener(listen_sock);
+            if (!listener) return -1;
+            std::unique_lock<std::mutex> lk(listener->mtx);
+            listener->cv.wait_for(lk, std::chrono::milliseconds(timeout_ms),
+                                  [&] { return listener->closed || !listener->pending.empty(); });
+            if (listener->closed || listener->pending.empty()) return -1;
+            int64_t sock = listener->pending.front();
+            listener->pending.pop_front();
+            return sock;
+        }
+
+        bool send(int64_t sock, const void* data, size_t size)
+        {
+            Endpoint endpoint = findEndpoint(sock);
+            return endpoint.connection && endpoint.connection->pipes[endpoint.side].write(data, size);
+        }
+
+        bool recv(int64_t sock, void* data, size_t size)
+        {
+            Endpoint endpoint = findEndpoint(sock);
+            return endpoint.connection && endpoint.connection->pipes[1 - endpoint.side].read(data, size);
+        }
+
+        bool waitReadable(int64_t sock, int timeout_ms)
+        {
+            if (std::shared_ptr<MemoryListener> listener = findListener(sock)) {
+                std::unique_lock<std::mutex> lk(listener->mtx);
+                return listener->cv.wait_for(lk, std::chrono::milliseconds(timeout_ms),
+                                             [&] { return listener->closed || !listener->pending.empty(); });
+            }
+            Endpoint endpoint = findEndpoint(sock);
+            return endpoint.connection && endpoint.connection->pipes[1 - endpoint.side].waitReadable(timeout_ms);
+        }
+
+        // Like shutdown(SHUT_RDWR): blocked reads and writes on both ends
+        // return, the peer still reads what was already sent
+        void shutdown(int64_t sock)
+        {
+            if (std::shared_ptr<MemoryListener> listener = findListener(sock)) {
+                std::lock_guard<std::mutex> lk(listener->mtx);
+                listener->closed = true;
+                listener->cv.notify_all();
+                return;
+            }
+            Endpoint endpoint = findEndpoint(sock);
+            if (!endpoint.connection) return;
+            endpoint.connection->pipes[endpoint.side].closeWriter();
+            endpoint.connection->pipes[1 - endpoint.side].closeReader();
+        }
+
+        void close(int64_t sock)
+        {
+            shutdown(sock);
+            std::shared_ptr<MemoryListener> listener;
+            {
+                std::lock_guard<std::mutex> lk(_mtx);
+                _endpoints.erase(sock);
+                auto it = _listeners.find(sock);
+                if (it == _listeners.end()) return;
+                listener = it->second;
+                _ports.erase(listener->port);
+                _listeners.erase(it);
+            }
+            // Connections nobody accepted
+            std::lock_guard<std::mutex> lk(listener->mtx);
+            for (int64_t pending : listener->pending) {
+                shutdown(pending);
+                std::lock_guard<std::mutex> registry(_mtx);
+                _endpoints.erase(pending);
+            }
+            listener->pending.clear();
+        }
+
+    private:
+        struct Endpoint
+        {
+            std::shared_ptr<MemoryConnection> connection;
+            int                               side;
+        };
+
+        int64_t allocate()
+        {
+            do {
+                if (++_next >= MEMORY_SOCKET_END) _next = MEMORY_SOCKET_BASE;
+            } while (_endpoints.count(_next) || _listeners.count(_next));
+            return _next;
+        }
+
+        Endpoint findEndpoint(int64_t sock)
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            auto it = _endpoints.find(sock);
+            return it != _endpoints.end() ? it->second : Endpoint { nullptr, 0 };
+        }
+
+        std::shared_ptr<MemoryListener> findListener(int64_t sock)
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            auto it = _listeners.find(sock);
+            return it != _listeners.end() ? it->second : std::shared_ptr<MemoryListener>();
+        }
+
+        std::mutex                                          _mtx;
+        int64_t                                             _next { MEMORY_SOCKET_BASE };
+        std::map<int64_t, Endpoint>                         _endpoints;
+        std::map<int64_t, std::shared_ptr<MemoryListener>>  _listeners;
+        std::map<int32_t, std::shared_ptr<MemoryListener>>  _ports;
+    };
+}
+
+#endif // __BN3MONKEY_REMOTE_COMMAND_TRANSPORT__
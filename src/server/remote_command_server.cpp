@@ -16,22 +16,58 @@ namespace Bn3Monkey
         int32_t     stream_port,
         const char* current_working_directory)
     {
+        return openRemoteCommandServer(discovery_port, command_port, stream_port,
+                                       current_working_directory,
+                                       RemoteCommandServerOptions{});
+    }
+
+    RemoteCommandServer* openRemoteCommandServer(
+        int32_t     discovery_port,
+        int32_t     command_port,
+        int32_t     stream_port,
+        const char* current_working_directory,
+        const RemoteCommandServerOptions& options)
+    {
 #ifdef _WIN32
         WSADATA wsa;
         if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) return nullptr;
 #endif
 
+        // Pre-opened listeners: systemd socket activation first, otherwise
+        // take them over from a running predecessor.
+        InheritedListeners listeners;
+        if (options.socket_activation && !options.in_memory)
+            listeners = listenersFromEnvironment(command_port, stream_port);
+
+        const bool use_handoff = options.handoff_path && options.handoff_path[0] && !options.in_memory;
+        if (use_handoff && !listeners.complete()) {
+            InheritedListeners taken;
+            if (takeOverListeners(options.handoff_path, command_port, stream_port, taken)) {
+                listeners.close();
+                listeners = taken;
+                printf("[Handoff] Took over listeners from predecessor\n");
+                fflush(stdout);
+            }
+        }
+
         auto* server = new RemoteCommandServer();
+        server->workers.open(options.worker_threads);
 
-        if (!server->stream_server.open(stream_port)) {
+        if (!server->stream_server.open(stream_port, options, listeners.stream_sock)) {
+            listeners.close();
             delete server;
 #ifdef _WIN32
             WSACleanup();
 #endif
             return nullptr;
         }
+        listeners.stream_sock = INVALID_SOCK;   // owned by stream_server now
 
-        if (!server->command_server.open(command_port, current_working_directory)) {
+        // command_server owns the command listeners from here on
+        std::vector<sock_t> command_socks;
+        command_socks.swap(listeners.command_socks);
+        if (!server->command_server.open(command_port, current_working_directory, options,
+                                         command_socks)) {
             server->stream_server.close();
             delete server;
 #ifdef _WIN32
@@ -40,7 +76,8 @@ namespace Bn3Monkey
             return nullptr;
         }
 
-        if (!server->discovery_server.open(discovery_port, command_port, stream_port)) {
+        if (!options.in_memory &&
+            !server->discovery_server.open(discovery_port, command_port, stream_port)) {
             server->command_server.close();
             server->stream_server.close();
             delete server;
@@ -50,6 +87,32 @@ namespace Bn3Monkey
             return nullptr;
         }
 
+        if (use_handoff) {
+            bool ok = server->handoff.open(options.handoff_path,
+                [server]() {
+                    InheritedListeners dup;
+                    dup.command_socks = server->command_server.duplicateListeners();
+                    dup.stream_sock   = server->stream_server.duplicateListener();
+                    return dup;
+                },
+                [server]() {
+                    // The successor binds discovery as soon as we answer
+                    server->command_server.stopAccepting();
+                    server->stream_server.stopAccepting();
+                    server->discovery_server.close();
+                });
+            if (!ok) {
+                server->discovery_server.close();
+                server->command_server.close();
+                server->stream_server.close();
+                delete server;
+#ifdef _WIN32
+                WSACleanup();
+#endif
+                return nullptr;
+            }
+        }
+
         return server;
     }
 
@@ -57,9 +120,11 @@ namespace Bn3Monkey
     {
         if (!server) return;
 
+        server->handoff.close();
         server->discovery_server.close();
-        server->command_server.close();
+        server->command_server.close();     // also ends every session
         server->stream_server.close();
+        server->workers.close();            // waits for operations already running
 
         delete server;
 
@@ -68,4 +133,19 @@ namespace Bn3Monkey
 #endif
     }
 
+    bool isRemoteCommandServerRetired(RemoteCommandServer* server)
+    {
+        return server && server->handoff.handedOff() && server->command_server.drained();
+    }
+
+    bool registerRemoteInstruction(RemoteCommandServer* server, int32_t instruction, RemoteInstructionHandler handler)
+    {
+        return server && server->instructions.add(instruction, std::move(handler));
+    }
+
+    bool unregisterRemoteInstruction(RemoteCommandServer* server, int32_t instruction)
+    {
+        return server && server->instructions.remove(instruction);
+    }
+
 } // namespace Bn3Monkey
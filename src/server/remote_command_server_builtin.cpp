@@ -0,0 +1,495 @@
+#include "remote_command_server_builtin.hpp"
+#include "remote_command_server_filesystem.hpp"
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace Bn3Monkey
+{
+#ifdef _WIN32
+
+    // Commands go to CreateProcessA without a shell; nothing to shortcut.
+    bool runBuiltinCommand(const std::string&, const char*, RemoteProcess&, int32_t&)
+    {
+        return false;
+    }
+
+#else
+
+    // -------------------------------------------------------------------------
+    // Helpers
+    // -------------------------------------------------------------------------
+
+    // Splits cmd on blanks.  False if it uses anything the shell would
+    // interpret (quoting, expansion, redirection, control operators).
+    static bool splitPlainCommand(const char* cmd, std::vector<std::string>& argv)
+    {
+        static const char SHELL_CHARS[] = "|&;<>()$`\\\"'*?[]#~={}!^\n\r";
+        std::string word;
+        for (const char* p = cmd; ; ++p) {
+            char c = *p;
+            if (c == ' ' || c == '\t' || c == '\0') {
+                if (!word.empty()) argv.push_back(std::move(word));
+                word.clear();
+                if (c == '\0') break;
+                continue;
+            }
+            if (strchr(SHELL_CHARS, c)) return false;
+            word.push_back(c);
+        }
+        return !argv.empty();
+    }
+
+    // The utilities print translated messages outside English locales;
+    // only take over where their output is the one reproduced here.
+    static bool messagesAreUntranslated()
+    {
+        const char* names[] = { "LC_ALL", "LC_MESSAGES", "LANG" };
+        for (const char* name : names) {
+            const char* value = getenv(name);
+            if (!value || !value[0]) continue;
+            return strcmp(value, "C") == 0 || strcmp(value, "POSIX") == 0 ||
+                   strncmp(value, "C.", 2) == 0 || strncmp(value, "en", 2) == 0;
+        }
+        return true;
+    }
+
+    // mkdir quotes with ‘...’ in UTF-8 locales and '...' otherwise
+    static bool localeIsUtf8()
+    {
+        const char* names[] = { "LC_ALL", "LC_CTYPE", "LANG" };
+        for (const char* name : names) {
+            const char* value = getenv(name);
+            if (!value || !value[0]) continue;
+            return strstr(value, "UTF-8") || strstr(value, "utf8") ||
+                   strstr(value, "UTF8")  || strstr(value, "utf-8");
+        }
+        return false;
+    }
+
+    static bool isOption(const std::string& arg)
+    {
+        return arg.size() > 1 && arg[0] == '-';
+    }
+
+    static bool parseCount(const char* text, uint64_t& value)
+    {
+        if (!*text) return false;
+        char* end = nullptr;
+        errno = 0;
+        unsigned long long parsed = strtoull(text, &end, 10);
+        if (errno != 0 || *end != '\0' || text[0] == '-' || text[0] == '+') return false;
+        value = parsed;
+        return true;
+    }
+
+    // stdout is buffered up to one reader-sized frame; stderr is sent at
+    // once, after whatever stdout precedes it.
+    class BuiltinOutput
+    {
+    public:
+        explicit BuiltinOutput(RemoteProcess& process) : _process(process) {}
+        ~BuiltinOutput() { flush(); }
+
+        void out(const char* data, size_t len)
+        {
+            while (len > 0) {
+                size_t chunk = std::min(len, FRAME_SIZE - _buffer.size());
+                _buffer.append(data, chunk);
+                data += chunk;
+                len  -= chunk;
+                if (_buffer.size() == FRAME_SIZE) flush();
+            }
+        }
+        void out(const std::string& text) { out(text.data(), text.size()); }
+
+        void err(const std::string& text)
+        {
+            flush();
+            _process.timeline().markFirst(_process.timeline().first_output);
+            _process.sendStreamFrame(RemoteCommandStreamType::STREAM_ERROR,
+                                     text.data(), static_cast<uint32_t>(text.size()));
+        }
+
+        void flush()
+        {
+            if (_buffer.empty()) return;
+            _process.timeline().markFirst(_process.timeline().first_output);
+            _process.sendStreamFrame(RemoteCommandStreamType::STREAM_OUTPUT,
+                                     _buffer.data(), static_cast<uint32_t>(_buffer.size()));
+            _buffer.clear();
+        }
+
+    private:
+        static constexpr size_t FRAME_SIZE = 4096;
+        RemoteProcess& _process;
+        std::string    _buffer;
+    };
+
+    static std::string errnoMessage(const char* tool, const std::string& what, int error)
+    {
+        return std::string(tool) + ": " + what + ": " + strerror(error) + "\n";
+    }
+
+    static bool isRegularFile(const std::string& path)
+    {
+        struct stat st;
+        return ::stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+    }
+
+    // -------------------------------------------------------------------------
+    // Utilities
+    // -------------------------------------------------------------------------
+
+    static bool builtinCat(const std::string& cwd, const std::vector<std::string>& argv,
+                           BuiltinOutput& output, int32_t& exit_code)
+    {
+        if (argv.size() < 2) return false;                  // would read stdin
+        for (size_t i = 1; i < argv.size(); ++i)
+            if (argv[i][0] == '-') return false;            // options, "-" or "--"
+
+        exit_code = 0;
+        std::vector<char> buffer(64 * 1024);
+        for (size_t i = 1; i < argv.size(); ++i) {
+            int fd = ::open(resolvePath(cwd, argv[i]).c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                output.err(errnoMessage("cat", argv[i], errno));
+                exit_code = 1;
+                continue;
+            }
+            ssize_t n;
+            while ((n = ::read(fd, buffer.data(), buffer.size())) > 0)
+                output.out(buffer.data(), static_cast<size_t>(n));
+            if (n < 0) {
+                output.err(errnoMessage("cat", argv[i], errno));
+                exit_code = 1;
+            }
+            ::close(fd);
+        }
+        return true;
+    }
+
+    static bool builtinRm(const std::string& cwd, const std::vector<std::string>& argv,
+                          BuiltinOutput& output, int32_t& exit_code)
+    {
+        bool force = false, recursive = false;
+        size_t first = 1;
+        for (; first < argv.size() && isOption(argv[first]); ++first) {
+            for (size_t c = 1; c < argv[first].size(); ++c) {
+                char flag = argv[first][c];
+                if (flag == 'f')                     force = true;
+                else if (flag == 'r' || flag == 'R') recursive = true;
+                else return false;
+            }
+        }
+        if (first == argv.size()) return false;
+
+        // rm refuses these with its own diagnostics; leave them to it.
+        for (size_t i = first; i < argv.size(); ++i) {
+            const std::string& arg = argv[i];
+            if (arg[0] == '-') return false;
+            size_t end = arg.find_last_not_of('/');
+            if (end == std::string::npos) return false;         // "/"
+            size_t begin = arg.find_last_of('/', end);
+            std::string last = arg.substr(begin == std::string::npos ? 0 : begin + 1,
+                                          begin == std::string::npos ? end + 1 : end - begin);
+            if (last == "." || last == "..") return false;
+        }
+
+        exit_code = 0;
+        for (size_t i = first; i < argv.size(); ++i) {
+            const std::string& arg = argv[i];
+            std::string path = resolvePath(cwd, arg).string();
+            std::string quoted = "cannot remove '" + arg + "'";
+
+            struct stat st;
+            if (::lstat(path.c_str(), &st) != 0) {
+                if (!(force && errno == ENOENT)) {
+                    output.err(errnoMessage("rm", quoted, errno));
+                    exit_code = 1;
+                }
+                continue;
+            }
+            if (S_ISDIR(st.st_mode)) {
+                if (!recursive) {
+                    output.err(errnoMessage("rm", quoted, EISDIR));
+                    exit_code = 1;
+                    continue;
+                }
+                std::error_code ec;
+                fs::remove_all(path, ec);
+                if (ec) {
+                    output.err("rm: " + quoted + ": " + ec.message() + "\n");
+                    exit_code = 1;
+                }
+                continue;
+            }
+            if (::unlink(path.c_str()) != 0) {
+                output.err(errnoMessage("rm", quoted, errno));
+                exit_code = 1;
+            }
+        }
+        return true;
+    }
+
+    static bool builtinTouch(const std::string& cwd, const std::vector<std::string>& argv,
+                             BuiltinOutput& output, int32_t& exit_code)
+    {
+        if (argv.size() < 2) return false;
+        for (size_t i = 1; i < argv.size(); ++i)
+            if (argv[i][0] == '-') return false;
+
+        exit_code = 0;
+        for (size_t i = 1; i < argv.size(); ++i) {
+            std::string path = resolvePath(cwd, argv[i]).string();
+            int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_NONBLOCK | O_NOCTTY | O_CLOEXEC, 0666);
+            int open_error = errno;
+            int result = fd >= 0 ? ::futimens(fd, nullptr)
+                                 : ::utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+            int error = errno;
+            if (fd >= 0) ::close(fd);
+            if (result != 0) {
+                // A directory cannot be opened for writing but can be touched
+                output.err(errnoMessage("touch", "cannot touch '" + argv[i] + "'",
+                                        fd < 0 && open_error != EISDIR ? open_error : error));
+                exit_code = 1;
+            }
+        }
+        return true;
+    }
+
+    static bool builtinMkdir(const std::string& cwd, const std::vector<std::string>& argv,
+                             BuiltinOutput& output, int32_t& exit_code)
+    {
+        bool parents = false;
+        size_t first = 1;
+        if (first < argv.size() && argv[first] == "-p") {
+            parents = true;
+            ++first;
+        }
+        if (first == argv.size()) return false;
+        for (size_t i = first; i < argv.size(); ++i)
+            if (argv[i][0] == '-') return false;
+
+        const char* open_quote  = localeIsUtf8() ? "\xe2\x80\x98" : "'";
+        const char* close_quote = localeIsUtf8() ? "\xe2\x80\x99" : "'";
+
+        exit_code = 0;
+        for (size_t i = first; i < argv.size(); ++i) {
+            fs::path target = resolvePath(cwd, argv[i]);
+            int error = 0;
+            if (!parents) {
+                if (::mkdir(target.c_str(), 0777) != 0) error = errno;
+            } else {
+                // Create each missing component; existing directories are fine
+                fs::path prefix;
+                for (const fs::path& part : target) {
+                    prefix /= part;
+                    if (part == prefix.root_path() || part.empty()) continue;
+                    if (::mkdir(prefix.c_str(), 0777) == 0) continue;
+                    int e = errno;
+                    struct stat st;
+                    if (e == EEXIST && ::stat(prefix.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) continue;
+                    error = e;
+                    break;
+                }
+            }
+            if (error != 0) {
+                output.err(errnoMessage("mkdir", std::string("cannot create directory ") +
+                                        open_quote + argv[i] + close_quote, error));
+                exit_code = 1;
+            }
+        }
+        return true;
+    }
+
+    static bool builtinTest(const std::string& cwd, const std::vector<std::string>& argv,
+                            int32_t& exit_code)
+    {
+        std::vector<std::string> args(argv.begin() + 1, argv.end());
+        if (argv[0] == "[") {
+            if (args.empty() || args.back() != "]") return false;
+            args.pop_back();
+        }
+        if (args.size() != 2 || args[0].size() != 2 || args[0][0] != '-') return false;
+
+        // An empty operand names no file (stat("") fails), not the cwd
+        std::string path = args[1].empty() ? std::string() : resolvePath(cwd, args[1]).string();
+        struct stat st;
+        bool result = false;
+        switch (args[0][1]) {
+        case 'e': result = ::stat(path.c_str(), &st) == 0;                           break;
+        case 'f': result = ::stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);    break;
+        case 'd': result = ::stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);    break;
+        case 's': result = ::stat(path.c_str(), &st) == 0 && st.st_size > 0;         break;
+        case 'r': result = ::access(path.c_str(), R_OK) == 0;                        break;
+        case 'w': result = ::access(path.c_str(), W_OK) == 0;                        break;
+        case 'x': result = ::access(path.c_str(), X_OK) == 0;                        break;
+        case 'L':
+        case 'h': result = ::lstat(path.c_str(), &st) == 0 && S_ISLNK(st.st_mode);   break;
+        default:  return false;
+        }
+        exit_code = result ? 0 : 1;
+        return true;
+    }
+
+    static bool builtinWc(const std::string& cwd, const std::vector<std::string>& argv,
+                          BuiltinOutput& output, int32_t& exit_code)
+    {
+        if (argv.size() < 3 || argv[1] != "-l") return false;
+
+        // wc's column width comes from the total size of its inputs, and its
+        // handling of anything but readable regular files varies; check first.
+        uint64_t size_total = 0;
+        for (size_t i = 2; i < argv.size(); ++i) {
+            struct stat st;
+            std::string path = resolvePath(cwd, argv[i]).string();
+            if (argv[i][0] == '-' || ::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode) ||
+                ::access(path.c_str(), R_OK) != 0)
+                return false;
+            size_total += static_cast<uint64_t>(st.st_size);
+        }
+        size_t files = argv.size() - 2;
+        int width = 1;
+        if (files > 1) {
+            for (; size_total >= 10; size_total /= 10) ++width;
+        }
+
+        exit_code = 0;
+        uint64_t total = 0;
+        std::vector<char> buffer(64 * 1024);
+        char line[64];
+        for (size_t i = 2; i < argv.size(); ++i) {
+            int fd = ::open(resolvePath(cwd, argv[i]).c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                output.err(errnoMessage("wc", argv[i], errno));
+                exit_code = 1;
+                continue;
+            }
+            uint64_t lines = 0;
+            ssize_t n;
+            while ((n = ::read(fd, buffer.data(), buffer.size())) > 0) {
+                for (ssize_t k = 0; k < n; ++k)
+                    if (buffer[k] == '\n') ++lines;
+            }
+            ::close(fd);
+            total += lines;
+            snprintf(line, sizeof(line), "%*llu ", width, static_cast<unsigned long long>(lines));
+            output.out(std::string(line) + argv[i] + "\n");
+        }
+        if (files > 1) {
+            snprintf(line, sizeof(line), "%*llu total\n", width, static_cast<unsigned long long>(total));
+            output.out(line);
+        }
+        return true;
+    }
+
+    static bool builtinHead(const std::string& cwd, const std::vector<std::string>& argv,
+                            BuiltinOutput& output, int32_t& exit_code)
+    {
+        uint64_t count = 10;
+        size_t first = 1;
+        if (first < argv.size() && argv[first] == "-n") {
+            if (first + 1 >= argv.size() || !parseCount(argv[first + 1].c_str(), count)) return false;
+            first += 2;
+        } else if (first < argv.size() && argv[first].compare(0, 2, "-n") == 0) {
+            if (!parseCount(argv[first].c_str() + 2, count)) return false;
+            ++first;
+        } else if (first < argv.size() && isOption(argv[first])) {
+            if (!parseCount(argv[first].c_str() + 1, count)) return false;
+            ++first;
+        }
+        if (first == argv.size()) return false;                 // would read stdin
+        for (size_t i = first; i < argv.size(); ++i) {
+            std::string path = resolvePath(cwd, argv[i]).string();
+            if (argv[i][0] == '-' || !isRegularFile(path) || ::access(path.c_str(), R_OK) != 0)
+                return false;
+        }
+
+        exit_code = 0;
+        const bool headers = argv.size() - first > 1;
+        std::vector<char> buffer(64 * 1024);
+        for (size_t i = first; i < argv.size(); ++i) {
+            if (headers)
+                output.out((i == first ? "==> " : "\n==> ") + argv[i] + " <==\n");
+
+            int fd = ::open(resolvePath(cwd, argv[i]).c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                output.err(errnoMessage("head", "cannot open '" + argv[i] + "' for reading", errno));
+                exit_code = 1;
+                continue;
+            }
+            uint64_t remaining = count;
+            ssize_t n;
+            while (remaining > 0 && (n = ::read(fd, buffer.data(), buffer.size())) > 0) {
+                ssize_t end = 0;
+                while (end < n && remaining > 0) {
+                    if (buffer[end++] == '\n') --remaining;
+                }
+                output.out(buffer.data(), static_cast<size_t>(end));
+            }
+            ::close(fd);
+        }
+        return true;
+    }
+
+    static bool builtinEcho(const std::vector<std::string>& argv, BuiltinOutput& output, int32_t& exit_code)
+    {
+        if (argv.size() > 1 && argv[1][0] == '-') return false;     // -n / -e differ between shells
+
+        std::string text;
+        for (size_t i = 1; i < argv.size(); ++i) {
+            if (i > 1) text.push_back(' ');
+            text += argv[i];
+        }
+        text.push_back('\n');
+        output.out(text);
+        exit_code = 0;
+        return true;
+    }
+
+    // -------------------------------------------------------------------------
+    // runBuiltinCommand
+    // -------------------------------------------------------------------------
+
+    bool runBuiltinCommand(const std::string& cwd, const char* cmd, RemoteProcess& process, int32_t& exit_code)
+    {
+        std::vector<std::string> argv;
+        if (!cmd || !splitPlainCommand(cmd, argv)) return false;
+
+        const std::string& name = argv[0];
+        if (name == "true")  { exit_code = 0; return true; }
+        if (name == "false") { exit_code = 1; return true; }
+        if (name == "test" || name == "[")
+            return builtinTest(cwd, argv, exit_code);
+
+        static const bool untranslated = messagesAreUntranslated();
+        if (!untranslated) return false;
+
+        BuiltinOutput output(process);
+        if (name == "cat")   return builtinCat(cwd, argv, output, exit_code);
+        if (name == "rm")    return builtinRm(cwd, argv, output, exit_code);
+        if (name == "touch") return builtinTouch(cwd, argv, output, exit_code);
+        if (name == "mkdir") return builtinMkdir(cwd, argv, output, exit_code);
+        if (name == "wc")    return builtinWc(cwd, argv, output, exit_code);
+        if (name == "head")  return builtinHead(cwd, argv, output, exit_code);
+        if (name == "echo")  return builtinEcho(argv, output, exit_code);
+        return false;
+    }
+
+#endif
+
+} // namespace Bn3Monkey
@@ -0,0 +1,33 @@
+#if !defined(__REMOTE_COMMAND_SERVER_BUILTIN__)
+#define __REMOTE_COMMAND_SERVER_BUILTIN__
+
+#include "remote_command_server_process.hpp"
+#include <cstdint>
+#include <string>
+
+namespace Bn3Monkey
+{
+    // -------------------------------------------------------------------------
+    // Built-in commands
+    //
+    // RUN_COMMAND normally pays for fork + /bin/sh + the utility.  For a
+    // handful of hot micro-commands written as plain argv (no quoting,
+    // globbing, variables, redirection or pipes), the same work is done
+    // in-process with the coreutils output and exit code:
+    //
+    //   cat FILE...            rm [-f] [-r] FILE...     touch FILE...
+    //   mkdir [-p] DIR...      test / [ -e|-f|-d|-s|-r|-w|-x|-L|-h PATH ]
+    //   wc -l FILE...          head [-n N | -N] FILE... echo WORD...
+    //   true                   false
+    //
+    // Anything else - other options, stdin input, non-regular files for
+    // wc / head, '.', '..' or '/' for rm - is left to the shell.  POSIX only.
+    // -------------------------------------------------------------------------
+
+    // Returns false without side effects when cmd is not a supported
+    // built-in; the caller then runs it through the shell.  Otherwise output
+    // goes to the stream socket through process and exit_code is set.
+    bool runBuiltinCommand(const std::string& cwd, const char* cmd, RemoteProcess& process, int32_t& exit_code);
+}
+
+#endif // __REMOTE_COMMAND_SERVER_BUILTIN__
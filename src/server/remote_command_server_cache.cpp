@@ -0,0 +1,318 @@
+#include "remote_command_server_cache.hpp"
+#include "remote_command_server_filesystem.hpp"
+#include "remote_command_server_sha256.hpp"
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace Bn3Monkey
+{
+    // Bumped whenever the key or manifest layout changes
+    static constexpr const char* CACHE_FORMAT = "remote-command-cache 1";
+
+    static bool splitList(const std::string& list, std::vector<std::string>& out)
+    {
+        out.clear();
+        if (!list.empty() && list.back() != '\0') return false;
+        for (size_t pos = 0; pos < list.size(); ) {
+            std::string entry(list.c_str() + pos);
+            pos += entry.size() + 1;
+            if (entry.empty()) return false;
+            out.push_back(std::move(entry));
+        }
+        return true;
+    }
+
+    bool parseCachedCommand(const std::string& command, const std::string& environment,
+                            const std::string& inputs, const std::string& outputs,
+                            CachedCommand& out)
+    {
+        out = CachedCommand();
+        if (command.empty()) return false;
+        out.command = command;
+        return splitList(environment, out.environment) &&
+               splitList(inputs, out.inputs) &&
+               splitList(outputs, out.outputs);
+    }
+
+    static std::string temporaryName()
+    {
+        static thread_local std::mt19937_64 random { std::random_device()() };
+        char name[32];
+        snprintf(name, sizeof(name), ".tmp-%016llx", static_cast<unsigned long long>(random()));
+        return name;
+    }
+
+    // The default store sits in the shared temp directory, where anyone
+    // could have made it first.  Only a directory of ours that nobody else
+    // can write will do; it is created 0700 if missing.
+    static bool isPrivateDirectory(const fs::path& path)
+    {
+#ifdef _WIN32
+        // %TEMP% is already under the user's profile
+        std::error_code ec;
+        fs::create_directories(path, ec);
+        return fs::is_directory(path, ec);
+#else
+        if (mkdir(path.c_str(), 0700) != 0 && errno != EEXIST) return false;
+        struct stat st;
+        if (lstat(path.c_str(), &st) != 0) return false;
+        return S_ISDIR(st.st_mode) && st.st_uid == geteuid() && (st.st_mode & 077) == 0;
+#endif
+    }
+
+    // Objects are named by their SHA-256, which also keeps a manifest from
+    // pointing outside objects/
+    static bool isBlobName(const std::string& name)
+    {
+        return name.size() == 64 && std::all_of(name.begin(), name.end(), [](char c) {
+            return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+        });
+    }
+
+    static bool isIntactBlob(const fs::path& path, const std::string& hash)
+    {
+        std::string actual;
+        return sha256File(path.string(), actual) && actual == hash;
+    }
+
+    void CommandCache::open(const std::string& directory)
+    {
+        if (!directory.empty()) {
+            _root = directory;
+            return;
+        }
+
+        std::error_code ec;
+#ifdef _WIN32
+        fs::path root = fs::temp_directory_path(ec) / "remote-command-cache";
+#else
+        fs::path root = fs::temp_directory_path(ec) / ("remote-command-cache-" + std::to_string(geteuid()));
+#endif
+        _root = !ec && isPrivateDirectory(root) ? root : fs::path();
+    }
+
+    std::string CommandCache::key(const std::string& cwd, const CachedCommand& command) const
+    {
+        // NUL cannot occur in any field, so it separates them unambiguously
+        Sha256 hash;
+        auto field = [&hash](const std::string& text) {
+            hash.update(text);
+            hash.update("", 1);
+        };
+
+        field(CACHE_FORMAT);
+        field(command.command);
+        field(fs::path(cwd).lexically_normal().string());
+
+        std::vector<std::string> environment = command.environment;
+        std::sort(environment.begin(), environment.end());
+        field("environment");
+        for (const std::string& entry : environment)
+            field(entry);
+
+        std::vector<std::string> inputs;
+        for (const std::string& entry : command.inputs) {
+            if (isGlobPattern(entry)) {
+                std::vector<std::string> matches = expandGlobAt(cwd, entry);
+                inputs.insert(inputs.end(), matches.begin(), matches.end());
+            } else {
+                inputs.push_back(entry);
+            }
+        }
+        std::sort(inputs.begin(), inputs.end());
+        inputs.erase(std::unique(inputs.begin(), inputs.end()), inputs.end());
+        field("inputs");
+        for (const std::string& input : inputs) {
+            std::string content;
+            if (!sha256File(resolvePath(cwd, input).string(), content))
+                content = "-";     // missing or unreadable; creating it changes the key
+            field(input);
+            field(content);
+        }
+
+        field("outputs");
+        for (const std::string& output : command.outputs)
+            field(output);
+        return hash.hexDigest();
+    }
+
+    bool CommandCache::restore(const std::string& key, const std::string& cwd,
+                               const CachedCommand& command, CachedResult& result) const
+    {
+        if (_root.empty()) return false;
+        std::ifstream manifest(_root / "actions" / key);
+        if (!manifest) return false;
+
+        struct Restored
+        {
+            std::string hash;
+            unsigned    perms { 0 };
+            std::string path;
+        };
+        std::vector<Restored> files;
+        std::string output_hash, error_hash, line;
+        int32_t exit_code = -1;
+        while (std::getline(manifest, line)) {
+            std::istringstream fields(line);
+            std::string tag;
+            fields >> tag;
+            if (tag == "exit") {
+                fields >> exit_code;
+            } else if (tag == "stdout") {
+                fields >> output_hash;
+            } else if (tag == "stderr") {
+                fields >> error_hash;
+            } else if (tag == "file") {
+                Restored file;
+                fields >> file.hash >> std::oct >> file.perms;
+                fields.get();
+                std::getline(fields, file.path);
+                files.push_back(std::move(file));
+            }
+        }
+        if (!isBlobName(output_hash) || !isBlobName(error_hash) || files.size() != command.outputs.size())
+            return false;
+        for (size_t i = 0; i < files.size(); ++i) {
+            if (!isBlobName(files[i].hash) || files[i].path != command.outputs[i]) return false;
+        }
+
+        // Blobs are checked against their names, so a damaged or planted one
+        // is a miss rather than a wrong result
+        const fs::path objects = _root / "objects";
+        auto readBlob = [&objects](const std::string& hash, std::string& data) -> bool {
+            std::ifstream blob(objects / hash, std::ios::binary);
+            if (!blob) return false;
+            data.assign((std::istreambuf_iterator<char>(blob)), std::istreambuf_iterator<char>());
+            Sha256 sha;
+            sha.update(data);
+            return sha.hexDigest() == hash;
+        };
+        CachedResult restored;
+        restored.exit_code = exit_code;
+        if (!readBlob(output_hash, restored.output) || !readBlob(error_hash, restored.error))
+            return false;
+
+        // Every file is copied next to its target and checked before any
+        // target is overwritten
+        std::error_code ec;
+        std::vector<fs::path> temporaries;
+        auto discard = [&temporaries, &ec]() {
+            for (const fs::path& temporary : temporaries)
+                fs::remove(temporary, ec);
+            return false;
+        };
+        for (const Restored& file : files) {
+            fs::path target = resolvePath(cwd, file.path);
+            fs::create_directories(target.parent_path(), ec);
+            fs::path temporary = target;
+            temporary += temporaryName();
+            temporaries.push_back(temporary);
+            fs::copy_file(objects / file.hash, temporary, ec);
+            if (ec || !isIntactBlob(temporary, file.hash)) return discard();
+            fs::permissions(temporary, static_cast<fs::perms>(file.perms), ec);
+        }
+        for (size_t i = 0; i < files.size(); ++i) {
+            fs::rename(temporaries[i], resolvePath(cwd, files[i].path), ec);
+            if (ec) return discard();
+        }
+        result = std::move(restored);
+        return true;
+    }
+
+    bool CommandCache::store(const std::string& key, const std::string& cwd,
+                             const CachedCommand& command, const CachedResult& result) const
+    {
+        if (_root.empty()) return false;
+        std::string output_hash, error_hash;
+        if (!storeBlob(result.output, output_hash) || !storeBlob(result.error, error_hash))
+            return false;
+
+        std::ostringstream manifest;
+        manifest << "exit " << result.exit_code << "\n"
+                 << "stdout " << output_hash << "\n"
+                 << "stderr " << error_hash << "\n";
+        for (const std::string& output : command.outputs) {
+            if (output.find('\n') != std::string::npos) return false;
+
+            std::error_code ec;
+            fs::path path = resolvePath(cwd, output);
+            fs::file_status status = fs::status(path, ec);
+            if (ec || !fs::is_regular_file(status)) return false;
+
+            std::string hash;
+            if (!storeFileBlob(path, hash)) return false;
+            manifest << "file " << hash << " " << std::oct << static_cast<unsigned>(status.permissions())
+                     << std::dec << " " << output << "\n";
+        }
+        return writeAtomically(_root / "actions" / key, manifest.str());
+    }
+
+    bool CommandCache::storeBlob(const std::string& data, std::string& hash) const
+    {
+        Sha256 sha;
+        sha.update(data);
+        hash = sha.hexDigest();
+
+        std::error_code ec;
+        fs::path path = _root / "objects" / hash;
+        if (fs::exists(path, ec) && isIntactBlob(path, hash)) return true;
+        return writeAtomically(path, data);
+    }
+
+    bool CommandCache::storeFileBlob(const fs::path& source, std::string& hash) const
+    {
+        if (!sha256File(source.string(), hash)) return false;
+
+        std::error_code ec;
+        fs::path path = _root / "objects" / hash;
+        if (fs::exists(path, ec) && isIntactBlob(path, hash)) return true;
+
+        fs::create_directories(path.parent_path(), ec);
+        fs::path temporary = path;
+        temporary += temporaryName();
+        fs::copy_file(source, temporary, ec);
+        if (!ec) fs::rename(temporary, path, ec);
+        if (ec) {
+            fs::remove(temporary, ec);
+            return false;
+        }
+        return true;
+    }
+
+    bool CommandCache::writeAtomically(const fs::path& path, const std::string& data) const
+    {
+        std::error_code ec;
+        fs::create_directories(path.parent_path(), ec);
+        fs::path temporary = path;
+        temporary += temporaryName();
+        {
+            std::ofstream file(temporary, std::ios::binary);
+            if (!file) return false;
+            file.write(data.data(), static_cast<std::streamsize>(data.size()));
+            if (!file) {
+                file.close();
+                fs::remove(temporary, ec);
+                return false;
+            }
+        }
+        fs::rename(temporary, path, ec);
+        if (ec) {
+            fs::remove(temporary, ec);
+            return false;
+        }
+        return true;
+    }
+
+} // namespace Bn3Monkey
@@ -0,0 +1,76 @@
+#if !defined(__REMOTE_COMMAND_SERVER_CACHE__)
+#define __REMOTE_COMMAND_SERVER_CACHE__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <filesystem>
+
+namespace Bn3Monkey
+{
+    // -------------------------------------------------------------------------
+    // Command result cache (INSTRUCTION_RUN_CACHED)
+    //
+    // A content-addressed store shared by every session of a server:
+    //   objects/<sha256>  file contents and captured output
+    //   actions/<sha256>  one manifest per key: exit code, output blobs and
+    //                     the declared output files
+    // Files are written under a temporary name and renamed into place, so
+    // concurrent sessions (or servers) sharing the directory never see a
+    // partial entry.  Every blob is checked against its hash before it is
+    // restored.  Nothing is ever evicted; deleting the directory is the way
+    // to clear it.
+    // -------------------------------------------------------------------------
+    struct CachedCommand
+    {
+        std::string              command;
+        std::vector<std::string> environment;   // "NAME=value"
+        std::vector<std::string> inputs;        // relative to cwd; globs allowed
+        std::vector<std::string> outputs;       // relative to cwd
+    };
+
+    // Decodes the RUN_CACHED payloads; false if they are malformed.
+    bool parseCachedCommand(const std::string& command, const std::string& environment,
+                            const std::string& inputs, const std::string& outputs,
+                            CachedCommand& out);
+
+    struct CachedResult
+    {
+        int32_t     exit_code { -1 };
+        std::string output;
+        std::string error;
+    };
+
+    class CommandCache
+    {
+    public:
+        // directory: root of the store, created when the first entry is
+        // written.  Empty = <temp directory>/remote-command-cache-<uid>,
+        // created 0700; if it exists but is not ours alone the cache is off
+        // (every run is a miss and nothing is stored).
+        void open(const std::string& directory);
+
+        // Hashes everything the result may depend on, inputs included.
+        std::string key(const std::string& cwd, const CachedCommand& command) const;
+
+        // On a hit, writes the declared outputs back under cwd and fills
+        // result.  A manifest whose blobs have gone or no longer match their
+        // hash counts as a miss.
+        bool restore(const std::string& key, const std::string& cwd,
+                     const CachedCommand& command, CachedResult& result) const;
+
+        // Records a finished run.  False (nothing stored) if a declared output
+        // is missing or the store cannot be written.
+        bool store(const std::string& key, const std::string& cwd,
+                   const CachedCommand& command, const CachedResult& result) const;
+
+    private:
+        bool storeBlob(const std::string& data, std::string& hash) const;
+        bool storeFileBlob(const std::filesystem::path& path, std::string& hash) const;
+        bool writeAtomically(const std::filesystem::path& path, const std::string& data) const;
+
+        std::filesystem::path _root;
+    };
+}
+
+#endif // __REMOTE_COMMAND_SERVER_CACHE__
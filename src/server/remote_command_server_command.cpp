@@ -1,5 +1,11 @@
 #include "remote_command_server_command.hpp"
+#include "remote_command_server_filesystem.hpp"
+#include "remote_command_server_progress.hpp"
+#include "remote_command_server_builtin.hpp"
+#include "remote_command_server_map.hpp"
+#include "remote_command_server_script.hpp"
 #include "remote_command_server_helper.hpp"
+#include "remote_command_server_trace.hpp"
 #include "../protocol/remote_command_protocol.hpp"
 
 #ifdef _WIN32
@@ -14,34 +20,159 @@
 #  include <arpa/inet.h>
 #endif
 
+#include <algorithm>
 #include <filesystem>
-#include <fstream>
 #include <vector>
 #include <cstring>
+#include <mutex>
 
 namespace fs = std::filesystem;
 
 namespace Bn3Monkey
 {
+    // Floor for WATCH_RESOURCES intervals
+    static constexpr uint32_t MIN_SAMPLE_INTERVAL_MS = 50;
+
+    // -------------------------------------------------------------------------
+    // submitOperation  –  run a slow filesystem instruction on the worker pool
+    // -------------------------------------------------------------------------
+
+    bool CommandServer::submitOperation(Session& session, const std::string& operation,
+                                        std::string p0, std::string p1)
+    {
+        RemoteCommandOperationInner inner;
+        if (operation.size() != sizeof(inner)) return false;
+        memcpy(&inner, operation.data(), sizeof(inner));
+
+        switch (inner.instruction) {
+        case RemoteCommandInstruction::INSTRUCTION_COPY_DIRECTORY:
+        case RemoteCommandInstruction::INSTRUCTION_REMOVE_DIRECTORY:
+        case RemoteCommandInstruction::INSTRUCTION_UPLOAD_FILE:
+        case RemoteCommandInstruction::INSTRUCTION_DOWNLOAD_FILE:
+            break;
+        default:
+            return false;
+        }
+
+        // The job gets its own copy of the cwd: the handler keeps serving
+        // (and may move the session's cwd) while it runs.
+        return _workers.submit(
+            [session = session.shared_from_this(), inner, cwd = session.current_directory,
+             p0 = std::move(p0), p1 = std::move(p1), interval_ms = _options.progress_interval_ms]()
+        {
+            std::vector<char> result(sizeof(inner));
+            memcpy(result.data(), &inner, sizeof(inner));
+
+            OperationProgress reporter(session->process, inner.operation_id, interval_ms);
+            FilesystemProgressCallback progress = reporter.callback();
+
+            switch (inner.instruction) {
+            case RemoteCommandInstruction::INSTRUCTION_COPY_DIRECTORY:
+                result.push_back(copyDirectoryAt(cwd, p0, p1, progress) ? 1 : 0);
+                break;
+            case RemoteCommandInstruction::INSTRUCTION_REMOVE_DIRECTORY:
+                result.push_back(removeDirectoryAt(cwd, p0, progress) ? 1 : 0);
+                break;
+            case RemoteCommandInstruction::INSTRUCTION_UPLOAD_FILE:
+                result.push_back(uploadFileAt(cwd, p0, p1, progress) ? 1 : 0);
+                break;
+            case RemoteCommandInstruction::INSTRUCTION_DOWNLOAD_FILE:
+            {
+                std::vector<char> data;
+                bool ok = downloadFileAt(cwd, p0, data, progress);
+                result.push_back(ok ? 1 : 0);
+                result.insert(result.end(), data.begin(), data.end());
+                break;
+            }
+            default:
+                break;
+            }
+            reporter.flush();
+
+            // Dropped if the client has gone meanwhile
+            session->process.sendStreamFrame(RemoteCommandStreamType::STREAM_OPERATION,
+                                             result.data(), static_cast<uint32_t>(result.size()));
+        });
+    }
+
+    // -------------------------------------------------------------------------
+    // invokeUserInstruction  –  run a registered handler on the session thread
     // -------------------------------------------------------------------------
-    // Helper: resolve a path relative to cwd
+
+    void CommandServer::invokeUserInstruction(Session& session, ResponseWriter& out, int32_t instruction,
+                                              std::string* payloads)
+    {
+        // The session answers in order and would only wait for a worker
+        // anyway; running here keeps slow handlers from holding up the
+        // asynchronous transfers queued on the pool.
+        RemoteInstructionResponse response;
+        bool result = false;
+        if (InstructionRegistry::Handler handler = _instructions.find(instruction)) {
+            try {
+                result = (*handler)(RemoteInstructionRequest(instruction, session.id(), payloads), response);
+            } catch (...) {
+                // An embedder's exception must not take the session down
+                result = false;
+            }
+        }
+
+        const std::string& data = response.data();
+        RemoteCommandResponseHeader resp(static_cast<RemoteCommandInstruction>(instruction),
+                                         static_cast<uint32_t>(sizeof(bool) + data.size()));
+        out.send(&resp, sizeof(resp));
+        out.send(&result, sizeof(bool));
+        if (!data.empty())
+            out.send(data.data(), data.size());
+    }
+
     // -------------------------------------------------------------------------
-    static fs::path resolvePath(const std::string& cwd, const std::string& p)
+    // Metrics helpers
+    // -------------------------------------------------------------------------
+
+    bool CommandServer::acquireJobSlot(Session& session, uint32_t& queued_ms)
+    {
+        if (!_scheduler.acquire(session.job, session.job_priority, queued_ms)) return false;
+        _metrics.recordJobQueue(static_cast<uint64_t>(queued_ms) * 1000);
+        return true;
+    }
+
+    // Runs job in the session's job slot, waiting for one first unless an
+    // open process already holds it.  False when the wait was cut short.
+    bool CommandServer::runAsJob(Session& session, const std::function<void()>& job)
+    {
+        uint32_t queued_ms = 0;
+        if (!session.process.is_running() && !acquireJobSlot(session, queued_ms))
+            return false;
+        job();
+        if (!session.process.is_running())
+            _scheduler.release(session.job);
+        return true;
+    }
+
+    ServerMetrics::Gauges CommandServer::gauges()
     {
-        fs::path fp(p);
-        return fp.is_absolute() ? fp : fs::path(cwd) / fp;
+        ServerMetrics::Gauges gauges;
+        gauges.sessions_active   = static_cast<uint32_t>(_sessions.active());
+        gauges.operations_queued = static_cast<uint32_t>(_workers.queued());
+        _scheduler.depth(gauges.jobs_running, gauges.jobs_waiting);
+        return gauges;
     }
 
     // -------------------------------------------------------------------------
-    // handleCommand  –  serve one connected client until it disconnects
+    // handleCommand  –  serve one session until its client disconnects
     // -------------------------------------------------------------------------
 
-    void CommandServer::handleCommand(sock_t client_sock)
+    void CommandServer::handleCommand(Session& session)
     {
+        sock_t client_sock = session.commandSocket();
+
         while (_running.load()) {
             RemoteCommandRequestHeader req(RemoteCommandInstruction::INSTRUCTION_EMPTY);
             if (!recvAll(client_sock, &req, sizeof(req))) break;
             if (!req.valid()) break;
+            session.heartbeat.touch();
+            const auto received = std::chrono::steady_clock::now();
+            TraceScope trace("handleCommand", "instruction", static_cast<int64_t>(req.instruction));
 
             std::string p0(req.payload_0_length, '\0');
             std::string p1(req.payload_1_length, '\0');
@@ -53,48 +184,94 @@ namespace Bn3Monkey
             if (req.payload_2_length > 0 && !recvAll(client_sock, p2.data(), req.payload_2_length)) break;
             if (req.payload_3_length > 0 && !recvAll(client_sock, p3.data(), req.payload_3_length)) break;
 
+            const auto executing = std::chrono::steady_clock::now();
+            _recorder.record(session.id(), req, received, elapsedMicroseconds(received, executing), p0, p1, p2, p3);
+            const uint64_t request_bytes = sizeof(req) + static_cast<uint64_t>(req.payload_0_length) +
+                                           req.payload_1_length + req.payload_2_length + req.payload_3_length;
+            ResponseWriter out(client_sock);
+
             switch (req.instruction)
             {
             // -----------------------------------------------------------------
+            case RemoteCommandInstruction::INSTRUCTION_SESSION_ID:
+            {
+                uint32_t id = session.id();
+                session.markTokenIssued();
+                RemoteCommandResponseHeader resp(req.instruction,
+                                                 static_cast<uint32_t>(sizeof(id) + sizeof(session.token())));
+                out.send(&resp, sizeof(resp));
+                out.send(&id, sizeof(id));
+                out.send(&session.token(), sizeof(session.token()));
+                break;
+            }
+            // -----------------------------------------------------------------
+            case RemoteCommandInstruction::INSTRUCTION_GET_STATS:
+            {
+                std::string stats = _metrics.snapshot(gauges());
+                RemoteCommandResponseHeader resp(req.instruction, static_cast<uint32_t>(stats.size()));
+                out.send(&resp, sizeof(resp));
+                out.send(stats.data(), stats.size());
+                break;
+            }
+            // -----------------------------------------------------------------
+            case RemoteCommandInstruction::INSTRUCTION_TRACE:
+            {
+                int32_t action = -1;
+                if (p0.size() == sizeof(action)) memcpy(&action, p0.data(), sizeof(action));
+                bool ok = true;
+                std::string json;
+                switch (static_cast<RemoteCommandTraceAction>(action)) {
+                case RemoteCommandTraceAction::TRACE_STOP:  ServerTrace::stop();  break;
+                case RemoteCommandTraceAction::TRACE_START: ServerTrace::start(); break;
+                case RemoteCommandTraceAction::TRACE_FETCH: json = ServerTrace::chromeJson(); break;
+                default: ok = false; break;
+                }
+                RemoteCommandResponseHeader resp(req.instruction, static_cast<uint32_t>(sizeof(ok) + json.size()));
+                out.send(&resp, sizeof(resp));
+                out.send(&ok, sizeof(ok));
+                if (!json.empty()) out.send(json.data(), json.size());
+                break;
+            }
+            // -----------------------------------------------------------------
             case RemoteCommandInstruction::INSTRUCTION_CURRENT_WORKING_DIRECTORY:
             {
-                const std::string& cwd = _current_directory;
+                const std::string& cwd = session.current_directory;
                 RemoteCommandResponseHeader resp(req.instruction,
                     static_cast<uint32_t>(cwd.size()));
-                sendAll(client_sock, &resp, sizeof(resp));
-                sendAll(client_sock, cwd.c_str(), cwd.size());
+                out.send(&resp, sizeof(resp));
+                out.send(cwd.c_str(), cwd.size());
                 break;
             }
             // -----------------------------------------------------------------
             case RemoteCommandInstruction::INSTRUCTION_MOVE_CURRENT_WORKING_DIRECTORY:
             {
                 std::error_code ec;
-                fs::path target = resolvePath(_current_directory, p0);
+                fs::path target = resolvePath(session.current_directory, p0);
                 bool result = false;
                 if (fs::exists(target, ec) && fs::is_directory(target, ec)) {
-                    _current_directory = target.string();
+                    session.current_directory = target.string();
                     result = true;
                 }
                 RemoteCommandResponseHeader resp(req.instruction, sizeof(bool));
-                sendAll(client_sock, &resp, sizeof(resp));
-                sendAll(client_sock, &result, sizeof(result));
+                out.send(&resp, sizeof(resp));
+                out.send(&result, sizeof(result));
                 break;
             }
             // -----------------------------------------------------------------
             case RemoteCommandInstruction::INSTRUCTION_DIRECTORY_EXISTS:
             {
                 std::error_code ec;
-                fs::path target = resolvePath(_current_directory, p0);
+                fs::path target = resolvePath(session.current_directory, p0);
                 bool result = fs::exists(target, ec) && fs::is_directory(target, ec);
                 RemoteCommandResponseHeader resp(req.instruction, sizeof(bool));
-                sendAll(client_sock, &resp, sizeof(resp));
-                sendAll(client_sock, &result, sizeof(result));
+                out.send(&resp, sizeof(resp));
+                out.send(&result, sizeof(result));
                 break;
             }
             // -----------------------------------------------------------------
             case RemoteCommandInstruction::INSTRUCTION_LIST_DIRECTORY_CONTENTS:
             {
-                fs::path target = resolvePath(_current_directory, p0.empty() ? "." : p0);
+                fs::path target = resolvePath(session.current_directory, p0.empty() ? "." : p0);
                 std::vector<RemoteDirectoryContentInner> contents;
                 std::error_code ec;
                 for (const auto& entry : fs::directory_iterator(target, ec)) {
@@ -108,81 +285,261 @@ namespace Bn3Monkey
                 uint32_t payload_len = sizeof(uint32_t) +
                     count * static_cast<uint32_t>(sizeof(RemoteDirectoryContentInner));
                 RemoteCommandResponseHeader resp(req.instruction, payload_len);
-                sendAll(client_sock, &resp, sizeof(resp));
-                sendAll(client_sock, &count, sizeof(count));
+                out.send(&resp, sizeof(resp));
+                out.send(&count, sizeof(count));
                 if (count > 0)
-                    sendAll(client_sock, contents.data(), count * sizeof(RemoteDirectoryContentInner));
+                    out.send(contents.data(), count * sizeof(RemoteDirectoryContentInner));
                 break;
             }
             // -----------------------------------------------------------------
             case RemoteCommandInstruction::INSTRUCTION_CREATE_DIRECTORY:
             {
                 std::error_code ec;
-                fs::path target = resolvePath(_current_directory, p0);
+                fs::path target = resolvePath(session.current_directory, p0);
                 bool result = fs::create_directories(target, ec);
                 RemoteCommandResponseHeader resp(req.instruction, sizeof(bool));
-                sendAll(client_sock, &resp, sizeof(resp));
-                sendAll(client_sock, &result, sizeof(result));
+                out.send(&resp, sizeof(resp));
+                out.send(&result, sizeof(result));
                 break;
             }
             // -----------------------------------------------------------------
             case RemoteCommandInstruction::INSTRUCTION_REMOVE_DIRECTORY:
             {
-                std::error_code ec;
-                fs::path target = resolvePath(_current_directory, p0);
-                bool result = (fs::remove_all(target, ec) > 0) && !ec;
+                bool result = removeDirectoryAt(session.current_directory, p0);
                 RemoteCommandResponseHeader resp(req.instruction, sizeof(bool));
-                sendAll(client_sock, &resp, sizeof(resp));
-                sendAll(client_sock, &result, sizeof(result));
+                out.send(&resp, sizeof(resp));
+                out.send(&result, sizeof(result));
                 break;
             }
             // -----------------------------------------------------------------
             case RemoteCommandInstruction::INSTRUCTION_COPY_DIRECTORY:
             {
-                std::error_code ec;
-                fs::path from = resolvePath(_current_directory, p0);
-                fs::path to   = resolvePath(_current_directory, p1);
-                fs::copy(from, to, fs::copy_options::recursive, ec);
-                bool result = !ec;
+                bool result = copyDirectoryAt(session.current_directory, p0, p1);
                 RemoteCommandResponseHeader resp(req.instruction, sizeof(bool));
-                sendAll(client_sock, &resp, sizeof(resp));
-                sendAll(client_sock, &result, sizeof(result));
+                out.send(&resp, sizeof(resp));
+                out.send(&result, sizeof(result));
                 break;
             }
             // -----------------------------------------------------------------
             case RemoteCommandInstruction::INSTRUCTION_MOVE_DIRECTORY:
             {
                 std::error_code ec;
-                fs::path from = resolvePath(_current_directory, p0);
-                fs::path to   = resolvePath(_current_directory, p1);
+                fs::path from = resolvePath(session.current_directory, p0);
+                fs::path to   = resolvePath(session.current_directory, p1);
                 fs::rename(from, to, ec);
                 bool result = !ec;
                 RemoteCommandResponseHeader resp(req.instruction, sizeof(bool));
-                sendAll(client_sock, &resp, sizeof(resp));
-                sendAll(client_sock, &result, sizeof(result));
+                out.send(&resp, sizeof(resp));
+                out.send(&result, sizeof(result));
                 break;
             }
             // -----------------------------------------------------------------
             case RemoteCommandInstruction::INSTRUCTION_RUN_COMMAND:
             {
-                // execute() starts the process + reader threads (stream via RemoteProcess)
-                int32_t pid = _remote_process.execute(_current_directory.c_str(), p0.c_str());
-                if (pid != -1)
-                    _remote_process.await(pid);   // blocks until done + all output flushed
+                // Plain micro-commands (cat, rm -f, ...) skip fork + shell.  Not
+                // while a process is open: the shell path would refuse too.
+                // Interpreter commands go to a warm zygote when one is idle.
+                // Neither when the session set launch options of its own.
+                std::shared_ptr<const LaunchOptions> launch = session.process.launchOptions();
+                const bool shortcuts = !session.process.is_running() && (!launch || !launch->custom);
+                uint32_t flags = 0;
+                if (p1.size() == sizeof(flags)) memcpy(&flags, p1.data(), sizeof(flags));
+                RunTimeline& timeline = session.process.timeline();
+                timeline.reset();
+                int64_t scheduled = 0;
+
+                RemoteCommandJobReplyInner reply;
+                bool builtin = _options.builtin_commands && shortcuts &&
+                               runBuiltinCommand(session.current_directory, p0.c_str(),
+                                                 session.process, reply.value);
+                if (builtin) {
+                    timeline.mark(timeline.exited);
+                    timeline.mark(timeline.drained);
+                }
+                // Anything else is a job and may have to wait for a slot.
+                // With a process open, execute() refuses at once anyway.
+                if (!builtin && (session.process.is_running() ||
+                                 acquireJobSlot(session, reply.queued_ms))) {
+                    scheduled = RunTimeline::ticks();
+                    bool warm = shortcuts &&
+                                _zygotes.run(session.current_directory, p0.c_str(), session.process,
+                                             session.zygote_job, reply.value);
+                    if (!warm) {
+                        // execute() starts the process + reader threads (stream via RemoteProcess)
+                        int32_t pid = session.process.execute(session.current_directory.c_str(), p0.c_str());
+                        if (pid != -1)
+                            reply.value = session.process.await(pid);   // blocks until done + all output flushed
+                    }
+                    if (!session.process.is_running())
+                        _scheduler.release(session.job);
+                }
 
-                RemoteCommandResponseHeader resp(req.instruction, 0);
-                sendAll(client_sock, &resp, sizeof(resp));
+                if (!(flags & RUN_COMMAND_TIMING)) {
+                    RemoteCommandResponseHeader resp(req.instruction, sizeof(reply));
+                    out.send(&resp, sizeof(resp));
+                    out.send(&reply, sizeof(reply));
+                    break;
+                }
+
+                const int64_t origin = RunTimeline::ticks(received);
+                auto offset = [origin](int64_t ticks) -> int64_t {
+                    return ticks ? (ticks - origin) / 1000 : -1;
+                };
+                RemoteCommandRunTimingInner timing;
+                timing.received_us     = offset(RunTimeline::ticks(executing));
+                timing.scheduled_us    = offset(scheduled);
+                timing.spawned_us      = offset(timeline.spawned.load(std::memory_order_relaxed));
+                timing.first_output_us = offset(timeline.first_output.load(std::memory_order_relaxed));
+                timing.exited_us       = offset(timeline.exited.load(std::memory_order_relaxed));
+                timing.drained_us      = offset(timeline.drained.load(std::memory_order_relaxed));
+                timing.replied_us      = offset(RunTimeline::ticks());
+
+                RemoteCommandResponseHeader resp(req.instruction, sizeof(reply) + sizeof(timing));
+                out.send(&resp, sizeof(resp));
+                out.send(&reply, sizeof(reply));
+                out.send(&timing, sizeof(timing));
+                break;
+            }
+            // -----------------------------------------------------------------
+            case RemoteCommandInstruction::INSTRUCTION_RUN_GRAPH:
+            {
+                // Blocks like RUN_COMMAND; a rejected graph gets an empty reply
+                std::vector<GraphNode> nodes;
+                int32_t max_parallel = 0;
+                std::vector<RemoteCommandNodeResultInner> results;
+                if (parseCommandGraph(p0, p1, p2, p3, nodes, max_parallel))
+                    runAsJob(session, [&]() {
+                        results = session.graph.run(session.current_directory, nodes, max_parallel, &_scheduler);
+                    });
+
+                uint32_t payload_len = static_cast<uint32_t>(results.size() * sizeof(RemoteCommandNodeResultInner));
+                RemoteCommandResponseHeader resp(req.instruction, payload_len);
+                out.send(&resp, sizeof(resp));
+                if (payload_len > 0)
+                    out.send(results.data(), payload_len);
+                break;
+            }
+            // -----------------------------------------------------------------
+            case RemoteCommandInstruction::INSTRUCTION_RUN_CACHED:
+            {
+                // A miss runs the command as a one-node graph to capture its
+                // output; either way the output is sent once it is known.
+                CachedCommand command;
+                RemoteCommandCachedReplyInner reply;
+                if (parseCachedCommand(p0, p1, p2, p3, command)) {
+                    const std::string& cwd = session.current_directory;
+                    std::string key = _cache.key(cwd, command);
+                    CachedResult result;
+                    bool known = true;
+                    if (_cache.restore(key, cwd, command, result)) {
+                        reply.hit = 1;
+                    } else {
+                        GraphNode node;
+                        node.command     = command.command;
+                        node.environment = command.environment;
+                        std::vector<GraphNodeOutput> outputs;
+                        std::vector<RemoteCommandNodeResultInner> results;
+                        known = runAsJob(session, [&]() {
+                            results = session.graph.run(cwd, { node }, 1, &_scheduler, &outputs);
+                        });
+                        if (known) {
+                            result.exit_code = results[0].exit_code;
+                            result.output    = std::move(outputs[0].output);
+                            result.error     = std::move(outputs[0].error);
+
+                            // Failures are not worth keeping, and cut-off output
+                            // could not be replayed faithfully
+                            bool complete = result.output.size() < GraphNodeOutput::MAX_CAPTURED_OUTPUT &&
+                                            result.error.size()  < GraphNodeOutput::MAX_CAPTURED_OUTPUT;
+                            if (results[0].state == RemoteCommandNodeStateInner::SUCCEEDED && complete)
+                                _cache.store(key, cwd, command, result);
+                        }
+                    }
+                    reply.exit_code = known ? result.exit_code : -1;
+
+                    auto replay = [&session](RemoteCommandStreamType type, const std::string& data) {
+                        static constexpr size_t CHUNK = 64 * 1024;
+                        for (size_t pos = 0; pos < data.size(); pos += CHUNK) {
+                            size_t len = std::min(CHUNK, data.size() - pos);
+                            session.process.sendStreamFrame(type, data.data() + pos, static_cast<uint32_t>(len));
+                        }
+                    };
+                    replay(RemoteCommandStreamType::STREAM_OUTPUT, result.output);
+                    replay(RemoteCommandStreamType::STREAM_ERROR, result.error);
+                }
+
+                RemoteCommandResponseHeader resp(req.instruction, sizeof(reply));
+                out.send(&resp, sizeof(resp));
+                out.send(&reply, sizeof(reply));
+                break;
+            }
+            // -----------------------------------------------------------------
+            case RemoteCommandInstruction::INSTRUCTION_MAP_FILES:
+            {
+                // Blocks like RUN_GRAPH; a rejected request gets an empty reply
+                RemoteCommandMapInner map;
+                FileMapPlan plan;
+                std::string reply;
+                if (p0.size() == sizeof(map)) {
+                    memcpy(&map, p0.data(), sizeof(map));
+                    if (planFileMap(session.current_directory, p1, p2, map.batch_size, map.max_parallel, plan)) {
+                        runAsJob(session, [&]() {
+                            std::vector<GraphNodeOutput> outputs;
+                            auto results = session.graph.run(session.current_directory, plan.invocations,
+                                                             map.max_parallel, &_scheduler, &outputs);
+                            reply = encodeFileMapReply(plan, results, outputs);
+                        });
+                    }
+                }
+
+                RemoteCommandResponseHeader resp(req.instruction, static_cast<uint32_t>(reply.size()));
+                out.send(&resp, sizeof(resp));
+                if (!reply.empty())
+                    out.send(reply.data(), reply.size());
+                break;
+            }
+            // -----------------------------------------------------------------
+            case RemoteCommandInstruction::INSTRUCTION_RUN_SCRIPT:
+            {
+                // Blocks like RUN_GRAPH; a rejected script gets an empty reply
+                uint32_t flags = 0;
+                std::vector<std::string> commands;
+                std::vector<RemoteCommandNodeResultInner> results;
+                if (parseCommandScript(p0, p1, flags, commands)) {
+                    bool stop_on_error = (flags & SCRIPT_STOP_ON_ERROR) != 0;
+                    runAsJob(session, [&]() {
+                        if ((flags & SCRIPT_SHARED_SHELL) == 0)
+                            results = session.graph.run(session.current_directory,
+                                                        chainCommandScript(commands, stop_on_error), 1, &_scheduler);
+                        else if (!ScriptShell::supported() ||
+                                 !session.shell.run(session.current_directory, commands, stop_on_error, results))
+                            results.clear();
+                    });
+                }
+
+                uint32_t payload_len = static_cast<uint32_t>(results.size() * sizeof(RemoteCommandNodeResultInner));
+                RemoteCommandResponseHeader resp(req.instruction, payload_len);
+                out.send(&resp, sizeof(resp));
+                if (payload_len > 0)
+                    out.send(results.data(), payload_len);
                 break;
             }
             // -----------------------------------------------------------------
             case RemoteCommandInstruction::INSTRUCTION_OPEN_PROCESS:
             {
-                // int32_t proc_id = _remote_process.execute(_current_directory.c_str(), p0.c_str());
-                int32_t proc_id = _remote_process.executeWithoutPipe(_current_directory.c_str(), p0.c_str());
-                
-                RemoteCommandResponseHeader resp(req.instruction, sizeof(int32_t));
-                sendAll(client_sock, &resp, sizeof(resp));
-                sendAll(client_sock, &proc_id, sizeof(proc_id));
+                // The process keeps its job slot until CLOSE_PROCESS
+                RemoteCommandJobReplyInner reply;
+                if (!session.process.is_running() &&
+                    acquireJobSlot(session, reply.queued_ms)) {
+                    // reply.value = session.process.execute(session.current_directory.c_str(), p0.c_str());
+                    reply.value = session.process.executeWithoutPipe(session.current_directory.c_str(), p0.c_str());
+                    if (reply.value == -1)
+                        _scheduler.release(session.job);
+                }
+
+                RemoteCommandResponseHeader resp(req.instruction, sizeof(reply));
+                out.send(&resp, sizeof(resp));
+                out.send(&reply, sizeof(reply));
                 break;
             }
             // -----------------------------------------------------------------
@@ -193,102 +550,297 @@ namespace Bn3Monkey
                     memcpy(&proc_id, p0.data(), sizeof(int32_t));
 
                 if (proc_id != -1) {
-                    // _remote_process.close(proc_id);
-                    _remote_process.closeWithoutPipe(proc_id);
+                    // session.process.close(proc_id);
+                    session.process.closeWithoutPipe(proc_id);
+                    if (!session.process.is_running())
+                        _scheduler.release(session.job);
                 }
                 RemoteCommandResponseHeader resp(req.instruction, 0);
-                sendAll(client_sock, &resp, sizeof(resp));
+                out.send(&resp, sizeof(resp));
                 break;
             }
             // -----------------------------------------------------------------
             case RemoteCommandInstruction::INSTRUCTION_UPLOAD_FILE:
             {
-                std::error_code ec;
-                fs::path target = resolvePath(_current_directory, p0);
-                fs::create_directories(target.parent_path(), ec);
-
-                bool result = false;
-                std::ofstream file(target, std::ios::binary);
-                if (file.is_open()) {
-                    if (!p1.empty())
-                        file.write(p1.data(), static_cast<std::streamsize>(p1.size()));
-                    result = !file.fail();
-                }
+                bool result = uploadFileAt(session.current_directory, p0, p1);
                 RemoteCommandResponseHeader resp(req.instruction, sizeof(bool));
-                sendAll(client_sock, &resp, sizeof(resp));
-                sendAll(client_sock, &result, sizeof(result));
+                out.send(&resp, sizeof(resp));
+                out.send(&result, sizeof(result));
                 break;
             }
             // -----------------------------------------------------------------
             case RemoteCommandInstruction::INSTRUCTION_DOWNLOAD_FILE:
             {
-                fs::path target = resolvePath(_current_directory, p0);
-                std::ifstream file(target, std::ios::binary);
-                if (!file.is_open()) {
+                std::vector<char> data;
+                if (!downloadFileAt(session.current_directory, p0, data)) {
                     uint8_t fail = 0;
                     RemoteCommandResponseHeader resp(req.instruction, sizeof(fail));
-                    sendAll(client_sock, &resp, sizeof(resp));
-                    sendAll(client_sock, &fail, sizeof(fail));
+                    out.send(&resp, sizeof(resp));
+                    out.send(&fail, sizeof(fail));
                 } else {
-                    std::vector<char> data(
-                        (std::istreambuf_iterator<char>(file)),
-                         std::istreambuf_iterator<char>());
                     uint32_t payload_len = 1u + static_cast<uint32_t>(data.size());
                     RemoteCommandResponseHeader resp(req.instruction, payload_len);
-                    sendAll(client_sock, &resp, sizeof(resp));
+                    out.send(&resp, sizeof(resp));
                     uint8_t ok = 1;
-                    sendAll(client_sock, &ok, sizeof(ok));
+                    out.send(&ok, sizeof(ok));
                     if (!data.empty())
-                        sendAll(client_sock, data.data(), data.size());
+                        out.send(data.data(), data.size());
+                }
+                break;
+            }
+            // -----------------------------------------------------------------
+            case RemoteCommandInstruction::INSTRUCTION_SET_LAUNCH_OPTIONS:
+            {
+                // Takes effect from the session's next spawn; all-default
+                // options go back to the server's own.
+                LaunchOptions launch;
+                std::vector<std::string> limits;
+                bool ok = parseLaunchOptions(p0, p1, p2, launch, limits);
+                if (ok && !limits.empty()) {
+                    std::string cgroup;
+                    if (_options.cgroup_root && _options.cgroup_root[0])
+                        cgroup = prepareLaunchCgroup(_options.cgroup_root, session.id(), limits);
+                    ok = !cgroup.empty();
+                    if (ok) {
+                        session.launch_cgroup = cgroup;
+                        launch.cgroup         = cgroup;
+                        launch.cgroup_procs   = cgroup + "/cgroup.procs";
+                    }
+                }
+                if (ok) {
+                    if (!launch.custom) {
+                        session.process.setLaunchOptions(_default_launch);
+                    } else {
+                        if (launch.cpus.empty())
+                            launch.cpus = _default_launch->cpus;   // still off the reserved cores
+                        session.process.setLaunchOptions(std::make_shared<const LaunchOptions>(std::move(launch)));
+                    }
+                }
+
+                RemoteCommandResponseHeader resp(req.instruction, sizeof(bool));
+                out.send(&resp, sizeof(resp));
+                out.send(&ok, sizeof(ok));
+                break;
+            }
+            // -----------------------------------------------------------------
+            case RemoteCommandInstruction::INSTRUCTION_SET_JOB_PRIORITY:
+            {
+                int32_t priority = -1;
+                if (p0.size() == sizeof(priority))
+                    memcpy(&priority, p0.data(), sizeof(priority));
+                bool ok = priority >= static_cast<int32_t>(RemoteCommandJobPriority::NORMAL) &&
+                          priority <= static_cast<int32_t>(RemoteCommandJobPriority::LOW);
+                if (ok)
+                    session.job_priority = static_cast<RemoteCommandJobPriority>(priority);
+
+                RemoteCommandResponseHeader resp(req.instruction, sizeof(bool));
+                out.send(&resp, sizeof(resp));
+                out.send(&ok, sizeof(ok));
+                break;
+            }
+            // -----------------------------------------------------------------
+            case RemoteCommandInstruction::INSTRUCTION_WATCH_RESOURCES:
+            {
+                uint32_t interval_ms = 0;
+                bool ok = p0.size() == sizeof(interval_ms);
+                if (ok) memcpy(&interval_ms, p0.data(), sizeof(interval_ms));
+#if !defined(__linux__)
+                ok = ok && interval_ms == 0;       // nothing to sample from
+#endif
+                if (ok) {
+                    if (interval_ms == 0) {
+                        session.resources.stop();
+                    } else {
+                        // Walking /proc more often than this costs more than it tells
+                        interval_ms = std::max<uint32_t>(interval_ms, MIN_SAMPLE_INTERVAL_MS);
+                        Session* owner = &session;
+                        session.resources.start(interval_ms, _sampler, session.id(),
+                                                [owner]() { return owner->processGroups(); });
+                    }
                 }
+
+                RemoteCommandResponseHeader resp(req.instruction, sizeof(bool));
+                out.send(&resp, sizeof(resp));
+                out.send(&ok, sizeof(ok));
+                break;
+            }
+            // -----------------------------------------------------------------
+            case RemoteCommandInstruction::INSTRUCTION_LIST_PROCESSES:
+            {
+                std::vector<RemoteCommandResourceInner> groups;
+                for (auto& other : _sessions.live()) {
+                    for (int64_t group : other->processGroups()) {
+                        RemoteCommandResourceInner entry;
+                        entry.session_id    = other->id();
+                        entry.process_group = static_cast<int32_t>(group);
+                        groups.push_back(entry);
+                    }
+                }
+                if (!groups.empty())
+                    _sampler.sample(groups);
+
+                uint32_t payload_len = static_cast<uint32_t>(groups.size() * sizeof(RemoteCommandResourceInner));
+                RemoteCommandResponseHeader resp(req.instruction, payload_len);
+                out.send(&resp, sizeof(resp));
+                if (payload_len > 0)
+                    out.send(groups.data(), payload_len);
+                break;
+            }
+            // -----------------------------------------------------------------
+            case RemoteCommandInstruction::INSTRUCTION_SUBMIT_OPERATION:
+            {
+                bool accepted = submitOperation(session, p0, std::move(p1), std::move(p2));
+                RemoteCommandResponseHeader resp(req.instruction, sizeof(bool));
+                out.send(&resp, sizeof(resp));
+                out.send(&accepted, sizeof(accepted));
                 break;
             }
             // -----------------------------------------------------------------
             default:
+            {
+                int32_t code = static_cast<int32_t>(req.instruction);
+                if (InstructionRegistry::isUserInstruction(code)) {
+                    std::string payloads[] { std::move(p0), std::move(p1), std::move(p2), std::move(p3) };
+                    invokeUserInstruction(session, out, code, payloads);
+                }
                 break;
             }
+            }
+
+            const auto executed = out.started() ? out.firstSend() : std::chrono::steady_clock::now();
+            _metrics.recordRequest(static_cast<int32_t>(req.instruction),
+                                   elapsedMicroseconds(received, executing),
+                                   elapsedMicroseconds(executing, executed),
+                                   out.sendMicroseconds(), request_bytes, out.bytes());
         }
     }
 
     // -------------------------------------------------------------------------
-    // handlerLoop  (runs in _handler thread)
+    // serveSession  (runs in the session's own thread)
     // -------------------------------------------------------------------------
 
-    void CommandServer::handlerLoop()
+    void CommandServer::serveSession(std::shared_ptr<Session> session, sockaddr_in client_addr, int32_t core)
     {
         setCurrentThreadName("RC_CMDH");
+        // Stay on the accepting core; Windows threads do not inherit the mask.
+        if (core >= 0)
+            pinCurrentThreadToCore(core);
+
+        char ip[INET_ADDRSTRLEN] = "?.?.?.?";
+        inet_ntop(AF_INET, &client_addr.sin_addr, ip, sizeof(ip));
+        printf("[Command] Client connected: %s:%d\n", ip, ntohs(client_addr.sin_port));
+        fflush(stdout);
+
+        session->heartbeat.watchCommandSocket(session->commandSocket());
+        handleCommand(*session);
+        _recorder.recordSessionEnd(session->id());
+        session->close();
+        _scheduler.release(session->job);      // an OPEN_PROCESS never closed
+        removeLaunchCgroup(session->launch_cgroup);
+
+        printf("[Command] Client disconnected: %s:%d\n", ip, ntohs(client_addr.sin_port));
+        fflush(stdout);
+    }
 
-        while (_running.load()) {
+    // -------------------------------------------------------------------------
+    // acceptLoop  (runs in one thread per acceptor)
+    // -------------------------------------------------------------------------
+
+    void CommandServer::acceptLoop(Acceptor& acceptor)
+    {
+        char name[16];
+        snprintf(name, sizeof(name), "RC_CMDA%d", acceptor.index);
+        setCurrentThreadName(name);
+        if (acceptor.core >= 0)
+            pinCurrentThreadToCore(acceptor.core);
+
+        while (_running.load() && _accepting.load()) {
             sockaddr_in client_addr {};
-            sock_t client_sock = acceptWithSelect(_server_sock, &client_addr, _running);
+            sock_t client_sock = acceptWithSelect(acceptor.listen_sock, &client_addr, _accepting);
+            _sessions.reap();
             if (client_sock == INVALID_SOCK) break;
 
-            char ip[INET_ADDRSTRLEN] = "?.?.?.?";
-            inet_ntop(AF_INET, &client_addr.sin_addr, ip, sizeof(ip));
-            printf("[Command] Client connected: %s:%d\n", ip, ntohs(client_addr.sin_port));
-            fflush(stdout);
+            applyLivenessOptions(client_sock, _options);
+            setNoDelay(client_sock);
 
-            _client_sock = client_sock;
-            handleCommand(client_sock);
+            auto session = _sessions.create(client_sock, _initial_directory, _options);
+            session->process.setLaunchOptions(_default_launch);
+            session->process.setMetrics(&_metrics);
+            _metrics.recordSessionAccepted();
+            session->thread = std::thread(&CommandServer::serveSession, this,
+                                          session, client_addr, acceptor.core);
+        }
 
-            // Kill any process left running when client disconnects
-            if (_remote_process.is_running())
-                _remote_process.close(1);
+        // After a handoff the successor owns the listening sockets; only
+        // drop our reference (shutdown() would stop its listener too).
+        if (_handed_off.load())
+            closeListener(acceptor);
+        _active_acceptors.fetch_sub(1);
+    }
 
-            printf("[Command] Client disconnected: %s:%d\n", ip, ntohs(client_addr.sin_port));
-            fflush(stdout);
+    void CommandServer::closeListener(Acceptor& acceptor)
+    {
+        if (acceptor.listen_sock == INVALID_SOCK) return;
+        if (!_handed_off.load())
+            shutdownSocket(acceptor.listen_sock);
+        closeSocket(acceptor.listen_sock);
+        acceptor.listen_sock = INVALID_SOCK;
+    }
 
-            closeSocket(client_sock);
-            _client_sock = INVALID_SOCK;
+    std::vector<sock_t> CommandServer::duplicateListeners() const
+    {
+        std::vector<sock_t> socks;
+        for (const auto& acceptor : _acceptors) {
+            sock_t sock = duplicateSocket(acceptor->listen_sock);
+            if (sock == INVALID_SOCK) {
+                for (sock_t dup : socks) closeSocket(dup);
+                return {};
+            }
+            socks.push_back(sock);
         }
+        return socks;
+    }
+
+    void CommandServer::stopAccepting()
+    {
+        _handed_off.store(true);
+        _accepting.store(false);
+        // The successor is only told to go ahead once none of our acceptors
+        // can take another connection off the shared backlogs.
+        while (_active_acceptors.load() > 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    bool CommandServer::drained() const
+    {
+        return _handed_off.load() && _active_acceptors.load() == 0 && _sessions.active() == 0;
     }
 
     // -------------------------------------------------------------------------
     // open / close
     // -------------------------------------------------------------------------
 
-    bool CommandServer::open(int32_t command_port, const char* initial_cwd)
+    bool CommandServer::open(int32_t command_port, const char* initial_cwd, const RemoteCommandServerOptions& options,
+                             const std::vector<sock_t>& listen_socks)
     {
+        _options = options;
+        _cache.open(options.cache_directory ? options.cache_directory : "");
+        _scheduler.open(options.job_slots);
+
+        std::vector<int32_t> reserved;
+        if (!parseCpuList(options.server_cores, reserved)) {
+            printf("[Command] Ignoring malformed server_cores \"%s\"\n", options.server_cores);
+            fflush(stdout);
+            reserved.clear();
+        }
+        auto launch = std::make_shared<LaunchOptions>();
+        launch->cpus = unreservedCpus(reserved);
+        _default_launch = launch;
+
+        _zygotes.open(options.python_executable ? options.python_executable : "python3",
+                      options.python_workers, options.python_preload ? options.python_preload : "",
+                      _default_launch);
+
         // Resolve initial working directory
         {
             std::error_code ec;
@@ -296,39 +848,72 @@ namespace Bn3Monkey
                              ? fs::path(initial_cwd)
                              : fs::current_path(ec);
             auto canonical = fs::canonical(p, ec);
-            _current_directory = ec ? p.string() : canonical.string();
+            _initial_directory = ec ? p.string() : canonical.string();
         }
 
-        sock_t sock = ::socket(AF_INET, SOCK_STREAM, 0);
-        if (sock == INVALID_SOCK) return false;
+        int32_t cores = static_cast<int32_t>(std::thread::hardware_concurrency());
+        if (cores <= 0) cores = 1;
+        int32_t count = options.in_memory             ? 1
+                      : options.acceptor_threads > 0 ? options.acceptor_threads : cores;
+        count = std::max(count, static_cast<int32_t>(listen_socks.size()));
+        const bool sharded = count > 1;
+        const bool pinned  = sharded && options.pin_acceptors;
+
+        for (int32_t i = 0; i < count; ++i) {
+            sock_t sock = INVALID_SOCK;
+            if (i < static_cast<int32_t>(listen_socks.size()))
+                sock = listen_socks[i];
+            else if (options.in_memory)
+                sock = openMemoryListenSocket(command_port);
+            else
+                sock = openListenSocket(command_port, SOMAXCONN, sharded);
+
+            if (sock == INVALID_SOCK) {
+                if (i == 0) return false;
+                // e.g. an inherited listener without SO_REUSEPORT, or no
+                // SO_REUSEPORT on this platform: carry on with what we have.
+                printf("[Command] Could not open acceptor %d of %d on port %d; using %d\n",
+                       i + 1, count, command_port, i);
+                fflush(stdout);
+                break;
+            }
 
-        int yes = 1;
-#ifdef _WIN32
-        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR,
-                   reinterpret_cast<const char*>(&yes), sizeof(yes));
-#else
-        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
-#endif
+            auto acceptor = std::make_unique<Acceptor>();
+            acceptor->index       = i;
+            acceptor->core        = !reserved.empty() ? reserved[i % reserved.size()]
+                                  : pinned          ? i % cores : -1;
+            acceptor->listen_sock = sock;
+            _acceptors.push_back(std::move(acceptor));
+        }
 
-        sockaddr_in addr {};
-        addr.sin_family      = AF_INET;
-        addr.sin_addr.s_addr = INADDR_ANY;
-        addr.sin_port        = htons(static_cast<uint16_t>(command_port));
+        if (!_exporter.open(options.metrics_file, options.metrics_port, options.metrics_address,
+                            options.metrics_interval_ms,
+                            [this]() { return _metrics.prometheus(gauges()); })) {
+            for (auto& acceptor : _acceptors)
+                closeListener(*acceptor);
+            _acceptors.clear();
+            return false;
+        }
 
-        if (::bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
-            ::listen(sock, 1) != 0) {
-#ifdef _WIN32
-            shutdown(sock, SD_BOTH);
-#else
-            shutdown(sock, SHUT_RDWR);
-#endif
-            closeSocket(sock);
+        if (!_recorder.open(options.record_file, options.record_payloads)) {
+            printf("[Command] Could not create recording %s\n", options.record_file);
+            _exporter.close();
+            for (auto& acceptor : _acceptors)
+                closeListener(*acceptor);
+            _acceptors.clear();
             return false;
         }
 
-        _server_sock = sock;
+        _trace_file = options.trace_file ? options.trace_file : "";
+        if (!_trace_file.empty())
+            ServerTrace::start();
+
+        _handed_off.store(false);
+        _accepting.store(true);
         _running.store(true);
-        _handler = std::thread(&CommandServer::handlerLoop, this);
+        _active_acceptors.store(static_cast<int>(_acceptors.size()));
+        for (auto& acceptor : _acceptors)
+            acceptor->thread = std::thread(&CommandServer::acceptLoop, this, std::ref(*acceptor));
         return true;
     }
 
@@ -337,25 +922,27 @@ namespace Bn3Monkey
         if (!_running.load()) return;
 
         _running.store(false);
+        _accepting.store(false);
 
-        // Wake up handleCommand if it is blocked on recvAll
-        if (_client_sock != INVALID_SOCK) {
-
-            closeSocket(_client_sock);
-            _client_sock = INVALID_SOCK;
+        for (auto& acceptor : _acceptors) {
+            if (acceptor->thread.joinable())
+                acceptor->thread.join();
+            closeListener(*acceptor);
         }
-
-        if (_handler.joinable())
-            _handler.join();
-
-        if (_server_sock != INVALID_SOCK) {
-#ifdef _WIN32
-            shutdown(_server_sock, SD_BOTH);
-#else
-            shutdown(_server_sock, SHUT_RDWR);
-#endif
-            closeSocket(_server_sock);
-            _server_sock = INVALID_SOCK;
+        _acceptors.clear();
+
+        // Wake up every handler blocked on recvAll (or waiting for a job
+        // slot) and wait for it.
+        _scheduler.close();
+        _sessions.closeAll();
+        _zygotes.close();
+        _exporter.close();
+        _recorder.close();
+        if (!_trace_file.empty()) {
+            ServerTrace::stop();
+            if (!ServerTrace::writeChromeJson(_trace_file))
+                printf("[Command] Could not write trace to %s\n", _trace_file.c_str());
+            _trace_file.clear();
         }
     }
 
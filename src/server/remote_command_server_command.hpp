@@ -1,36 +1,94 @@
 #if !defined (__REMOTE_COMMAND_SERVER_COMMAND__)
 #define __REMOTE_COMMAND_SERVER_COMMAND__
 
-#include "remote_command_server_process.hpp"
+#include "remote_command_server_session.hpp"
+#include "remote_command_server_worker.hpp"
+#include "remote_command_server_instruction.hpp"
+#include "remote_command_server_cache.hpp"
+#include "remote_command_server_zygote.hpp"
+#include "remote_command_server_scheduler.hpp"
+#include "remote_command_server_metrics.hpp"
+#include "remote_command_server_recorder.hpp"
 #include "remote_command_server_socket.hpp"
 #include <cstdint>
 #include <string>
+#include <vector>
+#include <memory>
 #include <thread>
 #include <atomic>
+#include <functional>
 
 namespace Bn3Monkey
 {
     class CommandServer
     {
     public:
-        explicit CommandServer(RemoteProcess& remote_process)
-            : _remote_process(remote_process) {}
+        CommandServer(SessionRegistry& sessions, WorkerPool& workers, InstructionRegistry& instructions)
+            : _sessions(sessions), _workers(workers), _instructions(instructions) {}
         ~CommandServer() { close(); }
 
-        // initial_cwd: starting working directory (CommandServer owns it)
-        bool open(int32_t command_port, const char* initial_cwd);
+        // initial_cwd: starting working directory of every new session
+        // listen_socks: pre-opened listeners (socket activation / handoff),
+        //               or empty to bind command_port here.  Owned by the
+        //               server from here on, also when open fails.
+        //
+        // options.acceptor_threads > 1 opens one SO_REUSEPORT listener per
+        // acceptor; the kernel spreads new connections across them.  Every
+        // pre-opened listener gets an acceptor of its own, even beyond
+        // acceptor_threads, so nothing queued on one is left unaccepted.
+        bool open(int32_t command_port, const char* initial_cwd, const RemoteCommandServerOptions& options,
+                  const std::vector<sock_t>& listen_socks = {});
         void close();
 
+        // Listener handoff: duplicate every acceptor's listener for a
+        // successor process (empty if one cannot be duplicated), then stop
+        // accepting; stopAccepting returns once every acceptor has stopped.
+        // Connected sessions are served to completion; drained()
+        // turns true once the last one has gone.
+        std::vector<sock_t> duplicateListeners() const;
+        void   stopAccepting();
+        bool   drained() const;
+
     private:
-        void handlerLoop();
-        void handleCommand(sock_t client_sock);
-
-        RemoteProcess&    _remote_process;
-        std::string       _current_directory;
-        sock_t            _server_sock  { INVALID_SOCK };
-        sock_t            _client_sock  { INVALID_SOCK };  // interrupted on close()
-        std::atomic<bool> _running      { false };
-        std::thread       _handler;
+        struct Acceptor
+        {
+            int32_t     index       { 0 };
+            int32_t     core        { -1 };    // -1 = not pinned
+            sock_t      listen_sock { INVALID_SOCK };
+            std::thread thread;
+        };
+
+        void acceptLoop(Acceptor& acceptor);
+        void serveSession(std::shared_ptr<Session> session, sockaddr_in client_addr, int32_t core);
+        void handleCommand(Session& session);
+        bool submitOperation(Session& session, const std::string& operation,
+                             std::string p0, std::string p1);
+        void invokeUserInstruction(Session& session, ResponseWriter& out, int32_t instruction,
+                                   std::string* payloads);
+        void closeListener(Acceptor& acceptor);
+        ServerMetrics::Gauges gauges();
+        bool acquireJobSlot(Session& session, uint32_t& queued_ms);
+        bool runAsJob(Session& session, const std::function<void()>& job);
+
+        SessionRegistry&  _sessions;
+        WorkerPool&       _workers;
+        InstructionRegistry& _instructions;
+        RemoteCommandServerOptions _options;
+        CommandCache      _cache;
+        ZygotePool        _zygotes;
+        JobScheduler      _scheduler;
+        ProcessSampler    _sampler;
+        ServerMetrics     _metrics;
+        MetricsExporter   _exporter;
+        std::string       _trace_file;         // written on close
+        SessionRecorder   _recorder;
+        std::shared_ptr<const LaunchOptions> _default_launch;   // off the reserved cores
+        std::string       _initial_directory;
+        std::vector<std::unique_ptr<Acceptor>> _acceptors;
+        std::atomic<bool> _running          { false };
+        std::atomic<bool> _accepting        { false };
+        std::atomic<bool> _handed_off       { false };
+        std::atomic<int>  _active_acceptors { 0 };
     };
 }
 
@@ -2,18 +2,24 @@
 #define __REMOTE_COMMAND_SERVER_CONTEXT__
 
 #include "remote_command_server_discovery.hpp"
-#include "remote_command_server_process.hpp"
+#include "remote_command_server_session.hpp"
+#include "remote_command_server_worker.hpp"
+#include "remote_command_server_instruction.hpp"
 #include "remote_command_server_stream.hpp"
 #include "remote_command_server_command.hpp"
+#include "remote_command_server_handoff.hpp"
 
 namespace Bn3Monkey
 {
     struct RemoteCommandServer
     {
-        RemoteProcess   process;
-        StreamServer    stream_server  { process };
-        CommandServer   command_server { process };
-        DiscoveryServer discovery_server;
+        SessionRegistry  sessions;
+        WorkerPool       workers;
+        InstructionRegistry instructions;
+        StreamServer     stream_server  { sessions };
+        CommandServer    command_server { sessions, workers, instructions };
+        DiscoveryServer  discovery_server;
+        HandoffServer    handoff;
     };
 }
 
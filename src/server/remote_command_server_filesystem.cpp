@@ -0,0 +1,342 @@
+#include "remote_command_server_filesystem.hpp"
+#include "remote_command_server_trace.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+namespace fs = std::filesystem;
+
+namespace Bn3Monkey
+{
+    // Files are moved in chunks of this size when progress is requested, so
+    // a single large file still reports while it is being copied.
+    static constexpr size_t PROGRESS_CHUNK = 1024 * 1024;
+
+    fs::path resolvePath(const std::string& cwd, const std::string& p)
+    {
+        fs::path fp(p);
+        return fp.is_absolute() ? fp : fs::path(cwd) / fp;
+    }
+
+    // Items and regular-file bytes under root (root itself included)
+    static void measureTree(const fs::path& root, FilesystemProgress& state)
+    {
+        std::error_code ec;
+        state.items_total = 1;
+        if (!fs::is_directory(root, ec)) {
+            uintmax_t size = fs::file_size(root, ec);
+            state.bytes_total = ec ? 0 : size;
+            return;
+        }
+        for (auto it = fs::recursive_directory_iterator(root, ec);
+             !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+            ++state.items_total;
+            if (it->is_regular_file(ec)) {
+                uintmax_t size = it->file_size(ec);
+                if (!ec) state.bytes_total += size;
+            }
+            ec.clear();
+        }
+    }
+
+    static bool copyFileWithProgress(const fs::path& from, const fs::path& to,
+                                     FilesystemProgress& state, const FilesystemProgressCallback& progress)
+    {
+        std::error_code ec;
+        if (fs::exists(to, ec)) return false;       // fs::copy never overwrites either
+
+        std::ifstream in(from, std::ios::binary);
+        std::ofstream out(to, std::ios::binary);
+        if (!in.is_open() || !out.is_open()) return false;
+
+        std::vector<char> buffer(PROGRESS_CHUNK);
+        while (in) {
+            in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            std::streamsize got = in.gcount();
+            if (got <= 0) break;
+            out.write(buffer.data(), got);
+            if (out.fail()) return false;
+            state.bytes_done += static_cast<uint64_t>(got);
+            progress(state);
+        }
+        out.close();
+        fs::permissions(to, fs::status(from, ec).permissions(), ec);
+        return !in.bad() && !out.fail();
+    }
+
+    bool copyDirectoryAt(const std::string& cwd, const std::string& from, const std::string& to,
+                         const FilesystemProgressCallback& progress)
+    {
+        std::error_code ec;
+        fs::path source = resolvePath(cwd, from);
+        fs::path target = resolvePath(cwd, to);
+        if (!progress) {
+            fs::copy(source, target, fs::copy_options::recursive, ec);
+            return !ec;
+        }
+
+        // Same outcome as fs::copy(recursive), walked by hand so every file
+        // and chunk can be reported.
+        FilesystemProgress state;
+        measureTree(source, state);
+        progress(state);
+
+        if (!fs::is_directory(source, ec)) {
+            if (fs::is_directory(target, ec))
+                target /= source.filename();
+            bool ok = copyFileWithProgress(source, target, state, progress);
+            state.items_done = 1;
+            progress(state);
+            return ok;
+        }
+
+        if (!fs::exists(target, ec) && !fs::create_directory(target, source, ec))
+            return false;
+        state.items_done = 1;
+
+        for (auto it = fs::recursive_directory_iterator(source, ec);
+             it != fs::recursive_directory_iterator(); it.increment(ec)) {
+            if (ec) return false;
+            fs::path dest = target / it->path().lexically_relative(source);
+            if (it->is_directory(ec)) {
+                if (!fs::exists(dest, ec) && !fs::create_directory(dest, it->path(), ec))
+                    return false;
+            } else if (!copyFileWithProgress(it->path(), dest, state, progress)) {
+                return false;
+            }
+            ++state.items_done;
+            progress(state);
+        }
+        return !ec;
+    }
+
+    bool removeDirectoryAt(const std::string& cwd, const std::string& path,
+                           const FilesystemProgressCallback& progress)
+    {
+        std::error_code ec;
+        fs::path root = resolvePath(cwd, path);
+        if (!progress)
+            return (fs::remove_all(root, ec) > 0) && !ec;
+
+        FilesystemProgress state;
+        measureTree(root, state);
+        progress(state);
+
+        if (!fs::exists(fs::symlink_status(root, ec)))
+            return false;
+
+        // Children before parents: collect depth-first, delete in reverse
+        std::vector<fs::directory_entry> entries { fs::directory_entry(root) };
+        if (fs::is_directory(fs::symlink_status(root, ec))) {
+            for (auto it = fs::recursive_directory_iterator(root, ec);
+                 it != fs::recursive_directory_iterator(); it.increment(ec)) {
+                if (ec) return false;
+                entries.push_back(*it);
+            }
+        }
+
+        for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+            uintmax_t size = it->is_regular_file(ec) ? it->file_size(ec) : 0;
+            if (!fs::remove(it->path(), ec) || ec)
+                return false;
+            state.bytes_done += size;
+            ++state.items_done;
+            progress(state);
+        }
+        return true;
+    }
+
+    bool uploadFileAt(const std::string& cwd, const std::string& path, const std::string& data,
+                      const FilesystemProgressCallback& progress)
+    {
+        TraceScope trace("writeFile", "bytes", static_cast<int64_t>(data.size()));
+        std::error_code ec;
+        fs::path target = resolvePath(cwd, path);
+        fs::create_directories(target.parent_path(), ec);
+
+        std::ofstream file(target, std::ios::binary);
+        if (!file.is_open()) return false;
+        if (!progress) {
+            if (!data.empty())
+                file.write(data.data(), static_cast<std::streamsize>(data.size()));
+            return !file.fail();
+        }
+
+        FilesystemProgress state;
+        state.bytes_total = data.size();
+        state.items_total = 1;
+        progress(state);
+        for (size_t offset = 0; offset < data.size(); offset += PROGRESS_CHUNK) {
+            size_t len = std::min(PROGRESS_CHUNK, data.size() - offset);
+            file.write(data.data() + offset, static_cast<std::streamsize>(len));
+            if (file.fail()) return false;
+            state.bytes_done += len;
+            progress(state);
+        }
+        state.items_done = 1;
+        progress(state);
+        return !file.fail();
+    }
+
+    bool downloadFileAt(const std::string& cwd, const std::string& path, std::vector<char>& data,
+                        const FilesystemProgressCallback& progress)
+    {
+        TraceScope trace("readFile");
+        std::ifstream file(resolvePath(cwd, path), std::ios::binary);
+        if (!file.is_open()) return false;
+        if (!progress) {
+            data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            return true;
+        }
+
+        std::error_code ec;
+        FilesystemProgress state;
+        uintmax_t size = fs::file_size(resolvePath(cwd, path), ec);
+        state.bytes_total = ec ? 0 : size;
+        state.items_total = 1;
+        progress(state);
+
+        data.clear();
+        data.reserve(static_cast<size_t>(state.bytes_total));
+        std::vector<char> buffer(PROGRESS_CHUNK);
+        while (file) {
+            file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            std::streamsize got = file.gcount();
+            if (got <= 0) break;
+            data.insert(data.end(), buffer.data(), buffer.data() + got);
+            state.bytes_done += static_cast<uint64_t>(got);
+            progress(state);
+        }
+        state.items_done = 1;
+        progress(state);
+        return !file.bad();
+    }
+
+    // -------------------------------------------------------------------------
+    // Glob expansion
+    // -------------------------------------------------------------------------
+
+    bool isGlobPattern(const std::string& pattern)
+    {
+        return pattern.find_first_of("*?[") != std::string::npos;
+    }
+
+    // '[...]' at pattern[p] (p on the '['); advances p past ']'.  False if
+    // the class is unterminated, in which case '[' is an ordinary character.
+    static bool matchClass(const std::string& pattern, size_t& p, char c, bool& matched)
+    {
+        size_t i = p + 1;
+        bool negate = i < pattern.size() && (pattern[i] == '!' || pattern[i] == '^');
+        if (negate) ++i;
+
+        matched = false;
+        bool first = true;
+        for (; i < pattern.size() && (first || pattern[i] != ']'); ++i, first = false) {
+            if (i + 2 < pattern.size() && pattern[i + 1] == '-' && pattern[i + 2] != ']') {
+                if (pattern[i] <= c && c <= pattern[i + 2]) matched = true;
+                i += 2;
+            } else if (pattern[i] == c) {
+                matched = true;
+            }
+        }
+        if (i >= pattern.size()) return false;
+        matched = matched != negate;
+        p = i + 1;
+        return true;
+    }
+
+    static bool matchComponent(const std::string& pattern, const std::string& name)
+    {
+        // Leading dots must be matched literally, as in the shell
+        if (!name.empty() && name[0] == '.' && (pattern.empty() || pattern[0] != '.'))
+            return false;
+
+        size_t p = 0, n = 0;
+        size_t star_p = std::string::npos, star_n = 0;
+        while (n < name.size()) {
+            if (p < pattern.size() && pattern[p] == '*') {
+                star_p = ++p;
+                star_n = n;
+                continue;
+            }
+            if (p < pattern.size()) {
+                size_t next = p;
+                bool matched = false;
+                if (pattern[p] == '[' && matchClass(pattern, next, name[n], matched)) {
+                    if (matched) { p = next; ++n; continue; }
+                } else if (pattern[p] == '?' || pattern[p] == name[n]) {
+                    ++p; ++n;
+                    continue;
+                }
+            }
+            if (star_p == std::string::npos) return false;
+            p = star_p;
+            n = ++star_n;
+        }
+        while (p < pattern.size() && pattern[p] == '*') ++p;
+        return p == pattern.size();
+    }
+
+    static void expandGlob(const std::vector<std::string>& components, size_t index,
+                           const fs::path& directory, const std::string& spelled,
+                           std::vector<std::string>& matches)
+    {
+        std::error_code ec;
+        if (index == components.size()) {
+            if (!spelled.empty() && fs::exists(directory, ec)) matches.push_back(spelled);
+            return;
+        }
+
+        const std::string& component = components[index];
+        auto join = [&spelled](const std::string& name) {
+            if (spelled.empty()) return name;
+            char last = spelled.back();
+            return (last == '/' || last == '\\') ? spelled + name : spelled + "/" + name;
+        };
+
+        if (component == "**") {
+            // Zero directories, then one more level at a time
+            expandGlob(components, index + 1, directory, spelled, matches);
+            for (auto it = fs::directory_iterator(directory, ec); !ec && it != fs::directory_iterator(); it.increment(ec)) {
+                std::string name = it->path().filename().string();
+                if (name[0] != '.' && it->is_directory(ec) && !it->is_symlink(ec))
+                    expandGlob(components, index, it->path(), join(name), matches);
+            }
+            return;
+        }
+        if (!isGlobPattern(component)) {
+            expandGlob(components, index + 1, directory / component, join(component), matches);
+            return;
+        }
+
+        bool last = index + 1 == components.size();
+        for (auto it = fs::directory_iterator(directory, ec); !ec && it != fs::directory_iterator(); it.increment(ec)) {
+            std::string name = it->path().filename().string();
+            if (!matchComponent(component, name)) continue;
+            if (last || it->is_directory(ec))
+                expandGlob(components, index + 1, it->path(), join(name), matches);
+        }
+    }
+
+    std::vector<std::string> expandGlobAt(const std::string& cwd, const std::string& pattern)
+    {
+        std::vector<std::string> matches;
+        fs::path path(pattern);
+        std::string spelled = path.root_path().string();
+        fs::path directory = path.is_absolute() ? path.root_path() : fs::path(cwd);
+
+        std::vector<std::string> components;
+        for (const fs::path& component : path.relative_path()) {
+            std::string name = component.string();
+            if (!name.empty()) components.push_back(name);
+        }
+        if (components.empty()) return matches;
+
+        expandGlob(components, 0, directory, spelled, matches);
+        std::sort(matches.begin(), matches.end());
+        matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+        return matches;
+    }
+
+} // namespace Bn3Monkey
@@ -0,0 +1,58 @@
+#if !defined(__REMOTE_COMMAND_SERVER_FILESYSTEM__)
+#define __REMOTE_COMMAND_SERVER_FILESYSTEM__
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace Bn3Monkey
+{
+    // -------------------------------------------------------------------------
+    // Filesystem instructions, relative to a session's working directory.
+    //
+    // Shared by the inline handlers and the worker pool, so they must not
+    // touch any session state beyond the cwd string they are given.
+    // -------------------------------------------------------------------------
+
+    // Work done so far by one helper call.  Totals are measured up front,
+    // so a copy or removal walks its tree twice when progress is requested.
+    struct FilesystemProgress
+    {
+        uint64_t bytes_done  { 0 };
+        uint64_t bytes_total { 0 };
+        uint64_t items_done  { 0 };
+        uint64_t items_total { 0 };
+    };
+
+    // Called often (every file and every chunk); throttling is up to the
+    // callee.  An empty callback keeps the helpers on their fast path.
+    using FilesystemProgressCallback = std::function<void(const FilesystemProgress&)>;
+
+    // Resolve a path relative to cwd
+    std::filesystem::path resolvePath(const std::string& cwd, const std::string& p);
+
+    bool copyDirectoryAt  (const std::string& cwd, const std::string& from, const std::string& to,
+                           const FilesystemProgressCallback& progress = {});
+    bool removeDirectoryAt(const std::string& cwd, const std::string& path,
+                           const FilesystemProgressCallback& progress = {});
+
+    bool uploadFileAt  (const std::string& cwd, const std::string& path, const std::string& data,
+                        const FilesystemProgressCallback& progress = {});
+
+    // Fills data with the file contents; false if it cannot be opened.
+    bool downloadFileAt(const std::string& cwd, const std::string& path, std::vector<char>& data,
+                        const FilesystemProgressCallback& progress = {});
+
+    // True if pattern contains a '*', '?' or '[' wildcard.
+    bool isGlobPattern(const std::string& pattern);
+
+    // Paths matching a shell-style pattern, sorted and spelled as the pattern
+    // is (relative patterns give relative paths).  '*', '?' and '[...]' match
+    // within one path component and skip dot files unless the component
+    // starts with '.'; a "**" component matches any number of directories.
+    std::vector<std::string> expandGlobAt(const std::string& cwd, const std::string& pattern);
+}
+
+#endif // __REMOTE_COMMAND_SERVER_FILESYSTEM__
@@ -0,0 +1,491 @@
+#include "remote_command_server_graph.hpp"
+#include "remote_command_server_filesystem.hpp"
+#include "remote_command_server_helper.hpp"
+
+#ifdef _WIN32
+// windows.h already pulled in via the hpp
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <signal.h>
+extern char** environ;
+#endif
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <algorithm>
+
+namespace Bn3Monkey
+{
+    struct GraphExecutor::Running
+    {
+        uint32_t    index { 0 };
+        std::unique_ptr<JobTicket> slot;    // extra job slot; nullptr on the caller's
+        std::thread thread;
+        RemoteCommandNodeResultInner result;
+#ifdef _WIN32
+        HANDLE      process { INVALID_HANDLE_VALUE };   // guarded by GraphExecutor::_mtx
+#else
+        pid_t       pid { -1 };                         // guarded by GraphExecutor::_mtx
+#endif
+    };
+
+    // -------------------------------------------------------------------------
+    // parseCommandGraph
+    // -------------------------------------------------------------------------
+
+    static bool validEnvironmentEntry(const std::string& entry)
+    {
+        size_t eq = entry.find('=');
+        return eq != std::string::npos && eq > 0;
+    }
+
+    bool parseCommandGraph(const std::string& graph, const std::string& nodes,
+                           const std::string& strings, const std::string& dependencies,
+                           std::vector<GraphNode>& out, int32_t& max_parallel)
+    {
+        out.clear();
+        RemoteCommandGraphInner header;
+        if (graph.size() != sizeof(header)) return false;
+        memcpy(&header, graph.data(), sizeof(header));
+
+        const uint64_t count = header.node_count;
+        if (nodes.size() != count * sizeof(RemoteCommandNodeInner)) return false;
+        max_parallel = header.max_parallel;
+
+        size_t string_offset = 0;
+        size_t dependency_offset = 0;
+        out.resize(static_cast<size_t>(count));
+        for (size_t i = 0; i < out.size(); ++i) {
+            RemoteCommandNodeInner inner;
+            memcpy(&inner, nodes.data() + i * sizeof(inner), sizeof(inner));
+
+            uint64_t string_length = static_cast<uint64_t>(inner.command_length) +
+                                     inner.cwd_length + inner.environment_length;
+            uint64_t dependency_length = static_cast<uint64_t>(inner.dependency_count) * sizeof(uint32_t);
+            if (string_length > strings.size() - string_offset) return false;
+            if (dependency_length > dependencies.size() - dependency_offset) return false;
+            if (inner.command_length == 0) return false;
+
+            GraphNode& node = out[i];
+            node.command.assign(strings, string_offset, inner.command_length);
+            string_offset += inner.command_length;
+            node.cwd.assign(strings, string_offset, inner.cwd_length);
+            string_offset += inner.cwd_length;
+
+            // NUL-terminated entries, so a non-empty block ends with '\0'
+            const char* env = strings.data() + string_offset;
+            if (inner.environment_length > 0 && env[inner.environment_length - 1] != '\0') return false;
+            for (size_t pos = 0; pos < inner.environment_length; ) {
+                std::string entry(env + pos);
+                if (!validEnvironmentEntry(entry)) return false;
+                pos += entry.size() + 1;
+                node.environment.push_back(std::move(entry));
+            }
+            string_offset += inner.environment_length;
+
+            node.dependencies.resize(inner.dependency_count);
+            if (inner.dependency_count > 0)
+                memcpy(node.dependencies.data(), dependencies.data() + dependency_offset,
+                       static_cast<size_t>(dependency_length));
+            dependency_offset += static_cast<size_t>(dependency_length);
+            for (uint32_t dependency : node.dependencies) {
+                if (dependency >= count || dependency == i) return false;
+            }
+        }
+        if (string_offset != strings.size() || dependency_offset != dependencies.size()) return false;
+
+        // Kahn's algorithm: every node is reachable from the roots iff there
+        // is no cycle.
+        std::vector<uint32_t> waiting(out.size());
+        std::vector<std::vector<uint32_t>> dependents(out.size());
+        std::vector<uint32_t> ready;
+        for (uint32_t i = 0; i < out.size(); ++i) {
+            waiting[i] = static_cast<uint32_t>(out[i].dependencies.size());
+            for (uint32_t dependency : out[i].dependencies)
+                dependents[dependency].push_back(i);
+            if (waiting[i] == 0) ready.push_back(i);
+        }
+        size_t visited = 0;
+        while (!ready.empty()) {
+            uint32_t i = ready.back();
+            ready.pop_back();
+            ++visited;
+            for (uint32_t dependent : dependents[i]) {
+                if (--waiting[dependent] == 0) ready.push_back(dependent);
+            }
+        }
+        return visited == out.size();
+    }
+
+    // -------------------------------------------------------------------------
+    // Node environment: the server's own, with the node's entries on top
+    // -------------------------------------------------------------------------
+
+    static bool sameVariable(const std::string& a, const std::string& b)
+    {
+        size_t length = a.find('=');
+        if (length == std::string::npos || b.size() <= length || b[length] != '=') return false;
+#ifdef _WIN32
+        // Windows variable names are case-insensitive
+        return _strnicmp(a.c_str(), b.c_str(), length) == 0;
+#else
+        return a.compare(0, length, b, 0, length) == 0;
+#endif
+    }
+
+    static std::vector<std::string> buildEnvironment(const std::vector<std::string>& overrides)
+    {
+        std::vector<std::string> environment;
+#ifdef _WIN32
+        char* block = GetEnvironmentStringsA();
+        if (block) {
+            for (const char* entry = block; *entry; entry += strlen(entry) + 1) {
+                if (entry[0] != '=')        // per-drive cwd entries ("=C:=C:\...")
+                    environment.emplace_back(entry);
+            }
+            FreeEnvironmentStringsA(block);
+        }
+#else
+        for (char** entry = environ; entry && *entry; ++entry)
+            environment.emplace_back(*entry);
+#endif
+        for (const std::string& entry : overrides) {
+            auto it = std::find_if(environment.begin(), environment.end(),
+                                   [&entry](const std::string& existing) { return sameVariable(entry, existing); });
+            if (it != environment.end())
+                *it = entry;
+            else
+                environment.push_back(entry);
+        }
+        return environment;
+    }
+
+    // -------------------------------------------------------------------------
+    // runNode  (one thread per running node)
+    // -------------------------------------------------------------------------
+
+    void GraphExecutor::runNode(Running& running, const std::string& cwd, const GraphNode& node,
+                                GraphNodeOutput* captured)
+    {
+        setCurrentThreadName("RC_NODE");
+        // Spread over every core even if the session thread is pinned
+        unpinCurrentThread();
+
+        auto start = std::chrono::steady_clock::now();
+        running.result.state     = RemoteCommandNodeStateInner::FAILED;
+        running.result.exit_code = -1;
+
+        std::string directory = node.cwd.empty() ? cwd : resolvePath(cwd, node.cwd).string();
+        std::vector<std::string> environment = buildEnvironment(node.environment);
+
+        // Output frames carry the node index in front of the data
+        auto forward = [this, index = running.index, captured](auto read, RemoteCommandStreamType type) {
+            char buf[sizeof(uint32_t) + 4096];
+            memcpy(buf, &index, sizeof(index));
+            std::string* sink = nullptr;
+            if (captured)
+                sink = type == RemoteCommandStreamType::STREAM_NODE_ERROR ? &captured->error : &captured->output;
+
+            uint32_t n;
+            while ((n = read(buf + sizeof(index), 4096)) > 0) {
+                if (!sink)
+                    _remote_process.sendStreamFrame(type, buf, static_cast<uint32_t>(sizeof(index)) + n);
+                else if (sink->size() < GraphNodeOutput::MAX_CAPTURED_OUTPUT)
+                    sink->append(buf + sizeof(index),
+                                 std::min<size_t>(n, GraphNodeOutput::MAX_CAPTURED_OUTPUT - sink->size()));
+            }
+        };
+
+#ifdef _WIN32
+        SECURITY_ATTRIBUTES sa {};
+        sa.nLength        = sizeof(sa);
+        sa.bInheritHandle = TRUE;
+
+        HANDLE stdout_read = INVALID_HANDLE_VALUE, stdout_write = INVALID_HANDLE_VALUE;
+        HANDLE stderr_read = INVALID_HANDLE_VALUE, stderr_write = INVALID_HANDLE_VALUE;
+        if (!CreatePipe(&stdout_read, &stdout_write, &sa, 0)) return;
+        if (!CreatePipe(&stderr_read, &stderr_write, &sa, 0)) {
+            CloseHandle(stdout_read);
+            CloseHandle(stdout_write);
+            return;
+        }
+        SetHandleInformation(stdout_read, HANDLE_FLAG_INHERIT, 0);
+        SetHandleInformation(stderr_read, HANDLE_FLAG_INHERIT, 0);
+
+        std::string block;
+        for (const std::string& entry : environment) {
+            block += entry;
+            block.push_back('\0');
+        }
+        block.push_back('\0');
+
+        STARTUPINFOA si {};
+        si.cb         = sizeof(si);
+        si.dwFlags    = STARTF_USESTDHANDLES;
+        si.hStdInput  = nullptr;        // nodes are not interactive
+        si.hStdOutput = stdout_write;
+        si.hStdError  = stderr_write;
+
+        std::string command_line(node.command);
+        PROCESS_INFORMATION pi {};
+        auto spawn_start = std::chrono::steady_clock::now();
+        bool ok = CreateProcessA(nullptr, command_line.data(), nullptr, nullptr, TRUE,
+                                 CREATE_NO_WINDOW, block.data(),
+                                 directory.empty() ? nullptr : directory.c_str(), &si, &pi);
+        CloseHandle(stdout_write);
+        CloseHandle(stderr_write);
+        if (!ok) {
+            CloseHandle(stdout_read);
+            CloseHandle(stderr_read);
+            return;
+        }
+        _remote_process.recordSpawn(spawn_start);
+        CloseHandle(pi.hThread);
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            running.process = pi.hProcess;
+            if (_cancelled.load())
+                TerminateProcess(pi.hProcess, 1);
+        }
+
+        auto reader = [](HANDLE pipe) {
+            return [pipe](char* buf, uint32_t size) -> uint32_t {
+                DWORD n = 0;
+                return ReadFile(pipe, buf, size, &n, nullptr) ? static_cast<uint32_t>(n) : 0;
+            };
+        };
+        std::thread stderr_thread([&]() { forward(reader(stderr_read), RemoteCommandStreamType::STREAM_NODE_ERROR); });
+        forward(reader(stdout_read), RemoteCommandStreamType::STREAM_NODE_OUTPUT);
+        stderr_thread.join();
+        CloseHandle(stdout_read);
+        CloseHandle(stderr_read);
+
+        WaitForSingleObject(pi.hProcess, INFINITE);
+        DWORD code = 0;
+        if (GetExitCodeProcess(pi.hProcess, &code))
+            running.result.exit_code = static_cast<int32_t>(code);
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            running.process = INVALID_HANDLE_VALUE;
+        }
+        CloseHandle(pi.hProcess);
+#else
+        // Everything the child needs is prepared before fork(): the server is
+        // multithreaded, so the child may only make async-signal-safe calls.
+        std::vector<char*> envp;
+        for (std::string& entry : environment)
+            envp.push_back(&entry[0]);
+        envp.push_back(nullptr);
+        const char* argv[] { "sh", "-c", node.command.c_str(), nullptr };
+        std::string cd_error = "sh: cannot change directory to " + directory + "\n";
+        std::shared_ptr<const LaunchOptions> launch = _remote_process.launchOptions();
+
+        int stdout_pipe[2], stderr_pipe[2];
+        if (pipeCloseOnExec(stdout_pipe) != 0) return;
+        if (pipeCloseOnExec(stderr_pipe) != 0) {
+            ::close(stdout_pipe[0]); ::close(stdout_pipe[1]);
+            return;
+        }
+        int devnull = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+        auto spawn_start = std::chrono::steady_clock::now();
+        pid_t pid = fork();
+        if (pid == 0) {
+            setpgid(0, 0);
+            applyLaunchOptions(launch.get());
+            if (devnull != -1) dup2(devnull, STDIN_FILENO);
+            dup2(stdout_pipe[1], STDOUT_FILENO);
+            dup2(stderr_pipe[1], STDERR_FILENO);
+            ::close(stdout_pipe[0]); ::close(stdout_pipe[1]);
+            ::close(stderr_pipe[0]); ::close(stderr_pipe[1]);
+            if (devnull != -1) ::close(devnull);
+            if (!directory.empty() && chdir(directory.c_str()) != 0) {
+                ssize_t ignored = write(STDERR_FILENO, cd_error.data(), cd_error.size());
+                (void)ignored;
+                _exit(127);
+            }
+            execve("/bin/sh", const_cast<char* const*>(argv), envp.data());
+            _exit(127);
+        }
+
+        ::close(stdout_pipe[1]);
+        ::close(stderr_pipe[1]);
+        if (devnull != -1) ::close(devnull);
+        if (pid < 0) {
+            ::close(stdout_pipe[0]);
+            ::close(stderr_pipe[0]);
+            return;
+        }
+        _remote_process.recordSpawn(spawn_start);
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            running.pid = pid;
+            if (_cancelled.load())
+                kill(-pid, SIGTERM);
+        }
+
+        auto reader = [](int fd) {
+            return [fd](char* buf, uint32_t size) -> uint32_t {
+                ssize_t n = ::read(fd, buf, size);
+                return n > 0 ? static_cast<uint32_t>(n) : 0;
+            };
+        };
+        std::thread stderr_thread([&]() { forward(reader(stderr_pipe[0]), RemoteCommandStreamType::STREAM_NODE_ERROR); });
+        forward(reader(stdout_pipe[0]), RemoteCommandStreamType::STREAM_NODE_OUTPUT);
+        stderr_thread.join();
+        ::close(stdout_pipe[0]);
+        ::close(stderr_pipe[0]);
+
+        // Forget the pid before reaping it, so cancel() never signals a
+        // recycled process group.
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            running.pid = -1;
+        }
+        int status;
+        if (waitpid(pid, &status, 0) == pid) {
+            if (WIFEXITED(status))
+                running.result.exit_code = WEXITSTATUS(status);
+            else if (WIFSIGNALED(status))
+                running.result.exit_code = 128 + WTERMSIG(status);
+        }
+#endif
+
+        if (running.result.exit_code == 0)
+            running.result.state = RemoteCommandNodeStateInner::SUCCEEDED;
+        running.result.elapsed_ms = static_cast<uint32_t>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start).count());
+    }
+
+    // -------------------------------------------------------------------------
+    // run  –  schedule ready nodes until the graph is done
+    // -------------------------------------------------------------------------
+
+    std::vector<RemoteCommandNodeResultInner> GraphExecutor::run(const std::string& cwd,
+                                                                 const std::vector<GraphNode>& nodes,
+                                                                 int32_t max_parallel,
+                                                                 JobScheduler* scheduler,
+                                                                 std::vector<GraphNodeOutput>* captured)
+    {
+        if (captured) captured->assign(nodes.size(), GraphNodeOutput());
+
+        // Nodes that never start keep the default SKIPPED result
+        std::vector<RemoteCommandNodeResultInner> results(nodes.size());
+
+        std::vector<uint32_t> waiting(nodes.size());
+        std::vector<std::vector<uint32_t>> dependents(nodes.size());
+        std::deque<uint32_t> ready;
+        for (uint32_t i = 0; i < nodes.size(); ++i) {
+            waiting[i] = static_cast<uint32_t>(nodes[i].dependencies.size());
+            for (uint32_t dependency : nodes[i].dependencies)
+                dependents[dependency].push_back(i);
+            if (waiting[i] == 0) ready.push_back(i);
+        }
+
+        size_t limit = max_parallel > 0 ? static_cast<size_t>(max_parallel) : std::thread::hardware_concurrency();
+        if (limit == 0) limit = 1;
+
+        std::mutex                            done_mtx;
+        std::condition_variable               done_cv;
+        std::deque<Running*>                  done;
+        std::vector<std::unique_ptr<Running>> active;
+        bool caller_slot_free = true;
+
+        for (;;) {
+            while (!ready.empty() && active.size() < limit && !_cancelled.load()) {
+                auto running = std::make_unique<Running>();
+                if (caller_slot_free) {
+                    caller_slot_free = false;
+                } else if (scheduler) {
+                    running->slot = std::make_unique<JobTicket>();
+                    if (!scheduler->tryAcquire(*running->slot))
+                        break;      // no slot to spare: wait for a node to finish
+                }
+                running->index = ready.front();
+                ready.pop_front();
+
+                Running* node = running.get();
+                {
+                    std::lock_guard<std::mutex> lk(_mtx);
+                    _running.push_back(node);
+                }
+                GraphNodeOutput* sink = captured ? &(*captured)[node->index] : nullptr;
+                node->thread = std::thread([this, node, sink, &cwd, &nodes, &done_mtx, &done_cv, &done]() {
+                    runNode(*node, cwd, nodes[node->index], sink);
+                    std::lock_guard<std::mutex> lk(done_mtx);
+                    done.push_back(node);
+                    done_cv.notify_one();
+                });
+                active.push_back(std::move(running));
+            }
+            if (active.empty()) break;
+
+            Running* finished = nullptr;
+            {
+                std::unique_lock<std::mutex> lk(done_mtx);
+                done_cv.wait(lk, [&done]() { return !done.empty(); });
+                finished = done.front();
+                done.pop_front();
+            }
+            finished->thread.join();
+            {
+                std::lock_guard<std::mutex> lk(_mtx);
+                _running.erase(std::find(_running.begin(), _running.end(), finished));
+            }
+
+            if (finished->slot)
+                scheduler->release(*finished->slot);
+            else
+                caller_slot_free = true;
+
+            results[finished->index] = finished->result;
+            bool succeeded = finished->result.state == RemoteCommandNodeStateInner::SUCCEEDED;
+            for (uint32_t dependent : dependents[finished->index]) {
+                if ((succeeded || nodes[dependent].after_failure) && --waiting[dependent] == 0)
+                    ready.push_back(dependent);
+            }
+            active.erase(std::find_if(active.begin(), active.end(),
+                                      [finished](const std::unique_ptr<Running>& r) { return r.get() == finished; }));
+        }
+        return results;
+    }
+
+    // -------------------------------------------------------------------------
+    // cancel  –  signal only; run() reaps
+    // -------------------------------------------------------------------------
+
+    void GraphExecutor::processGroups(std::vector<int64_t>& groups)
+    {
+#ifndef _WIN32
+        std::lock_guard<std::mutex> lk(_mtx);
+        for (Running* running : _running) {
+            if (running->pid != -1)
+                groups.push_back(running->pid);
+        }
+#else
+        (void)groups;
+#endif
+    }
+
+    void GraphExecutor::cancel()
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        _cancelled.store(true);
+        for (Running* running : _running) {
+#ifdef _WIN32
+            if (running->process != INVALID_HANDLE_VALUE)
+                TerminateProcess(running->process, 1);
+#else
+            if (running->pid != -1)
+                kill(-running->pid, SIGTERM);
+#endif
+        }
+    }
+
+} // namespace Bn3Monkey
@@ -0,0 +1,89 @@
+#if !defined(__REMOTE_COMMAND_SERVER_GRAPH__)
+#define __REMOTE_COMMAND_SERVER_GRAPH__
+
+#include "remote_command_server_process.hpp"
+#include "remote_command_server_scheduler.hpp"
+#include "../protocol/remote_command_protocol.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+namespace Bn3Monkey
+{
+    // -------------------------------------------------------------------------
+    // Command graphs (INSTRUCTION_RUN_GRAPH)
+    //
+    // A build-and-test pipeline sent as one request: the server starts every
+    // node whose dependencies have succeeded, up to max_parallel at a time,
+    // and streams each node's output tagged with its index.  The client pays
+    // one round trip for the whole graph instead of one per command.
+    // -------------------------------------------------------------------------
+    struct GraphNode
+    {
+        std::string              command;
+        std::string              cwd;            // relative to the session's cwd
+        std::vector<std::string> environment;    // "NAME=value", overrides the server's
+        std::vector<uint32_t>    dependencies;
+        bool                     after_failure { false };   // start even if a dependency failed
+    };
+
+    // Output of one node, when the caller collects it instead of streaming it.
+    // Each stream keeps at most MAX_CAPTURED_OUTPUT bytes; the rest is dropped.
+    struct GraphNodeOutput
+    {
+        static constexpr size_t MAX_CAPTURED_OUTPUT = 4 * 1024 * 1024;
+
+        std::string output;
+        std::string error;
+    };
+
+    // Decodes the four RUN_GRAPH payloads.  False if they are malformed, a
+    // dependency is out of range or the graph has a cycle.
+    bool parseCommandGraph(const std::string& graph, const std::string& nodes,
+                           const std::string& strings, const std::string& dependencies,
+                           std::vector<GraphNode>& out, int32_t& max_parallel);
+
+    class GraphExecutor
+    {
+    public:
+        explicit GraphExecutor(RemoteProcess& remote_process)
+            : _remote_process(remote_process) {}
+
+        // Blocks until every node has finished or been skipped.  Output goes
+        // to the stream socket through remote_process, or into captured (one
+        // entry per node) when it is given.
+        // The caller holds one job slot for the whole run, which one node at
+        // a time uses.  Every further node running alongside it needs a
+        // slot of its own from scheduler, taken only when one is free; the
+        // node otherwise waits for a running one to finish.  nullptr = no
+        // limit beyond max_parallel.
+        std::vector<RemoteCommandNodeResultInner> run(const std::string& cwd,
+                                                      const std::vector<GraphNode>& nodes,
+                                                      int32_t max_parallel,
+                                                      JobScheduler* scheduler,
+                                                      std::vector<GraphNodeOutput>* captured = nullptr);
+
+        // Terminates the running nodes and skips the rest, including those
+        // of any later graph: meant for session teardown.  Safe to call from
+        // another thread.
+        void cancel();
+
+        // Appends the process group of every running node.  POSIX only.
+        void processGroups(std::vector<int64_t>& groups);
+
+    private:
+        struct Running;
+
+        void runNode(Running& running, const std::string& cwd, const GraphNode& node,
+                     GraphNodeOutput* captured);
+
+        RemoteProcess&        _remote_process;
+        std::mutex            _mtx;           // guards _running
+        std::vector<Running*> _running;
+        std::atomic<bool>     _cancelled { false };
+    };
+}
+
+#endif // __REMOTE_COMMAND_SERVER_GRAPH__
@@ -0,0 +1,292 @@
+#include "remote_command_server_handoff.hpp"
+#include "remote_command_server_helper.hpp"
+
+#ifndef _WIN32
+#  include <sys/un.h>
+#  include <fcntl.h>
+#  include <cstdlib>
+#  include <cerrno>
+#endif
+
+namespace Bn3Monkey
+{
+    static constexpr uint32_t HANDOFF_VERSION = 2;
+
+    struct HandoffRequest
+    {
+        char     magic[sizeof(REMOTE_COMMAND_MAGIC)] {0};
+        uint32_t version      { HANDOFF_VERSION };
+        int32_t  command_port { 0 };
+        int32_t  stream_port  { 0 };
+
+        HandoffRequest() { memcpy(magic, REMOTE_COMMAND_MAGIC, sizeof(magic)); }
+        inline bool valid() const {
+            return strncmp(magic, REMOTE_COMMAND_MAGIC, sizeof(magic)) == 0 &&
+                   version == HANDOFF_VERSION;
+        }
+    };
+
+    // Carries 1 + command_count descriptors as SCM_RIGHTS ancillary data:
+    //   [0] stream listener, [1..] command listeners
+    struct HandoffMessage
+    {
+        char     magic[sizeof(REMOTE_COMMAND_MAGIC)] {0};
+        uint32_t version       { HANDOFF_VERSION };
+        int32_t  command_port  { 0 };
+        int32_t  stream_port   { 0 };
+        uint32_t command_count { 0 };
+
+        HandoffMessage() { memcpy(magic, REMOTE_COMMAND_MAGIC, sizeof(magic)); }
+        inline bool valid() const {
+            return strncmp(magic, REMOTE_COMMAND_MAGIC, sizeof(magic)) == 0 &&
+                   version == HANDOFF_VERSION;
+        }
+    };
+
+    void InheritedListeners::close()
+    {
+        for (sock_t sock : command_socks) closeSocket(sock);
+        command_socks.clear();
+        if (stream_sock != INVALID_SOCK) { closeSocket(stream_sock); stream_sock = INVALID_SOCK; }
+    }
+
+    int32_t listeningPort(sock_t sock)
+    {
+        sockaddr_storage addr {};
+        socklen_t len = sizeof(addr);
+        if (::getsockname(sock, reinterpret_cast<sockaddr*>(&addr), &len) != 0)
+            return -1;
+        if (addr.ss_family == AF_INET)
+            return ntohs(reinterpret_cast<sockaddr_in*>(&addr)->sin_port);
+        if (addr.ss_family == AF_INET6)
+            return ntohs(reinterpret_cast<sockaddr_in6*>(&addr)->sin6_port);
+        return -1;
+    }
+
+#ifdef _WIN32
+
+    InheritedListeners listenersFromEnvironment(int32_t, int32_t) { return {}; }
+    bool takeOverListeners(const char*, int32_t, int32_t, InheritedListeners&) { return false; }
+    bool HandoffServer::open(const char*, DuplicateListeners, OnHandedOff) { return false; }
+    void HandoffServer::close() {}
+    void HandoffServer::serveLoop() {}
+    void HandoffServer::closeListener() {}
+
+#else
+
+    // -------------------------------------------------------------------------
+    // Socket activation
+    // -------------------------------------------------------------------------
+
+    InheritedListeners listenersFromEnvironment(int32_t command_port, int32_t stream_port)
+    {
+        static constexpr int SD_LISTEN_FDS_START = 3;
+
+        InheritedListeners result;
+        const char* pid_env = getenv("LISTEN_PID");
+        const char* fds_env = getenv("LISTEN_FDS");
+        if (!pid_env || !fds_env) return result;
+        if (static_cast<pid_t>(atol(pid_env)) != getpid()) return result;
+
+        int count = atoi(fds_env);
+        for (int fd = SD_LISTEN_FDS_START; fd < SD_LISTEN_FDS_START + count; ++fd) {
+            int32_t port = listeningPort(fd);
+            if (port == command_port)
+                result.command_socks.push_back(fd);
+            else if (port == stream_port && result.stream_sock == INVALID_SOCK)
+                result.stream_sock = fd;
+            else
+                continue;
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+
+        // Children spawned by runCommand must not think they were activated.
+        unsetenv("LISTEN_PID");
+        unsetenv("LISTEN_FDS");
+        unsetenv("LISTEN_FDNAMES");
+        return result;
+    }
+
+    // -------------------------------------------------------------------------
+    // Successor side
+    // -------------------------------------------------------------------------
+
+    static bool makeUnixAddress(const char* path, sockaddr_un& addr)
+    {
+        if (!path || strlen(path) >= sizeof(addr.sun_path)) return false;
+        addr = {};
+        addr.sun_family = AF_UNIX;
+        snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+        return true;
+    }
+
+    bool takeOverListeners(const char* path, int32_t command_port, int32_t stream_port,
+                           InheritedListeners& out)
+    {
+        sockaddr_un addr;
+        if (!makeUnixAddress(path, addr)) return false;
+
+        int sock = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (sock < 0) return false;
+        if (::connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            ::close(sock);      // nobody serving: fresh start
+            return false;
+        }
+
+        HandoffRequest request;
+        request.command_port = command_port;
+        request.stream_port  = stream_port;
+        if (!sendAll(sock, &request, sizeof(request))) {
+            ::close(sock);
+            return false;
+        }
+
+        HandoffMessage message;
+        char control[CMSG_SPACE((1 + MAX_HANDOFF_COMMAND_LISTENERS) * sizeof(int))] {0};
+        iovec iov { &message, sizeof(message) };
+        msghdr msg {};
+        msg.msg_iov        = &iov;
+        msg.msg_iovlen     = 1;
+        msg.msg_control    = control;
+        msg.msg_controllen = sizeof(control);
+
+        ssize_t n = ::recvmsg(sock, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            // Take ownership of whatever arrived, so a bad message leaks nothing
+            size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            std::vector<int> fds(count);
+            memcpy(fds.data(), CMSG_DATA(cmsg), count * sizeof(int));
+            if (count > 0) out.stream_sock = fds[0];
+            for (size_t i = 1; i < count; ++i)
+                out.command_socks.push_back(fds[i]);
+        }
+
+        // Wait until the predecessor has let go of the discovery port and the
+        // control path; only then may we bind them ourselves.
+        char released = 0;
+        bool ok = n == static_cast<ssize_t>(sizeof(message)) && message.valid() &&
+                  !(msg.msg_flags & MSG_CTRUNC) && out.complete() &&
+                  out.command_socks.size() == message.command_count &&
+                  message.command_port == command_port &&
+                  message.stream_port  == stream_port &&
+                  recvAll(sock, &released, sizeof(released)) && released == 1;
+        ::close(sock);
+
+        if (!ok) out.close();
+        return ok;
+    }
+
+    // -------------------------------------------------------------------------
+    // Predecessor side
+    // -------------------------------------------------------------------------
+
+    bool HandoffServer::open(const char* path, DuplicateListeners duplicate, OnHandedOff on_handed_off)
+    {
+        sockaddr_un addr;
+        if (!makeUnixAddress(path, addr)) return false;
+
+        // A stale socket file from a crashed server would make bind() fail.
+        ::unlink(path);
+
+        int sock = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (sock < 0) return false;
+        fcntl(sock, F_SETFD, FD_CLOEXEC);
+        if (::bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+            ::listen(sock, 1) != 0) {
+            ::close(sock);
+            return false;
+        }
+
+        _path          = path;
+        _listen_sock   = sock;
+        _duplicate     = std::move(duplicate);
+        _on_handed_off = std::move(on_handed_off);
+        _running.store(true);
+        _thread = std::thread(&HandoffServer::serveLoop, this);
+        return true;
+    }
+
+    void HandoffServer::closeListener()
+    {
+        if (_listen_sock == INVALID_SOCK) return;
+        ::close(_listen_sock);
+        _listen_sock = INVALID_SOCK;
+        ::unlink(_path.c_str());
+    }
+
+    void HandoffServer::close()
+    {
+        _running.store(false);
+        if (_thread.joinable())
+            _thread.join();
+        // After a handoff the path already belongs to the successor.
+        if (!_handed_off.load())
+            closeListener();
+    }
+
+    void HandoffServer::serveLoop()
+    {
+        setCurrentThreadName("RC_HANDOFF");
+
+        while (_running.load()) {
+            sock_t peer = acceptWithSelect(_listen_sock, nullptr, _running);
+            if (peer == INVALID_SOCK) break;
+
+            HandoffRequest request;
+            if (!recvAll(peer, &request, sizeof(request)) || !request.valid()) {
+                ::close(peer);
+                continue;
+            }
+
+            InheritedListeners listeners = _duplicate();
+            if (!listeners.complete() || listeners.command_socks.size() > MAX_HANDOFF_COMMAND_LISTENERS) {
+                listeners.close();
+                ::close(peer);
+                continue;
+            }
+
+            HandoffMessage message;
+            message.command_port  = listeningPort(listeners.command_socks.front());
+            message.stream_port   = listeningPort(listeners.stream_sock);
+            message.command_count = static_cast<uint32_t>(listeners.command_socks.size());
+
+            std::vector<int> fds { listeners.stream_sock };
+            fds.insert(fds.end(), listeners.command_socks.begin(), listeners.command_socks.end());
+            std::vector<char> control(CMSG_SPACE(fds.size() * sizeof(int)), 0);
+            iovec iov { &message, sizeof(message) };
+            msghdr msg {};
+            msg.msg_iov        = &iov;
+            msg.msg_iovlen     = 1;
+            msg.msg_control    = control.data();
+            msg.msg_controllen = control.size();
+            cmsghdr* cmsg   = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type  = SCM_RIGHTS;
+            cmsg->cmsg_len   = CMSG_LEN(fds.size() * sizeof(int));
+            memcpy(CMSG_DATA(cmsg), fds.data(), fds.size() * sizeof(int));
+
+            ssize_t sent = ::sendmsg(peer, &msg, MSG_NOSIGNAL);
+            listeners.close();      // the successor holds its own copies now
+            if (sent != static_cast<ssize_t>(sizeof(message))) {
+                ::close(peer);
+                continue;
+            }
+
+            printf("[Handoff] Listeners handed to successor, draining\n");
+            fflush(stdout);
+
+            _handed_off.store(true);
+            _on_handed_off();
+            closeListener();
+
+            char released = 1;
+            sendAll(peer, &released, sizeof(released));
+            ::close(peer);
+            break;
+        }
+    }
+
+#endif
+
+} // namespace Bn3Monkey
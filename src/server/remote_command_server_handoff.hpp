@@ -0,0 +1,97 @@
+#if !defined(__REMOTE_COMMAND_SERVER_HANDOFF__)
+#define __REMOTE_COMMAND_SERVER_HANDOFF__
+
+#include "remote_command_server_socket.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+namespace Bn3Monkey
+{
+    // -------------------------------------------------------------------------
+    // Listener handoff between server processes (POSIX only)
+    //
+    // Lets a new server binary take over the listening sockets of a running
+    // one, so an upgrade never refuses a connection:
+    //
+    //   new                                old (HandoffServer on `path`)
+    //    |--- connect + HandoffRequest ---->|
+    //    |                                  | dup listeners
+    //    |<-- HandoffMessage + SCM_RIGHTS --|
+    //    |                                  | stop accepting, close discovery
+    //    |                                  | and the control socket
+    //    |<-- released (1 byte) ------------|
+    //    | open discovery, serve `path`     | drain current session, retire
+    //
+    // Both processes hold the same kernel listening sockets for a moment, so
+    // pending connections simply wait in the backlog for whichever accepts.
+    // A server with several acceptors hands over every command listener
+    // (each has its own SO_REUSEPORT backlog), and the successor runs at
+    // least one acceptor per listener it received.
+    // -------------------------------------------------------------------------
+
+    // Most command listeners one handoff carries
+    static constexpr size_t MAX_HANDOFF_COMMAND_LISTENERS = 64;
+
+    struct InheritedListeners
+    {
+        std::vector<sock_t> command_socks;      // one per acceptor
+        sock_t              stream_sock { INVALID_SOCK };
+
+        inline bool complete() const {
+            return !command_socks.empty() && stream_sock != INVALID_SOCK;
+        }
+        void close();   // closes whatever was received (error paths)
+    };
+
+    // Local port a bound socket listens on, or -1.
+    int32_t listeningPort(sock_t sock);
+
+    // systemd-style socket activation: adopts $LISTEN_FDS descriptors (when
+    // $LISTEN_PID is this process) whose bound port matches command_port /
+    // stream_port; every match of command_port becomes an acceptor.
+    // Unmatched descriptors are left untouched.
+    InheritedListeners listenersFromEnvironment(int32_t command_port, int32_t stream_port);
+
+    // Asks the server listening on `path` to hand over its listeners.
+    // Returns false if no server answers there (nothing to take over).
+    // On success the predecessor has already released its discovery port.
+    bool takeOverListeners(const char* path, int32_t command_port, int32_t stream_port,
+                           InheritedListeners& out);
+
+    class HandoffServer
+    {
+    public:
+        // Returns duplicates of the listener descriptors; the originals keep
+        // accepting until the transfer succeeded.
+        using DuplicateListeners = std::function<InheritedListeners()>;
+        // Called once the descriptors were delivered, before the successor is
+        // told to proceed: stop accepting and free the discovery port.
+        using OnHandedOff        = std::function<void()>;
+
+        HandoffServer() {}
+        ~HandoffServer() { close(); }
+
+        bool open(const char* path, DuplicateListeners duplicate, OnHandedOff on_handed_off);
+        void close();
+
+        inline bool handedOff() const { return _handed_off.load(); }
+
+    private:
+        void serveLoop();
+        void closeListener();
+
+        std::string        _path;
+        sock_t             _listen_sock { INVALID_SOCK };
+        DuplicateListeners _duplicate;
+        OnHandedOff        _on_handed_off;
+        std::atomic<bool>  _running    { false };
+        std::atomic<bool>  _handed_off { false };
+        std::thread        _thread;
+    };
+}
+
+#endif // __REMOTE_COMMAND_SERVER_HANDOFF__
@@ -0,0 +1,130 @@
+#include "remote_command_server_heartbeat.hpp"
+#include "remote_command_server_helper.hpp"
+
+#include <chrono>
+#include <vector>
+
+namespace Bn3Monkey
+{
+    int64_t HeartbeatMonitor::nowMs()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void HeartbeatMonitor::configure(int32_t interval_ms, int32_t miss_count)
+    {
+        _interval_ms = interval_ms > 0 ? interval_ms : 0;
+        _miss_count  = miss_count  > 0 ? miss_count  : 1;
+    }
+
+    void HeartbeatMonitor::touch()
+    {
+        _last_seen_ms.store(nowMs());
+        _missed.store(0);
+    }
+
+    void HeartbeatMonitor::watchCommandSocket(sock_t sock)
+    {
+        _command_sock.store(sock);
+        if (sock != INVALID_SOCK)
+            touch();
+    }
+
+    // -------------------------------------------------------------------------
+    // attach / detach
+    // -------------------------------------------------------------------------
+
+    void HeartbeatMonitor::attach(sock_t stream_sock)
+    {
+        detach();
+        if (!enabled() || stream_sock == INVALID_SOCK) return;
+
+        std::lock_guard<std::mutex> lk(_thread_mtx);
+        touch();
+        _running.store(true);
+        _thread = std::thread(&HeartbeatMonitor::monitorLoop, this, stream_sock);
+    }
+
+    void HeartbeatMonitor::detach()
+    {
+        std::lock_guard<std::mutex> lk(_thread_mtx);
+        _running.store(false);
+        if (_thread.joinable())
+            _thread.join();
+    }
+
+    // -------------------------------------------------------------------------
+    // monitorLoop  (runs in _thread)
+    // -------------------------------------------------------------------------
+
+    void HeartbeatMonitor::monitorLoop(sock_t stream_sock)
+    {
+        setCurrentThreadName("RC_HEART");
+
+        uint32_t sequence     = 0;
+        int64_t  last_ping_ms = 0;
+        uint64_t frames_sent  = _remote_process.streamFramesSent();
+
+        while (_running.load()) {
+            // 100 ms, so detach() is never kept waiting
+            if (waitReadable(stream_sock, 100)) {
+                RemoteCommandStreamHeader header(RemoteCommandStreamType::INVALID, 0);
+                if (!recvAll(stream_sock, &header, sizeof(header)) || !header.valid())
+                    return;     // orderly close: the command socket reports it too
+                if (header.payload_length > 4096)
+                    return;     // clients only ever send small control frames
+
+                std::vector<char> payload(header.payload_length);
+                if (header.payload_length > 0 &&
+                    !recvAll(stream_sock, payload.data(), header.payload_length))
+                    return;
+
+                if (header.type == RemoteCommandStreamType::STREAM_PONG)
+                    touch();
+                continue;
+            }
+
+            // Output that got through means the client is draining its
+            // socket, which is as good as a PONG.  A flood of output keeps
+            // the stream lock busy, so pings may not get out at all then.
+            uint64_t frames = _remote_process.streamFramesSent();
+            if (frames != frames_sent) {
+                frames_sent = frames;
+                touch();
+            }
+
+            int64_t now = nowMs();
+            if (now - _last_seen_ms.load() < _interval_ms) continue;
+            if (now - last_ping_ms < _interval_ms)         continue;
+
+            if (_missed.load() >= _miss_count) {
+                declareDead(stream_sock);
+                return;
+            }
+
+            // Reaching here, not one frame went out for a whole interval.
+            // If the ping cannot be sent either, a reader is stuck in send to
+            // a peer that stopped draining, and that counts as missed too.
+            ++sequence;
+            _remote_process.trySendStreamFrame(RemoteCommandStreamType::STREAM_PING,
+                                               &sequence, sizeof(sequence));
+            frames_sent = _remote_process.streamFramesSent();
+            _missed.fetch_add(1);
+            last_ping_ms = now;
+        }
+    }
+
+    void HeartbeatMonitor::declareDead(sock_t stream_sock)
+    {
+        printf("[Heartbeat] Client missed %d pings, dropping session\n", _miss_count);
+        fflush(stdout);
+
+        // The handler owns both sockets; shutdown only wakes it up so it can
+        // run its normal disconnect path (kill processes, close, re-accept).
+        shutdownSocket(_command_sock.load());
+        shutdownSocket(stream_sock);
+        _remote_process.terminate();
+    }
+
+} // namespace Bn3Monkey
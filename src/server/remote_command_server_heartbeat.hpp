@@ -0,0 +1,69 @@
+#if !defined(__REMOTE_COMMAND_SERVER_HEARTBEAT__)
+#define __REMOTE_COMMAND_SERVER_HEARTBEAT__
+
+#include "remote_command_server_process.hpp"
+#include "remote_command_server_socket.hpp"
+#include <cstdint>
+#include <thread>
+#include <atomic>
+#include <mutex>
+
+namespace Bn3Monkey
+{
+    // -------------------------------------------------------------------------
+    // HeartbeatMonitor
+    //
+    // Detects a silently dead client (pulled cable, frozen host) that would
+    // otherwise leave the command handler blocked in recvAll forever.
+    //
+    // While a stream socket is attached, a monitor thread reads PONG frames
+    // from it and, whenever the client has been silent for interval_ms, sends
+    // a PING.  Any request on the command socket (touch()) and any frame the
+    // client drained from the stream also count as traffic.  After
+    // miss_count unanswered pings the session is declared dead: the command
+    // and stream sockets are shut down, which wakes the handler, and the
+    // running process is terminated.
+    // -------------------------------------------------------------------------
+    class HeartbeatMonitor
+    {
+    public:
+        explicit HeartbeatMonitor(RemoteProcess& remote_process)
+            : _remote_process(remote_process) {}
+        ~HeartbeatMonitor() { detach(); }
+
+        void configure(int32_t interval_ms, int32_t miss_count);
+        inline bool enabled() const { return _interval_ms > 0; }
+
+        // Record client traffic; resets the missed-ping counter.
+        void touch();
+
+        // Command socket to shut down when the peer is declared dead.
+        // Pass INVALID_SOCK when the client disconnects.
+        void watchCommandSocket(sock_t sock);
+
+        // Start / stop monitoring the given stream socket.  attach() replaces
+        // any previous socket.  The caller keeps ownership of the socket and
+        // must detach() before closing it.
+        void attach(sock_t stream_sock);
+        void detach();
+
+    private:
+        void monitorLoop(sock_t stream_sock);
+        void declareDead(sock_t stream_sock);
+        static int64_t nowMs();
+
+        RemoteProcess&       _remote_process;
+        int32_t              _interval_ms { 0 };
+        int32_t              _miss_count  { 3 };
+
+        std::atomic<int64_t> _last_seen_ms { 0 };
+        std::atomic<int32_t> _missed       { 0 };
+        std::atomic<sock_t>  _command_sock { INVALID_SOCK };
+
+        std::mutex           _thread_mtx;    // guards _thread / _running
+        std::atomic<bool>    _running { false };
+        std::thread          _thread;
+    };
+}
+
+#endif // __REMOTE_COMMAND_SERVER_HEARTBEAT__
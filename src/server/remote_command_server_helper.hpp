@@ -4,14 +4,22 @@
 #include <thread>
 #include <string>
 #include <cstring>
+#include <cstdint>
+#include <vector>
 
 #if defined(_WIN32)
     #include <windows.h>
 #elif defined(__linux__)
     #include <pthread.h>
+    #include <sched.h>
     #include <errno.h>
 #endif
 
+#if !defined(_WIN32)
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
 namespace Bn3Monkey
 {
     inline void setCurrentThreadName(const char* name) noexcept
@@ -54,6 +62,91 @@ namespace Bn3Monkey
         return;
     #endif
     }
+
+    // Pins the calling thread to one core.  Threads it creates afterwards
+    // inherit the mask on Linux.  Returns false where unsupported.
+    inline bool pinCurrentThreadToCore(int32_t core) noexcept
+    {
+    #if defined(_WIN32)
+
+        if (core < 0 || core >= static_cast<int32_t>(sizeof(DWORD_PTR) * 8))
+            return false;
+        return SetThreadAffinityMask(GetCurrentThread(),
+                                     static_cast<DWORD_PTR>(1) << core) != 0;
+
+    #elif defined(__linux__)
+
+        if (core < 0 || core >= CPU_SETSIZE)
+            return false;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(core, &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+
+    #else
+        (void)core;
+        return false;
+    #endif
+    }
+
+    // Pins the calling thread to a set of cores (the server's reserved ones).
+    // An empty set leaves it alone.  Returns false where unsupported.
+    inline bool pinCurrentThreadToCores(const std::vector<int32_t>& cores) noexcept
+    {
+        if (cores.empty()) return true;
+    #if defined(_WIN32)
+
+        DWORD_PTR mask = 0;
+        for (int32_t core : cores) {
+            if (core >= 0 && core < static_cast<int32_t>(sizeof(DWORD_PTR) * 8))
+                mask |= static_cast<DWORD_PTR>(1) << core;
+        }
+        return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+
+    #elif defined(__linux__)
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int32_t core : cores) {
+            if (core >= 0 && core < CPU_SETSIZE)
+                CPU_SET(core, &set);
+        }
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+
+    #else
+        return false;
+    #endif
+    }
+
+    // Undoes an inherited pin so the thread (or a freshly forked child) may
+    // run on any core the process is allowed to use.
+    inline void unpinCurrentThread() noexcept
+    {
+    #if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int i = 0; i < CPU_SETSIZE; ++i)
+            CPU_SET(i, &set);
+        sched_setaffinity(0, sizeof(set), &set);   // kernel masks it to the allowed cpuset
+    #endif
+    }
+
+#if !defined(_WIN32)
+    // pipe() whose ends a child only keeps if it dup2()s them, so a command
+    // forked by another thread meanwhile never holds a write end open (and
+    // with it the reader's EOF).  Atomic where pipe2 exists.
+    inline int pipeCloseOnExec(int fds[2]) noexcept
+    {
+    #if defined(__APPLE__)
+        if (pipe(fds) != 0) return -1;
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+        return 0;
+    #else
+        return pipe2(fds, O_CLOEXEC);
+    #endif
+    }
+#endif
 }
 
 #endif // __REMOTE_COMMAND_SERVER_HELPER__
\ No newline at end of file
@@ -0,0 +1,37 @@
+#include "remote_command_server_instruction.hpp"
+
+#include <atomic>
+
+namespace Bn3Monkey
+{
+    bool InstructionRegistry::isUserInstruction(int32_t instruction)
+    {
+        return instruction >= REMOTE_COMMAND_USER_INSTRUCTION_BASE &&
+               instruction <  REMOTE_COMMAND_USER_INSTRUCTION_BASE + REMOTE_COMMAND_USER_INSTRUCTION_COUNT;
+    }
+
+    bool InstructionRegistry::add(int32_t instruction, RemoteInstructionHandler handler)
+    {
+        if (!isUserInstruction(instruction) || !handler) return false;
+
+        Handler& slot = _handlers[static_cast<size_t>(instruction - REMOTE_COMMAND_USER_INSTRUCTION_BASE)];
+        Handler expected;
+        Handler desired = std::make_shared<const RemoteInstructionHandler>(std::move(handler));
+        return std::atomic_compare_exchange_strong(&slot, &expected, desired);
+    }
+
+    bool InstructionRegistry::remove(int32_t instruction)
+    {
+        if (!isUserInstruction(instruction)) return false;
+
+        Handler& slot = _handlers[static_cast<size_t>(instruction - REMOTE_COMMAND_USER_INSTRUCTION_BASE)];
+        return std::atomic_exchange(&slot, Handler()) != nullptr;
+    }
+
+    InstructionRegistry::Handler InstructionRegistry::find(int32_t instruction) const
+    {
+        if (!isUserInstruction(instruction)) return nullptr;
+        return std::atomic_load(&_handlers[static_cast<size_t>(instruction - REMOTE_COMMAND_USER_INSTRUCTION_BASE)]);
+    }
+
+} // namespace Bn3Monkey
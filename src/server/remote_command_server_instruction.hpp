@@ -0,0 +1,40 @@
+#if !defined(__REMOTE_COMMAND_SERVER_INSTRUCTION__)
+#define __REMOTE_COMMAND_SERVER_INSTRUCTION__
+
+#include "../../include/remote_command_server.hpp"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace Bn3Monkey
+{
+    // -------------------------------------------------------------------------
+    // InstructionRegistry
+    //
+    // Handlers for the user instruction range, indexed directly by
+    // instruction - REMOTE_COMMAND_USER_INSTRUCTION_BASE.  Lookups are
+    // lock-free (atomic shared_ptr loads), so dispatch costs the same no
+    // matter how many handlers are registered or whether one is being
+    // swapped concurrently.
+    // -------------------------------------------------------------------------
+    class InstructionRegistry
+    {
+    public:
+        using Handler = std::shared_ptr<const RemoteInstructionHandler>;
+
+        InstructionRegistry() : _handlers(REMOTE_COMMAND_USER_INSTRUCTION_COUNT) {}
+
+        static bool isUserInstruction(int32_t instruction);
+
+        bool add(int32_t instruction, RemoteInstructionHandler handler);
+        bool remove(int32_t instruction);
+
+        // nullptr if nothing is registered for instruction
+        Handler find(int32_t instruction) const;
+
+    private:
+        std::vector<Handler> _handlers;
+    };
+}
+
+#endif // __REMOTE_COMMAND_SERVER_INSTRUCTION__
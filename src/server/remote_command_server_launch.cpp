@@ -0,0 +1,222 @@
+#include "remote_command_server_launch.hpp"
+#include "remote_command_server_helper.hpp"
+#include "../protocol/remote_command_protocol.hpp"
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace Bn3Monkey
+{
+    // linux/ioprio.h, which not every libc ships
+    static constexpr int IOPRIO_WHO_PROCESS  = 1;
+    static constexpr int IOPRIO_CLASS_SHIFT  = 13;
+    static constexpr int32_t IOPRIO_CLASS_MAX = 3;
+    static constexpr int32_t IOPRIO_LEVEL_MAX = 7;
+
+    static constexpr const char* CGROUP_LIMITS[] = { "cpu.max", "memory.max" };
+
+    bool parseCpuList(const char* text, std::vector<int32_t>& cpus)
+    {
+        cpus.clear();
+        if (!text) return true;
+        const char* p = text;
+        while (*p) {
+            char* end;
+            long first = strtol(p, &end, 10);
+            if (end == p || first < 0) return false;
+            long last = first;
+            p = end;
+            if (*p == '-') {
+                last = strtol(p + 1, &end, 10);
+                if (end == p + 1 || last < first) return false;
+                p = end;
+            }
+            if (last > 4095) return false;
+            for (long cpu = first; cpu <= last; ++cpu)
+                cpus.push_back(static_cast<int32_t>(cpu));
+            if (*p == ',') ++p;
+            else if (*p)   return false;
+        }
+        return true;
+    }
+
+    std::vector<int32_t> unreservedCpus(const std::vector<int32_t>& reserved)
+    {
+        std::vector<int32_t> cpus;
+        if (reserved.empty()) return cpus;
+        int32_t count = static_cast<int32_t>(std::thread::hardware_concurrency());
+        for (int32_t cpu = 0; cpu < count; ++cpu) {
+            bool taken = false;
+            for (int32_t r : reserved) taken = taken || r == cpu;
+            if (!taken) cpus.push_back(cpu);
+        }
+        return cpus;
+    }
+
+    bool parseLaunchOptions(const std::string& launch, const std::string& cpus, const std::string& limits,
+                            LaunchOptions& out, std::vector<std::string>& cgroup_limits)
+    {
+        out = LaunchOptions();
+        cgroup_limits.clear();
+
+        RemoteCommandLaunchInner inner;
+        if (launch.size() != sizeof(inner)) return false;
+        memcpy(&inner, launch.data(), sizeof(inner));
+        if (cpus.size() % sizeof(uint32_t) != 0) return false;
+        if (!limits.empty() && limits.back() != '\0') return false;
+
+        if (inner.nice < -20 || inner.nice > 19) return false;
+        if (inner.io_class < 0 || inner.io_class > IOPRIO_CLASS_MAX) return false;
+        if (inner.io_level < 0 || inner.io_level > IOPRIO_LEVEL_MAX) return false;
+        out.nice     = inner.nice;
+        out.io_class = inner.io_class;
+        out.io_level = inner.io_level;
+
+        for (size_t pos = 0; pos < cpus.size(); pos += sizeof(uint32_t)) {
+            uint32_t cpu;
+            memcpy(&cpu, cpus.data() + pos, sizeof(cpu));
+            if (cpu >= static_cast<uint32_t>(std::max(1u, std::thread::hardware_concurrency()))) return false;
+            out.cpus.push_back(static_cast<int32_t>(cpu));
+        }
+
+        for (size_t pos = 0; pos < limits.size(); ) {
+            std::string entry(limits.c_str() + pos);
+            pos += entry.size() + 1;
+            size_t eq = entry.find('=');
+            if (eq == std::string::npos || eq + 1 == entry.size()) return false;
+
+            bool known = false;
+            for (const char* name : CGROUP_LIMITS)
+                known = known || entry.compare(0, eq, name) == 0;
+            if (!known) return false;
+            for (size_t i = eq + 1; i < entry.size(); ++i) {
+                if (!isalnum(static_cast<unsigned char>(entry[i])) && entry[i] != ' ') return false;
+            }
+            cgroup_limits.push_back(std::move(entry));
+        }
+
+#ifdef _WIN32
+        if (!out.cpus.empty() || out.nice != 0 || out.io_class != 0 || !cgroup_limits.empty())
+            return false;
+#elif !defined(__linux__)
+        // Affinity, I/O priority and cgroups are Linux interfaces
+        if (!out.cpus.empty() || out.io_class != 0 || !cgroup_limits.empty())
+            return false;
+#endif
+        out.custom = !out.cpus.empty() || out.nice != 0 || out.io_class != 0 || !cgroup_limits.empty();
+        return true;
+    }
+
+    static bool writeControlFile(const fs::path& path, const std::string& value)
+    {
+        std::ofstream file(path);
+        if (!file) return false;
+        file << value;
+        file.flush();
+        return static_cast<bool>(file);
+    }
+
+    std::string prepareLaunchCgroup(const std::string& cgroup_root, uint32_t session_id,
+                                    const std::vector<std::string>& limits)
+    {
+#ifndef __linux__
+        (void)cgroup_root; (void)session_id; (void)limits;
+        return std::string();
+#else
+        char name[48];
+        snprintf(name, sizeof(name), "rc-%ld-%u", static_cast<long>(getpid()), session_id);
+
+        std::error_code ec;
+        fs::path root(cgroup_root);
+        fs::path dir = root / name;
+        fs::create_directory(dir, ec);
+        if (ec || !fs::exists(dir / "cgroup.procs", ec)) return std::string();
+
+        // The limits need their controllers enabled for the children of
+        // root; one at a time, since one refusal fails the whole write.
+        for (const char* controller : { "+cpu", "+memory" })
+            writeControlFile(root / "cgroup.subtree_control", controller);
+
+        // Limits not asked for go back to unlimited
+        for (const char* name_of_limit : CGROUP_LIMITS) {
+            std::string value = "max";
+            std::string prefix = std::string(name_of_limit) + "=";
+            for (const std::string& limit : limits) {
+                if (limit.compare(0, prefix.size(), prefix) == 0)
+                    value = limit.substr(prefix.size());
+            }
+            bool requested = value != "max";
+            if (!writeControlFile(dir / name_of_limit, value) && requested)
+                return std::string();
+        }
+        return dir.string();
+#endif
+    }
+
+    void removeLaunchCgroup(const std::string& cgroup)
+    {
+        if (cgroup.empty()) return;
+        // Killed processes take a moment to leave the cgroup
+        for (int attempt = 0; attempt < 10; ++attempt) {
+            std::error_code ec;
+            if (fs::remove(cgroup, ec) || !fs::exists(cgroup, ec)) return;
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+    }
+
+    void applyLaunchOptions(const LaunchOptions* options) noexcept
+    {
+        if (!options || options->cpus.empty()) {
+            unpinCurrentThread();
+        }
+#ifdef __linux__
+        else {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int32_t cpu : options->cpus) {
+                if (cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+            }
+            sched_setaffinity(0, sizeof(set), &set);
+        }
+#endif
+        if (!options) return;
+
+#ifndef _WIN32
+        if (options->nice != 0)
+            setpriority(PRIO_PROCESS, 0, options->nice);
+#endif
+#ifdef __linux__
+        if (options->io_class != 0)
+            syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+                    (options->io_class << IOPRIO_CLASS_SHIFT) | options->io_level);
+        if (!options->cgroup_procs.empty()) {
+            // "0" moves the writing process itself
+            int fd = ::open(options->cgroup_procs.c_str(), O_WRONLY | O_CLOEXEC);
+            if (fd != -1) {
+                ssize_t written = ::write(fd, "0", 1);
+                (void)written;
+                ::close(fd);
+            }
+        }
+#endif
+    }
+
+} // namespace Bn3Monkey
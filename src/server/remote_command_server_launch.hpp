@@ -0,0 +1,66 @@
+#if !defined(__REMOTE_COMMAND_SERVER_LAUNCH__)
+#define __REMOTE_COMMAND_SERVER_LAUNCH__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+
+namespace Bn3Monkey
+{
+    // -------------------------------------------------------------------------
+    // Launch options (INSTRUCTION_SET_LAUNCH_OPTIONS)
+    //
+    // Where and how processes started for a session run: CPU affinity, nice
+    // level, I/O priority and an optional cgroup v2 with cpu.max /
+    // memory.max.  The session's RemoteProcess holds the current set; every
+    // spawner (RUN_COMMAND, OPEN_PROCESS, graphs, scripts, maps, cached
+    // commands) applies it in the child between fork and exec.
+    //
+    // Processes started without explicit affinity stay off the server's
+    // reserved cores (RemoteCommandServerOptions::server_cores).
+    // -------------------------------------------------------------------------
+    struct LaunchOptions
+    {
+        std::vector<int32_t> cpus;             // empty = every core
+        int32_t              nice     { 0 };   // 0 = inherit
+        int32_t              io_class { 0 };   // 0 = inherit, else IOPRIO_CLASS_*
+        int32_t              io_level { 0 };
+        std::string          cgroup;           // directory, empty = none
+        std::string          cgroup_procs;     // its cgroup.procs, built before any fork
+
+        // True when the session asked for something beyond the server's
+        // defaults; in-process shortcuts (built-ins, warm interpreters) are
+        // skipped then, so the command really runs under these settings.
+        bool                 custom   { false };
+    };
+
+    // "0-3,8" -> {0,1,2,3,8}; false if malformed.
+    bool parseCpuList(const char* text, std::vector<int32_t>& cpus);
+
+    // Every core the server may use, minus the reserved ones; empty when
+    // nothing is reserved (or nothing would be left).
+    std::vector<int32_t> unreservedCpus(const std::vector<int32_t>& reserved);
+
+    // Decodes and checks the SET_LAUNCH_OPTIONS payloads.  limits receives
+    // the "cpu.max=..." / "memory.max=..." entries.  False if a value is out
+    // of range or unsupported on this platform.
+    bool parseLaunchOptions(const std::string& launch, const std::string& cpus, const std::string& limits,
+                            LaunchOptions& out, std::vector<std::string>& cgroup_limits);
+
+    // Creates (or reuses) cgroup_root/rc-<server pid>-<session_id> and
+    // writes the limits into it.  Returns the cgroup directory, or an empty
+    // string on failure.
+    std::string prepareLaunchCgroup(const std::string& cgroup_root, uint32_t session_id,
+                                    const std::vector<std::string>& limits);
+
+    // Best effort: the directory only goes once its processes have exited.
+    void removeLaunchCgroup(const std::string& cgroup);
+
+    // Called in a freshly forked child before exec.  nullptr = no options
+    // (just undo the parent thread's core pin).  Failures are ignored: the
+    // command still runs, with the server's own settings.
+    void applyLaunchOptions(const LaunchOptions* options) noexcept;
+}
+
+#endif // __REMOTE_COMMAND_SERVER_LAUNCH__
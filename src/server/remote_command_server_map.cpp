@@ -0,0 +1,159 @@
+#include "remote_command_server_map.hpp"
+#include "remote_command_server_filesystem.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <thread>
+
+namespace Bn3Monkey
+{
+    // One argument to `sh -c` may not exceed 128 KiB on Linux, and a Windows
+    // command line is limited to 32 K characters; batches stay below both.
+    static constexpr size_t MAX_BATCH_COMMAND = 30000;
+
+    // Automatic batches give every worker a few invocations, so one slow
+    // batch does not leave the others idle at the end.
+    static constexpr size_t AUTO_BATCHES_PER_WORKER = 4;
+    static constexpr size_t AUTO_BATCH_LIMIT        = 64;
+
+    static std::string quoteArgument(const std::string& argument)
+    {
+#ifdef _WIN32
+        // '"' cannot appear in a Windows path
+        return "\"" + argument + "\"";
+#else
+        bool plain = !argument.empty() &&
+            std::all_of(argument.begin(), argument.end(), [](char c) {
+                return isalnum(static_cast<unsigned char>(c)) || strchr("_./-+,:@%=", c) != nullptr;
+            });
+        if (plain) return argument;
+
+        std::string quoted = "'";
+        for (char c : argument) {
+            if (c == '\'') quoted += "'\\''";
+            else           quoted += c;
+        }
+        return quoted + "'";
+#endif
+    }
+
+    static std::string replaceAll(std::string text, const std::string& placeholder, const std::string& value)
+    {
+        for (size_t pos = text.find(placeholder); pos != std::string::npos;
+             pos = text.find(placeholder, pos + value.size()))
+            text.replace(pos, placeholder.size(), value);
+        return text;
+    }
+
+    bool planFileMap(const std::string& cwd, const std::string& command_template,
+                     const std::string& inputs, int32_t batch_size, int32_t parallelism,
+                     FileMapPlan& plan)
+    {
+        plan = FileMapPlan();
+        if (command_template.empty()) return false;
+        if (!inputs.empty() && inputs.back() != '\0') return false;
+
+        const bool single  = command_template.find("{}") != std::string::npos;
+        const bool batched = command_template.find("{+}") != std::string::npos;
+        if (single && batched) return false;
+
+        for (size_t pos = 0; pos < inputs.size(); ) {
+            std::string entry(inputs.c_str() + pos);
+            pos += entry.size() + 1;
+            if (entry.empty()) return false;
+
+            if (isGlobPattern(entry)) {
+                std::vector<std::string> matches = expandGlobAt(cwd, entry);
+                plan.items.insert(plan.items.end(), matches.begin(), matches.end());
+            } else {
+                plan.items.push_back(std::move(entry));
+            }
+        }
+
+        size_t limit = 1;
+        if (!single) {
+            if (batch_size > 0) {
+                limit = static_cast<size_t>(batch_size);
+            } else {
+                size_t workers = parallelism > 0 ? static_cast<size_t>(parallelism) : std::thread::hardware_concurrency();
+                workers = std::max<size_t>(workers, 1);
+                limit = plan.items.size() / (workers * AUTO_BATCHES_PER_WORKER);
+                limit = std::min(std::max<size_t>(limit, 1), AUTO_BATCH_LIMIT);
+            }
+        }
+
+        auto emit = [&](std::string arguments) {
+            GraphNode node;
+            if (single)
+                node.command = replaceAll(command_template, "{}", arguments);
+            else if (batched)
+                node.command = replaceAll(command_template, "{+}", arguments);
+            else
+                node.command = command_template + " " + arguments;
+            plan.invocations.push_back(std::move(node));
+        };
+
+        std::string arguments;
+        size_t in_batch = 0;
+        plan.invocation_of.reserve(plan.items.size());
+        for (const std::string& item : plan.items) {
+            std::string quoted = quoteArgument(item);
+            bool full = in_batch == limit ||
+                        (in_batch > 0 && command_template.size() + arguments.size() + quoted.size() + 1 > MAX_BATCH_COMMAND);
+            if (full) {
+                emit(std::move(arguments));
+                arguments.clear();
+                in_batch = 0;
+            }
+            if (in_batch > 0) arguments += ' ';
+            arguments += quoted;
+            ++in_batch;
+            plan.invocation_of.push_back(static_cast<uint32_t>(plan.invocations.size()));
+        }
+        if (in_batch > 0)
+            emit(std::move(arguments));
+        return true;
+    }
+
+    std::string encodeFileMapReply(const FileMapPlan& plan,
+                                   const std::vector<RemoteCommandNodeResultInner>& results,
+                                   const std::vector<GraphNodeOutput>& outputs)
+    {
+        RemoteCommandMapReplyInner header;
+        header.item_count       = static_cast<uint32_t>(plan.items.size());
+        header.invocation_count = static_cast<uint32_t>(plan.invocations.size());
+
+        std::string reply(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (size_t i = 0; i < plan.items.size(); ++i) {
+            RemoteCommandMapItemInner item;
+            item.invocation  = plan.invocation_of[i];
+            item.path_length = static_cast<uint32_t>(plan.items[i].size());
+            reply.append(reinterpret_cast<const char*>(&item), sizeof(item));
+        }
+
+        size_t budget = MAX_MAP_REPLY;
+        std::vector<size_t> output_lengths(plan.invocations.size()), error_lengths(plan.invocations.size());
+        for (size_t i = 0; i < plan.invocations.size(); ++i) {
+            output_lengths[i] = std::min(outputs[i].output.size(), budget);
+            budget -= output_lengths[i];
+            error_lengths[i] = std::min(outputs[i].error.size(), budget);
+            budget -= error_lengths[i];
+
+            RemoteCommandMapInvocationInner invocation;
+            invocation.result        = results[i];
+            invocation.output_length = static_cast<uint32_t>(output_lengths[i]);
+            invocation.error_length  = static_cast<uint32_t>(error_lengths[i]);
+            reply.append(reinterpret_cast<const char*>(&invocation), sizeof(invocation));
+        }
+
+        for (const std::string& item : plan.items)
+            reply += item;
+        for (size_t i = 0; i < plan.invocations.size(); ++i) {
+            reply.append(outputs[i].output, 0, output_lengths[i]);
+            reply.append(outputs[i].error, 0, error_lengths[i]);
+        }
+        return reply;
+    }
+
+} // namespace Bn3Monkey
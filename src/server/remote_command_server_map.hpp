@@ -0,0 +1,41 @@
+#if !defined(__REMOTE_COMMAND_SERVER_MAP__)
+#define __REMOTE_COMMAND_SERVER_MAP__
+
+#include "remote_command_server_graph.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Bn3Monkey
+{
+    // -------------------------------------------------------------------------
+    // Parallel map over files (INSTRUCTION_MAP_FILES)
+    //
+    // The file list is expanded on the server, cut into invocations of the
+    // command template and run as a dependency-free command graph, so the
+    // work is spread over max_parallel processes.  Output is captured per
+    // invocation instead of interleaving on the stream socket.
+    // -------------------------------------------------------------------------
+    struct FileMapPlan
+    {
+        std::vector<std::string> items;         // expanded inputs, in order
+        std::vector<uint32_t>    invocation_of; // item index -> invocation index
+        std::vector<GraphNode>   invocations;
+    };
+
+    // inputs: NUL-terminated entries.  parallelism is only used to size
+    // automatic batches (batch_size <= 0).  False if the template uses both
+    // "{}" and "{+}" or the inputs are malformed.
+    bool planFileMap(const std::string& cwd, const std::string& command_template,
+                     const std::string& inputs, int32_t batch_size, int32_t parallelism,
+                     FileMapPlan& plan);
+
+    // The MAP_FILES response payload.  Output beyond MAX_MAP_REPLY bytes in
+    // total is cut off.
+    static constexpr size_t MAX_MAP_REPLY = 256 * 1024 * 1024;
+    std::string encodeFileMapReply(const FileMapPlan& plan,
+                                   const std::vector<RemoteCommandNodeResultInner>& results,
+                                   const std::vector<GraphNodeOutput>& outputs);
+}
+
+#endif // __REMOTE_COMMAND_SERVER_MAP__
@@ -0,0 +1,402 @@
+#include "remote_command_server_metrics.hpp"
+#include "remote_command_server_helper.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+namespace Bn3Monkey
+{
+    // -------------------------------------------------------------------------
+    // Prometheus helpers
+    // -------------------------------------------------------------------------
+
+    // Prometheus summary: name{labels,quantile=...}, name_sum, name_count
+    // (in seconds).  labels may be empty.
+    static void writePrometheusSummary(std::string& out, const LatencyHistogram& histogram,
+                                       const char* name, const std::string& labels)
+    {
+        const uint64_t count = histogram.count();
+        const std::string prefix = labels.empty() ? "" : labels + ",";
+        const std::string braces = labels.empty() ? "" : "{" + labels + "}";
+        char number[48];
+        for (double q : { 0.5, 0.9, 0.99 }) {
+            snprintf(number, sizeof(number), "quantile=\"%g\"} %.6f\n",
+                     q, static_cast<double>(histogram.quantile(q, count)) / 1e6);
+            out += name; out += '{'; out += prefix; out += number;
+        }
+        snprintf(number, sizeof(number), " %.6f\n", static_cast<double>(histogram.sum()) / 1e6);
+        out += name; out += "_sum"; out += braces; out += number;
+        snprintf(number, sizeof(number), " %llu\n", static_cast<unsigned long long>(count));
+        out += name; out += "_count"; out += braces; out += number;
+    }
+
+    // -------------------------------------------------------------------------
+    // InstrumentedMutex
+    // -------------------------------------------------------------------------
+
+#if defined(REMOTE_COMMAND_LOCK_STATS)
+    void InstrumentedMutex::lock()
+    {
+        if (!_stats) {
+            _mtx.lock();
+            return;
+        }
+        if (_mtx.try_lock()) {
+            _acquired = std::chrono::steady_clock::now();
+            _stats->wait.record(0);
+        } else {
+            const auto start = std::chrono::steady_clock::now();
+            _mtx.lock();
+            _acquired = std::chrono::steady_clock::now();
+            _stats->contended.fetch_add(1, std::memory_order_relaxed);
+            _stats->wait.record(elapsedMicroseconds(start, _acquired));
+        }
+        _stats->acquisitions.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool InstrumentedMutex::try_lock()
+    {
+        if (!_mtx.try_lock()) return false;
+        if (_stats) {
+            _acquired = std::chrono::steady_clock::now();
+            _stats->wait.record(0);
+            _stats->acquisitions.fetch_add(1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    void InstrumentedMutex::unlock()
+    {
+        if (!_stats) {
+            _mtx.unlock();
+            return;
+        }
+        const uint64_t held = elapsedMicroseconds(_acquired);
+        LockStats* stats = _stats;
+        _mtx.unlock();
+        stats->hold.record(held);
+    }
+#endif
+
+    // -------------------------------------------------------------------------
+    // ServerMetrics
+    // -------------------------------------------------------------------------
+
+    ServerMetrics::InstructionSlot* ServerMetrics::slotFor(int32_t instruction) noexcept
+    {
+        if (instruction == 0) return nullptr;
+
+        // Open addressing: a slot, once claimed, keeps its code for good
+        size_t start = (static_cast<uint32_t>(instruction) * 2654435761u) % INSTRUCTION_SLOTS;
+        for (size_t i = 0; i < INSTRUCTION_SLOTS; ++i) {
+            InstructionSlot& slot = _instructions[(start + i) % INSTRUCTION_SLOTS];
+            int32_t current = slot.instruction.load(std::memory_order_acquire);
+            if (current == instruction) return &slot;
+            if (current == 0) {
+                int32_t expected = 0;
+                if (slot.instruction.compare_exchange_strong(expected, instruction, std::memory_order_acq_rel) ||
+                    expected == instruction)
+                    return &slot;
+            }
+        }
+        return nullptr;
+    }
+
+    void ServerMetrics::recordRequest(int32_t instruction, uint64_t receive_us, uint64_t execute_us, uint64_t send_us,
+                                      uint64_t bytes_received, uint64_t bytes_sent) noexcept
+    {
+        _command_bytes_received.fetch_add(bytes_received, std::memory_order_relaxed);
+        _command_bytes_sent.fetch_add(bytes_sent, std::memory_order_relaxed);
+
+        InstructionSlot* slot = slotFor(instruction);
+        if (!slot) return;
+        slot->receive.record(receive_us);
+        slot->execute.record(execute_us);
+        slot->send.record(send_us);
+    }
+
+    std::string ServerMetrics::snapshot(const Gauges& gauges) const
+    {
+        RemoteCommandStatsInner stats;
+        stats.uptime_ms              = elapsedMicroseconds(_started) / 1000;
+        stats.command_bytes_received = _command_bytes_received.load(std::memory_order_relaxed);
+        stats.command_bytes_sent     = _command_bytes_sent.load(std::memory_order_relaxed);
+        stats.stream_bytes_sent      = _stream_bytes_sent.load(std::memory_order_relaxed);
+        stats.sessions_accepted      = _sessions_accepted.load(std::memory_order_relaxed);
+        stats.sessions_active        = gauges.sessions_active;
+        stats.jobs_running           = gauges.jobs_running;
+        stats.jobs_waiting           = gauges.jobs_waiting;
+        stats.operations_queued      = gauges.operations_queued;
+        stats.spawn                  = _spawn.summary();
+        stats.job_queue              = _job_queue.summary();
+
+        std::vector<RemoteCommandInstructionStatsInner> entries;
+        for (const InstructionSlot& slot : _instructions) {
+            int32_t instruction = slot.instruction.load(std::memory_order_acquire);
+            if (instruction == 0) continue;
+            RemoteCommandInstructionStatsInner entry;
+            entry.instruction = static_cast<RemoteCommandInstruction>(instruction);
+            entry.receive     = slot.receive.summary();
+            entry.execute     = slot.execute.summary();
+            entry.send        = slot.send.summary();
+            entries.push_back(entry);
+        }
+        std::sort(entries.begin(), entries.end(),
+                  [](const RemoteCommandInstructionStatsInner& a, const RemoteCommandInstructionStatsInner& b) {
+                      return a.instruction < b.instruction;
+                  });
+        stats.instruction_count = static_cast<uint32_t>(entries.size());
+
+        std::vector<RemoteCommandLockStatsInner> locks;
+#if defined(REMOTE_COMMAND_LOCK_STATS)
+        RemoteCommandLockStatsInner stream;
+        snprintf(stream.name, sizeof(stream.name), "%s", "stream");
+        stream.acquisitions = _stream_lock.acquisitions.load(std::memory_order_relaxed);
+        stream.contended    = _stream_lock.contended.load(std::memory_order_relaxed);
+        stream.wait         = _stream_lock.wait.summary();
+        stream.hold         = _stream_lock.hold.summary();
+        locks.push_back(stream);
+#endif
+        stats.lock_count = static_cast<uint32_t>(locks.size());
+
+        const size_t entries_size = entries.size() * sizeof(RemoteCommandInstructionStatsInner);
+        std::string payload(sizeof(stats) + entries_size + locks.size() * sizeof(RemoteCommandLockStatsInner), '\0');
+        memcpy(payload.data(), &stats, sizeof(stats));
+        if (!entries.empty())
+            memcpy(payload.data() + sizeof(stats), entries.data(), entries_size);
+        if (!locks.empty())
+            memcpy(payload.data() + sizeof(stats) + entries_size, locks.data(), locks.size() * sizeof(locks[0]));
+        return payload;
+    }
+
+    static std::string instructionLabel(int32_t instruction)
+    {
+        if (const char* known = instructionName(static_cast<RemoteCommandInstruction>(instruction)))
+            return known;
+        char name[32];
+        if (instruction >= static_cast<int32_t>(RemoteCommandInstruction::INSTRUCTION_USER_BASE))
+            snprintf(name, sizeof(name), "user_%d",
+                     instruction - static_cast<int32_t>(RemoteCommandInstruction::INSTRUCTION_USER_BASE));
+        else
+            snprintf(name, sizeof(name), "0x%08x", static_cast<unsigned>(instruction));
+        return name;
+    }
+
+    std::string ServerMetrics::prometheus(const Gauges& gauges) const
+    {
+        // Names and help texts are appended as strings; only the numbers go
+        // through snprintf, one value at a time, so nothing is ever cut off.
+        std::string out;
+        auto header = [&out](const char* name, const char* type, const char* help) {
+            out += "# HELP "; out += name; out += ' '; out += help; out += '\n';
+            out += "# TYPE "; out += name; out += ' '; out += type; out += '\n';
+        };
+        auto sample = [&out](const char* series, double value) {
+            char number[32];
+            snprintf(number, sizeof(number), " %.15g\n", value);
+            out += series;
+            out += number;
+        };
+        auto counter = [&out](const char* series, uint64_t value) {
+            char number[32];
+            snprintf(number, sizeof(number), " %llu\n", static_cast<unsigned long long>(value));
+            out += series;
+            out += number;
+        };
+        auto metric = [&header, &sample](const char* name, const char* type, const char* help, double value) {
+            header(name, type, help);
+            sample(name, value);
+        };
+
+        metric("remote_command_uptime_seconds", "gauge", "Time since the server started.",
+               static_cast<double>(elapsedMicroseconds(_started)) / 1e6);
+        metric("remote_command_sessions_accepted_total", "counter", "Command connections accepted.",
+               static_cast<double>(_sessions_accepted.load(std::memory_order_relaxed)));
+        metric("remote_command_sessions_active", "gauge", "Sessions currently connected.",
+               gauges.sessions_active);
+        metric("remote_command_jobs_running", "gauge", "Jobs holding a job slot.", gauges.jobs_running);
+        metric("remote_command_jobs_waiting", "gauge", "Jobs queued for a job slot.", gauges.jobs_waiting);
+        metric("remote_command_operations_queued", "gauge", "Asynchronous operations waiting for a worker.",
+               gauges.operations_queued);
+
+        header("remote_command_bytes_total", "counter", "Bytes moved per channel and direction.");
+        counter("remote_command_bytes_total{channel=\"command\",direction=\"received\"}",
+                _command_bytes_received.load(std::memory_order_relaxed));
+        counter("remote_command_bytes_total{channel=\"command\",direction=\"sent\"}",
+                _command_bytes_sent.load(std::memory_order_relaxed));
+        counter("remote_command_bytes_total{channel=\"stream\",direction=\"sent\"}",
+                _stream_bytes_sent.load(std::memory_order_relaxed));
+
+        header("remote_command_spawn_seconds", "summary", "Time to fork / create a child process.");
+        writePrometheusSummary(out, _spawn, "remote_command_spawn_seconds", "");
+        header("remote_command_job_queue_seconds", "summary", "Time jobs waited for a job slot.");
+        writePrometheusSummary(out, _job_queue, "remote_command_job_queue_seconds", "");
+
+        static const struct
+        {
+            const char* phase;
+            LatencyHistogram InstructionSlot::* histogram;
+        } phases[] = {
+            { "receive", &InstructionSlot::receive },
+            { "execute", &InstructionSlot::execute },
+            { "send",    &InstructionSlot::send },
+        };
+        header("remote_command_request_seconds", "summary", "Request latency per instruction and phase.");
+        for (const InstructionSlot& slot : _instructions) {
+            int32_t instruction = slot.instruction.load(std::memory_order_acquire);
+            if (instruction == 0) continue;
+            const std::string name = instructionLabel(instruction);
+            for (const auto& phase : phases) {
+                std::string labels = "instruction=\"" + name + "\",phase=\"" + phase.phase + "\"";
+                writePrometheusSummary(out, slot.*phase.histogram, "remote_command_request_seconds", labels);
+            }
+        }
+
+#if defined(REMOTE_COMMAND_LOCK_STATS)
+        header("remote_command_lock_acquisitions_total", "counter", "Mutex acquisitions.");
+        counter("remote_command_lock_acquisitions_total{lock=\"stream\"}",
+                _stream_lock.acquisitions.load(std::memory_order_relaxed));
+        header("remote_command_lock_contended_total", "counter", "Acquisitions that found the mutex taken.");
+        counter("remote_command_lock_contended_total{lock=\"stream\"}",
+                _stream_lock.contended.load(std::memory_order_relaxed));
+        header("remote_command_lock_wait_seconds", "summary", "Time spent waiting for a mutex.");
+        writePrometheusSummary(out, _stream_lock.wait, "remote_command_lock_wait_seconds", "lock=\"stream\"");
+        header("remote_command_lock_hold_seconds", "summary", "Time a mutex was held.");
+        writePrometheusSummary(out, _stream_lock.hold, "remote_command_lock_hold_seconds", "lock=\"stream\"");
+#endif
+        return out;
+    }
+
+    // -------------------------------------------------------------------------
+    // ResponseWriter
+    // -------------------------------------------------------------------------
+
+    bool ResponseWriter::send(const void* data, size_t size)
+    {
+        auto start = std::chrono::steady_clock::now();
+        if (!_started) {
+            _started    = true;
+            _first_send = start;
+        }
+        bool ok = sendAll(_sock, data, size);
+        _send_ns += static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        if (ok) _bytes += size;
+        return ok;
+    }
+
+    // -------------------------------------------------------------------------
+    // MetricsExporter
+    // -------------------------------------------------------------------------
+
+    bool MetricsExporter::open(const char* file, int32_t port, const char* address, int32_t interval_ms, Render render)
+    {
+        const bool to_file = file && file[0];
+        if (!to_file && port <= 0) return true;
+
+        _render      = std::move(render);
+        _file        = to_file ? file : "";
+        _interval_ms = interval_ms > 0 ? interval_ms : 10000;
+
+        if (port > 0) {
+            // Unauthenticated, so nothing beyond this host unless asked for
+            if (!address || !address[0]) address = "127.0.0.1";
+            _http_sock = openListenSocket(port, 16, false, address);
+            if (_http_sock == INVALID_SOCK) {
+                printf("[Metrics] Could not listen on %s:%d\n", address, port);
+                fflush(stdout);
+                return false;
+            }
+        }
+
+        _running.store(true);
+        if (to_file)
+            _file_thread = std::thread(&MetricsExporter::fileLoop, this);
+        if (_http_sock != INVALID_SOCK)
+            _http_thread = std::thread(&MetricsExporter::httpLoop, this);
+        return true;
+    }
+
+    void MetricsExporter::close()
+    {
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            _running.store(false);
+            _cv.notify_all();
+        }
+        if (_http_thread.joinable()) _http_thread.join();
+        if (_file_thread.joinable()) {
+            _file_thread.join();
+            writeFile();        // final numbers for whoever reads the file after us
+        }
+        if (_http_sock != INVALID_SOCK) {
+            closeSocket(_http_sock);
+            _http_sock = INVALID_SOCK;
+        }
+    }
+
+    void MetricsExporter::writeFile()
+    {
+        const std::string text = _render();
+        const std::string temporary = _file + ".tmp";
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            if (!out) return;
+            out.write(text.data(), static_cast<std::streamsize>(text.size()));
+            if (!out) return;
+        }
+        // rename() replaces the target on POSIX; Windows needs it gone first
+#ifdef _WIN32
+        std::remove(_file.c_str());
+#endif
+        std::rename(temporary.c_str(), _file.c_str());
+    }
+
+    void MetricsExporter::fileLoop()
+    {
+        setCurrentThreadName("RC_METRICS");
+        std::unique_lock<std::mutex> lk(_mtx);
+        while (_running.load()) {
+            lk.unlock();
+            writeFile();
+            lk.lock();
+            _cv.wait_for(lk, std::chrono::milliseconds(_interval_ms), [this]() { return !_running.load(); });
+        }
+    }
+
+    // How long a scraper may take to send its request.
+    static constexpr int HTTP_REQUEST_TIMEOUT_MS = 1000;
+
+    void MetricsExporter::httpLoop()
+    {
+        setCurrentThreadName("RC_METRICS_HTTP");
+        while (_running.load()) {
+            sock_t peer = acceptWithSelect(_http_sock, nullptr, _running);
+            if (peer == INVALID_SOCK) break;
+
+            // One GET per connection; whatever was asked, the answer is the
+            // same.  A peer that sends nothing in time is dropped so it does
+            // not hold up the scrapers behind it.
+            if (!waitReadable(peer, HTTP_REQUEST_TIMEOUT_MS)) {
+                closeSocket(peer);
+                continue;
+            }
+            char request[2048];
+            ::recv(peer, request, sizeof(request), 0);
+
+            const std::string body = _render();
+            char header[160];
+            int length = snprintf(header, sizeof(header),
+                                  "HTTP/1.0 200 OK\r\n"
+                                  "Content-Type: text/plain; version=0.0.4\r\n"
+                                  "Content-Length: %zu\r\n"
+                                  "Connection: close\r\n\r\n", body.size());
+            if (sendAll(peer, header, static_cast<size_t>(length)))
+                sendAll(peer, body.data(), body.size());
+            closeSocket(peer);
+        }
+    }
+
+} // namespace Bn3Monkey
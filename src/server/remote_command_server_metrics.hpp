@@ -0,0 +1,190 @@
+#if !defined(__REMOTE_COMMAND_SERVER_METRICS__)
+#define __REMOTE_COMMAND_SERVER_METRICS__
+
+#include "remote_command_server_socket.hpp"
+#include "../protocol/remote_command_protocol.hpp"
+#include "../protocol/remote_command_histogram.hpp"
+
+#include <cstdint>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+namespace Bn3Monkey
+{
+    // -------------------------------------------------------------------------
+    // Server metrics (INSTRUCTION_GET_STATS, Prometheus dump)
+    //
+    // Everything here is updated with relaxed atomics from the session
+    // handlers, reader threads and spawners, so recording never takes a lock.
+    // A snapshot reads the counters one by one and may be a few events apart
+    // between fields, which is fine for monitoring.
+    // -------------------------------------------------------------------------
+
+    inline uint64_t elapsedMicroseconds(std::chrono::steady_clock::time_point start,
+                                        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now())
+    {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        return us > 0 ? static_cast<uint64_t>(us) : 0;
+    }
+
+    // Acquisitions of one kind of mutex; every session's stream mutex
+    // reports to the same one.  Wait and hold times in microseconds.
+    struct LockStats
+    {
+        std::atomic<uint64_t> acquisitions { 0 };
+        std::atomic<uint64_t> contended    { 0 };   // found the mutex taken
+        LatencyHistogram      wait;
+        LatencyHistogram      hold;
+    };
+
+    // A std::mutex that reports to a LockStats (cmake
+    // -DREMOTE_COMMAND_LOCK_STATS=ON).  Otherwise it is a plain std::mutex
+    // and setStats does nothing, so the default build pays nothing.
+#if defined(REMOTE_COMMAND_LOCK_STATS)
+    class InstrumentedMutex
+    {
+    public:
+        // Before the mutex is shared between threads
+        inline void setStats(LockStats* stats) { _stats = stats; }
+
+        void lock();
+        bool try_lock();
+        void unlock();
+
+    private:
+        std::mutex _mtx;
+        LockStats* _stats { nullptr };
+        std::chrono::steady_clock::time_point _acquired;   // guarded by _mtx
+    };
+#else
+    class InstrumentedMutex : public std::mutex
+    {
+    public:
+        inline void setStats(LockStats*) {}
+    };
+#endif
+
+    class ServerMetrics
+    {
+    public:
+        // Read by the owner at snapshot time; not tracked here.
+        struct Gauges
+        {
+            uint32_t sessions_active   { 0 };
+            uint32_t jobs_running      { 0 };
+            uint32_t jobs_waiting      { 0 };
+            uint32_t operations_queued { 0 };
+        };
+
+        ServerMetrics() : _started(std::chrono::steady_clock::now()) {}
+
+        // One request on a command socket, including its header and payload
+        // bytes received and response bytes sent.
+        void recordRequest(int32_t instruction, uint64_t receive_us, uint64_t execute_us, uint64_t send_us,
+                           uint64_t bytes_received, uint64_t bytes_sent) noexcept;
+        void recordSpawn(uint64_t us) noexcept              { _spawn.record(us); }
+        void recordJobQueue(uint64_t us) noexcept           { _job_queue.record(us); }
+        void recordStreamBytes(uint64_t bytes) noexcept     { _stream_bytes_sent.fetch_add(bytes, std::memory_order_relaxed); }
+        void recordSessionAccepted() noexcept               { _sessions_accepted.fetch_add(1, std::memory_order_relaxed); }
+        LockStats& streamLock() noexcept                    { return _stream_lock; }
+
+        // INSTRUCTION_GET_STATS payload
+        std::string snapshot(const Gauges& gauges) const;
+
+        // Prometheus text exposition format, version 0.0.4
+        std::string prometheus(const Gauges& gauges) const;
+
+    private:
+        struct InstructionSlot
+        {
+            std::atomic<int32_t> instruction { 0 };    // 0 = free
+            LatencyHistogram     receive;
+            LatencyHistogram     execute;
+            LatencyHistogram     send;
+        };
+
+        // Enough for every built-in instruction and a few dozen user ones;
+        // codes beyond that are not broken down.
+        static constexpr size_t INSTRUCTION_SLOTS = 64;
+
+        InstructionSlot* slotFor(int32_t instruction) noexcept;
+
+        std::chrono::steady_clock::time_point _started;
+        InstructionSlot       _instructions[INSTRUCTION_SLOTS];
+        LatencyHistogram      _spawn;
+        LatencyHistogram      _job_queue;
+        LockStats             _stream_lock;        // RemoteProcess::_stream_mtx
+        std::atomic<uint64_t> _command_bytes_received { 0 };
+        std::atomic<uint64_t> _command_bytes_sent     { 0 };
+        std::atomic<uint64_t> _stream_bytes_sent      { 0 };
+        std::atomic<uint64_t> _sessions_accepted      { 0 };
+    };
+
+    // Writes one response on a command socket while timing it: the first
+    // byte sent marks the end of execution.
+    class ResponseWriter
+    {
+    public:
+        explicit ResponseWriter(sock_t sock) : _sock(sock) {}
+
+        bool send(const void* data, size_t size);
+
+        inline sock_t   socket() const  { return _sock; }
+        inline bool     started() const { return _started; }
+        inline uint64_t bytes() const   { return _bytes; }
+        inline uint64_t sendMicroseconds() const { return _send_ns / 1000; }
+        inline std::chrono::steady_clock::time_point firstSend() const { return _first_send; }
+
+    private:
+        sock_t   _sock;
+        bool     _started { false };
+        uint64_t _bytes   { 0 };
+        uint64_t _send_ns { 0 };
+        std::chrono::steady_clock::time_point _first_send;
+    };
+
+    // -------------------------------------------------------------------------
+    // Prometheus exporter
+    //
+    // file: rewritten (atomically, through a temporary name) every
+    //       interval_ms and once more on close, for node_exporter's textfile
+    //       collector or a sidecar.
+    // port: plain HTTP; every request is answered with the current text,
+    //       whatever its path.
+    // -------------------------------------------------------------------------
+    class MetricsExporter
+    {
+    public:
+        using Render = std::function<std::string()>;
+
+        ~MetricsExporter() { close(); }
+
+        // file nullptr / empty and port <= 0 leave the exporter off.  The
+        // port listens on address, loopback when nullptr / empty.  False if
+        // the port cannot be bound.
+        bool open(const char* file, int32_t port, const char* address, int32_t interval_ms, Render render);
+        void close();
+
+    private:
+        void fileLoop();
+        void httpLoop();
+        void writeFile();
+
+        Render                  _render;
+        std::string             _file;
+        int32_t                 _interval_ms { 0 };
+        sock_t                  _http_sock   { INVALID_SOCK };
+        std::atomic<bool>       _running     { false };
+        std::mutex              _mtx;
+        std::condition_variable _cv;
+        std::thread             _file_thread;
+        std::thread             _http_thread;
+    };
+}
+
+#endif // __REMOTE_COMMAND_SERVER_METRICS__
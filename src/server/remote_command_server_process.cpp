@@ -1,9 +1,12 @@
 #include "remote_command_server_process.hpp"
 #include "remote_command_server_helper.hpp"
+#include "remote_command_server_metrics.hpp"
+#include "remote_command_server_trace.hpp"
 
 #ifdef _WIN32
 // windows.h already pulled in via the hpp
 #else
+#include <cerrno>
 #include <unistd.h>
 #include <sys/wait.h>
 #include <signal.h>
@@ -43,18 +46,42 @@ namespace Bn3Monkey
         if (_stderr_reader.joinable()) _stderr_reader.join();
     }
 
+    void RemoteProcess::waitForExit()
+    {
+#ifdef _WIN32
+        HANDLE process = _hProcess.load();
+        if (process != INVALID_HANDLE_VALUE)
+            WaitForSingleObject(process, INFINITE);
+#else
+        pid_t pid = _pid.load();
+        if (pid == -1) return;
+        siginfo_t info {};
+        while (waitid(P_PID, static_cast<id_t>(pid), &info, WEXITED | WNOWAIT) != 0 && errno == EINTR) {}
+#endif
+    }
+
     void RemoteProcess::reapProcess()
     {
 #ifdef _WIN32
+        _exit_code = -1;
         if (_hProcess != INVALID_HANDLE_VALUE) {
             WaitForSingleObject(_hProcess, INFINITE);
+            DWORD code = 0;
+            if (GetExitCodeProcess(_hProcess, &code))
+                _exit_code = static_cast<int32_t>(code);
             CloseHandle(_hProcess);
             _hProcess = INVALID_HANDLE_VALUE;
         }
 #else
+        _exit_code = -1;
         if (_pid != -1) {
             int status;
-            waitpid(_pid, &status, 0);
+            if (waitpid(_pid, &status, 0) == _pid) {
+                if (WIFEXITED(status))
+                    _exit_code = WEXITSTATUS(status);
+                else if (WIFSIGNALED(status))
+                    _exit_code = 128 + WTERMSIG(status);
+            }
             _pid = -1;
         }
 #endif
@@ -78,12 +105,111 @@ namespace Bn3Monkey
 
     sock_t RemoteProcess::setStreamSocket(sock_t sock)
     {
-        std::lock_guard<std::mutex> lk(_stream_mtx);
+        std::lock_guard<InstrumentedMutex> lk(_stream_mtx);
         sock_t old = _stream_sock;
         _stream_sock = sock;
         return old;
     }
 
+    int64_t RemoteProcess::processGroup() const
+    {
+#ifdef _WIN32
+        return -1;
+#else
+        return _current_process_id != -1 ? static_cast<int64_t>(_pid.load()) : -1;
+#endif
+    }
+
+    void RemoteProcess::setLaunchOptions(std::shared_ptr<const LaunchOptions> options)
+    {
+        std::lock_guard<std::mutex> lk(_launch_mtx);
+        _launch = std::move(options);
+    }
+
+    std::shared_ptr<const LaunchOptions> RemoteProcess::launchOptions() const
+    {
+        std::lock_guard<std::mutex> lk(_launch_mtx);
+        return _launch;
+    }
+
+    int64_t RunTimeline::ticks(std::chrono::steady_clock::time_point time)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    }
+
+    void RunTimeline::reset()
+    {
+        spawned.store(0, std::memory_order_relaxed);
+        first_output.store(0, std::memory_order_relaxed);
+        exited.store(0, std::memory_order_relaxed);
+        drained.store(0, std::memory_order_relaxed);
+    }
+
+    void RunTimeline::markFirst(std::atomic<int64_t>& phase)
+    {
+        if (phase.load(std::memory_order_relaxed) != 0) return;
+        int64_t expected = 0;
+        phase.compare_exchange_strong(expected, ticks(), std::memory_order_relaxed);
+    }
+
+    void RemoteProcess::setMetrics(ServerMetrics* metrics)
+    {
+        _metrics = metrics;
+        _stream_mtx.setStats(metrics ? &metrics->streamLock() : nullptr);
+    }
+
+    void RemoteProcess::recordSpawn(std::chrono::steady_clock::time_point start)
+    {
+        _timeline.mark(_timeline.spawned);
+        if (_metrics) _metrics->recordSpawn(elapsedMicroseconds(start));
+    }
+
+    void RemoteProcess::countStreamFrame(uint32_t len)
+    {
+        _stream_frames_sent.fetch_add(1);
+        if (_metrics) _metrics->recordStreamBytes(sizeof(RemoteCommandStreamHeader) + len);
+    }
+
+    bool RemoteProcess::sendStreamFrame(RemoteCommandStreamType type, const void* data, uint32_t len)
+    {
+        TraceScope trace("sendStream", "bytes", len);
+        RemoteCommandStreamHeader header(type, len);
+        std::unique_lock<InstrumentedMutex> lk = tracedLock(_stream_mtx, "lock _stream_mtx");
+        if (_stream_sock == INVALID_SOCK) return false;
+        if (!sendAll(_stream_sock, &header, sizeof(header))) return false;
+        if (len != 0 && !sendAll(_stream_sock, data, len)) return false;
+        countStreamFrame(len);
+        return true;
+    }
+
+    bool RemoteProcess::trySendStreamFrame(RemoteCommandStreamType type, const void* data, uint32_t len)
+    {
+        RemoteCommandStreamHeader header(type, len);
+        std::unique_lock<InstrumentedMutex> lk(_stream_mtx, std::try_to_lock);
+        if (!lk.owns_lock() || _stream_sock == INVALID_SOCK) return false;
+        if (!sendAll(_stream_sock, &header, sizeof(header))) return false;
+        if (len != 0 && !sendAll(_stream_sock, data, len)) return false;
+        countStreamFrame(len);
+        return true;
+    }
+
+    // -------------------------------------------------------------------------
+    // terminate  –  signal only; the owning thread reaps
+    // -------------------------------------------------------------------------
+
+    void RemoteProcess::terminate()
+    {
+#ifdef _WIN32
+        HANDLE process = _hProcess.load();
+        if (process != INVALID_HANDLE_VALUE)
+            TerminateProcess(process, 1);
+#else
+        pid_t pid = _pid.load();
+        if (pid != -1)
+            kill(-pid, SIGTERM);
+#endif
+    }
+
     // -------------------------------------------------------------------------
     // Reader threads
     // -------------------------------------------------------------------------
@@ -96,16 +222,22 @@ namespace Bn3Monkey
 #ifdef _WIN32
         DWORD bytesRead;
         while (ReadFile(_stdout_read, buf, sizeof(buf), &bytesRead, nullptr) && bytesRead > 0) {
-            std::lock_guard<std::mutex> lk(_stream_mtx);
-            if (_stream_sock != INVALID_SOCK)
+            _timeline.markFirst(_timeline.first_output);
+            std::unique_lock<InstrumentedMutex> lk = tracedLock(_stream_mtx, "lock _stream_mtx");
+            if (_stream_sock != INVALID_SOCK) {
                 sendStream(_stream_sock, RemoteCommandStreamType::STREAM_OUTPUT, buf, bytesRead);
+                countStreamFrame(bytesRead);
+            }
         }
 #else
         ssize_t n;
         while ((n = ::read(_stdout_read, buf, sizeof(buf))) > 0) {
-            std::lock_guard<std::mutex> lk(_stream_mtx);
-            if (_stream_sock != INVALID_SOCK)
+            _timeline.markFirst(_timeline.first_output);
+            std::unique_lock<InstrumentedMutex> lk = tracedLock(_stream_mtx, "lock _stream_mtx");
+            if (_stream_sock != INVALID_SOCK) {
                 sendStream(_stream_sock, RemoteCommandStreamType::STREAM_OUTPUT, buf, static_cast<uint32_t>(n));
+                countStreamFrame(static_cast<uint32_t>(n));
+            }
         }
 #endif
     }
@@ -118,16 +250,22 @@ namespace Bn3Monkey
 #ifdef _WIN32
         DWORD bytesRead;
         while (ReadFile(_stderr_read, buf, sizeof(buf), &bytesRead, nullptr) && bytesRead > 0) {
-            std::lock_guard<std::mutex> lk(_stream_mtx);
-            if (_stream_sock != INVALID_SOCK)
+            _timeline.markFirst(_timeline.first_output);
+            std::unique_lock<InstrumentedMutex> lk = tracedLock(_stream_mtx, "lock _stream_mtx");
+            if (_stream_sock != INVALID_SOCK) {
                 sendStream(_stream_sock, RemoteCommandStreamType::STREAM_ERROR, buf, bytesRead);
+                countStreamFrame(bytesRead);
+            }
         }
 #else
         ssize_t n;
         while ((n = ::read(_stderr_read, buf, sizeof(buf))) > 0) {
-            std::lock_guard<std::mutex> lk(_stream_mtx);
-            if (_stream_sock != INVALID_SOCK)
+            _timeline.markFirst(_timeline.first_output);
+            std::unique_lock<InstrumentedMutex> lk = tracedLock(_stream_mtx, "lock _stream_mtx");
+            if (_stream_sock != INVALID_SOCK) {
                 sendStream(_stream_sock, RemoteCommandStreamType::STREAM_ERROR, buf, static_cast<uint32_t>(n));
+                countStreamFrame(static_cast<uint32_t>(n));
+            }
         }
 #endif
     }
@@ -140,6 +278,7 @@ namespace Bn3Monkey
     {
         if (_current_process_id != -1)
             return -1;
+        TraceScope trace("execute");
 
         // Clean up threads and pipes from the previous execution
         joinReaders();
@@ -189,6 +328,7 @@ namespace Bn3Monkey
 
         PROCESS_INFORMATION pi {};
 
+        auto spawn_start = std::chrono::steady_clock::now();
         bool ok = CreateProcessA(
             nullptr, cmdLine.data(),
             nullptr, nullptr,
@@ -210,24 +350,30 @@ namespace Bn3Monkey
             closePipes();
             return -1;
         }
+        recordSpawn(spawn_start);
 
         CloseHandle(pi.hThread);
         _hProcess = pi.hProcess;
 
 #else
+        std::shared_ptr<const LaunchOptions> launch = launchOptions();
         int stdin_pipe[2], stdout_pipe[2], stderr_pipe[2];
 
-        if (pipe(stdin_pipe) != 0) return -1;
-        if (pipe(stdout_pipe) != 0) {
+        // Close-on-exec so that processes started concurrently by other
+        // sessions do not inherit these pipes; dup2 in the child clears the
+        // flag on its own 0/1/2.
+        if (pipeCloseOnExec(stdin_pipe) != 0) return -1;
+        if (pipeCloseOnExec(stdout_pipe) != 0) {
             ::close(stdin_pipe[0]); ::close(stdin_pipe[1]);
             return -1;
         }
-        if (pipe(stderr_pipe) != 0) {
+        if (pipeCloseOnExec(stderr_pipe) != 0) {
             ::close(stdin_pipe[0]); ::close(stdin_pipe[1]);
             ::close(stdout_pipe[0]); ::close(stdout_pipe[1]);
             return -1;
         }
 
+        auto spawn_start = std::chrono::steady_clock::now();
         pid_t pid = fork();
         if (pid < 0) {
             ::close(stdin_pipe[0]);  ::close(stdin_pipe[1]);
@@ -240,6 +386,8 @@ namespace Bn3Monkey
             // Child: become a new process group leader so kill(-pgid) later
             // can terminate the entire subtree (including grandchildren).
             setpgid(0, 0);
+            // Do not inherit the session thread's core pin.
+            applyLaunchOptions(launch.get());
             dup2(stdin_pipe[0],  STDIN_FILENO);
             dup2(stdout_pipe[1], STDOUT_FILENO);
             dup2(stderr_pipe[1], STDERR_FILENO);
@@ -251,6 +399,8 @@ namespace Bn3Monkey
             _exit(127);
         }
 
+        recordSpawn(spawn_start);
+
         // Parent: close read end of stdin pipe and both write ends of output pipes.
         // Keep _stdin_write open so the child never receives EOF on stdin.
         ::close(stdin_pipe[0]);
@@ -274,11 +424,19 @@ namespace Bn3Monkey
     // await  –  wait for the process + all output to finish
     // -------------------------------------------------------------------------
 
-    void RemoteProcess::await(int32_t /*process_id*/)
+    int32_t RemoteProcess::await(int32_t /*process_id*/)
     {
+        // The exit is noted apart from the end of the output: the readers
+        // may still be forwarding, or a background grandchild may hold the
+        // pipes open.  Reaping waits until they are done, so terminate()
+        // can still reach the whole group meanwhile.
+        waitForExit();
+        _timeline.mark(_timeline.exited);
         // Reader threads exit naturally when the process ends (pipe EOF).
         joinReaders();
+        _timeline.mark(_timeline.drained);
         reapProcess();  // waitpid/WaitForSingleObject + sets _current_process_id = -1
+        return _exit_code;
     }
 
     // -------------------------------------------------------------------------
@@ -319,6 +477,7 @@ namespace Bn3Monkey
     {
         if (_current_process_id != -1)
             return -1;
+        TraceScope trace("execute");
 
 #ifdef _WIN32
         char buffer[4096] {0};
@@ -328,6 +487,7 @@ namespace Bn3Monkey
         PROCESS_INFORMATION pi{};
         si.cb = sizeof(si);
 
+        auto spawn_start = std::chrono::steady_clock::now();
         BOOL result = CreateProcessA(
             nullptr,
             buffer,
@@ -343,21 +503,26 @@ namespace Bn3Monkey
 
         if (!result)
             return -1;
+        recordSpawn(spawn_start);
 
         CloseHandle(pi.hThread);
         _hProcess = pi.hProcess;
 
 #else
+        std::shared_ptr<const LaunchOptions> launch = launchOptions();
+        auto spawn_start = std::chrono::steady_clock::now();
         pid_t pid = fork();
         if (pid < 0)
             return -1;
 
         if (pid == 0) {
             setpgid(0, 0);
+            applyLaunchOptions(launch.get());
             if (cwd && cwd[0]) chdir(cwd);
             execl("/bin/sh", "sh", "-c", cmd, nullptr);
             _exit(127);
         }
+        recordSpawn(spawn_start);
 
         _pid = pid;
 #endif
@@ -2,11 +2,15 @@
 #define __REMOTE_COMMAND_SERVER_PROCESS__
 
 #include "remote_command_server_socket.hpp"
+#include "remote_command_server_launch.hpp"
+#include "remote_command_server_metrics.hpp"
 
 #include <cstdint>
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include <chrono>
+#include <memory>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -16,6 +20,26 @@
 
 namespace Bn3Monkey
 {
+    // When the phases of one run happened, as steady_clock ticks in
+    // nanoseconds (0 = not reached).  The RUN_COMMAND handler resets it;
+    // execute(), await() and the reader threads fill it in, and so does the
+    // warm interpreter pool for the jobs it runs.
+    struct RunTimeline
+    {
+        std::atomic<int64_t> spawned      { 0 };
+        std::atomic<int64_t> first_output { 0 };
+        std::atomic<int64_t> exited       { 0 };
+        std::atomic<int64_t> drained      { 0 };
+
+        static int64_t ticks(std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now());
+
+        void reset();
+        inline void mark(std::atomic<int64_t>& phase) { phase.store(ticks(), std::memory_order_relaxed); }
+
+        // Keeps an earlier mark (called for every chunk of output)
+        void markFirst(std::atomic<int64_t>& phase);
+    };
+
     class RemoteProcess
     {
     public:
@@ -29,7 +53,9 @@ namespace Bn3Monkey
         int32_t execute(const char* cwd, const char* cmd);
 
         // Blocks until the process finishes and all output has been flushed.
-        void await(int32_t process_id);
+        // Returns its exit code (128 + signal number if it was killed, the
+        // shell's convention), or -1 if it could not be collected.
+        int32_t await(int32_t process_id);
 
         // Kills the process, then blocks until all threads are joined.
         void close(int32_t process_id);
@@ -39,35 +65,85 @@ namespace Bn3Monkey
 
         inline bool is_running() const { return _current_process_id != -1; }
 
+        // Process group of the running process (its pid), or -1.  POSIX only.
+        int64_t processGroup() const;
+
+        // Signals the running process (group) to terminate without waiting.
+        // Safe to call from a thread other than the one that owns the process;
+        // the owner still reaps it through await() / close().
+        void terminate();
+
         // Called by StreamServer when a stream client connects / disconnects.
         // Atomically replaces the current socket and returns the old one so the
         // caller can close it.  Pass INVALID_SOCK to clear.
         sock_t setStreamSocket(sock_t sock);
 
+        // Sends one frame on the current stream socket, serialised with the
+        // reader threads.  Returns false if no stream client is attached or
+        // the send failed.
+        bool sendStreamFrame(RemoteCommandStreamType type, const void* data, uint32_t len);
+
+        // Same as sendStreamFrame, but gives up instead of waiting when a
+        // reader thread currently holds the stream (e.g. stuck sending to a
+        // dead peer).
+        bool trySendStreamFrame(RemoteCommandStreamType type, const void* data, uint32_t len);
+
+        // Frames fully written to the stream socket so far, by anyone.  While
+        // it grows the client is draining its socket.
+        inline uint64_t streamFramesSent() const { return _stream_frames_sent.load(); }
+
+        // Affinity / priority / cgroup that every process started for this
+        // session is launched with (execute, graphs, scripts...).  Takes
+        // effect from the next spawn; nullptr = the server's own settings.
+        void setLaunchOptions(std::shared_ptr<const LaunchOptions> options);
+        std::shared_ptr<const LaunchOptions> launchOptions() const;
+
+        // Where stream bytes and spawn times are counted (nullptr = nowhere).
+        // Set once, before the session starts.
+        // Also points _stream_mtx at the server's lock stats.  Before the
+        // process is shared between threads.
+        void setMetrics(ServerMetrics* metrics);
+
+        // Called by every spawner of this session right after fork /
+        // CreateProcess returned in the parent; start is taken just before.
+        void recordSpawn(std::chrono::steady_clock::time_point start);
+
+        inline RunTimeline& timeline() { return _timeline; }
+
     private:
         void stdoutReader();
         void stderrReader();
         void joinReaders();     // joins _stdout_reader, _stderr_reader
+        void waitForExit();     // like reapProcess, but leaves the process to reap
         void reapProcess();     // WaitForSingleObject/waitpid + handle cleanup
         void closePipes();      // closes platform pipe read-handles
+        void countStreamFrame(uint32_t len);
 
         // _stream_mtx guards both _stream_sock (for setStreamSocket) and
         // concurrent sendStream calls from the two reader threads.
         sock_t     _stream_sock { INVALID_SOCK };
-        std::mutex _stream_mtx;
+        InstrumentedMutex _stream_mtx;
+        std::atomic<uint64_t> _stream_frames_sent { 0 };
 
         std::thread _stdout_reader;
         std::thread _stderr_reader;
 
+        ServerMetrics* _metrics { nullptr };
+        RunTimeline    _timeline;
+
+        mutable std::mutex                   _launch_mtx;   // guards _launch
+        std::shared_ptr<const LaunchOptions> _launch;
+
         std::atomic<int32_t> _current_process_id { -1 };
+        int32_t              _exit_code { -1 };    // of the last reaped process
 
 #ifdef _WIN32
-        HANDLE _hProcess    { INVALID_HANDLE_VALUE };
+        std::atomic<HANDLE> _hProcess { INVALID_HANDLE_VALUE };
         HANDLE _stdin_write { INVALID_HANDLE_VALUE };
         HANDLE _stdout_read { INVALID_HANDLE_VALUE };
         HANDLE _stderr_read { INVALID_HANDLE_VALUE };
 #else
-        pid_t _pid         { -1 };
+        std::atomic<pid_t> _pid { -1 };
         int   _stdin_write { -1 };
         int   _stdout_read { -1 };
         int   _stderr_read { -1 };
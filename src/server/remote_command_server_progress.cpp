@@ -0,0 +1,54 @@
+#include "remote_command_server_progress.hpp"
+#include "../protocol/remote_command_protocol.hpp"
+
+namespace Bn3Monkey
+{
+    OperationProgress::OperationProgress(RemoteProcess& remote_process, uint32_t operation_id, int32_t interval_ms)
+        : _remote_process(remote_process), _operation_id(operation_id),
+          _interval(interval_ms), _start(std::chrono::steady_clock::now())
+    {
+    }
+
+    FilesystemProgressCallback OperationProgress::callback()
+    {
+        if (_interval.count() <= 0) return {};
+        return [this](const FilesystemProgress& state) { update(state); };
+    }
+
+    void OperationProgress::update(const FilesystemProgress& state)
+    {
+        _state   = state;
+        _pending = true;
+
+        // The first report carries the totals; send it straight away.
+        auto now = std::chrono::steady_clock::now();
+        if (!_sent_any || now - _last_sent >= _interval)
+            send(now);
+    }
+
+    void OperationProgress::flush()
+    {
+        if (_pending && _interval.count() > 0)
+            send(std::chrono::steady_clock::now());
+    }
+
+    void OperationProgress::send(std::chrono::steady_clock::time_point now)
+    {
+        RemoteCommandProgressInner inner;
+        inner.operation_id = _operation_id;
+        inner.bytes_done   = _state.bytes_done;
+        inner.bytes_total  = _state.bytes_total;
+        inner.items_done   = _state.items_done;
+        inner.items_total  = _state.items_total;
+
+        auto elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(now - _start).count();
+        if (elapsed_us > 0)
+            inner.bytes_per_second = _state.bytes_done * 1000000ull / static_cast<uint64_t>(elapsed_us);
+
+        _remote_process.trySendStreamFrame(RemoteCommandStreamType::STREAM_PROGRESS, &inner, sizeof(inner));
+        _last_sent = now;
+        _sent_any  = true;
+        _pending   = false;
+    }
+
+} // namespace Bn3Monkey
@@ -0,0 +1,46 @@
+#if !defined(__REMOTE_COMMAND_SERVER_PROGRESS__)
+#define __REMOTE_COMMAND_SERVER_PROGRESS__
+
+#include "remote_command_server_filesystem.hpp"
+#include "remote_command_server_process.hpp"
+#include <cstdint>
+#include <chrono>
+
+namespace Bn3Monkey
+{
+    // -------------------------------------------------------------------------
+    // OperationProgress
+    //
+    // Turns the filesystem helpers' progress callbacks into STREAM_PROGRESS
+    // frames for one asynchronous operation, at most one per interval_ms.
+    // Frames are best-effort: one that would wait for the stream socket is
+    // dropped rather than stalling the worker.
+    // -------------------------------------------------------------------------
+    class OperationProgress
+    {
+    public:
+        // interval_ms <= 0: callback() is empty and nothing is sent
+        OperationProgress(RemoteProcess& remote_process, uint32_t operation_id, int32_t interval_ms);
+
+        FilesystemProgressCallback callback();
+
+        // Sends the latest state if the interval held it back, so the last
+        // frame before completion shows the final counts.
+        void flush();
+
+    private:
+        void update(const FilesystemProgress& state);
+        void send(std::chrono::steady_clock::time_point now);
+
+        RemoteProcess&                        _remote_process;
+        const uint32_t                        _operation_id;
+        const std::chrono::milliseconds       _interval;
+        const std::chrono::steady_clock::time_point _start;
+        std::chrono::steady_clock::time_point _last_sent;
+        FilesystemProgress                    _state;
+        bool                                  _sent_any { false };
+        bool                                  _pending  { false };
+    };
+}
+
+#endif // __REMOTE_COMMAND_SERVER_PROGRESS__
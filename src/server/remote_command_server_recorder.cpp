@@ -0,0 +1,83 @@
+#include "remote_command_server_recorder.hpp"
+#include "remote_command_server_metrics.hpp"
+
+#include <algorithm>
+
+namespace Bn3Monkey
+{
+    bool SessionRecorder::open(const char* path, bool payloads)
+    {
+        close();
+        if (!path || path[0] == '\0') return true;
+
+        std::FILE* file = std::fopen(path, "wb");
+        if (!file) return false;
+        std::setvbuf(file, nullptr, _IOFBF, 1 << 20);
+
+        RemoteCommandRecordingHeader header;
+        header.flags = payloads ? RECORDING_PAYLOADS : 0;
+        header.started_unix_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        if (std::fwrite(&header, sizeof(header), 1, file) != 1) {
+            std::fclose(file);
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lk(_mtx);
+        _file     = file;
+        _payloads = payloads;
+        _started  = std::chrono::steady_clock::now();
+        _enabled.store(true, std::memory_order_release);
+        return true;
+    }
+
+    void SessionRecorder::close()
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        _enabled.store(false, std::memory_order_release);
+        if (_file) {
+            std::fclose(_file);
+            _file = nullptr;
+        }
+    }
+
+    void SessionRecorder::record(uint32_t session_id, const RemoteCommandRequestHeader& header,
+                                 std::chrono::steady_clock::time_point received, uint64_t receive_us,
+                                 const std::string& p0, const std::string& p1, const std::string& p2, const std::string& p3)
+    {
+        if (!enabled()) return;
+        RemoteCommandRecordInner record;
+        record.session_id        = session_id;
+        record.instruction       = header.instruction;
+        record.offset_us         = elapsedMicroseconds(_started, received);
+        record.receive_us        = static_cast<uint32_t>(std::min<uint64_t>(receive_us, UINT32_MAX));
+        record.payload_length[0] = header.payload_0_length;
+        record.payload_length[1] = header.payload_1_length;
+        record.payload_length[2] = header.payload_2_length;
+        record.payload_length[3] = header.payload_3_length;
+        const std::string* payloads[] { &p0, &p1, &p2, &p3 };
+        write(record, payloads);
+    }
+
+    void SessionRecorder::recordSessionEnd(uint32_t session_id)
+    {
+        if (!enabled()) return;
+        RemoteCommandRecordInner record;
+        record.session_id = session_id;
+        record.offset_us  = elapsedMicroseconds(_started);
+        write(record, nullptr);
+    }
+
+    void SessionRecorder::write(const RemoteCommandRecordInner& record, const std::string* const* payloads)
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        if (!_file) return;
+        std::fwrite(&record, sizeof(record), 1, _file);
+        if (_payloads && payloads) {
+            for (size_t i = 0; i < 4; ++i) {
+                if (!payloads[i]->empty())
+                    std::fwrite(payloads[i]->data(), 1, payloads[i]->size(), _file);
+            }
+        }
+    }
+}
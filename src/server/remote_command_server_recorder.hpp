@@ -0,0 +1,53 @@
+#if !defined(__REMOTE_COMMAND_SERVER_RECORDER__)
+#define __REMOTE_COMMAND_SERVER_RECORDER__
+
+#include "../protocol/remote_command_protocol.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+namespace Bn3Monkey
+{
+    // -------------------------------------------------------------------------
+    // Session recorder (RemoteCommandServerOptions::record_file)
+    //
+    // Appends one RemoteCommandRecordInner per request, and optionally its
+    // payloads, to a binary log that remote_command_replay re-issues.  All
+    // sessions write to the same buffered file under one mutex; the request
+    // is recorded as it arrives, before it runs.  Off, record() costs one
+    // relaxed load.
+    // -------------------------------------------------------------------------
+    class SessionRecorder
+    {
+    public:
+        ~SessionRecorder() { close(); }
+
+        // False if the file cannot be created.  path nullptr / empty leaves
+        // the recorder off.
+        bool open(const char* path, bool payloads);
+        void close();
+
+        inline bool enabled() const noexcept { return _enabled.load(std::memory_order_relaxed); }
+
+        // p0 .. p3: the request payloads, sized as the header says
+        void record(uint32_t session_id, const RemoteCommandRequestHeader& header,
+                    std::chrono::steady_clock::time_point received, uint64_t receive_us,
+                    const std::string& p0, const std::string& p1, const std::string& p2, const std::string& p3);
+        void recordSessionEnd(uint32_t session_id);
+
+    private:
+        void write(const RemoteCommandRecordInner& record, const std::string* const* payloads);
+
+        std::atomic<bool> _enabled  { false };
+        bool              _payloads { false };
+        std::mutex        _mtx;
+        std::FILE*        _file     { nullptr };
+        std::chrono::steady_clock::time_point _started;
+    };
+}
+
+#endif // __REMOTE_COMMAND_SERVER_RECORDER__
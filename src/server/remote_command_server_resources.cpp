@@ -0,0 +1,218 @@
+#include "remote_command_server_resources.hpp"
+#include "remote_command_server_helper.hpp"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace Bn3Monkey
+{
+    // Entries of groups that have not been sampled for this long are dropped
+    static constexpr auto FORGET_AFTER = std::chrono::seconds(60);
+
+#ifdef __linux__
+    static bool readSmallFile(const char* path, char* buffer, size_t size)
+    {
+        int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) return false;
+        ssize_t length = ::read(fd, buffer, size - 1);
+        ::close(fd);
+        if (length <= 0) return false;
+        buffer[length] = '\0';
+        return true;
+    }
+
+    static uint32_t countEntries(const char* path)
+    {
+        DIR* dir = opendir(path);
+        if (!dir) return 0;
+        uint32_t count = 0;
+        while (dirent* entry = readdir(dir)) {
+            if (entry->d_name[0] != '.') ++count;
+        }
+        closedir(dir);
+        return count;
+    }
+
+    struct GroupTotals
+    {
+        uint32_t processes    { 0 };
+        uint32_t threads      { 0 };
+        uint32_t fds          { 0 };
+        uint64_t ticks        { 0 };
+        uint64_t rss_pages    { 0 };
+        uint64_t read_bytes   { 0 };
+        uint64_t write_bytes  { 0 };
+        uint64_t leader_start { 0 };    // clock ticks after boot; 0 = leader gone
+    };
+
+    // Adds /proc/<pid> to its group's totals if the group is wanted
+    static void addProcess(const char* pid, std::map<int64_t, GroupTotals>& totals)
+    {
+        char path[64];
+        char buffer[1024];
+        snprintf(path, sizeof(path), "/proc/%s/stat", pid);
+        if (!readSmallFile(path, buffer, sizeof(buffer))) return;
+
+        // The command name may contain anything, so fields count from its ')'
+        const char* fields = strrchr(buffer, ')');
+        if (!fields) return;
+        // value[n] is field n + 3 of proc(5); field 3, the state, is a letter
+        uint64_t value[22] {};
+        char* p = const_cast<char*>(fields) + 2;
+        while (*p && *p != ' ') ++p;
+        for (int n = 1; n < 22 && *p; ++n)
+            value[n] = strtoull(p, &p, 10);
+        const int64_t group = static_cast<int64_t>(value[5 - 3]);
+        auto it = totals.find(group);
+        if (it == totals.end()) return;
+
+        GroupTotals& total = it->second;
+        total.processes += 1;
+        total.ticks     += value[14 - 3] + value[15 - 3] + value[16 - 3] + value[17 - 3];
+        total.threads   += static_cast<uint32_t>(value[20 - 3]);
+        total.rss_pages += value[24 - 3];
+        if (atoll(pid) == group)
+            total.leader_start = value[22 - 3];
+
+        snprintf(path, sizeof(path), "/proc/%s/fd", pid);
+        total.fds += countEntries(path);
+
+        snprintf(path, sizeof(path), "/proc/%s/io", pid);
+        if (readSmallFile(path, buffer, sizeof(buffer))) {
+            if (const char* read = strstr(buffer, "\nread_bytes: "))
+                total.read_bytes += strtoull(read + 13, nullptr, 10);
+            if (const char* write = strstr(buffer, "\nwrite_bytes: "))
+                total.write_bytes += strtoull(write + 14, nullptr, 10);
+        }
+    }
+#endif
+
+    void ProcessSampler::sample(std::vector<RemoteCommandResourceInner>& groups)
+    {
+#ifndef __linux__
+        groups.clear();
+#else
+        std::map<int64_t, GroupTotals> totals;
+        for (const RemoteCommandResourceInner& group : groups)
+            totals[group.process_group];
+
+        if (DIR* proc = opendir("/proc")) {
+            while (dirent* entry = readdir(proc)) {
+                if (entry->d_name[0] >= '1' && entry->d_name[0] <= '9')
+                    addProcess(entry->d_name, totals);
+            }
+            closedir(proc);
+        }
+
+        double uptime = 0.0;
+        char buffer[128];
+        if (readSmallFile("/proc/uptime", buffer, sizeof(buffer)))
+            uptime = strtod(buffer, nullptr);
+        const double ticks_per_second = static_cast<double>(sysconf(_SC_CLK_TCK));
+        const uint64_t page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+        const auto now = std::chrono::steady_clock::now();
+
+        std::lock_guard<std::mutex> lk(_mtx);
+        for (RemoteCommandResourceInner& group : groups) {
+            const GroupTotals& total = totals[group.process_group];
+            if (total.processes == 0) continue;
+
+            double cpu_ticks = 0.0, seconds = 0.0;
+            auto previous = _previous.find(group.process_group);
+            if (previous != _previous.end()) {
+                if (total.ticks > previous->second.ticks)
+                    cpu_ticks = static_cast<double>(total.ticks - previous->second.ticks);
+                seconds = std::chrono::duration<double>(now - previous->second.when).count();
+            } else if (total.leader_start != 0) {
+                cpu_ticks = static_cast<double>(total.ticks);
+                seconds   = uptime - static_cast<double>(total.leader_start) / ticks_per_second;
+            }
+            _previous[group.process_group] = { total.ticks, now };
+
+            group.processes   = total.processes;
+            group.threads     = total.threads;
+            group.open_files  = total.fds;
+            group.cpu_milli   = seconds > 0.0
+                ? static_cast<uint32_t>(cpu_ticks / ticks_per_second / seconds * 1000.0 + 0.5)
+                : 0;
+            group.rss_bytes   = total.rss_pages * page_size;
+            group.read_bytes  = total.read_bytes;
+            group.write_bytes = total.write_bytes;
+        }
+        groups.erase(std::remove_if(groups.begin(), groups.end(),
+                                    [&totals](const RemoteCommandResourceInner& group) {
+                                        return totals[group.process_group].processes == 0;
+                                    }),
+                     groups.end());
+
+        for (auto it = _previous.begin(); it != _previous.end(); ) {
+            if (now - it->second.when > FORGET_AFTER) it = _previous.erase(it);
+            else ++it;
+        }
+#endif
+    }
+
+    // -------------------------------------------------------------------------
+    // ResourceMonitor
+    // -------------------------------------------------------------------------
+
+    void ResourceMonitor::start(uint32_t interval_ms, ProcessSampler& sampler, uint32_t session_id,
+                                GroupSource source)
+    {
+        stop();
+        std::lock_guard<std::mutex> lk(_mtx);
+        _running = true;
+        _thread  = std::thread(&ResourceMonitor::monitorLoop, this, interval_ms, std::ref(sampler),
+                               session_id, std::move(source));
+    }
+
+    void ResourceMonitor::stop()
+    {
+        std::thread thread;
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            _running = false;
+            thread = std::move(_thread);
+        }
+        _cv.notify_all();
+        if (thread.joinable())
+            thread.join();
+    }
+
+    void ResourceMonitor::monitorLoop(uint32_t interval_ms, ProcessSampler& sampler, uint32_t session_id,
+                                      GroupSource source)
+    {
+        setCurrentThreadName("RC_SAMPLE");
+        std::vector<RemoteCommandResourceInner> groups;
+        std::unique_lock<std::mutex> lk(_mtx);
+        while (_running) {
+            _cv.wait_for(lk, std::chrono::milliseconds(interval_ms));
+            if (!_running) break;
+            lk.unlock();
+
+            groups.clear();
+            for (int64_t group : source()) {
+                RemoteCommandResourceInner entry;
+                entry.session_id    = session_id;
+                entry.process_group = static_cast<int32_t>(group);
+                groups.push_back(entry);
+            }
+            if (!groups.empty())
+                sampler.sample(groups);
+            // Skip a frame rather than queue behind a stuck reader
+            if (!groups.empty())
+                _remote_process.trySendStreamFrame(RemoteCommandStreamType::STREAM_RESOURCES, groups.data(),
+                    static_cast<uint32_t>(groups.size() * sizeof(RemoteCommandResourceInner)));
+            lk.lock();
+        }
+    }
+
+} // namespace Bn3Monkey
@@ -0,0 +1,74 @@
+#if !defined(__REMOTE_COMMAND_SERVER_RESOURCES__)
+#define __REMOTE_COMMAND_SERVER_RESOURCES__
+
+#include "remote_command_server_process.hpp"
+#include "../protocol/remote_command_protocol.hpp"
+#include <cstdint>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace Bn3Monkey
+{
+    // -------------------------------------------------------------------------
+    // Resource sampling (INSTRUCTION_WATCH_RESOURCES / LIST_PROCESSES)
+    //
+    // Every process the server starts leads its own process group, so one
+    // pass over /proc/<pid>/{stat,io,fd} adds up a command together with
+    // everything it forked: CPU, RSS, I/O bytes, threads and open fds.
+    // CPU is the share of one core since the group was last sampled (by
+    // anyone), or since it started on its first sample.  Linux only; other
+    // platforms report nothing.
+    // -------------------------------------------------------------------------
+
+    // Shared by all sessions; remembers the CPU time of each group between
+    // samples.
+    class ProcessSampler
+    {
+    public:
+        // groups: entries with session_id and process_group set.  Fills in
+        // the rest and drops groups that have no process left.
+        void sample(std::vector<RemoteCommandResourceInner>& groups);
+
+    private:
+        struct Previous
+        {
+            uint64_t                              ticks;
+            std::chrono::steady_clock::time_point when;
+        };
+
+        std::mutex                  _mtx;        // guards _previous
+        std::map<int64_t, Previous> _previous;
+    };
+
+    // Pushes STREAM_RESOURCES frames for one session.
+    class ResourceMonitor
+    {
+    public:
+        using GroupSource = std::function<std::vector<int64_t>()>;
+
+        explicit ResourceMonitor(RemoteProcess& remote_process)
+            : _remote_process(remote_process) {}
+        ~ResourceMonitor() { stop(); }
+
+        // Every interval_ms, samples the groups from source and sends them in
+        // one frame (none while nothing runs).  Replaces a previous start().
+        void start(uint32_t interval_ms, ProcessSampler& sampler, uint32_t session_id, GroupSource source);
+        void stop();
+
+    private:
+        void monitorLoop(uint32_t interval_ms, ProcessSampler& sampler, uint32_t session_id, GroupSource source);
+
+        RemoteProcess&          _remote_process;
+        std::mutex              _mtx;            // guards _running, _thread
+        std::condition_variable _cv;
+        bool                    _running { false };
+        std::thread             _thread;
+    };
+}
+
+#endif // __REMOTE_COMMAND_SERVER_RESOURCES__
@@ -0,0 +1,144 @@
+#include "remote_command_server_scheduler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace Bn3Monkey
+{
+    static int32_t rankOf(RemoteCommandJobPriority priority)
+    {
+        switch (priority) {
+        case RemoteCommandJobPriority::HIGH: return 0;
+        case RemoteCommandJobPriority::LOW:  return 2;
+        default:                return 1;
+        }
+    }
+
+    // -------------------------------------------------------------------------
+    // JobTicket
+    // -------------------------------------------------------------------------
+
+    void JobTicket::cancel()
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        _cancelled = true;
+        _cv.notify_all();
+    }
+
+    // -------------------------------------------------------------------------
+    // JobScheduler
+    // -------------------------------------------------------------------------
+
+    void JobScheduler::open(int32_t slots)
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        if (slots < 0) {
+            slots = static_cast<int32_t>(std::thread::hardware_concurrency());
+            if (slots <= 0) slots = 1;
+        }
+        _slots   = slots;
+        _running = 0;
+        _open    = true;
+    }
+
+    void JobScheduler::close()
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        _open = false;
+        for (Waiter& waiter : _waiting)
+            waiter.ticket->cancel();
+        _waiting.clear();
+    }
+
+    bool JobScheduler::acquire(JobTicket& ticket, RemoteCommandJobPriority priority, uint32_t& queued_ms)
+    {
+        queued_ms = 0;
+        auto start = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            std::lock_guard<std::mutex> tk(ticket._mtx);
+            if (ticket._cancelled || !_open) return false;
+            if (_slots == 0) return true;            // no limit: nothing to hold
+            if (_running < _slots && _waiting.empty()) {
+                ++_running;
+                ticket._granted = true;
+                return true;
+            }
+            _waiting.push_back({ &ticket, rankOf(priority), _sequence++ });
+        }
+
+        bool granted;
+        {
+            std::unique_lock<std::mutex> tk(ticket._mtx);
+            ticket._cv.wait(tk, [&ticket]() { return ticket._granted || ticket._cancelled; });
+            granted = ticket._granted && !ticket._cancelled;
+        }
+        queued_ms = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count());
+        if (granted) return true;
+
+        // Cancelled: leave the queue, or hand back a slot granted meanwhile
+        std::lock_guard<std::mutex> lk(_mtx);
+        _waiting.erase(std::remove_if(_waiting.begin(), _waiting.end(),
+                                      [&ticket](const Waiter& waiter) { return waiter.ticket == &ticket; }),
+                       _waiting.end());
+        std::lock_guard<std::mutex> tk(ticket._mtx);
+        if (ticket._granted) {
+            ticket._granted = false;
+            --_running;
+            grantLocked();
+        }
+        return false;
+    }
+
+    bool JobScheduler::tryAcquire(JobTicket& ticket)
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        std::lock_guard<std::mutex> tk(ticket._mtx);
+        if (ticket._cancelled || !_open) return false;
+        if (_slots == 0) return true;
+        if (_running >= _slots || !_waiting.empty()) return false;
+        ++_running;
+        ticket._granted = true;
+        return true;
+    }
+
+    void JobScheduler::depth(uint32_t& running, uint32_t& waiting)
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        running = static_cast<uint32_t>(std::max(_running, 0));
+        waiting = static_cast<uint32_t>(_waiting.size());
+    }
+
+    void JobScheduler::release(JobTicket& ticket)
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        {
+            std::lock_guard<std::mutex> tk(ticket._mtx);
+            if (!ticket._granted) return;
+            ticket._granted = false;
+        }
+        --_running;
+        grantLocked();
+    }
+
+    void JobScheduler::grantLocked()
+    {
+        while (_running < _slots && !_waiting.empty()) {
+            auto next = std::min_element(_waiting.begin(), _waiting.end(),
+                [](const Waiter& a, const Waiter& b) {
+                    return a.rank != b.rank ? a.rank < b.rank : a.sequence < b.sequence;
+                });
+            JobTicket* ticket = next->ticket;
+            _waiting.erase(next);
+
+            std::lock_guard<std::mutex> tk(ticket->_mtx);
+            if (ticket->_cancelled) continue;      // its acquire is on the way out
+            ticket->_granted = true;
+            ++_running;
+            ticket->_cv.notify_all();
+        }
+    }
+
+} // namespace Bn3Monkey
@@ -0,0 +1,92 @@
+#if !defined(__REMOTE_COMMAND_SERVER_SCHEDULER__)
+#define __REMOTE_COMMAND_SERVER_SCHEDULER__
+
+#include "../protocol/remote_command_protocol.hpp"
+
+#include <cstdint>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+namespace Bn3Monkey
+{
+    // -------------------------------------------------------------------------
+    // Job scheduler
+    //
+    // Caps how many jobs run at once across all sessions
+    // (RemoteCommandServerOptions::job_slots).  A job is a RUN_COMMAND, an
+    // OPEN_PROCESS, or a RUN_GRAPH / MAP_FILES / RUN_SCRIPT / RUN_CACHED miss;
+    // graph nodes beyond the first that run alongside it take extra slots
+    // with tryAcquire.  A job that finds no free slot waits in the queue:
+    //   - HIGH before NORMAL before LOW, strictly
+    //   - first come, first served within a class.  A session has at most
+    //     one job waiting or running (its handler blocks), so sessions of one
+    //     class take turns instead of one of them filling every slot.
+    // RUN_COMMAND holds its slot until the command exits, OPEN_PROCESS until
+    // CLOSE_PROCESS or the end of the session, the others until they reply.
+    // -------------------------------------------------------------------------
+
+    // A session's place in the scheduler, so Session::interrupt can pull it
+    // out of the queue.
+    class JobTicket
+    {
+    public:
+        // Wakes a waiting acquire and refuses later ones.  Safe to call from
+        // another thread.
+        void cancel();
+
+    private:
+        friend class JobScheduler;
+        std::mutex              _mtx;          // guards _granted, _cancelled
+        std::condition_variable _cv;
+        bool                    _granted   { false };
+        bool                    _cancelled { false };
+    };
+
+    class JobScheduler
+    {
+    public:
+        ~JobScheduler() { close(); }
+
+        // slots: jobs that may run at once; 0 = no limit, < 0 = one per core.
+        void open(int32_t slots);
+
+        // Fails every waiting acquire.
+        void close();
+
+        // Blocks until ticket may run a job.  queued_ms receives the time
+        // spent waiting.  False if the ticket was cancelled or the scheduler
+        // closed meanwhile; nothing is held then.
+        bool acquire(JobTicket& ticket, RemoteCommandJobPriority priority, uint32_t& queued_ms);
+
+        // Takes a slot only if one is free and nobody is waiting for it.
+        // For work that can make progress without it, so it never queues.
+        bool tryAcquire(JobTicket& ticket);
+
+        // Gives the ticket's slot to the next job in line.  No-op if the
+        // ticket holds none.
+        void release(JobTicket& ticket);
+
+        // Jobs holding a slot and jobs waiting for one, for the metrics.
+        void depth(uint32_t& running, uint32_t& waiting);
+
+    private:
+        struct Waiter
+        {
+            JobTicket* ticket;
+            int32_t    rank;       // 0 runs first
+            uint64_t   sequence;
+        };
+
+        void grantLocked();
+
+        std::mutex          _mtx;       // guards everything below; taken before a ticket's
+        std::vector<Waiter> _waiting;
+        int32_t             _slots    { 0 };
+        int32_t             _running  { 0 };
+        uint64_t            _sequence { 0 };
+        bool                _open     { false };
+    };
+}
+
+#endif // __REMOTE_COMMAND_SERVER_SCHEDULER__
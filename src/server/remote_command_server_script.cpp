@@ -0,0 +1,284 @@
+#include "remote_command_server_script.hpp"
+#include "remote_command_server_helper.hpp"
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <signal.h>
+#endif
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+
+namespace Bn3Monkey
+{
+    // One argument to `sh -c` may not exceed 128 KiB on Linux
+    static constexpr size_t MAX_SHELL_SCRIPT = 120 * 1024;
+
+    // The shell reports each command's exit status on this descriptor
+    static constexpr int STATUS_FD = 9;
+
+    bool parseCommandScript(const std::string& script, const std::string& commands,
+                            uint32_t& flags, std::vector<std::string>& out)
+    {
+        out.clear();
+        RemoteCommandScriptInner header;
+        if (script.size() != sizeof(header)) return false;
+        memcpy(&header, script.data(), sizeof(header));
+        flags = header.flags;
+
+        if (!commands.empty() && commands.back() != '\0') return false;
+        for (size_t pos = 0; pos < commands.size(); ) {
+            std::string command(commands.c_str() + pos);
+            pos += command.size() + 1;
+            if (command.empty()) return false;
+            out.push_back(std::move(command));
+        }
+        return true;
+    }
+
+    std::vector<GraphNode> chainCommandScript(const std::vector<std::string>& commands, bool stop_on_error)
+    {
+        std::vector<GraphNode> nodes(commands.size());
+        for (size_t i = 0; i < commands.size(); ++i) {
+            nodes[i].command = commands[i];
+            if (i > 0) {
+                nodes[i].dependencies.push_back(static_cast<uint32_t>(i - 1));
+                nodes[i].after_failure = !stop_on_error;
+            }
+        }
+        return nodes;
+    }
+
+    bool ScriptShell::supported()
+    {
+#ifdef _WIN32
+        return false;
+#else
+        return true;
+#endif
+    }
+
+    int64_t ScriptShell::processGroup()
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        return _pid;
+    }
+
+    void ScriptShell::cancel()
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        _cancelled.store(true);
+#ifndef _WIN32
+        if (_pid != -1)
+            kill(-static_cast<pid_t>(_pid), SIGTERM);
+#endif
+    }
+
+#ifdef _WIN32
+    bool ScriptShell::run(const std::string&, const std::vector<std::string>& commands, bool,
+                          std::vector<RemoteCommandNodeResultInner>& results)
+    {
+        results.assign(commands.size(), RemoteCommandNodeResultInner());
+        return false;
+    }
+#else
+    // Forwards one output stream as frames tagged with the current command,
+    // moving on to the next command at every marker.
+    class MarkerSplitter
+    {
+    public:
+        MarkerSplitter(RemoteProcess& remote_process, RemoteCommandStreamType type, const std::string& marker)
+            : _remote_process(remote_process), _type(type), _marker(marker) {}
+
+        void feed(const char* data, size_t size)
+        {
+            _pending.append(data, size);
+            size_t pos;
+            while ((pos = _pending.find(_marker)) != std::string::npos) {
+                send(_pending.data(), pos);
+                _pending.erase(0, pos + _marker.size());
+                ++_index;
+            }
+            // The tail may be the start of a marker split across two reads
+            size_t keep = std::min(_pending.size(), _marker.size() - 1);
+            send(_pending.data(), _pending.size() - keep);
+            _pending.erase(0, _pending.size() - keep);
+        }
+
+        void finish()
+        {
+            send(_pending.data(), _pending.size());
+            _pending.clear();
+        }
+
+    private:
+        void send(const char* data, size_t size)
+        {
+            if (size == 0) return;
+            std::string frame(reinterpret_cast<const char*>(&_index), sizeof(_index));
+            frame.append(data, size);
+            _remote_process.sendStreamFrame(_type, frame.data(), static_cast<uint32_t>(frame.size()));
+        }
+
+        RemoteProcess&                _remote_process;
+        const RemoteCommandStreamType _type;
+        const std::string             _marker;
+        std::string                   _pending;
+        uint32_t                      _index { 0 };
+    };
+
+    bool ScriptShell::run(const std::string& cwd, const std::vector<std::string>& commands, bool stop_on_error,
+                          std::vector<RemoteCommandNodeResultInner>& results)
+    {
+        results.assign(commands.size(), RemoteCommandNodeResultInner());
+        if (commands.empty() || _cancelled.load()) return true;
+
+        // Random, so no command prints it by accident
+        char marker[40];
+        std::random_device random;
+        snprintf(marker, sizeof(marker), "\x1eRC%08x%08x\x1e", random(), random());
+
+        // Each command runs in braces that hide the status descriptor from it
+        // (and from anything it leaves running in the background).
+        std::string script;
+        for (const std::string& command : commands) {
+            script += "{\n" + command + "\n} " + std::to_string(STATUS_FD) + ">&-\n";
+            script += "__rc_status=$?; printf '%s' '" + std::string(marker) + "'; printf '%s' '" +
+                      std::string(marker) + "' >&2; echo $__rc_status >&" + std::to_string(STATUS_FD);
+            if (stop_on_error)
+                script += "; [ $__rc_status -eq 0 ] || exit $__rc_status";
+            script += "\n";
+        }
+        if (script.size() > MAX_SHELL_SCRIPT) return false;
+
+        int stdout_pipe[2], stderr_pipe[2], status_pipe[2];
+        if (pipeCloseOnExec(stdout_pipe) != 0) return false;
+        if (pipeCloseOnExec(stderr_pipe) != 0) {
+            ::close(stdout_pipe[0]); ::close(stdout_pipe[1]);
+            return false;
+        }
+        if (pipeCloseOnExec(status_pipe) != 0) {
+            ::close(stdout_pipe[0]); ::close(stdout_pipe[1]);
+            ::close(stderr_pipe[0]); ::close(stderr_pipe[1]);
+            return false;
+        }
+        int devnull = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+        std::shared_ptr<const LaunchOptions> launch = _remote_process.launchOptions();
+
+        auto start = std::chrono::steady_clock::now();
+        pid_t pid = fork();
+        if (pid == 0) {
+            setpgid(0, 0);
+            applyLaunchOptions(launch.get());
+            if (devnull != -1) dup2(devnull, STDIN_FILENO);
+            dup2(stdout_pipe[1], STDOUT_FILENO);
+            dup2(stderr_pipe[1], STDERR_FILENO);
+            ::close(stdout_pipe[0]); ::close(stdout_pipe[1]);
+            ::close(stderr_pipe[0]); ::close(stderr_pipe[1]);
+            ::close(status_pipe[0]);
+            // dup2 onto itself would leave close-on-exec set
+            if (status_pipe[1] == STATUS_FD)
+                fcntl(STATUS_FD, F_SETFD, 0);
+            else {
+                dup2(status_pipe[1], STATUS_FD);
+                ::close(status_pipe[1]);
+            }
+            if (devnull != -1) ::close(devnull);
+            if (!cwd.empty() && chdir(cwd.c_str()) != 0) _exit(127);
+            execl("/bin/sh", "sh", "-c", script.c_str(), nullptr);
+            _exit(127);
+        }
+
+        ::close(stdout_pipe[1]);
+        ::close(stderr_pipe[1]);
+        ::close(status_pipe[1]);
+        if (devnull != -1) ::close(devnull);
+        if (pid < 0) {
+            ::close(stdout_pipe[0]);
+            ::close(stderr_pipe[0]);
+            ::close(status_pipe[0]);
+            return false;
+        }
+        _remote_process.recordSpawn(start);
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            _pid = pid;
+            if (_cancelled.load())
+                kill(-pid, SIGTERM);
+        }
+
+        auto forward = [this, &marker](int fd, RemoteCommandStreamType type) {
+            MarkerSplitter splitter(_remote_process, type, marker);
+            char buf[4096];
+            ssize_t n;
+            while ((n = ::read(fd, buf, sizeof(buf))) > 0)
+                splitter.feed(buf, static_cast<size_t>(n));
+            splitter.finish();
+        };
+        std::thread stdout_thread(forward, stdout_pipe[0], RemoteCommandStreamType::STREAM_NODE_OUTPUT);
+        std::thread stderr_thread(forward, stderr_pipe[0], RemoteCommandStreamType::STREAM_NODE_ERROR);
+
+        // One status line per finished command
+        size_t done = 0;
+        auto last = start;
+        std::string line;
+        char buf[256];
+        ssize_t n;
+        while ((n = ::read(status_pipe[0], buf, sizeof(buf))) > 0) {
+            line.append(buf, static_cast<size_t>(n));
+            size_t eol;
+            while ((eol = line.find('\n')) != std::string::npos && done < results.size()) {
+                auto now = std::chrono::steady_clock::now();
+                RemoteCommandNodeResultInner& result = results[done++];
+                result.exit_code  = atoi(line.c_str());
+                result.state      = result.exit_code == 0 ? RemoteCommandNodeStateInner::SUCCEEDED
+                                                          : RemoteCommandNodeStateInner::FAILED;
+                result.elapsed_ms = static_cast<uint32_t>(
+                    std::chrono::duration_cast<std::chrono::milliseconds>(now - last).count());
+                last = now;
+                line.erase(0, eol + 1);
+            }
+        }
+        ::close(status_pipe[0]);
+
+        stdout_thread.join();
+        stderr_thread.join();
+        ::close(stdout_pipe[0]);
+        ::close(stderr_pipe[0]);
+
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            _pid = -1;
+        }
+        int32_t shell_exit = -1;
+        int status;
+        if (waitpid(pid, &status, 0) == pid) {
+            if (WIFEXITED(status))
+                shell_exit = WEXITSTATUS(status);
+            else if (WIFSIGNALED(status))
+                shell_exit = 128 + WTERMSIG(status);
+        }
+
+        // The shell stopped inside a command (`exit`, a syntax error, a
+        // signal) rather than after a failure with stop_on_error: that
+        // command gets the shell's status and the rest stay skipped.
+        bool stopped_on_error = stop_on_error && done > 0 &&
+                                results[done - 1].state == RemoteCommandNodeStateInner::FAILED;
+        if (done < results.size() && !stopped_on_error) {
+            RemoteCommandNodeResultInner& result = results[done];
+            result.exit_code  = shell_exit;
+            result.state      = shell_exit == 0 ? RemoteCommandNodeStateInner::SUCCEEDED
+                                                : RemoteCommandNodeStateInner::FAILED;
+            result.elapsed_ms = static_cast<uint32_t>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - last).count());
+        }
+        return true;
+    }
+#endif
+
+} // namespace Bn3Monkey
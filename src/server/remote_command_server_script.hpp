@@ -0,0 +1,63 @@
+#if !defined(__REMOTE_COMMAND_SERVER_SCRIPT__)
+#define __REMOTE_COMMAND_SERVER_SCRIPT__
+
+#include "remote_command_server_graph.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+namespace Bn3Monkey
+{
+    // -------------------------------------------------------------------------
+    // Scripts (INSTRUCTION_RUN_SCRIPT)
+    //
+    // An ordered list of commands answered with one response.  By default
+    // each command gets its own shell: the list becomes a chain on the
+    // session's GraphExecutor.  With SCRIPT_SHARED_SHELL, ScriptShell runs
+    // the whole list in a single /bin/sh so cd, variables and functions carry
+    // over from one command to the next.
+    // -------------------------------------------------------------------------
+
+    // Decodes the RUN_SCRIPT payloads; false if they are malformed.
+    bool parseCommandScript(const std::string& script, const std::string& commands,
+                            uint32_t& flags, std::vector<std::string>& out);
+
+    // The list as a chain of graph nodes: each one waits for the previous
+    // one, and with stop_on_error only for its success.
+    std::vector<GraphNode> chainCommandScript(const std::vector<std::string>& commands, bool stop_on_error);
+
+    class ScriptShell
+    {
+    public:
+        explicit ScriptShell(RemoteProcess& remote_process)
+            : _remote_process(remote_process) {}
+
+        // True where a shared shell is available (POSIX).
+        static bool supported();
+
+        // Runs the commands in one shell and blocks until it exits.  Between
+        // two commands the shell writes a marker to stdout and stderr and the
+        // exit status to a separate pipe, which is how output is tagged and
+        // results are timed.  False (nothing run) if the generated script
+        // would not fit in one `sh -c` argument.
+        bool run(const std::string& cwd, const std::vector<std::string>& commands, bool stop_on_error,
+                 std::vector<RemoteCommandNodeResultInner>& results);
+
+        // Terminates a running shell and refuses later ones: meant for
+        // session teardown.  Safe to call from another thread.
+        void cancel();
+
+        // Process group of the running shell, or -1.
+        int64_t processGroup();
+
+    private:
+        RemoteProcess&    _remote_process;
+        std::mutex        _mtx;          // guards _pid
+        int64_t           _pid { -1 };
+        std::atomic<bool> _cancelled { false };
+    };
+}
+
+#endif // __REMOTE_COMMAND_SERVER_SCRIPT__
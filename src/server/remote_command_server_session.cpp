@@ -0,0 +1,225 @@
+#include "remote_command_server_session.hpp"
+
+#include <vector>
+#include <random>
+
+#ifndef _WIN32
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+namespace Bn3Monkey
+{
+    // Session tokens come from the OS's cryptographic generator; a token
+    // that could be predicted would be no better than the sequential id.
+    static void fillRandom(void* data, size_t size)
+    {
+#ifndef _WIN32
+        int fd = ::open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            char*  ptr       = static_cast<char*>(data);
+            size_t remaining = size;
+            while (remaining > 0) {
+                ssize_t n = ::read(fd, ptr, remaining);
+                if (n <= 0) break;
+                ptr       += n;
+                remaining -= static_cast<size_t>(n);
+            }
+            ::close(fd);
+            if (remaining == 0) return;
+        }
+#endif
+        // Windows: rand_s, which is RtlGenRandom underneath
+        std::random_device device;
+        unsigned char* ptr = static_cast<unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i)
+            ptr[i] = static_cast<unsigned char>(device());
+    }
+
+    // Compares without an early exit, so response timing says nothing about
+    // how much of a guessed token was right.
+    static bool sameToken(const RemoteCommandSessionTokenInner& a, const RemoteCommandSessionTokenInner& b)
+    {
+        unsigned char diff = 0;
+        for (size_t i = 0; i < sizeof(a.bytes); ++i)
+            diff |= static_cast<unsigned char>(a.bytes[i] ^ b.bytes[i]);
+        return diff == 0;
+    }
+
+    // -------------------------------------------------------------------------
+    // Session
+    // -------------------------------------------------------------------------
+
+    Session::Session(uint32_t id, sock_t command_sock, std::string cwd,
+                     const RemoteCommandServerOptions& options)
+        : current_directory(std::move(cwd)), _id(id), _command_sock(command_sock)
+    {
+        fillRandom(_token.bytes, sizeof(_token.bytes));
+        heartbeat.configure(options.heartbeat_interval_ms, options.heartbeat_miss_count);
+    }
+
+    Session::~Session()
+    {
+        close();
+        if (thread.joinable()) {
+            if (thread.get_id() == std::this_thread::get_id())
+                thread.detach();
+            else
+                thread.join();
+        }
+    }
+
+    bool Session::attachStream(sock_t stream_sock)
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        if (_closed.load()) return false;
+
+        // The heartbeat monitor reads from the old socket, so stop it first.
+        heartbeat.detach();
+        sock_t old_sock = process.setStreamSocket(stream_sock);
+        if (old_sock != INVALID_SOCK)
+            closeSocket(old_sock);
+        heartbeat.attach(stream_sock);
+        _has_stream.store(true);
+        return true;
+    }
+
+    std::vector<int64_t> Session::processGroups()
+    {
+        std::vector<int64_t> groups;
+        for (int64_t group : { process.processGroup(), shell.processGroup(), zygote_job.processGroup() }) {
+            if (group > 0) groups.push_back(group);
+        }
+        graph.processGroups(groups);
+        return groups;
+    }
+
+    void Session::interrupt()
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        if (_closed.load()) return;     // the descriptor may already be reused
+        shutdownSocket(_command_sock);
+        process.terminate();            // a running RUN_COMMAND would keep the handler busy
+        graph.cancel();                 // ... and so would a RUN_GRAPH
+        shell.cancel();                 // ... or a shared-shell RUN_SCRIPT
+        zygote_job.cancel();            // ... or a RUN_COMMAND on a warm interpreter
+        job.cancel();                   // ... or one still waiting for a job slot
+    }
+
+    void Session::close()
+    {
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            if (_closed.load()) return;
+            _closed.store(true);
+        }
+
+        heartbeat.watchCommandSocket(INVALID_SOCK);
+        heartbeat.detach();
+        resources.stop();
+
+        // Kill any process left running when the client disconnects
+        if (process.is_running())
+            process.close(1);
+
+        sock_t stream_sock = process.setStreamSocket(INVALID_SOCK);
+        if (stream_sock != INVALID_SOCK)
+            closeSocket(stream_sock);
+        _has_stream.store(false);
+
+        closeSocket(_command_sock);
+    }
+
+    // -------------------------------------------------------------------------
+    // SessionRegistry
+    // -------------------------------------------------------------------------
+
+    std::shared_ptr<Session> SessionRegistry::create(sock_t command_sock, const std::string& cwd,
+                                                     const RemoteCommandServerOptions& options)
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        uint32_t id = _next_id++;
+        if (_next_id == 0) _next_id = 1;    // 0 is never a valid id
+        auto session = std::make_shared<Session>(id, command_sock, cwd, options);
+        _sessions.emplace(id, session);
+        return session;
+    }
+
+    std::shared_ptr<Session> SessionRegistry::find(const RemoteCommandSessionTokenInner& token)
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        for (auto& entry : _sessions) {
+            if (!entry.second->closed() && sameToken(entry.second->token(), token))
+                return entry.second;
+        }
+        return nullptr;
+    }
+
+    std::shared_ptr<Session> SessionRegistry::oldestWithoutStream()
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        for (auto& entry : _sessions) {
+            if (!entry.second->closed() && !entry.second->hasStream() &&
+                !entry.second->tokenIssued())
+                return entry.second;
+        }
+        return nullptr;
+    }
+
+    void SessionRegistry::reap()
+    {
+        std::vector<std::shared_ptr<Session>> finished;
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            for (auto it = _sessions.begin(); it != _sessions.end(); ) {
+                if (it->second->closed()) {
+                    finished.push_back(std::move(it->second));
+                    it = _sessions.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        // Join outside the lock: the handler may still be printing its farewell.
+        for (auto& session : finished) {
+            if (session->thread.joinable())
+                session->thread.join();
+        }
+    }
+
+    void SessionRegistry::closeAll()
+    {
+        std::map<uint32_t, std::shared_ptr<Session>> sessions;
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            sessions.swap(_sessions);
+        }
+        for (auto& entry : sessions)
+            entry.second->interrupt();
+        for (auto& entry : sessions) {
+            if (entry.second->thread.joinable())
+                entry.second->thread.join();
+        }
+    }
+
+    std::vector<std::shared_ptr<Session>> SessionRegistry::live()
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        std::vector<std::shared_ptr<Session>> sessions;
+        for (auto& entry : _sessions) {
+            if (!entry.second->closed()) sessions.push_back(entry.second);
+        }
+        return sessions;
+    }
+
+    size_t SessionRegistry::active()
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        size_t count = 0;
+        for (auto& entry : _sessions) {
+            if (!entry.second->closed()) ++count;
+        }
+        return count;
+    }
+
+} // namespace Bn3Monkey
@@ -0,0 +1,133 @@
+#if !defined(__REMOTE_COMMAND_SERVER_SESSION__)
+#define __REMOTE_COMMAND_SERVER_SESSION__
+
+#include "remote_command_server_process.hpp"
+#include "remote_command_server_heartbeat.hpp"
+#include "remote_command_server_graph.hpp"
+#include "remote_command_server_script.hpp"
+#include "remote_command_server_zygote.hpp"
+#include "remote_command_server_scheduler.hpp"
+#include "remote_command_server_resources.hpp"
+#include "remote_command_server_socket.hpp"
+#include <cstdint>
+#include <string>
+#include <map>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+namespace Bn3Monkey
+{
+    // -------------------------------------------------------------------------
+    // Session
+    //
+    // Everything that belongs to one connected client: its command socket,
+    // working directory, process slot, command graph, script shell, warm
+    // interpreter job, job scheduler ticket and heartbeat.  The stream socket is
+    // attached later by StreamServer and lives in RemoteProcess.
+    //
+    // A session is served by its own handler thread, started by the acceptor
+    // that accepted the command connection (and pinned to that acceptor's
+    // core when acceptors are pinned).
+    // -------------------------------------------------------------------------
+    class Session : public std::enable_shared_from_this<Session>
+    {
+    public:
+        Session(uint32_t id, sock_t command_sock, std::string cwd,
+                const RemoteCommandServerOptions& options);
+        ~Session();
+
+        inline uint32_t id() const { return _id; }
+        inline const RemoteCommandSessionTokenInner& token() const { return _token; }
+
+        // Set when the client asked for its token (INSTRUCTION_SESSION_ID):
+        // it will name its stream itself, so the arrival-order pairing of
+        // older clients must never hand it someone else's.
+        inline void markTokenIssued() { _token_issued.store(true); }
+        inline bool tokenIssued() const { return _token_issued.load(); }
+        inline sock_t   commandSocket() const { return _command_sock; }
+
+        RemoteProcess    process;
+        HeartbeatMonitor heartbeat { process };
+        GraphExecutor    graph     { process };
+        ScriptShell      shell     { process };
+        ZygoteJob        zygote_job;
+        ResourceMonitor  resources { process };
+        JobTicket        job;                 // slot in the server's job scheduler
+        RemoteCommandJobPriority job_priority { RemoteCommandJobPriority::NORMAL };   // handler thread only
+        std::string      current_directory;   // touched only by the handler thread
+        std::string      launch_cgroup;       // from SET_LAUNCH_OPTIONS; removed when the session ends
+
+        // Binds the stream socket, replacing (and closing) any previous one.
+        // Returns false once the session is closing; the caller then still
+        // owns stream_sock.
+        bool attachStream(sock_t stream_sock);
+        inline bool hasStream() const { return _has_stream.load(); }
+
+        // Process groups of everything the session is running right now.
+        std::vector<int64_t> processGroups();
+
+        // Wakes the handler if it is blocked on the command socket.
+        void interrupt();
+
+        // Called by the handler on the way out: kills what is still running,
+        // releases the stream socket and closes the command socket.
+        void close();
+        inline bool closed() const { return _closed.load(); }
+
+        std::thread thread;
+
+    private:
+        const uint32_t    _id;
+        RemoteCommandSessionTokenInner _token;   // random, set once in the constructor
+        const sock_t      _command_sock;
+        std::mutex        _mtx;           // serialises attachStream / close
+        std::atomic<bool> _has_stream { false };
+        std::atomic<bool> _closed     { false };
+        std::atomic<bool> _token_issued { false };
+    };
+
+    // -------------------------------------------------------------------------
+    // SessionRegistry
+    //
+    // Shared by the command acceptors (which create sessions) and the stream
+    // acceptor (which looks them up to attach stream sockets).
+    // -------------------------------------------------------------------------
+    class SessionRegistry
+    {
+    public:
+        SessionRegistry() {}
+        ~SessionRegistry() { closeAll(); }
+
+        std::shared_ptr<Session> create(sock_t command_sock, const std::string& cwd,
+                                        const RemoteCommandServerOptions& options);
+
+        // Live session holding the given token, or nullptr.
+        std::shared_ptr<Session> find(const RemoteCommandSessionTokenInner& token);
+
+        // Oldest live session that has no stream yet and never asked for its
+        // token (clients that do not send STREAM_ATTACH), or nullptr.
+        std::shared_ptr<Session> oldestWithoutStream();
+
+        // Joins and forgets sessions whose handler has returned.
+        void reap();
+
+        // Interrupts every session and joins all handler threads.
+        void closeAll();
+
+        // Number of sessions whose handler is still running.
+        size_t active();
+
+        // Every session whose handler is still running.
+        std::vector<std::shared_ptr<Session>> live();
+
+    private:
+        std::mutex _mtx;
+        uint32_t   _next_id { 1 };
+        std::map<uint32_t, std::shared_ptr<Session>> _sessions;   // ordered by age
+    };
+}
+
+#endif // __REMOTE_COMMAND_SERVER_SESSION__
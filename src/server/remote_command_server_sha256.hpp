@@ -0,0 +1,40 @@
+#if !defined(__REMOTE_COMMAND_SERVER_SHA256__)
+#define __REMOTE_COMMAND_SERVER_SHA256__
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace Bn3Monkey
+{
+    // -------------------------------------------------------------------------
+    // Sha256
+    //
+    // Plain FIPS 180-4 SHA-256, enough to key and address the command cache
+    // without pulling in a crypto library.
+    // -------------------------------------------------------------------------
+    class Sha256
+    {
+    public:
+        Sha256();
+
+        void update(const void* data, size_t size);
+        inline void update(const std::string& text) { update(text.data(), text.size()); }
+
+        // Lower-case hex of the digest.  Call once; the object is spent.
+        std::string hexDigest();
+
+    private:
+        void transform(const uint8_t* block);
+
+        uint32_t _state[8];
+        uint8_t  _buffer[64];
+        size_t   _buffered { 0 };
+        uint64_t _length   { 0 };
+    };
+
+    // Hex SHA-256 of a file's content; false if it cannot be read.
+    bool sha256File(const std::string& path, std::string& hex);
+}
+
+#endif // __REMOTE_COMMAND_SERVER_SHA256__
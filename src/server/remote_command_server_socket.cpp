@@ -1,9 +1,31 @@
 #include "remote_command_server_socket.hpp"
+#include "remote_command_server_trace.hpp"
+
+#ifdef _WIN32
+#  include <mstcpip.h>
+#else
+#  include <netinet/tcp.h>
+#  include <fcntl.h>
+#  include <poll.h>
+#endif
+
+#include <chrono>
 
 using namespace Bn3Monkey;
 
+// A peer that vanished mid-send must surface as a send() error, not as a
+// SIGPIPE that kills the embedding process.
+#if defined(MSG_NOSIGNAL)
+static constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+static constexpr int SEND_FLAGS = 0;
+#endif
+
 bool Bn3Monkey::sendAll(sock_t sock, const void* data, size_t size)
 {
+    TraceScope trace("sendAll", "bytes", static_cast<int64_t>(size));
+    if (isMemorySocket(static_cast<int64_t>(sock)))
+        return MemoryTransport::instance().send(static_cast<int64_t>(sock), data, size);
     const char* ptr = static_cast<const char*>(data);
     size_t remaining = size;
     while (remaining > 0) {
@@ -11,7 +33,7 @@ bool Bn3Monkey::sendAll(sock_t sock, const void* data, size_t size)
         int chunk = static_cast<int>(remaining > 65536 ? 65536 : remaining);
         int sent  = ::send(sock, ptr, chunk, 0);
 #else
-        ssize_t sent = ::send(sock, ptr, remaining, 0);
+        ssize_t sent = ::send(sock, ptr, remaining, SEND_FLAGS);
 #endif
         if (sent <= 0) return false;
         ptr       += sent;
@@ -22,9 +44,38 @@ bool Bn3Monkey::sendAll(sock_t sock, const void* data, size_t size)
 
 bool Bn3Monkey::recvAll(sock_t sock, void* data, size_t size)
 {
+    TraceScope trace("recvAll", "bytes", static_cast<int64_t>(size));
+    if (isMemorySocket(static_cast<int64_t>(sock)))
+        return MemoryTransport::instance().recv(static_cast<int64_t>(sock), data, size);
+    char* ptr = static_cast<char*>(data);
+    size_t remaining = size;
+    while (remaining > 0) {
+#ifdef _WIN32
+        int chunk    = static_cast<int>(remaining > 65536 ? 65536 : remaining);
+        int received = ::recv(sock, ptr, chunk, 0);
+#else
+        ssize_t received = ::recv(sock, ptr, remaining, 0);
+#endif
+        if (received <= 0) return false;
+        ptr       += received;
+        remaining -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+bool Bn3Monkey::recvAllWithin(sock_t sock, void* data, size_t size, int timeout_ms)
+{
+    // In-memory peers live in this process and always send whole frames.
+    if (isMemorySocket(static_cast<int64_t>(sock)))
+        return waitReadable(sock, timeout_ms) && recvAll(sock, data, size);
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
     char* ptr = static_cast<char*>(data);
     size_t remaining = size;
     while (remaining > 0) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        if (left <= 0 || !waitReadable(sock, static_cast<int>(left))) return false;
 #ifdef _WIN32
         int chunk    = static_cast<int>(remaining > 65536 ? 65536 : remaining);
         int received = ::recv(sock, ptr, chunk, 0);
@@ -49,6 +100,7 @@ void Bn3Monkey::sendStream(sock_t stream_sock,
                         uint32_t len)
 {
     if (len == 0) return;
+    TraceScope trace("sendStream", "bytes", len);
     RemoteCommandStreamHeader header(type, len);
     Bn3Monkey::sendAll(stream_sock, &header, sizeof(header));
     Bn3Monkey::sendAll(stream_sock, data,    len);
@@ -61,8 +113,9 @@ void Bn3Monkey::sendStreamLocked(std::mutex& mtx,
                                 uint32_t len)
 {
     if (len == 0) return;
+    TraceScope trace("sendStream", "bytes", len);
     RemoteCommandStreamHeader header(type, len);
-    std::lock_guard<std::mutex> lk(mtx);
+    std::unique_lock<std::mutex> lk = tracedLock(mtx, "lock stream");
     Bn3Monkey::sendAll(stream_sock, &header, sizeof(header));
     Bn3Monkey::sendAll(stream_sock, data,    len);
 }
@@ -71,31 +124,199 @@ sock_t Bn3Monkey::acceptWithSelect(sock_t          server_sock,
                                    sockaddr_in*    addr_out,
                                    std::atomic<bool>& running)
 {
+    if (isMemorySocket(static_cast<int64_t>(server_sock))) {
+        while (running.load()) {
+            int64_t client = MemoryTransport::instance().accept(static_cast<int64_t>(server_sock), 100);
+            if (client >= 0) {
+                if (addr_out) *addr_out = sockaddr_in {};
+                return static_cast<sock_t>(client);
+            }
+        }
+        return INVALID_SOCK;
+    }
+
     while (running.load()) {
-        fd_set read_fds;
-        FD_ZERO(&read_fds);
-        FD_SET(server_sock, &read_fds);
+        if (!waitReadable(server_sock, 100)) continue;  // timeout or transient error → retry
+        if (!running.load()) break;   // stopped while waiting: leave the connection queued
+
+        socklen_t len = sizeof(sockaddr_in);
+        sockaddr_in tmp{};
+        // Close-on-exec from the start: every session spawns children, and
+        // none of them may inherit another session's connection.
+#if defined(__linux__)
+        sock_t client = ::accept4(server_sock,
+                                    reinterpret_cast<sockaddr*>(&tmp), &len, SOCK_CLOEXEC);
+#else
+        sock_t client = ::accept(server_sock,
+                                    reinterpret_cast<sockaddr*>(&tmp), &len);
+#  ifndef _WIN32
+        if (client != INVALID_SOCK) fcntl(client, F_SETFD, FD_CLOEXEC);
+#  endif
+#endif
+        if (client == INVALID_SOCK) continue;
+        if (addr_out) *addr_out = tmp;
+        return client;
+    }
+    return INVALID_SOCK;
+}
+
+void Bn3Monkey::applyLivenessOptions(sock_t sock, const RemoteCommandServerOptions& options)
+{
+    if (isMemorySocket(static_cast<int64_t>(sock))) return;
+#ifdef _WIN32
+    if (options.tcp_keepalive_idle_s > 0) {
+        // SIO_KEEPALIVE_VALS enables keepalive and sets idle/interval in one go;
+        // the probe count is fixed by the OS.
+        tcp_keepalive ka {};
+        ka.onoff             = 1;
+        ka.keepalivetime     = static_cast<ULONG>(options.tcp_keepalive_idle_s) * 1000;
+        ka.keepaliveinterval = static_cast<ULONG>(options.tcp_keepalive_interval_s > 0
+                                   ? options.tcp_keepalive_interval_s : 1) * 1000;
+        DWORD returned = 0;
+        WSAIoctl(sock, SIO_KEEPALIVE_VALS, &ka, sizeof(ka),
+                 nullptr, 0, &returned, nullptr, nullptr);
+    }
+#else
+    if (options.tcp_keepalive_idle_s > 0) {
+        int yes = 1;
+        setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &yes, sizeof(yes));
+#  if defined(TCP_KEEPIDLE)
+        int idle = options.tcp_keepalive_idle_s;
+        setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+#  elif defined(TCP_KEEPALIVE)
+        int idle = options.tcp_keepalive_idle_s;
+        setsockopt(sock, IPPROTO_TCP, TCP_KEEPALIVE, &idle, sizeof(idle));
+#  endif
+#  if defined(TCP_KEEPINTVL)
+        if (options.tcp_keepalive_interval_s > 0) {
+            int interval = options.tcp_keepalive_interval_s;
+            setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+        }
+#  endif
+#  if defined(TCP_KEEPCNT)
+        if (options.tcp_keepalive_count > 0) {
+            int count = options.tcp_keepalive_count;
+            setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+        }
+#  endif
+    }
+#  if defined(TCP_USER_TIMEOUT)
+    if (options.tcp_user_timeout_ms > 0) {
+        unsigned int timeout = static_cast<unsigned int>(options.tcp_user_timeout_ms);
+        setsockopt(sock, IPPROTO_TCP, TCP_USER_TIMEOUT, &timeout, sizeof(timeout));
+    }
+#  endif
+#endif
+}
 
-        timeval tv{};
-        tv.tv_usec = 100 * 1000; // 100 ms
+void Bn3Monkey::setNoDelay(sock_t sock)
+{
+    if (isMemorySocket(static_cast<int64_t>(sock))) return;
+    int yes = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&yes), sizeof(yes));
+}
 
+void Bn3Monkey::shutdownSocket(sock_t sock)
+{
+    if (sock == INVALID_SOCK) return;
+    if (isMemorySocket(static_cast<int64_t>(sock))) {
+        MemoryTransport::instance().shutdown(static_cast<int64_t>(sock));
+        return;
+    }
 #ifdef _WIN32
-        int ret = ::select(0, &read_fds, nullptr, nullptr, &tv);
+    shutdown(sock, SD_BOTH);
 #else
-        int ret = ::select(static_cast<int>(server_sock) + 1,
-                            &read_fds, nullptr, nullptr, &tv);
+    shutdown(sock, SHUT_RDWR);
 #endif
-        if (ret <= 0) continue; // timeout or transient error → retry
-
-        if (FD_ISSET(server_sock, &read_fds)) {
-            socklen_t len = sizeof(sockaddr_in);
-            sockaddr_in tmp{};
-            sock_t client = ::accept(server_sock,
-                                        reinterpret_cast<sockaddr*>(&tmp), &len);
-            if (client == INVALID_SOCK) continue;
-            if (addr_out) *addr_out = tmp;
-            return client;
+}
+
+sock_t Bn3Monkey::openListenSocket(int32_t port, int backlog, bool reuse_port, const char* address)
+{
+    sockaddr_in addr {};
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port        = htons(static_cast<uint16_t>(port));
+    if (address && inet_pton(AF_INET, address, &addr.sin_addr) != 1)
+        return INVALID_SOCK;
+
+    sock_t sock = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (sock == INVALID_SOCK) return INVALID_SOCK;
+
+    int yes = 1;
+#ifdef _WIN32
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR,
+               reinterpret_cast<const char*>(&yes), sizeof(yes));
+    if (reuse_port) {
+        closeSocket(sock);
+        return INVALID_SOCK;
+    }
+#else
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    fcntl(sock, F_SETFD, FD_CLOEXEC);
+    if (reuse_port) {
+#  if defined(SO_REUSEPORT)
+        if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)) != 0) {
+            ::close(sock);
+            return INVALID_SOCK;
         }
+#  else
+        ::close(sock);
+        return INVALID_SOCK;
+#  endif
+    }
+#endif
+
+    if (::bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        ::listen(sock, backlog) != 0) {
+        shutdownSocket(sock);
+        closeSocket(sock);
+        return INVALID_SOCK;
     }
+    return sock;
+}
+
+bool Bn3Monkey::waitReadable(sock_t sock, int timeout_ms)
+{
+    if (isMemorySocket(static_cast<int64_t>(sock)))
+        return MemoryTransport::instance().waitReadable(static_cast<int64_t>(sock), timeout_ms);
+
+#ifdef _WIN32
+    fd_set read_fds;
+    FD_ZERO(&read_fds);
+    FD_SET(sock, &read_fds);
+
+    timeval tv{};
+    tv.tv_sec  = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+    int ret = ::select(0, &read_fds, nullptr, nullptr, &tv);
+    return ret > 0 && FD_ISSET(sock, &read_fds);
+#else
+    // poll, not select: FD_SET on a descriptor >= FD_SETSIZE is undefined,
+    // and a busy server passes 1024 open descriptors quickly.
+    pollfd pfd{};
+    pfd.fd     = sock;
+    pfd.events = POLLIN;
+    int ret = ::poll(&pfd, 1, timeout_ms);
+    return ret > 0 && (pfd.revents & (POLLIN | POLLHUP | POLLERR)) != 0;
+#endif
+}
+
+sock_t Bn3Monkey::openMemoryListenSocket(int32_t port)
+{
+    int64_t sock = MemoryTransport::instance().listen(port);
+    return sock < 0 ? INVALID_SOCK : static_cast<sock_t>(sock);
+}
+
+sock_t Bn3Monkey::duplicateSocket(sock_t sock)
+{
+    // An in-memory listener cannot leave the process
+    if (isMemorySocket(static_cast<int64_t>(sock))) return INVALID_SOCK;
+#ifdef _WIN32
+    (void)sock;
     return INVALID_SOCK;
-}
\ No newline at end of file
+#else
+    int fd = ::fcntl(sock, F_DUPFD_CLOEXEC, 0);
+    return fd < 0 ? INVALID_SOCK : fd;
+#endif
+}
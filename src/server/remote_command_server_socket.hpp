@@ -2,6 +2,8 @@
 #define __REMOTE_COMMAND_SERVER_SOCKET__
 
 #include "../protocol/remote_command_protocol.hpp"
+#include "../protocol/remote_command_transport.hpp"
+#include "../../include/remote_command_server.hpp"
 #include <mutex>
 #include <atomic>
 
@@ -14,7 +16,11 @@
 #  include <windows.h>
    typedef SOCKET sock_t;
    static constexpr sock_t INVALID_SOCK = INVALID_SOCKET;
-   inline void closeSocket(sock_t s) { closesocket(s); }
+   inline void closeSocket(sock_t s)
+   {
+       if (Bn3Monkey::isMemorySocket(static_cast<int64_t>(s))) Bn3Monkey::MemoryTransport::instance().close(static_cast<int64_t>(s));
+       else closesocket(s);
+   }
 #else
 #  include <sys/socket.h>
 #  include <netinet/in.h>
@@ -24,7 +30,11 @@
 #  include <signal.h>
    typedef int sock_t;
    static constexpr sock_t INVALID_SOCK = -1;
-   inline void closeSocket(sock_t s) { close(s); }
+   inline void closeSocket(sock_t s)
+   {
+       if (Bn3Monkey::isMemorySocket(s)) Bn3Monkey::MemoryTransport::instance().close(s);
+       else close(s);
+   }
 #endif
 
 
@@ -33,6 +43,10 @@ namespace Bn3Monkey {
     bool sendAll(sock_t sock, const void* data, size_t size);
     bool recvAll(sock_t sock, void* data, size_t size);
 
+    // recvAll that gives up once timeout_ms have passed, for reads from a
+    // peer that has not proven it speaks the protocol yet.
+    bool recvAllWithin(sock_t sock, void* data, size_t size, int timeout_ms);
+
     // -------------------------------------------------------------------------
     // Send a stream chunk (stdout or stderr) to the stream socket.
     // The Locked variant serialises concurrent writes (openProcess IO threads
@@ -50,15 +64,54 @@ namespace Bn3Monkey {
                             uint32_t len);
 
     // -------------------------------------------------------------------------
-    // Accept one connection on server_sock, using select() with a 100 ms
-    // timeout so the loop can be interrupted by setting running = false.
+    // Accept one connection on server_sock, waiting (waitReadable) at most
+    // 100 ms at a time so the loop can be interrupted by setting running = false.
     // Returns INVALID_SOCK when running becomes false or on error.
     // addr_out may be nullptr if the caller does not need the peer address.
     // -------------------------------------------------------------------------
     sock_t acceptWithSelect(sock_t          server_sock,
                                    sockaddr_in*    addr_out,
                                    std::atomic<bool>& running);
-    
+
+    // -------------------------------------------------------------------------
+    // Apply the TCP keepalive / TCP_USER_TIMEOUT settings from options to an
+    // accepted socket.  Options left at 0 keep the OS default.
+    // -------------------------------------------------------------------------
+    void applyLivenessOptions(sock_t sock, const RemoteCommandServerOptions& options);
+
+    // Disable Nagle on an accepted socket.  Headers and payloads go out in
+    // separate sends; with Nagle on, each request / response round trip
+    // stalls on the peer's delayed ACK.
+    void setNoDelay(sock_t sock);
+
+    // Wake up any thread blocked in recv()/send() on sock without releasing
+    // the descriptor (the owner still closes it).
+    void shutdownSocket(sock_t sock);
+
+    // True once sock has data (or end of stream) to read, or for a listener
+    // a connection to accept; false after timeout_ms.
+    bool waitReadable(sock_t sock, int timeout_ms);
+
+    // -------------------------------------------------------------------------
+    // Create a TCP socket bound to address:port (nullptr = INADDR_ANY) and
+    // listening with the given backlog.  Returns INVALID_SOCK on failure,
+    // including an address that is not a dotted IPv4 one.
+    // reuse_port sets SO_REUSEPORT so several listeners can share the port and
+    // the kernel balances new connections across them (Linux / BSD only;
+    // fails elsewhere).
+    // -------------------------------------------------------------------------
+    sock_t openListenSocket(int32_t port, int backlog, bool reuse_port = false,
+                            const char* address = nullptr);
+
+    // Listener of an in_memory server: port only names it among the
+    // in-process listeners (remote_command_transport.hpp).  INVALID_SOCK if
+    // another in-memory server already took the port.
+    sock_t openMemoryListenSocket(int32_t port);
+
+    // Duplicate a descriptor so it can be handed to another process while the
+    // original stays owned by its thread.  INVALID_SOCK where unsupported.
+    sock_t duplicateSocket(sock_t sock);
+
 }
 
 #endif // __REMOTE_COMMAND_SERVER_SOCKET__
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "remote_command_server_stream.hpp"
 #include "remote_command_server_helper.hpp"
+#include "remote_command_server_launch.hpp"
 
 #ifdef _WIN32
 #  ifndef WIN32_LEAN_AND_MEAN
@@ -12,8 +13,65 @@
 #  include <netinet/in.h>
 #endif
 
+#include <chrono>
+
 namespace Bn3Monkey
 {
+    // How long a new stream connection may take to name its session, and how
+    // long a silent (pre-session-id) client may wait for its command socket.
+    static constexpr int ATTACH_TIMEOUT_MS   = 200;
+    static constexpr int FALLBACK_TIMEOUT_MS = 1000;
+
+    // Stream connections still naming their session; more are refused.
+    static constexpr size_t MAX_PENDING_ATTACHES = 64;
+
+    // -------------------------------------------------------------------------
+    // attachToSession
+    // -------------------------------------------------------------------------
+
+    void StreamServer::attachToSession(sock_t stream_sock)
+    {
+        std::shared_ptr<Session> session;
+
+        if (waitReadable(stream_sock, ATTACH_TIMEOUT_MS)) {
+            // Bounded reads: a peer that sends part of a frame and stalls
+            // is dropped, not waited for.
+            RemoteCommandStreamHeader header(RemoteCommandStreamType::INVALID, 0);
+            RemoteCommandSessionTokenInner token;
+            if (recvAllWithin(stream_sock, &header, sizeof(header), ATTACH_TIMEOUT_MS) && header.valid() &&
+                header.type == RemoteCommandStreamType::STREAM_ATTACH &&
+                header.payload_length == sizeof(token) &&
+                recvAllWithin(stream_sock, &token, sizeof(token), ATTACH_TIMEOUT_MS))
+                session = _sessions.find(token);
+        }
+        else {
+            // Older clients never send STREAM_ATTACH; pair them in arrival
+            // order.  Their command connection may still be in the backlog.
+            auto deadline = std::chrono::steady_clock::now() +
+                            std::chrono::milliseconds(FALLBACK_TIMEOUT_MS);
+            while (!(session = _sessions.oldestWithoutStream()) &&
+                   _accepting.load() &&
+                   std::chrono::steady_clock::now() < deadline)
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        if (!session || !session->attachStream(stream_sock))
+            closeSocket(stream_sock);
+    }
+
+    void StreamServer::reapAttachers(bool wait_all)
+    {
+        for (auto it = _attachers.begin(); it != _attachers.end(); ) {
+            if (wait_all || it->done.load()) {
+                if (it->thread.joinable())
+                    it->thread.join();
+                it = _attachers.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
     // -------------------------------------------------------------------------
     // acceptLoop  (runs in _accepter thread)
     // -------------------------------------------------------------------------
@@ -21,63 +79,72 @@ namespace Bn3Monkey
     void StreamServer::acceptLoop()
     {
         setCurrentThreadName("RC_STACC");
+        std::vector<int32_t> reserved;
+        if (parseCpuList(_options.server_cores, reserved))
+            pinCurrentThreadToCores(reserved);
 
-        while (_running.load()) {
-            sock_t new_sock = acceptWithSelect(_server_sock, nullptr, _running);
+        while (_running.load() && _accepting.load()) {
+            sock_t new_sock = acceptWithSelect(_server_sock, nullptr, _accepting);
             if (new_sock == INVALID_SOCK)
                 break;
 
-            // Hand the new socket to RemoteProcess; get back the old one to close.
-            sock_t old_sock = _remote_process.setStreamSocket(new_sock);
-            if (old_sock != INVALID_SOCK)
-                closeSocket(old_sock);
+            applyLivenessOptions(new_sock, _options);
+            setNoDelay(new_sock);
+
+            reapAttachers(false);
+            if (_attachers.size() >= MAX_PENDING_ATTACHES) {
+                closeSocket(new_sock);
+                continue;
+            }
+            _attachers.emplace_back();
+            Attacher& attacher = _attachers.back();
+            attacher.thread = std::thread([this, &attacher, new_sock]() {
+                setCurrentThreadName("RC_ATTACH");
+                attachToSession(new_sock);
+                attacher.done.store(true);
+            });
         }
 
-        // Clear the socket in RemoteProcess on the way out
-        sock_t remaining = _remote_process.setStreamSocket(INVALID_SOCK);
-        if (remaining != INVALID_SOCK)
-            closeSocket(remaining);
+        // Handed off: drop only our reference to the listener the successor
+        // now owns.
+        if (_handed_off.load() && _server_sock != INVALID_SOCK) {
+            closeSocket(_server_sock);
+            _server_sock = INVALID_SOCK;
+        }
+        _accepter_active.store(false);
     }
 
     // -------------------------------------------------------------------------
     // open
     // -------------------------------------------------------------------------
 
-    bool StreamServer::open(int32_t stream_port)
+    bool StreamServer::open(int32_t stream_port, const RemoteCommandServerOptions& options,
+                            sock_t listen_sock)
     {
-        sock_t sock = ::socket(AF_INET, SOCK_STREAM, 0);
-        if (sock == INVALID_SOCK) return false;
+        _options = options;
 
-        int yes = 1;
-#ifdef _WIN32
-        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR,
-                   reinterpret_cast<const char*>(&yes), sizeof(yes));
-#else
-        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
-#endif
-
-        sockaddr_in addr {};
-        addr.sin_family      = AF_INET;
-        addr.sin_addr.s_addr = INADDR_ANY;
-        addr.sin_port        = htons(static_cast<uint16_t>(stream_port));
-
-        if (::bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
-            ::listen(sock, 1) != 0) {
-#ifdef _WIN32
-            shutdown(sock, SD_BOTH);
-#else
-            shutdown(sock, SHUT_RDWR);
-#endif
-            closeSocket(sock);
-            return false;
-        }
+        sock_t sock = listen_sock != INVALID_SOCK ? listen_sock
+                    : options.in_memory           ? openMemoryListenSocket(stream_port)
+                                                  : openListenSocket(stream_port, SOMAXCONN);
+        if (sock == INVALID_SOCK) return false;
 
         _server_sock = sock;
+        _handed_off.store(false);
+        _accepting.store(true);
         _running.store(true);
+        _accepter_active.store(true);
         _accepter = std::thread(&StreamServer::acceptLoop, this);
         return true;
     }
 
+    void StreamServer::stopAccepting()
+    {
+        _handed_off.store(true);
+        _accepting.store(false);
+        while (_accepter_active.load())
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
     // -------------------------------------------------------------------------
     // close
     // -------------------------------------------------------------------------
@@ -87,16 +154,15 @@ namespace Bn3Monkey
         if (!_running.load()) return;
 
         _running.store(false);
+        _accepting.store(false);
 
         if (_accepter.joinable())
             _accepter.join();
+        reapAttachers(true);     // each gives up within ATTACH + FALLBACK timeouts
 
+        // Attached streams belong to their sessions and are released with them.
         if (_server_sock != INVALID_SOCK) {
-#ifdef _WIN32
-            shutdown(_server_sock, SD_BOTH);
-#else
-            shutdown(_server_sock, SHUT_RDWR);
-#endif
+            shutdownSocket(_server_sock);
             closeSocket(_server_sock);
             _server_sock = INVALID_SOCK;
         }
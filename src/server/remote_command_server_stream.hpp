@@ -1,30 +1,60 @@
 #if !defined(__REMOTE_COMMAND_SERVER_STREAM__)
 #define __REMOTE_COMMAND_SERVER_STREAM__
 
-#include "remote_command_server_process.hpp"
+#include "remote_command_server_session.hpp"
 #include "remote_command_server_socket.hpp"
 #include <thread>
 #include <atomic>
+#include <list>
 
 namespace Bn3Monkey
 {
     class StreamServer
     {
     public:
-        explicit StreamServer(RemoteProcess& remote_process)
-            : _remote_process(remote_process) {}
+        explicit StreamServer(SessionRegistry& sessions) : _sessions(sessions) {}
         ~StreamServer() { close(); }
 
-        bool open(int32_t stream_port);
+        // listen_sock: pre-opened listener (socket activation / handoff), or
+        //              INVALID_SOCK to bind stream_port here.
+        bool open(int32_t stream_port, const RemoteCommandServerOptions& options,
+                  sock_t listen_sock = INVALID_SOCK);
         void close();
 
+        // Listener handoff: see CommandServer.  Streams already attached to
+        // sessions are kept so draining clients still receive their output.
+        // stopAccepting returns once the acceptor has let go of the listener.
+        sock_t duplicateListener() const { return duplicateSocket(_server_sock); }
+        void   stopAccepting();
+
     private:
         void acceptLoop();
 
-        RemoteProcess&    _remote_process;
+        // Reads the client's STREAM_ATTACH frame and binds the socket to that
+        // session.  Clients that send nothing get the oldest session still
+        // waiting for a stream that never asked for its token.  Closes the
+        // socket if no session takes it.  Runs on its own short-lived thread
+        // so a slow or silent peer never holds up the acceptor.
+        void attachToSession(sock_t stream_sock);
+
+        // Joins attach threads that have finished; all of them when wait_all.
+        void reapAttachers(bool wait_all);
+
+        struct Attacher
+        {
+            std::thread       thread;
+            std::atomic<bool> done { false };
+        };
+
+        SessionRegistry&  _sessions;
+        RemoteCommandServerOptions _options;
         sock_t            _server_sock { INVALID_SOCK };
         std::atomic<bool> _running     { false };
+        std::atomic<bool> _accepting   { false };
+        std::atomic<bool> _handed_off  { false };
+        std::atomic<bool> _accepter_active { false };   // acceptLoop not yet returned
         std::thread       _accepter;
+        std::list<Attacher> _attachers;   // acceptor thread, then close() once it has joined
     };
 }
 
@@ -0,0 +1,259 @@
+#include "remote_command_server_trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <vector>
+
+#ifdef _WIN32
+#  ifndef WIN32_LEAN_AND_MEAN
+#    define WIN32_LEAN_AND_MEAN
+#  endif
+#  include <windows.h>
+#else
+#  include <unistd.h>
+#  include <pthread.h>
+#endif
+
+namespace Bn3Monkey
+{
+    std::atomic<bool> ServerTrace::_enabled { false };
+
+    namespace
+    {
+        // Single writer (the owning thread); readers copy a range and then
+        // check that the writer has not lapped it.  Fields are atomics so a
+        // concurrent copy is a stale read, not a data race.
+        struct TraceEvent
+        {
+            std::atomic<const char*> name     { nullptr };
+            std::atomic<const char*> arg_name { nullptr };
+            std::atomic<int64_t>     begin_ns { 0 };
+            std::atomic<int64_t>     end_ns   { 0 };
+            std::atomic<int64_t>     arg      { 0 };
+            std::atomic<uint32_t>    tid      { 0 };
+        };
+
+        struct TraceRing
+        {
+            static constexpr uint64_t CAPACITY = 4096;   // per thread, ~200 KB
+
+            std::atomic<uint64_t> head { 0 };            // events ever written
+            TraceEvent            events[CAPACITY];
+        };
+
+        struct PlainEvent
+        {
+            const char* name;
+            const char* arg_name;
+            int64_t     begin_ns;
+            int64_t     end_ns;
+            int64_t     arg;
+            uint32_t    tid;
+        };
+
+        // Rings are only created, never freed: a ring whose thread ended
+        // goes back to free and keeps its events until it is reused.
+        struct TraceRegistry
+        {
+            std::mutex                              mtx;
+            std::vector<std::unique_ptr<TraceRing>> rings;
+            std::vector<TraceRing*>                 free;
+            std::map<uint32_t, std::string>         thread_names;
+            std::atomic<uint32_t>                   next_tid   { 1 };
+            std::atomic<int64_t>                    started_ns { 0 };
+        };
+
+        TraceRegistry& registry()
+        {
+            static TraceRegistry* instance = new TraceRegistry();   // used by threads during exit
+            return *instance;
+        }
+
+        std::string currentThreadName()
+        {
+#if defined(__linux__)
+            char name[16] {};
+            if (pthread_getname_np(pthread_self(), name, sizeof(name)) == 0)
+                return name;
+#endif
+            return std::string();
+        }
+
+        class ThreadRing
+        {
+        public:
+            ~ThreadRing()
+            {
+                if (!_ring) return;
+                TraceRegistry& reg = registry();
+                std::lock_guard<std::mutex> lk(reg.mtx);
+                reg.free.push_back(_ring);
+            }
+
+            TraceRing* get(uint32_t& tid)
+            {
+                if (!_ring) {
+                    TraceRegistry& reg = registry();
+                    _tid = reg.next_tid.fetch_add(1, std::memory_order_relaxed);
+                    std::string name = currentThreadName();
+                    std::lock_guard<std::mutex> lk(reg.mtx);
+                    if (!reg.free.empty()) {
+                        _ring = reg.free.back();
+                        reg.free.pop_back();
+                    } else {
+                        reg.rings.push_back(std::unique_ptr<TraceRing>(new TraceRing()));
+                        _ring = reg.rings.back().get();
+                    }
+                    if (!name.empty())
+                        reg.thread_names[_tid] = std::move(name);
+                }
+                tid = _tid;
+                return _ring;
+            }
+
+        private:
+            TraceRing* _ring { nullptr };
+            uint32_t   _tid  { 0 };
+        };
+
+        thread_local ThreadRing t_ring;
+
+        void appendEscaped(std::string& out, const char* text)
+        {
+            for (const char* p = text; *p; ++p) {
+                unsigned char c = static_cast<unsigned char>(*p);
+                if (c == '"' || c == '\\') {
+                    out += '\\';
+                    out += static_cast<char>(c);
+                } else if (c < 0x20) {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out += static_cast<char>(c);
+                }
+            }
+        }
+    }
+
+    int64_t ServerTrace::now() noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void ServerTrace::start()
+    {
+        TraceRegistry& reg = registry();
+        reg.started_ns.store(now(), std::memory_order_relaxed);
+        _enabled.store(true, std::memory_order_release);
+    }
+
+    void ServerTrace::stop()
+    {
+        _enabled.store(false, std::memory_order_release);
+    }
+
+    void ServerTrace::record(const char* name, int64_t begin_ns, int64_t end_ns,
+                             const char* arg_name, int64_t arg) noexcept
+    {
+        uint32_t   tid  = 0;
+        TraceRing* ring = t_ring.get(tid);
+        const uint64_t index = ring->head.load(std::memory_order_relaxed);
+        TraceEvent& event = ring->events[index % TraceRing::CAPACITY];
+        event.name.store(name, std::memory_order_relaxed);
+        event.arg_name.store(arg_name, std::memory_order_relaxed);
+        event.begin_ns.store(begin_ns, std::memory_order_relaxed);
+        event.end_ns.store(end_ns, std::memory_order_relaxed);
+        event.arg.store(arg, std::memory_order_relaxed);
+        event.tid.store(tid, std::memory_order_relaxed);
+        ring->head.store(index + 1, std::memory_order_release);
+    }
+
+    std::string ServerTrace::chromeJson()
+    {
+        TraceRegistry& reg = registry();
+        const int64_t started = reg.started_ns.load(std::memory_order_relaxed);
+
+        std::vector<PlainEvent>         events;
+        std::map<uint32_t, std::string> names;
+        {
+            std::lock_guard<std::mutex> lk(reg.mtx);
+            names = reg.thread_names;
+            for (const auto& ring : reg.rings) {
+                const uint64_t head  = ring->head.load(std::memory_order_acquire);
+                const uint64_t first = head > TraceRing::CAPACITY ? head - TraceRing::CAPACITY : 0;
+                const size_t   mark  = events.size();
+                for (uint64_t i = first; i < head; ++i) {
+                    const TraceEvent& event = ring->events[i % TraceRing::CAPACITY];
+                    PlainEvent plain;
+                    plain.name     = event.name.load(std::memory_order_relaxed);
+                    plain.arg_name = event.arg_name.load(std::memory_order_relaxed);
+                    plain.begin_ns = event.begin_ns.load(std::memory_order_relaxed);
+                    plain.end_ns   = event.end_ns.load(std::memory_order_relaxed);
+                    plain.arg      = event.arg.load(std::memory_order_relaxed);
+                    plain.tid      = event.tid.load(std::memory_order_relaxed);
+                    events.push_back(plain);
+                }
+                // The writer may have lapped the start of the copy meanwhile
+                std::atomic_thread_fence(std::memory_order_acquire);
+                const uint64_t after = ring->head.load(std::memory_order_acquire);
+                const uint64_t valid = after > TraceRing::CAPACITY ? after - TraceRing::CAPACITY : 0;
+                if (valid > first)
+                    events.erase(events.begin() + mark,
+                                 events.begin() + mark + static_cast<size_t>(std::min(valid, head) - first));
+            }
+        }
+
+#ifdef _WIN32
+        const unsigned long pid = GetCurrentProcessId();
+#else
+        const unsigned long pid = static_cast<unsigned long>(getpid());
+#endif
+        std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        char line[160];
+        bool first_event = true;
+        for (const auto& entry : names) {
+            snprintf(line, sizeof(line),
+                     "%s\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%lu,\"tid\":%u,\"args\":{\"name\":\"",
+                     first_event ? "" : ",", pid, entry.first);
+            out += line;
+            appendEscaped(out, entry.second.c_str());
+            out += "\"}}";
+            first_event = false;
+        }
+        for (const auto& event : events) {
+            // Left over from before start()
+            if (!event.name || event.begin_ns < started) continue;
+            snprintf(line, sizeof(line), "%s\n{\"ph\":\"X\",\"cat\":\"server\",\"pid\":%lu,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"name\":\"",
+                     first_event ? "" : ",", pid, event.tid,
+                     (event.begin_ns - started) / 1000.0, (event.end_ns - event.begin_ns) / 1000.0);
+            out += line;
+            appendEscaped(out, event.name);
+            out += '"';
+            if (event.arg_name) {
+                out += ",\"args\":{\"";
+                appendEscaped(out, event.arg_name);
+                snprintf(line, sizeof(line), "\":%lld}", static_cast<long long>(event.arg));
+                out += line;
+            }
+            out += '}';
+            first_event = false;
+        }
+        out += "\n]}\n";
+        return out;
+    }
+
+    bool ServerTrace::writeChromeJson(const std::string& path)
+    {
+        const std::string text = chromeJson();
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        out.write(text.data(), static_cast<std::streamsize>(text.size()));
+        return static_cast<bool>(out);
+    }
+}
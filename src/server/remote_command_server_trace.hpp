@@ -0,0 +1,84 @@
+#if !defined(__REMOTE_COMMAND_SERVER_TRACE__)
+#define __REMOTE_COMMAND_SERVER_TRACE__
+
+#include <cstdint>
+#include <string>
+#include <atomic>
+#include <mutex>
+
+namespace Bn3Monkey
+{
+    // -------------------------------------------------------------------------
+    // Server trace (INSTRUCTION_TRACE, RemoteCommandServerOptions::trace_file)
+    //
+    // Scoped events on the hot paths (requests, socket reads and writes,
+    // spawns, stream frames, file transfers, _stream_mtx waits) go into a
+    // ring of the calling thread, so recording takes no lock once the thread
+    // has its ring.  Off, a scope costs one relaxed load.  The trace is process-wide: every server in the
+    // process records into the same rings.
+    //
+    // A thread's ring outlives the thread and is handed to the next new one,
+    // so short-lived reader threads do not pile up rings; each event keeps
+    // the id of the thread that recorded it.
+    // -------------------------------------------------------------------------
+    class ServerTrace
+    {
+    public:
+        static inline bool enabled() noexcept { return _enabled.load(std::memory_order_relaxed); }
+
+        // start() drops whatever was recorded before
+        static void start();
+        static void stop();
+
+        static int64_t now() noexcept;   // steady_clock, nanoseconds
+
+        // name and arg_name must be string literals (only the pointer is kept)
+        static void record(const char* name, int64_t begin_ns, int64_t end_ns,
+                           const char* arg_name = nullptr, int64_t arg = 0) noexcept;
+
+        // Chrome trace-event JSON ({"traceEvents": [...]}), which
+        // chrome://tracing and ui.perfetto.dev open as is.  Safe while
+        // recording: events overwritten during the copy are left out.
+        static std::string chromeJson();
+        static bool        writeChromeJson(const std::string& path);
+
+    private:
+        static std::atomic<bool> _enabled;
+    };
+
+    class TraceScope
+    {
+    public:
+        explicit TraceScope(const char* name, const char* arg_name = nullptr, int64_t arg = 0) noexcept
+            : _name(ServerTrace::enabled() ? name : nullptr), _arg_name(arg_name), _arg(arg),
+              _begin(_name ? ServerTrace::now() : 0) {}
+        ~TraceScope() { end(); }
+
+        TraceScope(const TraceScope&) = delete;
+        TraceScope& operator=(const TraceScope&) = delete;
+
+        // Records now instead of at the end of the scope
+        inline void end() noexcept
+        {
+            if (!_name) return;
+            ServerTrace::record(_name, _begin, ServerTrace::now(), _arg_name, _arg);
+            _name = nullptr;
+        }
+
+    private:
+        const char* _name;
+        const char* _arg_name;
+        int64_t     _arg;
+        int64_t     _begin;
+    };
+
+    // Locks mtx, recording the wait as an event called name while tracing.
+    template<typename Mutex>
+    inline std::unique_lock<Mutex> tracedLock(Mutex& mtx, const char* name)
+    {
+        TraceScope scope(name);
+        return std::unique_lock<Mutex>(mtx);
+    }
+}
+
+#endif // __REMOTE_COMMAND_SERVER_TRACE__
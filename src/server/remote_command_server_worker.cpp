@@ -0,0 +1,73 @@
+#include "remote_command_server_worker.hpp"
+#include "remote_command_server_helper.hpp"
+
+#include <cstdio>
+
+namespace Bn3Monkey
+{
+    void WorkerPool::open(int32_t num_threads)
+    {
+        if (num_threads <= 0)
+            num_threads = static_cast<int32_t>(std::thread::hardware_concurrency());
+        if (num_threads <= 0)
+            num_threads = 1;
+
+        std::lock_guard<std::mutex> lk(_mtx);
+        _running = true;
+        for (int32_t i = 0; i < num_threads; ++i)
+            _threads.emplace_back(&WorkerPool::workerLoop, this, i);
+    }
+
+    void WorkerPool::close()
+    {
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            _running = false;
+            _jobs.clear();
+        }
+        _cv.notify_all();
+
+        for (auto& thread : _threads) {
+            if (thread.joinable())
+                thread.join();
+        }
+        _threads.clear();
+    }
+
+    bool WorkerPool::submit(Job job)
+    {
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            if (!_running) return false;
+            _jobs.push_back(std::move(job));
+        }
+        _cv.notify_one();
+        return true;
+    }
+
+    size_t WorkerPool::queued()
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        return _jobs.size();
+    }
+
+    void WorkerPool::workerLoop(int32_t index)
+    {
+        char name[16];
+        snprintf(name, sizeof(name), "RC_WORK%d", index);
+        setCurrentThreadName(name);
+
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lk(_mtx);
+                _cv.wait(lk, [this]() { return !_running || !_jobs.empty(); });
+                if (!_running) return;
+                job = std::move(_jobs.front());
+                _jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+} // namespace Bn3Monkey
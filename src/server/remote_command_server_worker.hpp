@@ -0,0 +1,52 @@
+#if !defined(__REMOTE_COMMAND_SERVER_WORKER__)
+#define __REMOTE_COMMAND_SERVER_WORKER__
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace Bn3Monkey
+{
+    // -------------------------------------------------------------------------
+    // WorkerPool
+    //
+    // Fixed set of threads shared by all sessions for slow filesystem work
+    // (INSTRUCTION_SUBMIT_OPERATION), so a long copy neither blocks its
+    // session's handler nor serialises with other sessions' copies.
+    // -------------------------------------------------------------------------
+    class WorkerPool
+    {
+    public:
+        using Job = std::function<void()>;
+
+        WorkerPool() {}
+        ~WorkerPool() { close(); }
+
+        // num_threads <= 0: one per core
+        void open(int32_t num_threads);
+
+        // Jobs still queued are dropped; running jobs are waited for.
+        void close();
+
+        // Returns false once the pool is closed.
+        bool submit(Job job);
+
+        // Jobs submitted but not picked up by a thread yet.
+        size_t queued();
+
+    private:
+        void workerLoop(int32_t index);
+
+        std::mutex               _mtx;
+        std::condition_variable  _cv;
+        std::deque<Job>          _jobs;
+        bool                     _running { false };
+        std::vector<std::thread> _threads;
+    };
+}
+
+#endif // __REMOTE_COMMAND_SERVER_WORKER__
@@ -0,0 +1,480 @@
+#include "remote_command_server_zygote.hpp"
+#include "remote_command_server_helper.hpp"
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#endif
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+namespace Bn3Monkey
+{
+    int64_t ZygoteJob::processGroup()
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        return _pid;
+    }
+
+    void ZygoteJob::cancel()
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        _cancelled.store(true);
+#ifndef _WIN32
+        if (_pid != -1) {
+            // The job may not have made itself a group leader yet
+            kill(-static_cast<pid_t>(_pid), SIGTERM);
+            kill(static_cast<pid_t>(_pid), SIGTERM);
+        }
+#endif
+    }
+
+#ifdef _WIN32
+    void ZygotePool::open(const std::string&, int32_t, const std::string&, std::shared_ptr<const LaunchOptions>) {}
+    void ZygotePool::close() {}
+    bool ZygotePool::run(const std::string&, const char*, RemoteProcess&, ZygoteJob&, int32_t&) { return false; }
+#else
+    // The zygote itself, passed to the interpreter with -c.  Preloads the
+    // modules named on its command line, then forks one child per job.
+    static const char ZYGOTE_SOURCE[] = R"PY(
+import array, atexit, os, runpy, socket, sys, threading, traceback, types
+
+def _recv_job(ctl):
+    fds = array.array('i')
+    head, ancillary, _, _ = ctl.recvmsg(4, socket.CMSG_LEN(2 * fds.itemsize))
+    for level, kind, data in ancillary:
+        if level == socket.SOL_SOCKET and kind == socket.SCM_RIGHTS:
+            fds.frombytes(data[:len(data) - len(data) % fds.itemsize])
+    while head and len(head) < 4:
+        more = ctl.recv(4 - len(head))
+        if not more:
+            head = b''
+        head += more
+    if len(head) < 4 or len(fds) != 2:
+        return None, None
+    size = int.from_bytes(head, 'little')
+    body = b''
+    while len(body) < size:
+        chunk = ctl.recv(size - len(body))
+        if not chunk:
+            return None, None
+        body += chunk
+    return list(fds), [f.decode('utf-8', 'surrogateescape') for f in body.split(b'\0')]
+
+def _run_job(fds, fields):
+    os.setpgid(0, 0)
+    null = os.open(os.devnull, os.O_RDONLY)
+    os.dup2(null, 0)
+    os.dup2(fds[0], 1)
+    os.dup2(fds[1], 2)
+    for fd in set([null, 3] + fds):
+        if fd > 2:
+            os.close(fd)
+    cwd, mode, target, args = fields[0], fields[1], fields[2], fields[3:]
+    code = 0
+    try:
+        os.chdir(cwd)
+        if mode == 'c':
+            sys.argv = ['-c'] + args
+            sys.path[0] = ''
+            main = types.ModuleType('__main__')
+            sys.modules['__main__'] = main
+            exec(compile(target, '<string>', 'exec'), main.__dict__)
+        elif mode == 'm':
+            sys.argv = [target] + args
+            sys.path[0] = os.getcwd()
+            runpy.run_module(target, run_name='__main__', alter_sys=True)
+        else:
+            sys.argv = [target] + args
+            sys.path[0] = os.path.dirname(os.path.realpath(target))
+            runpy.run_path(target, run_name='__main__')
+    except SystemExit as e:
+        if e.code is None:
+            code = 0
+        elif isinstance(e.code, int):
+            code = e.code & 0xff
+        else:
+            print(e.code, file=sys.stderr)
+            code = 1
+    except BaseException as e:
+        traceback.print_exception(type(e), e, e.__traceback__.tb_next)
+        code = 1
+    # What interpreter shutdown does before os._exit skips the rest: wait
+    # for non-daemon threads, then run atexit handlers.
+    try:
+        threading._shutdown()
+    except BaseException as e:
+        traceback.print_exception(type(e), e, e.__traceback__)
+    try:
+        atexit._run_exitfuncs()
+    except BaseException:
+        pass
+    try:
+        sys.stdout.flush()
+        sys.stderr.flush()
+    except BaseException:
+        pass
+    os._exit(code)
+
+def _serve():
+    for name in sys.argv[1:]:
+        try:
+            __import__(name)
+        except BaseException as e:
+            print('zygote: cannot preload %s: %s' % (name, e), file=sys.stderr)
+    ctl = socket.socket(fileno=3)
+    ctl.sendall(b'ready\n')
+    while True:
+        fds, fields = _recv_job(ctl)
+        if fds is None:
+            return
+        pid = os.fork()
+        if pid == 0:
+            _run_job(fds, fields)
+        for fd in fds:
+            os.close(fd)
+        ctl.sendall(b'pid %d\n' % pid)
+        _, status = os.waitpid(pid, 0)
+        code = 128 + os.WTERMSIG(status) if os.WIFSIGNALED(status) else os.WEXITSTATUS(status)
+        ctl.sendall(b'exit %d\n' % code)
+
+_serve()
+)PY";
+
+#if defined(MSG_NOSIGNAL)
+    static constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+    static constexpr int SEND_FLAGS = 0;
+#endif
+
+    static void setCloseOnExec(int fd)
+    {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+
+    // Splits cmd into words the way /bin/sh would, for commands that use
+    // nothing but plain words and quotes.  False on any other shell syntax.
+    static bool splitQuotedCommand(const char* cmd, std::vector<std::string>& argv)
+    {
+        static const char SHELL_CHARS[] = "|&;<>()$`*?[]#~{}!\n\r";
+        argv.clear();
+        std::string word;
+        bool in_word = false;
+        for (const char* p = cmd; *p; ++p) {
+            char c = *p;
+            if (c == ' ' || c == '\t') {
+                if (in_word) argv.push_back(std::move(word));
+                word.clear();
+                in_word = false;
+            } else if (c == '\'') {
+                const char* end = strchr(p + 1, '\'');
+                if (!end) return false;
+                word.append(p + 1, end);
+                p = end;
+                in_word = true;
+            } else if (c == '"') {
+                for (++p; *p != '"'; ++p) {
+                    if (*p == '\0' || *p == '$' || *p == '`') return false;
+                    if (*p == '\\' && strchr("\"\\$`\n", p[1]) && p[1] != '\0') {
+                        if (p[1] == '\n') return false;
+                        ++p;
+                    }
+                    word += *p;
+                }
+                in_word = true;
+            } else if (c == '\\') {
+                if (p[1] == '\0' || p[1] == '\n') return false;
+                word += *++p;
+                in_word = true;
+            } else {
+                if (strchr(SHELL_CHARS, c)) return false;
+                word += c;
+                in_word = true;
+            }
+        }
+        if (in_word) argv.push_back(std::move(word));
+
+        // NAME=value in front of the command is an assignment
+        return !argv.empty() && argv[0].find('=') == std::string::npos;
+    }
+
+    static bool readLine(int fd, std::string& line)
+    {
+        line.clear();
+        char c;
+        for (;;) {
+            ssize_t n = ::read(fd, &c, 1);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            if (c == '\n') return true;
+            line += c;
+        }
+    }
+
+    static bool writeAll(int fd, const char* data, size_t size)
+    {
+        while (size > 0) {
+            ssize_t n = ::send(fd, data, size, SEND_FLAGS);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            data += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    void ZygotePool::open(const std::string& executable, int32_t workers, const std::string& preload,
+                          std::shared_ptr<const LaunchOptions> launch)
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        _executable = executable;
+        _launch     = std::move(launch);
+        _preload.clear();
+        for (size_t pos = 0; pos <= preload.size(); ) {
+            size_t comma = preload.find(',', pos);
+            if (comma == std::string::npos) comma = preload.size();
+            std::string name = preload.substr(pos, comma - pos);
+            if (!name.empty()) _preload.push_back(name);
+            pos = comma + 1;
+        }
+
+        _workers.assign(workers > 0 ? static_cast<size_t>(workers) : 0, Worker());
+        _enabled = !_workers.empty();
+        for (Worker& worker : _workers) {
+            if (!spawn(worker)) {
+                _enabled = false;
+                break;
+            }
+        }
+    }
+
+    void ZygotePool::close()
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        _enabled = false;
+        for (Worker& worker : _workers)
+            retire(worker);
+        _workers.clear();
+    }
+
+    bool ZygotePool::spawn(Worker& worker)
+    {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return false;
+        setCloseOnExec(sv[0]);
+        setCloseOnExec(sv[1]);
+
+        // Everything the child needs is built before fork
+        std::vector<const char*> argv { _executable.c_str(), "-c", ZYGOTE_SOURCE };
+        for (const std::string& name : _preload)
+            argv.push_back(name.c_str());
+        argv.push_back(nullptr);
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            applyLaunchOptions(_launch.get());
+            if (sv[1] == 3) fcntl(3, F_SETFD, 0);
+            else            dup2(sv[1], 3);
+            int null = ::open("/dev/null", O_RDWR);
+            if (null != -1) {
+                dup2(null, STDIN_FILENO);
+                dup2(null, STDOUT_FILENO);
+            }
+            execvp(argv[0], const_cast<char* const*>(argv.data()));
+            _exit(127);
+        }
+        ::close(sv[1]);
+        if (pid < 0) {
+            ::close(sv[0]);
+            return false;
+        }
+        worker.pid     = pid;
+        worker.control = sv[0];
+        worker.ready   = false;
+        worker.busy    = false;
+        return true;
+    }
+
+    void ZygotePool::retire(Worker& worker)
+    {
+        if (worker.control != -1) {
+            ::close(worker.control);    // EOF ends the zygote's loop
+            worker.control = -1;
+        }
+        if (worker.pid != -1) {
+            kill(static_cast<pid_t>(worker.pid), SIGTERM);
+            waitpid(static_cast<pid_t>(worker.pid), nullptr, 0);
+            worker.pid = -1;
+        }
+        worker.ready = false;
+    }
+
+    bool ZygotePool::run(const std::string& cwd, const char* cmd, RemoteProcess& process,
+                         ZygoteJob& job, int32_t& exit_code)
+    {
+        std::vector<std::string> argv;
+        if (job._cancelled.load()) return false;
+        if (!splitQuotedCommand(cmd, argv) || argv.size() < 2 || argv[0] != _executable)
+            return false;
+
+        // cwd, mode, target, args
+        std::vector<std::string> fields { cwd };
+        size_t first_arg;
+        if (argv[1] == "-c" || argv[1] == "-m") {
+            if (argv.size() < 3) return false;
+            fields.push_back(argv[1].substr(1));
+            fields.push_back(argv[2]);
+            first_arg = 3;
+        } else if (argv[1][0] != '-') {
+            fields.push_back("p");
+            fields.push_back(argv[1]);
+            first_arg = 2;
+        } else {
+            return false;
+        }
+        fields.insert(fields.end(), argv.begin() + first_arg, argv.end());
+
+        Worker* worker = nullptr;
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            if (!_enabled) return false;
+            for (Worker& candidate : _workers) {
+                if (!candidate.busy && candidate.control != -1) {
+                    worker = &candidate;
+                    worker->busy = true;
+                    break;
+                }
+            }
+        }
+        if (!worker) return false;
+
+        bool ran = runOn(*worker, fields, process, job, exit_code);
+
+        std::lock_guard<std::mutex> lk(_mtx);
+        worker->busy = false;
+        return ran;
+    }
+
+    bool ZygotePool::runOn(Worker& worker, const std::vector<std::string>& fields,
+                           RemoteProcess& process, ZygoteJob& job, int32_t& exit_code)
+    {
+        std::string line;
+        if (!worker.ready) {
+            if (!readLine(worker.control, line) || line != "ready") {
+                // Never came up (missing interpreter, broken install): stop
+                // trying instead of paying for a fork on every command.
+                std::lock_guard<std::mutex> lk(_mtx);
+                retire(worker);
+                _enabled = false;
+                return false;
+            }
+            worker.ready = true;
+        }
+
+        auto restart = [this, &worker]() {
+            std::lock_guard<std::mutex> lk(_mtx);
+            retire(worker);
+            if (_enabled) spawn(worker);
+        };
+
+        // A write end inherited by an unrelated fork would delay EOF
+        int stdout_pipe[2], stderr_pipe[2];
+        if (pipeCloseOnExec(stdout_pipe) != 0) return false;
+        if (pipeCloseOnExec(stderr_pipe) != 0) {
+            ::close(stdout_pipe[0]); ::close(stdout_pipe[1]);
+            return false;
+        }
+
+        std::string body;
+        for (size_t i = 0; i < fields.size(); ++i) {
+            if (i > 0) body.push_back('\0');
+            body += fields[i];
+        }
+        uint32_t size = static_cast<uint32_t>(body.size());
+
+        // The header carries the pipe ends; the body follows as plain data
+        int fds[2] { stdout_pipe[1], stderr_pipe[1] };
+        char control[CMSG_SPACE(sizeof(fds))];
+        memset(control, 0, sizeof(control));
+        iovec iov { &size, sizeof(size) };
+        msghdr msg {};
+        msg.msg_iov        = &iov;
+        msg.msg_iovlen     = 1;
+        msg.msg_control    = control;
+        msg.msg_controllen = sizeof(control);
+        cmsghdr* cmsg   = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type  = SCM_RIGHTS;
+        cmsg->cmsg_len   = CMSG_LEN(sizeof(fds));
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+        bool sent = ::sendmsg(worker.control, &msg, SEND_FLAGS) == static_cast<ssize_t>(sizeof(size)) &&
+                    writeAll(worker.control, body.data(), body.size());
+        ::close(stdout_pipe[1]);
+        ::close(stderr_pipe[1]);
+        if (!sent) {
+            ::close(stdout_pipe[0]);
+            ::close(stderr_pipe[0]);
+            restart();
+            return false;
+        }
+
+        RunTimeline& timeline = process.timeline();
+        auto forward = [&process, &timeline](int fd, RemoteCommandStreamType type) {
+            char buf[4096];
+            ssize_t n;
+            while ((n = ::read(fd, buf, sizeof(buf))) > 0 || (n < 0 && errno == EINTR)) {
+                if (n <= 0) continue;
+                timeline.markFirst(timeline.first_output);
+                process.sendStreamFrame(type, buf, static_cast<uint32_t>(n));
+            }
+        };
+        std::thread stderr_thread(forward, stderr_pipe[0], RemoteCommandStreamType::STREAM_ERROR);
+        std::thread stdout_thread(forward, stdout_pipe[0], RemoteCommandStreamType::STREAM_OUTPUT);
+
+        bool finished = false;
+        pid_t pid = -1;
+        exit_code = -1;
+        if (readLine(worker.control, line) && line.compare(0, 4, "pid ") == 0) {
+            pid = static_cast<pid_t>(atoll(line.c_str() + 4));
+            timeline.mark(timeline.spawned);
+            {
+                std::lock_guard<std::mutex> lk(job._mtx);
+                job._pid = pid;
+            }
+            if (job._cancelled.load())
+                job.cancel();
+            if (readLine(worker.control, line) && line.compare(0, 5, "exit ") == 0) {
+                exit_code = atoi(line.c_str() + 5);
+                finished = true;
+                timeline.mark(timeline.exited);
+            }
+            std::lock_guard<std::mutex> lk(job._mtx);
+            job._pid = -1;
+        }
+        if (!finished) {
+            // The zygote died: its orphaned job would keep the pipes open
+            if (pid > 0) {
+                kill(-pid, SIGKILL);
+                kill(pid, SIGKILL);
+            }
+            restart();
+        }
+
+        stdout_thread.join();
+        stderr_thread.join();
+        timeline.mark(timeline.drained);
+        ::close(stdout_pipe[0]);
+        ::close(stderr_pipe[0]);
+        return true;
+    }
+#endif
+
+} // namespace Bn3Monkey
@@ -0,0 +1,97 @@
+#if !defined(__REMOTE_COMMAND_SERVER_ZYGOTE__)
+#define __REMOTE_COMMAND_SERVER_ZYGOTE__
+
+#include "remote_command_server_process.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <memory>
+
+namespace Bn3Monkey
+{
+    // -------------------------------------------------------------------------
+    // Warm interpreter pool
+    //
+    // `python3 -c ...` spends most of its time starting the interpreter.
+    // ZygotePool keeps a few python3 processes running with the configured
+    // modules already imported.  A RUN_COMMAND of the form
+    //
+    //   python3 -c CODE [ARG...]   python3 -m MODULE [ARG...]   python3 SCRIPT [ARG...]
+    //
+    // (quotes allowed, no other shell syntax) is handed to an idle one, which
+    // forks: the child takes the job's cwd, argv and output pipes and runs it
+    // like the interpreter would, while the zygote stays warm for the next
+    // job.  Jobs run with an empty stdin.  When every zygote is busy the
+    // command goes through the shell as usual.  POSIX only.
+    //
+    // The zygote speaks a small protocol on its fd 3 (a Unix socket):
+    //   server -> zygote : uint32 length + NUL-separated cwd, mode ("c", "m"
+    //                      or "p"), target, args; stdout / stderr pipe ends
+    //                      attached as SCM_RIGHTS
+    //   zygote -> server : "ready\n" once, then "pid N\n" and "exit N\n" per job
+    // -------------------------------------------------------------------------
+
+    // The running job of one session, so Session::interrupt can kill it.
+    class ZygoteJob
+    {
+    public:
+        // Terminates the running job and refuses later ones.  Safe to call
+        // from another thread.
+        void cancel();
+
+        // Process group of the running job, or -1.
+        int64_t processGroup();
+
+    private:
+        friend class ZygotePool;
+        std::mutex        _mtx;          // guards _pid
+        int64_t           _pid { -1 };
+        std::atomic<bool> _cancelled { false };
+    };
+
+    class ZygotePool
+    {
+    public:
+        ~ZygotePool() { close(); }
+
+        // Starts workers zygotes of executable with the comma-separated
+        // preload modules imported.  workers <= 0 leaves the pool empty.
+        // Zygotes are launched with launch (the server's default options), so
+        // sessions with options of their own do not use the pool.
+        void open(const std::string& executable, int32_t workers, const std::string& preload,
+                  std::shared_ptr<const LaunchOptions> launch);
+        void close();
+
+        // Runs cmd on an idle zygote and blocks until it is done; output goes
+        // to the stream socket through process.  Returns false, without
+        // running anything, if cmd is not a plain interpreter command or no
+        // zygote is free: the caller then uses the shell.
+        bool run(const std::string& cwd, const char* cmd, RemoteProcess& process,
+                 ZygoteJob& job, int32_t& exit_code);
+
+    private:
+        struct Worker
+        {
+            int64_t pid     { -1 };
+            int     control { -1 };
+            bool    ready   { false };
+            bool    busy    { false };
+        };
+
+        bool spawn(Worker& worker);
+        void retire(Worker& worker);
+        bool runOn(Worker& worker, const std::vector<std::string>& fields,
+                   RemoteProcess& process, ZygoteJob& job, int32_t& exit_code);
+
+        std::string              _executable;
+        std::shared_ptr<const LaunchOptions> _launch;
+        std::vector<std::string> _preload;
+        std::mutex               _mtx;          // guards _workers and _enabled
+        std::vector<Worker>      _workers;
+        bool                     _enabled { false };
+    };
+}
+
+#endif // __REMOTE_COMMAND_SERVER_ZYGOTE__
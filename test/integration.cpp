@@ -2,7 +2,10 @@
 
 #include "remote_command_client.hpp"
 #include "remote_command_server.hpp"
+#include "../src/protocol/remote_command_protocol.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <filesystem>
 #include <fstream>
 #include <thread>
@@ -10,6 +13,8 @@
 #include <mutex>
 #include <string>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <vector>
 
 namespace fs = std::filesystem;
@@ -330,6 +335,516 @@ TEST_F(Integration, runCommand)
     }
 }
 
+// ---------------------------------------------------------------------------
+// Built-in commands must be indistinguishable from the shell: run each one
+// as-is (in-process) and with a trailing ';' (forces /bin/sh) and compare.
+// ---------------------------------------------------------------------------
+#ifndef _WIN32
+struct CommandResult
+{
+    std::string out;
+    std::string err;
+    int32_t     exit_code { -1 };
+};
+
+static CommandResult runCaptured(RemoteCommandClient* client, const std::string& cmd)
+{
+    {
+        std::lock_guard<std::mutex> lk(g_buf_mutex);
+        g_stdout_buf.clear();
+        g_stderr_buf.clear();
+    }
+    CommandResult result;
+    result.exit_code = runCommandImpl(client, cmd.c_str());
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    std::lock_guard<std::mutex> lk(g_buf_mutex);
+    result.out = g_stdout_buf;
+    result.err = g_stderr_buf;
+    return result;
+}
+
+TEST_F(Integration, builtinCommands)
+{
+    auto writeLines = [this](const char* name, int count) {
+        std::ofstream f(test_dir / name);
+        for (int i = 1; i <= count; ++i) f << "line " << i << "\n";
+    };
+    writeLines("a.txt", 3);
+    writeLines("b.txt", 12);
+    fs::create_directories(test_dir / "sub");
+
+    // Re-creates whatever the previous run removed / created
+    auto reset = [&]() {
+        std::error_code ec;
+        writeLines("victim.txt", 1);
+        fs::create_directories(test_dir / "tree" / "leaf", ec);
+        fs::remove_all(test_dir / "made", ec);
+        fs::remove(test_dir / "touched.txt", ec);
+    };
+
+    const char* commands[] = {
+        "cat a.txt", "cat a.txt b.txt", "cat a.txt missing.txt", "cat sub",
+        "wc -l a.txt", "wc -l a.txt b.txt",
+        "head b.txt", "head -n 2 b.txt", "head -n4 b.txt", "head -3 a.txt b.txt",
+        "test -f a.txt", "test -d a.txt", "[ -d sub ]", "test -e missing.txt",
+        "test -d \"\"", "test -e ''", "[ -r \"\" ]",
+        "echo hello   world", "true", "false",
+        "mkdir -p made/x/y", "mkdir sub", "mkdir made/x",
+        "rm -f missing.txt", "rm missing.txt", "rm sub", "rm victim.txt", "rm -rf tree",
+        "touch touched.txt", "touch a.txt", "touch nodir/t.txt",
+    };
+    for (const char* cmd : commands) {
+        reset();
+        CommandResult builtin = runCaptured(client, cmd);
+        std::vector<std::string> builtin_listing;
+        for (auto& entry : fs::recursive_directory_iterator(test_dir))
+            builtin_listing.push_back(entry.path().string());
+
+        reset();
+        CommandResult shell = runCaptured(client, std::string(cmd) + ";");
+        std::vector<std::string> shell_listing;
+        for (auto& entry : fs::recursive_directory_iterator(test_dir))
+            shell_listing.push_back(entry.path().string());
+
+        EXPECT_EQ(builtin.out, shell.out) << cmd;
+        EXPECT_EQ(builtin.err, shell.err) << cmd;
+        EXPECT_EQ(builtin.exit_code, shell.exit_code) << cmd;
+        std::sort(builtin_listing.begin(), builtin_listing.end());
+        std::sort(shell_listing.begin(), shell_listing.end());
+        EXPECT_EQ(builtin_listing, shell_listing) << cmd;
+    }
+
+    EXPECT_EQ(runCommandImpl(client, "false"), 1);
+    EXPECT_EQ(runCommandImpl(client, "exit 3"), 3);
+    EXPECT_EQ(runCommandImpl(client, "kill -9 $$"), 128 + 9);
+}
+#endif
+
+#ifndef _WIN32
+// ---------------------------------------------------------------------------
+// Cached commands: a miss runs and stores, a hit restores outputs and
+// replays output without running; inputs and environment change the key,
+// failures are never stored and a damaged blob is never restored.
+// ---------------------------------------------------------------------------
+#include <unistd.h>
+
+TEST_F(Integration, cachedCommand)
+{
+    // A per-run seed keeps repeated runs of this test from sharing entries
+    std::ofstream(test_dir / "gen.in") << "seed " << std::chrono::system_clock::now().time_since_epoch().count() << "\n";
+    auto lines = [this](const char* name) {
+        std::ifstream f(test_dir / name);
+        return std::count(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>(), '\n');
+    };
+    auto clearOutput = []() {
+        std::lock_guard<std::mutex> lk(g_buf_mutex);
+        g_stdout_buf.clear();
+        g_stderr_buf.clear();
+    };
+
+    RemoteCachedCommand command;
+    command.command = "echo run >> runs.log; mkdir -p out && cat gen.in > out/gen.txt && echo generated && echo note >&2";
+    command.inputs  = { "*.in" };
+    command.outputs = { "out/gen.txt" };
+
+    // ---- 1. miss: runs and stores ----
+    bool hit = true;
+    EXPECT_EQ(runCachedCommand(client, command, &hit), 0);
+    EXPECT_FALSE(hit);
+    EXPECT_EQ(lines("runs.log"), 1);
+
+    // ---- 2. hit: outputs and output come back, nothing runs ----
+    flushStream();
+    clearOutput();
+    fs::remove_all(test_dir / "out");
+    EXPECT_EQ(runCachedCommand(client, command, &hit), 0);
+    EXPECT_TRUE(hit);
+    flushStream();
+    EXPECT_EQ(lines("runs.log"), 1);
+    ASSERT_TRUE(fs::exists(test_dir / "out" / "gen.txt"));
+    EXPECT_EQ(fs::file_size(test_dir / "out" / "gen.txt"), fs::file_size(test_dir / "gen.in"));
+    {
+        std::lock_guard<std::mutex> lk(g_buf_mutex);
+        EXPECT_EQ(g_stdout_buf, "generated\n");
+        EXPECT_EQ(g_stderr_buf, "note\n");
+    }
+
+    // ---- 3. new input content or environment: miss ----
+    std::ofstream(test_dir / "gen.in", std::ios::app) << "more\n";
+    EXPECT_EQ(runCachedCommand(client, command, &hit), 0);
+    EXPECT_FALSE(hit);
+    command.environment = { "MODE=release" };
+    EXPECT_EQ(runCachedCommand(client, command, &hit), 0);
+    EXPECT_FALSE(hit);
+    EXPECT_EQ(runCachedCommand(client, command, &hit), 0);
+    EXPECT_TRUE(hit);
+    EXPECT_EQ(lines("runs.log"), 3);
+
+    // ---- 4. a blob that no longer matches its hash: miss, then stored again ----
+    const fs::path store = fs::temp_directory_path() / ("remote-command-cache-" + std::to_string(geteuid()));
+    std::string generated;
+    {
+        std::ifstream f(test_dir / "out" / "gen.txt", std::ios::binary);
+        generated.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+    }
+    int tampered = 0;
+    for (const auto& entry : fs::directory_iterator(store / "objects")) {
+        std::ifstream f(entry.path(), std::ios::binary);
+        std::string content((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+        if (content != generated) continue;
+        f.close();
+        std::ofstream(entry.path(), std::ios::binary | std::ios::trunc) << "tampered\n";
+        ++tampered;
+    }
+    EXPECT_EQ(tampered, 1);
+    EXPECT_EQ(runCachedCommand(client, command, &hit), 0);
+    EXPECT_FALSE(hit);
+    EXPECT_EQ(runCachedCommand(client, command, &hit), 0);
+    EXPECT_TRUE(hit);
+    EXPECT_EQ(lines("runs.log"), 4);
+    {
+        std::ifstream f(test_dir / "out" / "gen.txt", std::ios::binary);
+        EXPECT_EQ(std::string(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>()), generated);
+    }
+
+    // ---- 5. the default store is the user's alone ----
+    EXPECT_EQ(fs::status(store).permissions() & (fs::perms::group_all | fs::perms::others_all), fs::perms::none);
+
+    // ---- 6. failures and missing outputs are not stored ----
+    RemoteCachedCommand failing;
+    failing.command = "echo run >> fails.log; cat gen.in > /dev/null; exit 3";
+    failing.inputs  = { "gen.in" };
+    EXPECT_EQ(runCachedCommand(client, failing, &hit), 3);
+    EXPECT_EQ(runCachedCommand(client, failing, &hit), 3);
+    EXPECT_FALSE(hit);
+    failing.command = "echo run >> fails.log; cat gen.in > /dev/null";
+    failing.outputs = { "never-written.txt" };
+    EXPECT_EQ(runCachedCommand(client, failing, &hit), 0);
+    EXPECT_EQ(runCachedCommand(client, failing, &hit), 0);
+    EXPECT_FALSE(hit);
+    EXPECT_EQ(lines("fails.log"), 4);
+    flushStream();
+}
+#endif
+
+#ifndef _WIN32
+// ---------------------------------------------------------------------------
+// Command graph: dependencies, per-node cwd / environment, parallel nodes,
+// skipped dependents of a failed node and tagged output.
+// ---------------------------------------------------------------------------
+static std::vector<std::pair<int32_t, std::string>> g_node_output;
+
+static void onNodeOutput(int32_t node, const char* text, bool is_error)
+{
+    std::lock_guard<std::mutex> lk(g_buf_mutex);
+    g_node_output.emplace_back(node, std::string(is_error ? "err:" : "out:") + text);
+}
+
+TEST_F(Integration, commandGraph)
+{
+    fs::create_directories(test_dir / "stage");
+    {
+        std::lock_guard<std::mutex> lk(g_buf_mutex);
+        g_node_output.clear();
+    }
+    onRemoteNodeOutput(client, onNodeOutput);
+
+    std::vector<RemoteCommandNode> nodes(9);
+    nodes[0].command = "echo a > a.txt";
+    nodes[0].cwd     = "stage";
+    nodes[1].command = "echo $GREETING > b.txt; echo warn >&2";
+    nodes[1].cwd     = "stage";
+    nodes[1].environment = { "GREETING=hi" };
+    nodes[2].command = "cat a.txt b.txt > c.txt && echo linked";
+    nodes[2].cwd     = "stage";
+    nodes[2].dependencies = { 0, 1 };
+    for (int i = 3; i <= 6; ++i) {
+        nodes[i].command      = "test -s stage/c.txt && sleep 0.3";
+        nodes[i].dependencies = { 2 };
+    }
+    nodes[7].command = "exit 4";
+    nodes[8].command = "echo never";
+    nodes[8].dependencies = { 7 };
+
+    std::vector<RemoteNodeResult> results;
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(runCommandGraph(client, nodes, 4, results));
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    flushStream();
+
+    ASSERT_EQ(results.size(), nodes.size());
+    for (int i = 0; i <= 6; ++i) {
+        EXPECT_EQ(results[i].state, RemoteNodeState::SUCCEEDED) << i;
+        EXPECT_EQ(results[i].exit_code, 0) << i;
+    }
+    EXPECT_GE(results[3].elapsed_ms, 250u);
+    EXPECT_EQ(results[7].state, RemoteNodeState::FAILED);
+    EXPECT_EQ(results[7].exit_code, 4);
+    EXPECT_EQ(results[8].state, RemoteNodeState::SKIPPED);
+
+    // The four 0.3 s test nodes ran side by side
+    EXPECT_LT(elapsed, std::chrono::milliseconds(1000));
+
+    std::ifstream c(test_dir / "stage" / "c.txt");
+    std::string contents((std::istreambuf_iterator<char>(c)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(contents, "a\nhi\n");
+
+    {
+        std::lock_guard<std::mutex> lk(g_buf_mutex);
+        auto has = [](int32_t node, const std::string& text) {
+            return std::find(g_node_output.begin(), g_node_output.end(),
+                             std::make_pair(node, text)) != g_node_output.end();
+        };
+        EXPECT_TRUE(has(1, "err:warn\n"));
+        EXPECT_TRUE(has(2, "out:linked\n"));
+        for (auto& entry : g_node_output)
+            EXPECT_NE(entry.second, "out:never\n");
+    }
+
+    // Cycles and out-of-range dependencies are rejected before anything runs
+    std::vector<RemoteCommandNode> cyclic(2);
+    cyclic[0].command = "touch ran.txt";
+    cyclic[0].dependencies = { 1 };
+    cyclic[1].command = "touch ran.txt";
+    cyclic[1].dependencies = { 0 };
+    EXPECT_FALSE(runCommandGraph(client, cyclic, 0, results));
+    EXPECT_TRUE(results.empty());
+    cyclic[1].dependencies = { 2 };
+    EXPECT_FALSE(runCommandGraph(client, cyclic, 0, results));
+    EXPECT_TRUE(results.empty());
+    EXPECT_FALSE(fs::exists(test_dir / "ran.txt"));
+
+    // The session carries on normally
+    std::vector<RemoteCommandNode> single(1);
+    single[0].command = "true";
+    EXPECT_TRUE(runCommandGraph(client, single, 0, results));
+    EXPECT_EQ(runCommandImpl(client, "exit 5"), 5);
+    onRemoteNodeOutput(client, nullptr);
+}
+#endif
+
+#ifndef _WIN32
+// ---------------------------------------------------------------------------
+// Parallel map: glob expansion, one file vs. batches per invocation, output
+// kept apart per invocation, failures and rejected templates.
+// ---------------------------------------------------------------------------
+TEST_F(Integration, mapFiles)
+{
+    std::vector<std::string> expected;
+    for (int i = 0; i < 20; ++i) {
+        std::string dir  = (i % 2) ? "src/odd" : "src/even";
+        std::string name = dir + "/f" + std::to_string(10 + i) + ".txt";
+        fs::create_directories(test_dir / dir);
+        std::ofstream(test_dir / name) << std::string(static_cast<size_t>(i + 1), 'x');
+        expected.push_back(name);
+    }
+    std::ofstream(test_dir / "src" / ".hidden.txt") << "hidden";
+    std::ofstream(test_dir / "src" / "top.txt") << "top";
+    expected.push_back("src/top.txt");
+    std::sort(expected.begin(), expected.end());
+
+    // ---- 1. one file per invocation, "**" spans directories ----
+    std::vector<RemoteMapItem> items;
+    std::vector<RemoteMapInvocation> invocations;
+    EXPECT_TRUE(mapFiles(client, "wc -c < {}", { "src/**/*.txt" }, 4, 0, items, invocations));
+    ASSERT_EQ(items.size(), expected.size());
+    ASSERT_EQ(invocations.size(), expected.size());
+    for (size_t i = 0; i < items.size(); ++i) {
+        EXPECT_EQ(items[i].file, expected[i]);
+        ASSERT_EQ(items[i].invocation, static_cast<int32_t>(i));
+        EXPECT_EQ(std::stoul(invocations[i].output), fs::file_size(test_dir / expected[i])) << expected[i];
+        EXPECT_EQ(invocations[i].state, RemoteNodeState::SUCCEEDED);
+    }
+
+    // ---- 2. batches of five, output in item order within a batch ----
+    EXPECT_TRUE(mapFiles(client, "cat {+}", { "src/*/f1?.txt" }, 0, 5, items, invocations));
+    ASSERT_EQ(items.size(), 10u);
+    ASSERT_EQ(invocations.size(), 2u);
+    for (size_t i = 0; i < items.size(); ++i)
+        EXPECT_EQ(items[i].invocation, static_cast<int32_t>(i / 5));
+    std::string batch;
+    for (size_t i = 0; i < 5; ++i) {
+        std::ifstream f(test_dir / items[i].file);
+        batch.append((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    }
+    EXPECT_EQ(invocations[0].output, batch);
+
+    // ---- 3. no placeholder: files appended; a failing batch is reported ----
+    EXPECT_FALSE(mapFiles(client, "ls -d", { "src/top.txt", "missing file" }, 0, 10, items, invocations));
+    ASSERT_EQ(items.size(), 2u);
+    ASSERT_EQ(invocations.size(), 1u);
+    EXPECT_EQ(items[1].file, "missing file");
+    EXPECT_EQ(invocations[0].state, RemoteNodeState::FAILED);
+    EXPECT_NE(invocations[0].exit_code, 0);
+    EXPECT_NE(invocations[0].output.find("src/top.txt"), std::string::npos);
+    EXPECT_NE(invocations[0].error.find("missing file"), std::string::npos);
+
+    // ---- 4. invocations run side by side ----
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_TRUE(mapFiles(client, "sleep 0.3; echo {}", { "src/even/*.txt" }, 10, 0, items, invocations));
+    EXPECT_EQ(invocations.size(), 10u);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(1500));
+    for (size_t i = 0; i < items.size(); ++i)
+        EXPECT_EQ(invocations[i].output, items[i].file + "\n");
+
+    // ---- 5. a glob without matches is empty; mixed placeholders are rejected ----
+    EXPECT_TRUE(mapFiles(client, "cat {}", { "src/*.none" }, 0, 0, items, invocations));
+    EXPECT_TRUE(items.empty());
+    EXPECT_FALSE(mapFiles(client, "echo {} {+}", { "src/top.txt" }, 0, 0, items, invocations));
+    EXPECT_TRUE(items.empty());
+    EXPECT_TRUE(invocations.empty());
+}
+#endif
+
+#ifndef _WIN32
+// ---------------------------------------------------------------------------
+// Scripts: separate shells with and without stop-on-error, and a shared
+// shell keeping cd / variables, tagging output and stopping at `exit`.
+// ---------------------------------------------------------------------------
+TEST_F(Integration, commandScript)
+{
+    {
+        std::lock_guard<std::mutex> lk(g_buf_mutex);
+        g_node_output.clear();
+    }
+    onRemoteNodeOutput(client, onNodeOutput);
+    auto outputOf = [](int32_t node, const char* prefix) {
+        std::lock_guard<std::mutex> lk(g_buf_mutex);
+        std::string text;
+        for (auto& entry : g_node_output)
+            if (entry.first == node && entry.second.compare(0, 4, prefix) == 0)
+                text += entry.second.substr(4);
+        return text;
+    };
+
+    // ---- 1. separate shells, stop on error ----
+    std::vector<RemoteNodeResult> results;
+    RemoteScriptOptions options;
+    EXPECT_FALSE(runCommandScript(client, { "echo one", "false", "touch ran.txt" }, options, results));
+    ASSERT_EQ(results.size(), 3u);
+    EXPECT_EQ(results[0].state, RemoteNodeState::SUCCEEDED);
+    EXPECT_EQ(results[1].state, RemoteNodeState::FAILED);
+    EXPECT_EQ(results[1].exit_code, 1);
+    EXPECT_EQ(results[2].state, RemoteNodeState::SKIPPED);
+    EXPECT_FALSE(fs::exists(test_dir / "ran.txt"));
+
+    // ---- 2. without stop on error everything runs, in order ----
+    options.stop_on_error = false;
+    EXPECT_FALSE(runCommandScript(client, { "exit 3", "echo a > order.txt", "echo b >> order.txt" },
+                                  options, results));
+    ASSERT_EQ(results.size(), 3u);
+    EXPECT_EQ(results[0].exit_code, 3);
+    EXPECT_EQ(results[2].state, RemoteNodeState::SUCCEEDED);
+    std::ifstream order(test_dir / "order.txt");
+    std::string contents((std::istreambuf_iterator<char>(order)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(contents, "a\nb\n");
+    flushStream();
+
+    // ---- 3. a shared shell keeps cd and variables ----
+    {
+        std::lock_guard<std::mutex> lk(g_buf_mutex);
+        g_node_output.clear();
+    }
+    fs::create_directories(test_dir / "shared");
+    options.stop_on_error = true;
+    options.shared_shell  = true;
+    EXPECT_TRUE(runCommandScript(client, { "cd shared && NAME=world", "echo hello $NAME; echo warn >&2",
+                                           "pwd", "sleep 0.2" }, options, results));
+    flushStream();
+    ASSERT_EQ(results.size(), 4u);
+    for (auto& result : results)
+        EXPECT_EQ(result.state, RemoteNodeState::SUCCEEDED);
+    EXPECT_GE(results[3].elapsed_ms, 150u);
+    EXPECT_EQ(outputOf(0, "out:"), "");
+    EXPECT_EQ(outputOf(1, "out:"), "hello world\n");
+    EXPECT_EQ(outputOf(1, "err:"), "warn\n");
+    EXPECT_EQ(fs::path(outputOf(2, "out:")).filename().string(), "shared\n");
+
+    // ---- 4. `exit` ends the shell; stop on error skips the rest ----
+    options.stop_on_error = false;
+    EXPECT_FALSE(runCommandScript(client, { "true", "exit 6", "touch ran.txt" }, options, results));
+    ASSERT_EQ(results.size(), 3u);
+    EXPECT_EQ(results[0].state, RemoteNodeState::SUCCEEDED);
+    EXPECT_EQ(results[1].state, RemoteNodeState::FAILED);
+    EXPECT_EQ(results[1].exit_code, 6);
+    EXPECT_EQ(results[2].state, RemoteNodeState::SKIPPED);
+    options.stop_on_error = true;
+    EXPECT_FALSE(runCommandScript(client, { "test -d nowhere", "touch ran.txt" }, options, results));
+    ASSERT_EQ(results.size(), 2u);
+    EXPECT_EQ(results[0].state, RemoteNodeState::FAILED);
+    EXPECT_EQ(results[1].state, RemoteNodeState::SKIPPED);
+    EXPECT_FALSE(fs::exists(test_dir / "ran.txt"));
+
+    // ---- 5. empty commands are rejected; the session carries on ----
+    EXPECT_FALSE(runCommandScript(client, { "true", "" }, options, results));
+    EXPECT_TRUE(results.empty());
+    EXPECT_EQ(runCommandImpl(client, "exit 5"), 5);
+    onRemoteNodeOutput(client, nullptr);
+}
+#endif
+
+#ifndef _WIN32
+// ---------------------------------------------------------------------------
+// Launch options: nice level and affinity reach every spawner, bad values
+// are refused without touching the current ones, defaults restore them.
+// ---------------------------------------------------------------------------
+TEST_F(Integration, launchOptions)
+{
+    auto firstLine = [this](const char* name) {
+        std::ifstream f(test_dir / name);
+        std::string line;
+        std::getline(f, line);
+        return line;
+    };
+    std::vector<RemoteNodeResult> results;
+
+    // ---- 1. server defaults ----
+    EXPECT_EQ(runCommandImpl(client, "nice > nice.txt"), 0);
+    EXPECT_EQ(firstLine("nice.txt"), "0");
+
+    // ---- 2. nice (and affinity on Linux) for runCommand and scripts ----
+    RemoteLaunchOptions options;
+    options.nice = 5;
+#ifdef __linux__
+    options.cpus     = { 0 };
+    options.io_class = RemoteIoClass::BEST_EFFORT;
+    options.io_level = 7;
+#endif
+    ASSERT_TRUE(setLaunchOptions(client, options));
+    EXPECT_EQ(runCommandImpl(client, "nice > nice.txt"), 0);
+    EXPECT_EQ(firstLine("nice.txt"), "5");
+    ASSERT_TRUE(runCommandScript(client, { "nice > script_nice.txt" }, RemoteScriptOptions(), results));
+    EXPECT_EQ(firstLine("script_nice.txt"), "5");
+#ifdef __linux__
+    EXPECT_EQ(runCommandImpl(client, "grep Cpus_allowed_list /proc/self/status > cpus.txt"), 0);
+    EXPECT_EQ(firstLine("cpus.txt"), "Cpus_allowed_list:\t0");
+#endif
+
+    // ---- 3. refused: out of range, or limits without a cgroup_root ----
+    RemoteLaunchOptions bad;
+    bad.nice = 40;
+    EXPECT_FALSE(setLaunchOptions(client, bad));
+    bad = RemoteLaunchOptions();
+    bad.cpus = { 4096 };
+    EXPECT_FALSE(setLaunchOptions(client, bad));
+    bad = RemoteLaunchOptions();
+    bad.io_class = RemoteIoClass::IDLE;
+    bad.io_level = 9;
+    EXPECT_FALSE(setLaunchOptions(client, bad));
+    bad = RemoteLaunchOptions();
+    bad.memory_max = "64M";
+    EXPECT_FALSE(setLaunchOptions(client, bad));
+    EXPECT_EQ(runCommandImpl(client, "nice > nice.txt"), 0);
+    EXPECT_EQ(firstLine("nice.txt"), "5");
+
+    // ---- 4. defaults restore the server's settings ----
+    ASSERT_TRUE(setLaunchOptions(client, RemoteLaunchOptions()));
+    EXPECT_EQ(runCommandImpl(client, "nice > nice.txt"), 0);
+    EXPECT_EQ(firstLine("nice.txt"), "0");
+}
+#endif
+
 // ---------------------------------------------------------------------------
 TEST_F(Integration, uploadFile)
 {
@@ -401,6 +916,374 @@ TEST_F(Integration, downloadFile)
     fs::remove(local_dst, ec);
 }
 
+// ---------------------------------------------------------------------------
+TEST_F(Integration, asyncOperations)
+{
+    // A small tree to copy and remove
+    fs::create_directories(test_dir / "tree" / "sub");
+    for (int i = 0; i < 20; ++i) {
+        std::ofstream f(test_dir / "tree" / "sub" / ("file" + std::to_string(i) + ".txt"));
+        f << "content " << i << "\n";
+    }
+
+    int32_t copy_id = copyDirectoryAsync(client, "tree", "tree_copy");
+    ASSERT_GT(copy_id, 0) << "copyDirectoryAsync should be accepted";
+
+    // The session keeps answering while the copy runs on the worker pool
+    EXPECT_NE(currentWorkingDirectory(client), nullptr);
+    EXPECT_TRUE(awaitOperation(client, copy_id));
+    EXPECT_TRUE(fs::exists(test_dir / "tree_copy" / "sub" / "file19.txt"));
+    EXPECT_FALSE(awaitOperation(client, copy_id)) << "an id is only awaited once";
+
+    // Upload and download in flight at the same time
+    fs::path local_src = fs::temp_directory_path() / "rcs_async_src.bin";
+    fs::path local_dst = fs::temp_directory_path() / "rcs_async_dst.bin";
+    const std::string content = "async \x01\x02 payload\n";
+    {
+        std::ofstream f(local_src, std::ios::binary);
+        f << content;
+    }
+    std::error_code ec;
+    fs::remove(local_dst, ec);
+
+    int32_t upload_id   = uploadFileAsync(client, local_src.string().c_str(), "async_uploaded.bin");
+    int32_t download_id = downloadFileAsync(client, local_dst.string().c_str(),
+                                            "tree/sub/file3.txt");
+    ASSERT_GT(upload_id, 0);
+    ASSERT_GT(download_id, 0);
+    EXPECT_NE(upload_id, download_id);
+    EXPECT_TRUE(awaitOperation(client, download_id));
+    EXPECT_TRUE(awaitOperation(client, upload_id));
+
+    {
+        std::ifstream f(test_dir / "async_uploaded.bin", std::ios::binary);
+        std::string got((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+        EXPECT_EQ(got, content);
+    }
+    {
+        std::ifstream f(local_dst, std::ios::binary);
+        std::string got((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+        EXPECT_EQ(got, "content 3\n");
+    }
+
+    int32_t missing_id = downloadFileAsync(client, local_dst.string().c_str(), "no_such_file.bin");
+    ASSERT_GT(missing_id, 0);
+    EXPECT_FALSE(awaitOperation(client, missing_id));
+
+    int32_t remove_id = removeDirectoryAsync(client, "tree_copy");
+    ASSERT_GT(remove_id, 0);
+    EXPECT_TRUE(awaitOperation(client, remove_id));
+    EXPECT_FALSE(fs::exists(test_dir / "tree_copy"));
+
+    fs::remove(local_src, ec);
+    fs::remove(local_dst, ec);
+}
+
+// ---------------------------------------------------------------------------
+static std::vector<RemoteOperationProgress> g_progress;
+
+static void onProgress(const RemoteOperationProgress& progress)
+{
+    std::lock_guard<std::mutex> lk(g_buf_mutex);
+    g_progress.push_back(progress);
+}
+
+TEST_F(Integration, operationProgress)
+{
+    // Three 1.5 MiB files: several chunks each
+    const uint64_t file_size = 3 * 512 * 1024;
+    fs::create_directories(test_dir / "big" / "sub");
+    for (int i = 0; i < 3; ++i) {
+        std::ofstream f(test_dir / "big" / "sub" / ("blob" + std::to_string(i) + ".bin"), std::ios::binary);
+        f << std::string(static_cast<size_t>(file_size), static_cast<char>('a' + i));
+    }
+    {
+        std::lock_guard<std::mutex> lk(g_buf_mutex);
+        g_progress.clear();
+    }
+    onRemoteProgress(client, onProgress);
+
+    int32_t copy_id = copyDirectoryAsync(client, "big", "big_copy");
+    ASSERT_GT(copy_id, 0);
+    EXPECT_TRUE(awaitOperation(client, copy_id));
+
+    // Progress frames precede the completion frame on the same stream
+    std::unique_lock<std::mutex> lk(g_buf_mutex);
+    ASSERT_FALSE(g_progress.empty()) << "expected at least one progress frame";
+    uint64_t last_bytes = 0;
+    for (const auto& p : g_progress) {
+        EXPECT_EQ(p.operation_id, copy_id);
+        EXPECT_EQ(p.bytes_total, 3 * file_size);
+        EXPECT_EQ(p.items_total, 5u) << "big, sub and three files";
+        EXPECT_GE(p.bytes_done, last_bytes) << "progress never goes backwards";
+        last_bytes = p.bytes_done;
+    }
+    EXPECT_EQ(g_progress.back().bytes_done, 3 * file_size) << "final counts are flushed";
+    EXPECT_EQ(g_progress.back().items_done, 5u);
+    g_progress.clear();
+    lk.unlock();
+
+    int32_t remove_id = removeDirectoryAsync(client, "big_copy");
+    ASSERT_GT(remove_id, 0);
+    EXPECT_TRUE(awaitOperation(client, remove_id));
+    onRemoteProgress(client, nullptr);
+
+    lk.lock();
+    ASSERT_FALSE(g_progress.empty());
+    EXPECT_EQ(g_progress.back().operation_id, remove_id);
+    EXPECT_EQ(g_progress.back().bytes_done, 3 * file_size);
+    EXPECT_EQ(g_progress.back().items_done, 5u);
+}
+
+// ---------------------------------------------------------------------------
+#ifdef __linux__
+static std::vector<RemoteProcessResources> g_resources;
+
+static void onResources(const RemoteProcessResources* groups, size_t count)
+{
+    std::lock_guard<std::mutex> lk(g_buf_mutex);
+    g_resources.insert(g_resources.end(), groups, groups + count);
+}
+
+TEST_F(Integration, resourceSampling)
+{
+    {
+        std::lock_guard<std::mutex> lk(g_buf_mutex);
+        g_resources.clear();
+    }
+    onRemoteResources(client, onResources);
+    ASSERT_TRUE(watchResources(client, 100));
+
+    int32_t pid = openProcess(client, "sh -c 'while :; do :; done'");
+    ASSERT_GT(pid, 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(800));
+
+    int32_t group_id = -1;
+    {
+        std::lock_guard<std::mutex> lk(g_buf_mutex);
+        ASSERT_FALSE(g_resources.empty()) << "expected resource frames while the loop runs";
+        const RemoteProcessResources& last = g_resources.back();
+        group_id = last.process_group;
+        EXPECT_GT(group_id, 0);
+        EXPECT_GE(last.processes, 1u);
+        EXPECT_GE(last.threads, 1u);
+        EXPECT_GT(last.rss_bytes, 0u);
+        EXPECT_GT(last.cpu_percent, 20.0) << "a busy loop keeps a core occupied";
+    }
+
+    std::vector<RemoteProcessResources> groups;
+    ASSERT_TRUE(listProcesses(client, groups));
+    bool listed = false;
+    for (const auto& group : groups)
+        listed = listed || group.process_group == group_id;
+    EXPECT_TRUE(listed) << "listProcesses reports the running group";
+
+    closeProcess(client, pid);
+    ASSERT_TRUE(listProcesses(client, groups));
+    for (const auto& group : groups)
+        EXPECT_NE(group.process_group, group_id) << "a closed group is no longer listed";
+
+    // Stopping: no frames after the reply (none are sent with nothing running either)
+    EXPECT_TRUE(watchResources(client, 0));
+    pid = openProcess(client, "sleep 2");
+    ASSERT_GT(pid, 0);
+    {
+        std::lock_guard<std::mutex> lk(g_buf_mutex);
+        g_resources.clear();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    {
+        std::lock_guard<std::mutex> lk(g_buf_mutex);
+        EXPECT_TRUE(g_resources.empty()) << "watchResources(0) stops sampling";
+    }
+    closeProcess(client, pid);
+    onRemoteResources(client, nullptr);
+}
+#endif
+
+// ---------------------------------------------------------------------------
+// Latency breakdown: phases come back in order when asked for, built-ins
+// are never spawned, and nothing is reported with the flag off.
+// ---------------------------------------------------------------------------
+TEST_F(Integration, runTiming)
+{
+    RemoteRunTiming timing;
+    EXPECT_EQ(runCommandImpl(client, "true"), 0);
+    EXPECT_FALSE(lastRunTiming(client, timing)) << "off by default";
+
+    enableRunTiming(client, true);
+#if defined(_WIN32)
+    const char* cmd = "echo x & ping -n 2 127.0.0.1 > nul";
+#else
+    const char* cmd = "echo x; sleep 0.1";
+#endif
+    EXPECT_EQ(runCommandImpl(client, cmd), 0);
+    ASSERT_TRUE(lastRunTiming(client, timing));
+    EXPECT_GE(timing.received_us, 0);
+    EXPECT_GE(timing.scheduled_us, timing.received_us);
+    EXPECT_GE(timing.spawned_us, timing.scheduled_us);
+    EXPECT_GE(timing.first_output_us, timing.spawned_us);
+    EXPECT_GE(timing.exited_us, timing.first_output_us);
+    EXPECT_GE(timing.exited_us - timing.spawned_us, 90000) << "the sleep runs between spawn and exit";
+    EXPECT_GE(timing.drained_us, timing.exited_us);
+    EXPECT_GE(timing.replied_us, timing.drained_us);
+    EXPECT_GE(timing.round_trip_us, timing.replied_us - timing.received_us);
+
+    EXPECT_EQ(runCommandImpl(client, "true"), 0);
+    ASSERT_TRUE(lastRunTiming(client, timing));
+    EXPECT_EQ(timing.spawned_us, -1) << "built-ins run in the server";
+    EXPECT_EQ(timing.first_output_us, -1);
+    EXPECT_GE(timing.drained_us, 0);
+    EXPECT_GE(timing.replied_us, timing.drained_us);
+
+    enableRunTiming(client, false);
+    EXPECT_EQ(runCommandImpl(client, "true"), 0);
+    EXPECT_FALSE(lastRunTiming(client, timing));
+}
+
+// ---------------------------------------------------------------------------
+// Client call stats: each call is counted with its bytes and a send / wait /
+// receive split, and the span hooks see every call with their context.
+// ---------------------------------------------------------------------------
+struct CallSpans
+{
+    std::vector<std::string> begun;
+    std::vector<RemoteCallTiming> ended;
+};
+
+static void onCallBegin(void* context, int32_t, const char* name)
+{
+    static_cast<CallSpans*>(context)->begun.push_back(name ? name : "?");
+}
+
+static void onCallEnd(void* context, const RemoteCallTiming& timing)
+{
+    static_cast<CallSpans*>(context)->ended.push_back(timing);
+}
+
+TEST_F(Integration, clientCallStats)
+{
+    resetClientStats(client);
+    CallSpans spans;
+    setRemoteCallHooks(client, onCallBegin, onCallEnd, &spans);
+
+    EXPECT_EQ(runCommandImpl(client, "echo stats | sort"), 0);
+    EXPECT_EQ(runCommandImpl(client, "true"), 0);
+    listDirectoryContents(client, ".");
+    setRemoteCallHooks(client, nullptr, nullptr, nullptr);
+
+    ASSERT_EQ(spans.begun.size(), 3u);
+    EXPECT_EQ(spans.begun[0], "run_command");
+    EXPECT_EQ(spans.begun[2], "list_directory_contents");
+    ASSERT_EQ(spans.ended.size(), 3u);
+    const RemoteCallTiming& run = spans.ended[0];
+    EXPECT_TRUE(run.ok);
+    EXPECT_EQ(run.instruction, 0x10002000);
+    EXPECT_EQ(run.bytes_sent, 24u + strlen("echo stats | sort"));
+    EXPECT_GE(run.bytes_received, 16u + 8u);
+    EXPECT_GT(run.wait_us, 0u) << "the command runs while the client waits";
+
+    RemoteClientStats stats;
+    ASSERT_TRUE(getClientStats(client, stats));
+    const RemoteCallStats* run_stats = nullptr;
+    for (const auto& call : stats.calls)
+        if (call.instruction == 0x10002000) run_stats = &call;
+    ASSERT_NE(run_stats, nullptr);
+    EXPECT_STREQ(run_stats->name, "run_command");
+    EXPECT_EQ(run_stats->total.count, 2u);
+    EXPECT_EQ(run_stats->failures, 0u);
+    EXPECT_EQ(run_stats->bytes_sent, 2 * 24u + strlen("echo stats | sort") + strlen("true"));
+    EXPECT_GE(run_stats->total.max_us, run_stats->wait.max_us);
+    EXPECT_GT(stats.stream_bytes_received, 0u) << "the echo came back on the stream socket";
+
+    resetClientStats(client);
+    ASSERT_TRUE(getClientStats(client, stats));
+    EXPECT_TRUE(stats.calls.empty());
+}
+
+// ---------------------------------------------------------------------------
+// Server trace: events recorded while on come back as Chrome trace JSON;
+// starting again drops them.
+// ---------------------------------------------------------------------------
+TEST_F(Integration, serverTrace)
+{
+    ASSERT_TRUE(startServerTrace(client));
+    EXPECT_EQ(runCommandImpl(client, "echo traced | sort"), 0);   // not a built-in
+    ASSERT_TRUE(stopServerTrace(client));
+
+    std::string json;
+    ASSERT_TRUE(fetchServerTrace(client, json));
+    EXPECT_EQ(json.compare(0, 2, "{\""), 0) << json.substr(0, 80);
+    EXPECT_NE(json.find("\"traceEvents\""), std::string::npos);
+    EXPECT_NE(json.find("\"ph\":\"X\""), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"handleCommand\""), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"recvAll\""), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"sendStream\""), std::string::npos) << "the echo goes out as a stream frame";
+#ifndef _WIN32
+    EXPECT_NE(json.find("\"name\":\"execute\""), std::string::npos);
+#endif
+    EXPECT_NE(json.find("\"name\":\"thread_name\""), std::string::npos);
+
+    // Fetching records nothing new once stopped
+    std::string again;
+    ASSERT_TRUE(fetchServerTrace(client, again));
+    EXPECT_EQ(again, json);
+
+    ASSERT_TRUE(startServerTrace(client));
+    ASSERT_TRUE(stopServerTrace(client));
+    ASSERT_TRUE(fetchServerTrace(client, json));
+    EXPECT_EQ(json.find("\"name\":\"execute\""), std::string::npos) << "start drops earlier events";
+}
+
+// ---------------------------------------------------------------------------
+TEST_F(Integration, customInstructions)
+{
+    const int32_t ADD  = REMOTE_COMMAND_USER_INSTRUCTION_BASE + 1;
+    const int32_t ECHO = REMOTE_COMMAND_USER_INSTRUCTION_BASE + 2;
+
+    ASSERT_TRUE(registerRemoteInstruction(server, ADD,
+        [](const RemoteInstructionRequest& request, RemoteInstructionResponse& response) {
+            int32_t a = 0, b = 0;
+            if (!request.read(0, a) || !request.read(1, b)) return false;
+            response.write(a + b);
+            return true;
+        }));
+    ASSERT_TRUE(registerRemoteInstruction(server, ECHO,
+        [](const RemoteInstructionRequest& request, RemoteInstructionResponse& response) {
+            response.append(request.payload(0));
+            response.append(request.payload(3));
+            return true;
+        }));
+    EXPECT_FALSE(registerRemoteInstruction(server, ADD,
+        [](const RemoteInstructionRequest&, RemoteInstructionResponse&) { return true; }))
+        << "a code can only be registered once";
+    EXPECT_FALSE(registerRemoteInstruction(server, 0x10001000,
+        [](const RemoteInstructionRequest&, RemoteInstructionResponse&) { return true; }))
+        << "built-in codes are not overridable";
+
+    int32_t a = 40, b = 2;
+    std::vector<char> reply;
+    EXPECT_TRUE(invokeRemoteInstruction(client, ADD,
+        { std::string(reinterpret_cast<char*>(&a), sizeof(a)),
+          std::string(reinterpret_cast<char*>(&b), sizeof(b)) }, reply));
+    ASSERT_EQ(reply.size(), sizeof(int32_t));
+    int32_t sum = 0;
+    memcpy(&sum, reply.data(), sizeof(sum));
+    EXPECT_EQ(sum, 42);
+
+    EXPECT_FALSE(invokeRemoteInstruction(client, ADD, { "short" }, reply))
+        << "a handler can reject malformed payloads";
+
+    EXPECT_TRUE(invokeRemoteInstruction(client, ECHO, { "head", "", "", "-tail" }, reply));
+    EXPECT_EQ(std::string(reply.begin(), reply.end()), "head-tail");
+
+    // Unregistered codes answer false instead of hanging the session
+    EXPECT_FALSE(invokeRemoteInstruction(client, REMOTE_COMMAND_USER_INSTRUCTION_BASE + 99, {}, reply));
+    EXPECT_TRUE(unregisterRemoteInstruction(server, ECHO));
+    EXPECT_FALSE(invokeRemoteInstruction(client, ECHO, { "x" }, reply));
+    EXPECT_NE(currentWorkingDirectory(client), nullptr) << "the session is still in step";
+}
+
 // ---------------------------------------------------------------------------
 TEST_F(Integration, openProcess_and_closeProcess)
 {
@@ -454,3 +1337,1002 @@ TEST_F(Integration, openProcess_output)
             << "stdout should contain 'hello_from_openprocess'";
     }
 }
+
+// ---------------------------------------------------------------------------
+// Heartbeat
+//
+// A raw socket pair stands in for a client whose host died: it connects both
+// sockets but never answers PING.  The server must drop the session and kill
+// its process within a few heartbeat intervals so the slot can be reused.
+// ---------------------------------------------------------------------------
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+static int connectRaw(int port)
+{
+    int sock = ::socket(AF_INET, SOCK_STREAM, 0);
+    fcntl(sock, F_SETFD, FD_CLOEXEC);   // keep it out of the server's children
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(static_cast<uint16_t>(port));
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (::connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        ::close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+TEST(Heartbeat, deadPeerIsDropped)
+{
+    static constexpr int DISC_PORT = 19013;
+    static constexpr int CMD_PORT  = 19011;
+    static constexpr int STR_PORT  = 19012;
+
+    fs::path dir = fs::temp_directory_path() / "rcs_heartbeat_test";
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+
+    RemoteCommandServerOptions options;
+    options.heartbeat_interval_ms = 200;
+    options.heartbeat_miss_count  = 2;
+    RemoteCommandServer* server = openRemoteCommandServer(DISC_PORT, CMD_PORT, STR_PORT,
+                                                          dir.string().c_str(), options);
+    ASSERT_NE(server, nullptr);
+
+    int command_sock = connectRaw(CMD_PORT);
+    int stream_sock  = connectRaw(STR_PORT);
+    ASSERT_GE(command_sock, 0);
+    ASSERT_GE(stream_sock, 0);
+
+    // Start a long command, then go silent
+    const char cmd[] = "sleep 30";
+    RemoteCommandRequestHeader req(RemoteCommandInstruction::INSTRUCTION_RUN_COMMAND,
+                                   static_cast<uint32_t>(sizeof(cmd) - 1));
+    ASSERT_EQ(::send(command_sock, &req, sizeof(req), 0), static_cast<ssize_t>(sizeof(req)));
+    ASSERT_EQ(::send(command_sock, cmd, sizeof(cmd) - 1, 0), static_cast<ssize_t>(sizeof(cmd) - 1));
+
+    timeval tv {};
+    tv.tv_sec = 5;
+    setsockopt(command_sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    auto start = std::chrono::steady_clock::now();
+    char byte = 0;
+    ssize_t n = ::recv(command_sock, &byte, 1, 0);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    std::printf("  Dropped after %lld ms\n", static_cast<long long>(elapsed));
+
+    EXPECT_EQ(n, 0) << "server should close the silent session";
+    EXPECT_LT(elapsed, 3000);
+
+    ::close(command_sock);
+    ::close(stream_sock);
+
+    // The slot is free again and the `sleep 30` is gone: a real client
+    // (which answers pings) is served straight away.
+    RemoteCommandClient* client = createRemoteCommandClient(CMD_PORT, STR_PORT);
+    ASSERT_NE(client, nullptr);
+    start = std::chrono::steady_clock::now();
+    EXPECT_NE(currentWorkingDirectory(client), nullptr);
+
+    // Stay idle across several intervals; pongs keep the session alive
+    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    EXPECT_TRUE(directoryExists(client, "."));
+    elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    EXPECT_LT(elapsed, 3000);
+
+    releaseRemoteCommandClient(client);
+    closeRemoteCommandServer(server);
+    fs::remove_all(dir, ec);
+}
+
+// A client busy draining heavy output is alive even while the flood keeps
+// the stream too busy for pings to get through.
+static std::atomic<size_t> g_flood_bytes { 0 };
+
+static void onFloodOutput(const char* msg)
+{
+    g_flood_bytes.fetch_add(std::strlen(msg));
+    std::this_thread::sleep_for(std::chrono::microseconds(500));   // a slow consumer
+}
+
+TEST(Heartbeat, floodingOutputKeepsSessionAlive)
+{
+    static constexpr int DISC_PORT = 19213;
+    static constexpr int CMD_PORT  = 19211;
+    static constexpr int STR_PORT  = 19212;
+
+    fs::path dir = fs::temp_directory_path() / "rcs_heartbeat_flood_test";
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+
+    RemoteCommandServerOptions options;
+    options.heartbeat_interval_ms = 100;
+    options.heartbeat_miss_count  = 2;
+    RemoteCommandServer* server = openRemoteCommandServer(DISC_PORT, CMD_PORT, STR_PORT,
+                                                          dir.string().c_str(), options);
+    ASSERT_NE(server, nullptr);
+
+    RemoteCommandClient* client = createRemoteCommandClient(CMD_PORT, STR_PORT);
+    ASSERT_NE(client, nullptr);
+    onRemoteOutput(client, onFloodOutput);
+    onRemoteError(client, onFloodOutput);
+
+    g_flood_bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    int32_t rc = runCommand(client, "(yes out | head -c 4000000) & (yes err | head -c 4000000 >&2); wait");
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    std::printf("  %zu bytes in %lld ms\n", g_flood_bytes.load(), static_cast<long long>(elapsed));
+
+    EXPECT_EQ(rc, 0) << "the session must survive its own output";
+    EXPECT_TRUE(directoryExists(client, "."));
+
+    releaseRemoteCommandClient(client);
+    closeRemoteCommandServer(server);
+    fs::remove_all(dir, ec);
+}
+#endif
+
+// ---------------------------------------------------------------------------
+// Listener handoff
+//
+// A second server started on the same ports and handoff path takes over the
+// listeners instead of failing to bind.  The first keeps serving its client
+// until it disconnects, then reports itself retired.
+// ---------------------------------------------------------------------------
+#ifndef _WIN32
+#ifdef __linux__
+// Listening TCP sockets bound to port, from /proc/net/tcp
+static int countListeners(int port)
+{
+    std::ifstream f("/proc/net/tcp");
+    std::string line;
+    std::getline(f, line);      // header
+    int count = 0;
+    while (std::getline(f, line)) {
+        unsigned local_port = 0, state = 0;
+        char local_addr[64] {0}, remote[64] {0};
+        if (std::sscanf(line.c_str(), " %*d: %63[0-9A-Fa-f]:%x %63s %x", local_addr, &local_port, remote, &state) == 4 &&
+            static_cast<int>(local_port) == port && state == 0x0A)
+            ++count;
+    }
+    return count;
+}
+#endif
+
+// old_acceptors > 1: every SO_REUSEPORT listener is handed over, and the
+// successor keeps accepting on all of them even with a single acceptor of
+// its own.
+static void runHandoff(int32_t old_acceptors)
+{
+    static constexpr int DISC_PORT = 19023;
+    static constexpr int CMD_PORT  = 19021;
+    static constexpr int STR_PORT  = 19022;
+
+    fs::path dir  = fs::temp_directory_path() / "rcs_handoff_test";
+    fs::path path = fs::temp_directory_path() / "rcs_handoff_test.sock";
+    std::error_code ec;
+    fs::create_directories(dir / "old", ec);
+    fs::create_directories(dir / "new", ec);
+
+    RemoteCommandServerOptions options;
+    std::string path_str = path.string();
+    options.handoff_path     = path_str.c_str();
+    options.acceptor_threads = old_acceptors;
+
+    RemoteCommandServer* old_server = openRemoteCommandServer(
+        DISC_PORT, CMD_PORT, STR_PORT, (dir / "old").string().c_str(), options);
+    ASSERT_NE(old_server, nullptr);
+
+    RemoteCommandClient* old_client = createRemoteCommandClient(CMD_PORT, STR_PORT);
+    ASSERT_NE(old_client, nullptr);
+    ASSERT_NE(currentWorkingDirectory(old_client), nullptr);
+
+    // Same ports: only works because the listeners are handed over
+    options.acceptor_threads = 1;
+    RemoteCommandServer* new_server = openRemoteCommandServer(
+        DISC_PORT, CMD_PORT, STR_PORT, (dir / "new").string().c_str(), options);
+    ASSERT_NE(new_server, nullptr) << "successor should take over instead of failing to bind";
+    EXPECT_FALSE(isRemoteCommandServerRetired(old_server)) << "old server still has a client";
+
+    // New connections land on the successor
+    RemoteCommandClient* new_client = createRemoteCommandClient(CMD_PORT, STR_PORT);
+    ASSERT_NE(new_client, nullptr);
+    const char* cwd = currentWorkingDirectory(new_client);
+    ASSERT_NE(cwd, nullptr);
+    EXPECT_NE(std::string(cwd).find("new"), std::string::npos);
+
+    // The draining client is still served by the old process
+    cwd = currentWorkingDirectory(old_client);
+    ASSERT_NE(cwd, nullptr);
+    EXPECT_NE(std::string(cwd).find("old"), std::string::npos);
+
+    releaseRemoteCommandClient(old_client);
+    bool retired = false;
+    for (int i = 0; i < 50 && !retired; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        retired = isRemoteCommandServerRetired(old_server);
+    }
+    EXPECT_TRUE(retired) << "old server should retire once drained";
+    closeRemoteCommandServer(old_server);
+
+#ifdef __linux__
+    EXPECT_EQ(countListeners(CMD_PORT), old_acceptors) << "every listener lives on in the successor";
+#endif
+
+    // Closing the predecessor must not disturb the successor's listeners,
+    // whichever of them the kernel picks for a connection
+    for (int i = 0; i < 2 * old_acceptors; ++i) {
+        RemoteCommandClient* late_client = createRemoteCommandClient(CMD_PORT, STR_PORT);
+        EXPECT_NE(late_client, nullptr) << "client " << i;
+        if (!late_client) continue;
+        cwd = currentWorkingDirectory(late_client);
+        EXPECT_TRUE(cwd && std::string(cwd).find("new") != std::string::npos) << "client " << i;
+        releaseRemoteCommandClient(late_client);
+    }
+    releaseRemoteCommandClient(new_client);
+
+    closeRemoteCommandServer(new_server);
+    fs::remove_all(dir, ec);
+}
+
+TEST(Handoff, successorTakesOverListeners)
+{
+    {
+        SCOPED_TRACE("one acceptor");
+        runHandoff(1);
+    }
+    {
+        SCOPED_TRACE("four acceptors");
+        runHandoff(4);
+    }
+}
+#endif
+
+// ---------------------------------------------------------------------------
+// Concurrent sessions
+//
+// Several clients served at once through sharded acceptors: each keeps its
+// own working directory, and their commands run in parallel.
+// ---------------------------------------------------------------------------
+TEST(Sessions, concurrentClientsAreIsolated)
+{
+    static constexpr int DISC_PORT = 19033;
+    static constexpr int CMD_PORT  = 19031;
+    static constexpr int STR_PORT  = 19032;
+    static constexpr int NUM_CLIENTS = 4;
+
+    fs::path dir = fs::temp_directory_path() / "rcs_sessions_test";
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+    fs::create_directories(dir, ec);
+
+    RemoteCommandServerOptions options;
+    options.acceptor_threads = 4;
+    RemoteCommandServer* server = openRemoteCommandServer(DISC_PORT, CMD_PORT, STR_PORT,
+                                                          dir.string().c_str(), options);
+    ASSERT_NE(server, nullptr);
+
+#ifndef _WIN32
+    // A stream connection that sends part of a frame and stalls holds up
+    // neither the clients behind it nor closing the server
+    int stalled = connectRaw(STR_PORT);
+    ASSERT_GE(stalled, 0);
+    ASSERT_EQ(::send(stalled, "R", 1, 0), 1);
+#endif
+
+    std::vector<RemoteCommandClient*> clients;
+    for (int i = 0; i < NUM_CLIENTS; ++i) {
+        RemoteCommandClient* client = createRemoteCommandClient(CMD_PORT, STR_PORT);
+        ASSERT_NE(client, nullptr) << "client " << i;
+        clients.push_back(client);
+    }
+
+    // Working directories are per session
+    for (int i = 0; i < NUM_CLIENTS; ++i) {
+        std::string name = "client" + std::to_string(i);
+        ASSERT_TRUE(createDirectory(clients[i], name.c_str()));
+        ASSERT_TRUE(moveWorkingDirectory(clients[i], name.c_str()));
+    }
+    for (int i = 0; i < NUM_CLIENTS; ++i) {
+        const char* cwd = currentWorkingDirectory(clients[i]);
+        ASSERT_NE(cwd, nullptr);
+        EXPECT_EQ(fs::path(cwd).filename().string(), "client" + std::to_string(i));
+    }
+
+#ifndef _WIN32
+    // Every stream was bound to its own session despite the stalled one
+    for (int i = 0; i < NUM_CLIENTS; ++i) {
+        onRemoteOutput(clients[i], onOutput);
+        EXPECT_EQ(runCaptured(clients[i], "pwd").out, (fs::canonical(dir) / ("client" + std::to_string(i))).string() + "\n");
+    }
+#endif
+
+    // Commands from different sessions do not wait for each other
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < NUM_CLIENTS; ++i)
+        threads.emplace_back([&clients, i]() { runCommand(clients[i], "sleep 0.5 && echo done > out.txt"); });
+    for (auto& t : threads) t.join();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    std::printf("  %d x 500 ms commands took %lld ms\n", NUM_CLIENTS, static_cast<long long>(elapsed));
+    EXPECT_LT(elapsed, 500 * NUM_CLIENTS - 500);
+
+    for (int i = 0; i < NUM_CLIENTS; ++i)
+        EXPECT_TRUE(fs::exists(dir / ("client" + std::to_string(i)) / "out.txt"));
+
+#ifndef _WIN32
+    // A stream connection presenting a token no session holds is refused
+    {
+        int raw = connectRaw(STR_PORT);
+        ASSERT_GE(raw, 0);
+        RemoteCommandSessionTokenInner guess;
+        RemoteCommandStreamHeader attach(RemoteCommandStreamType::STREAM_ATTACH, sizeof(guess));
+        ASSERT_EQ(::send(raw, &attach, sizeof(attach), 0), static_cast<ssize_t>(sizeof(attach)));
+        ASSERT_EQ(::send(raw, &guess, sizeof(guess), 0), static_cast<ssize_t>(sizeof(guess)));
+        char byte;
+        EXPECT_EQ(::recv(raw, &byte, 1, 0), 0);
+        ::close(raw);
+    }
+#endif
+
+#ifdef __linux__
+    // Children inherit none of the server's connections, theirs or others'
+    EXPECT_EQ(runCommand(clients[0], "find /proc/self/fd -lname 'socket:*' | grep -q . && exit 1; exit 0"), 0);
+#endif
+
+    for (auto* client : clients)
+        releaseRemoteCommandClient(client);
+    closeRemoteCommandServer(server);
+#ifndef _WIN32
+    ::close(stalled);
+#endif
+    fs::remove_all(dir, ec);
+}
+
+// ---------------------------------------------------------------------------
+// Older servers
+//
+// A server from before INSTRUCTION_SESSION_ID skips it without replying.  A
+// raw socket pair plays one: the client must still connect, leave its stream
+// unnamed for arrival-order pairing, and skip the reply should it turn up
+// late after all.
+// ---------------------------------------------------------------------------
+#ifndef _WIN32
+static int listenRaw(int port)
+{
+    int sock = ::socket(AF_INET, SOCK_STREAM, 0);
+    fcntl(sock, F_SETFD, FD_CLOEXEC);
+    int yes = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    sockaddr_in addr {};
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(sock, 4) != 0) {
+        ::close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+static bool recvExactly(int sock, void* data, size_t size)
+{
+    return size == 0 || ::recv(sock, data, size, MSG_WAITALL) == static_cast<ssize_t>(size);
+}
+
+TEST(Sessions, olderServerWithoutSessionId)
+{
+    static constexpr int CMD_PORT = 19221;
+    static constexpr int STR_PORT = 19222;
+
+    int command_listener = listenRaw(CMD_PORT);
+    int stream_listener  = listenRaw(STR_PORT);
+    ASSERT_GE(command_listener, 0);
+    ASSERT_GE(stream_listener, 0);
+
+    int command = -1, stream = -1;
+    std::thread old_server([&]() {
+        command = ::accept(command_listener, nullptr, nullptr);
+        RemoteCommandRequestHeader ask(RemoteCommandInstruction::INSTRUCTION_EMPTY);
+        recvExactly(command, &ask, sizeof(ask));        // and never answer it
+        stream = ::accept(stream_listener, nullptr, nullptr);
+    });
+    auto start = std::chrono::steady_clock::now();
+    RemoteCommandClient* client = createRemoteCommandClient(CMD_PORT, STR_PORT);
+    old_server.join();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    ASSERT_NE(client, nullptr);
+    EXPECT_LT(elapsed, 5000);
+
+    // Nothing names the stream
+    char byte;
+    EXPECT_EQ(::recv(stream, &byte, 1, MSG_DONTWAIT), -1);
+
+    // A late SESSION_ID reply ahead of the next one is skipped
+    std::thread late_reply([&]() {
+        RemoteCommandRequestHeader req(RemoteCommandInstruction::INSTRUCTION_EMPTY);
+        recvExactly(command, &req, sizeof(req));
+        std::vector<char> path(req.payload_0_length);
+        recvExactly(command, path.data(), path.size());
+
+        RemoteCommandResponseHeader late(RemoteCommandInstruction::INSTRUCTION_SESSION_ID, sizeof(uint32_t));
+        uint32_t id = 7;
+        RemoteCommandResponseHeader resp(req.instruction, sizeof(bool));
+        bool exists = true;
+        ::send(command, &late, sizeof(late), 0);
+        ::send(command, &id, sizeof(id), 0);
+        ::send(command, &resp, sizeof(resp), 0);
+        ::send(command, &exists, sizeof(exists), 0);
+    });
+    EXPECT_TRUE(directoryExists(client, "anything"));
+    late_reply.join();
+
+    releaseRemoteCommandClient(client);
+    ::close(command);
+    ::close(stream);
+    ::close(command_listener);
+    ::close(stream_listener);
+}
+#endif
+
+// ---------------------------------------------------------------------------
+// Warm interpreters
+//
+// python3 commands without shell syntax run on a preloaded zygote (json is
+// already imported there, unlike in a fresh interpreter); -c, -m and script
+// forms, exit codes, tracebacks, cwd and an empty stdin behave as usual.
+// ---------------------------------------------------------------------------
+#ifndef _WIN32
+TEST(Zygote, pythonCommandsRunWarm)
+{
+    if (std::system("python3 -c pass > /dev/null 2>&1") != 0)
+        GTEST_SKIP() << "python3 is not available";
+
+    static constexpr int DISC_PORT = 19043;
+    static constexpr int CMD_PORT  = 19041;
+    static constexpr int STR_PORT  = 19042;
+
+    fs::path dir = fs::temp_directory_path() / "rcs_zygote_test";
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+    fs::create_directories(dir / "tools", ec);
+    std::ofstream(dir / "tools" / "tool.py") << "import sys, json\nprint(json.dumps(sys.argv[1:]))\nsys.exit(3)\n";
+    std::ofstream(dir / "tools" / "mod_tool.py") << "print('module', __name__)\n";
+
+    RemoteCommandServerOptions options;
+    options.python_workers = 2;
+    options.python_preload = "json";
+    RemoteCommandServer* server = openRemoteCommandServer(DISC_PORT, CMD_PORT, STR_PORT,
+                                                          dir.string().c_str(), options);
+    ASSERT_NE(server, nullptr);
+    RemoteCommandClient* client = createRemoteCommandClient(CMD_PORT, STR_PORT);
+    ASSERT_NE(client, nullptr);
+    onRemoteOutput(client, onOutput);
+    onRemoteError(client, onError);
+
+    auto run = [client](const char* cmd, std::string& out, std::string& err) {
+        {
+            std::lock_guard<std::mutex> lk(g_buf_mutex);
+            g_stdout_buf.clear();
+            g_stderr_buf.clear();
+        }
+        int32_t exit_code = runCommandImpl(client, cmd);
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        std::lock_guard<std::mutex> lk(g_buf_mutex);
+        out = g_stdout_buf;
+        err = g_stderr_buf;
+        return exit_code;
+    };
+    std::string out, err;
+
+    // ---- 1. warm vs. shell ----
+    EXPECT_EQ(run("python3 -c 'import sys; print(\"json\" in sys.modules)'", out, err), 0);
+    EXPECT_EQ(out, "True\n");
+    EXPECT_EQ(run("python3 -c 'import sys; print(\"json\" in sys.modules)' | cat", out, err), 0);
+    EXPECT_EQ(out, "False\n");
+
+    // ---- 2. -c with arguments, exit codes, tracebacks, empty stdin ----
+    EXPECT_EQ(run("python3 -c 'import sys; print(sys.argv[1:]); sys.exit(4)' a \"b c\"", out, err), 4);
+    EXPECT_EQ(out, "['a', 'b c']\n");
+    EXPECT_EQ(run("python3 -c '1 / 0'", out, err), 1);
+    EXPECT_NE(err.find("ZeroDivisionError"), std::string::npos);
+    EXPECT_EQ(run("python3 -c 'import sys; print(repr(sys.stdin.read()))'", out, err), 0);
+    EXPECT_EQ(out, "''\n");
+
+    // ---- 2b. the job exits like an interpreter: threads, then atexit ----
+    EXPECT_EQ(run("python3 -c 'import atexit,threading,time; atexit.register(print,\"atexit-ran\"); "
+                  "threading.Thread(target=lambda:(time.sleep(0.2),print(\"thread-ran\"))).start()'", out, err), 0);
+    EXPECT_EQ(out, "thread-ran\natexit-ran\n");
+
+    // ---- 3. scripts and modules, relative to the session's cwd ----
+    ASSERT_TRUE(moveWorkingDirectory(client, "tools"));
+    EXPECT_EQ(run("python3 tool.py x", out, err), 3);
+    EXPECT_EQ(out, "[\"x\"]\n");
+    EXPECT_EQ(run("python3 -m mod_tool", out, err), 0);
+    EXPECT_EQ(out, "module __main__\n");
+
+    // ---- 4. jobs do not leak state into the zygote ----
+    EXPECT_EQ(run("python3 -c 'import os; os.environ[\"LEAK\"] = \"1\"'", out, err), 0);
+    EXPECT_EQ(run("python3 -c 'import os; print(os.environ.get(\"LEAK\"))'", out, err), 0);
+    EXPECT_EQ(out, "None\n");
+
+    releaseRemoteCommandClient(client);
+    closeRemoteCommandServer(server);
+    fs::remove_all(dir, ec);
+}
+#endif
+
+#ifdef __linux__
+// ---------------------------------------------------------------------------
+// Reserved cores: spawned processes stay off the cores kept for the server.
+// ---------------------------------------------------------------------------
+TEST(Launch, reservedCoresAreLeftToTheServer)
+{
+    static constexpr int DISC_PORT = 19053;
+    static constexpr int CMD_PORT  = 19051;
+    static constexpr int STR_PORT  = 19052;
+
+    fs::path dir = fs::temp_directory_path() / "rcs_launch_test";
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+    fs::create_directories(dir, ec);
+
+    RemoteCommandServerOptions options;
+    options.server_cores = "0";
+    RemoteCommandServer* server = openRemoteCommandServer(DISC_PORT, CMD_PORT, STR_PORT,
+                                                          dir.string().c_str(), options);
+    ASSERT_NE(server, nullptr);
+    RemoteCommandClient* client = createRemoteCommandClient(CMD_PORT, STR_PORT);
+    ASSERT_NE(client, nullptr);
+
+    auto allowedCpus = [&dir, client]() {
+        EXPECT_EQ(runCommandImpl(client, "grep Cpus_allowed_list /proc/self/status > cpus.txt"), 0);
+        std::ifstream f(dir / "cpus.txt");
+        std::string line;
+        std::getline(f, line);
+        return line;
+    };
+
+    unsigned cores = std::thread::hardware_concurrency();
+    if (cores > 1) {
+        // Core 0 is the server's; the rest is the commands'
+        std::string expected = cores == 2 ? "1" : "1-" + std::to_string(cores - 1);
+        EXPECT_EQ(allowedCpus(), "Cpus_allowed_list:\t" + expected);
+    } else {
+        // Nothing would be left, so nothing is kept back
+        EXPECT_EQ(allowedCpus(), "Cpus_allowed_list:\t0");
+    }
+
+    // Explicit affinity may still ask for a reserved core
+    RemoteLaunchOptions launch;
+    launch.cpus = { 0 };
+    ASSERT_TRUE(setLaunchOptions(client, launch));
+    EXPECT_EQ(allowedCpus(), "Cpus_allowed_list:\t0");
+
+    releaseRemoteCommandClient(client);
+    closeRemoteCommandServer(server);
+    fs::remove_all(dir, ec);
+}
+#endif
+
+#ifndef _WIN32
+// ---------------------------------------------------------------------------
+// Job queue: with one slot, jobs wait for it and report the wait; a HIGH
+// session overtakes a LOW one that queued first; built-ins never wait.
+// ---------------------------------------------------------------------------
+TEST(Scheduler, jobsWaitForASlot)
+{
+    static constexpr int DISC_PORT = 19063;
+    static constexpr int CMD_PORT  = 19061;
+    static constexpr int STR_PORT  = 19062;
+
+    RemoteCommandServerOptions options;
+    options.job_slots = 1;
+    RemoteCommandServer* server = openRemoteCommandServer(DISC_PORT, CMD_PORT, STR_PORT, ".", options);
+    ASSERT_NE(server, nullptr);
+
+    RemoteCommandClient* holder = createRemoteCommandClient(CMD_PORT, STR_PORT);
+    RemoteCommandClient* low    = createRemoteCommandClient(CMD_PORT, STR_PORT);
+    RemoteCommandClient* high   = createRemoteCommandClient(CMD_PORT, STR_PORT);
+    ASSERT_NE(holder, nullptr);
+    ASSERT_NE(low, nullptr);
+    ASSERT_NE(high, nullptr);
+    ASSERT_TRUE(setJobPriority(low, RemoteJobPriority::LOW));
+    ASSERT_TRUE(setJobPriority(high, RemoteJobPriority::HIGH));
+
+    // ---- 1. a running command makes the next one wait ----
+    std::thread first([holder]() { EXPECT_EQ(runCommandImpl(holder, "sleep 1"), 0); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    EXPECT_EQ(runCommandImpl(low, "sleep 0"), 0);
+    EXPECT_GE(lastQueueTime(low), 400u);
+    first.join();
+    EXPECT_EQ(runCommandImpl(low, "sleep 0"), 0);
+    EXPECT_LT(lastQueueTime(low), 200u);
+
+    // ---- 2. HIGH overtakes LOW; built-ins do not queue ----
+    int32_t pid = openProcessImpl(holder, "sleep 30");
+    ASSERT_NE(pid, -1);
+    std::mutex order_mtx;
+    std::vector<std::string> order;
+    std::thread low_job([&]() {
+        EXPECT_EQ(runCommandImpl(low, "sleep 0"), 0);
+        std::lock_guard<std::mutex> lk(order_mtx);
+        order.push_back("low");
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    std::thread high_job([&]() {
+        EXPECT_EQ(runCommandImpl(high, "sleep 0.3"), 0);
+        std::lock_guard<std::mutex> lk(order_mtx);
+        order.push_back("high");
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    RemoteCommandClient* other = createRemoteCommandClient(CMD_PORT, STR_PORT);
+    ASSERT_NE(other, nullptr);
+    EXPECT_EQ(runCommandImpl(other, "true"), 0);
+    EXPECT_EQ(lastQueueTime(other), 0u);
+
+    closeProcess(holder, pid);
+    high_job.join();
+    low_job.join();
+    ASSERT_EQ(order.size(), 2u);
+    EXPECT_EQ(order[0], "high");
+    EXPECT_EQ(order[1], "low");
+
+    // ---- 3. scripts and graphs are jobs; parallel nodes need slots too ----
+    std::thread busy([holder]() { EXPECT_EQ(runCommandImpl(holder, "sleep 1"), 0); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    auto started = std::chrono::steady_clock::now();
+    std::vector<RemoteNodeResult> results;
+    EXPECT_TRUE(runCommandScript(low, { "true" }, RemoteScriptOptions(), results));
+    EXPECT_GE(std::chrono::steady_clock::now() - started, std::chrono::milliseconds(400));
+    busy.join();
+
+    std::vector<RemoteCommandNode> pair(2);
+    pair[0].command = "sleep 0.5";
+    pair[1].command = "sleep 0.5";
+    started = std::chrono::steady_clock::now();
+    EXPECT_TRUE(runCommandGraph(low, pair, 2, results));
+    EXPECT_GE(std::chrono::steady_clock::now() - started, std::chrono::milliseconds(950));
+
+    releaseRemoteCommandClient(other);
+    releaseRemoteCommandClient(high);
+    releaseRemoteCommandClient(low);
+    releaseRemoteCommandClient(holder);
+    closeRemoteCommandServer(server);
+}
+#endif
+
+// ---------------------------------------------------------------------------
+// Metrics
+//
+// GET_STATS counts requests per instruction, bytes per channel and spawns;
+// the Prometheus file carries the same numbers.
+// ---------------------------------------------------------------------------
+TEST(Metrics, statsAndPrometheusDump)
+{
+    static constexpr int DISC_PORT = 19073;
+    static constexpr int CMD_PORT  = 19071;
+    static constexpr int STR_PORT  = 19072;
+    static constexpr int HTTP_PORT = 19223;
+
+    const fs::path metrics_file = fs::temp_directory_path() / "rcs_metrics.prom";
+    std::error_code ec;
+    fs::remove(metrics_file, ec);
+    const std::string metrics_path = metrics_file.string();
+
+    RemoteCommandServerOptions options;
+    options.metrics_file        = metrics_path.c_str();
+    options.metrics_interval_ms = 100;
+    options.metrics_port        = HTTP_PORT;
+    RemoteCommandServer* server = openRemoteCommandServer(DISC_PORT, CMD_PORT, STR_PORT, ".", options);
+    ASSERT_NE(server, nullptr);
+    RemoteCommandClient* client = createRemoteCommandClient(CMD_PORT, STR_PORT);
+    ASSERT_NE(client, nullptr);
+
+    // Goes through the shell: a pipe is not a built-in command
+#ifdef _WIN32
+    const char* command = "cmd /c echo metrics";
+#else
+    const char* command = "echo metrics | cat";
+#endif
+    EXPECT_EQ(runCommandImpl(client, command), 0);
+    EXPECT_EQ(runCommandImpl(client, command), 0);
+
+    RemoteServerStats stats;
+    ASSERT_TRUE(getServerStats(client, stats));
+    EXPECT_EQ(stats.sessions_accepted, 1u);
+    EXPECT_EQ(stats.sessions_active, 1u);
+    EXPECT_GT(stats.command_bytes_received, 2 * strlen(command));
+    EXPECT_GT(stats.command_bytes_sent, 0u);
+    EXPECT_GE(stats.stream_bytes_sent, 2 * strlen("metrics\n")) << "output travels on the stream channel";
+    EXPECT_EQ(stats.spawn.count, 2u);
+    EXPECT_LE(stats.spawn.p50_us, stats.spawn.p99_us);
+    EXPECT_LE(stats.spawn.p99_us, stats.spawn.max_us);
+    EXPECT_EQ(stats.job_queue.count, 2u);
+
+    const RemoteInstructionStats* run = nullptr;
+    for (const auto& entry : stats.instructions) {
+        if (entry.instruction == 0x10002000) run = &entry;
+    }
+    ASSERT_NE(run, nullptr) << "runCommand is broken down";
+    EXPECT_EQ(run->receive.count, 2u);
+    EXPECT_EQ(run->execute.count, 2u);
+    EXPECT_EQ(run->send.count, 2u);
+    EXPECT_GT(run->execute.p50_us, 0u) << "a shell pipeline takes time";
+    EXPECT_GE(run->execute.total_us, run->execute.p50_us);
+
+    // The exporter rewrites the file every 100 ms
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    auto readFile = [&metrics_file]() {
+        std::ifstream f(metrics_file);
+        return std::string((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    };
+    std::string text = readFile();
+    EXPECT_NE(text.find("# TYPE remote_command_request_seconds summary"), std::string::npos);
+    EXPECT_NE(text.find("remote_command_request_seconds_count{instruction=\"run_command\",phase=\"execute\"} 2"),
+              std::string::npos) << text;
+    EXPECT_NE(text.find("remote_command_bytes_total{channel=\"stream\",direction=\"sent\"}"), std::string::npos);
+    EXPECT_NE(text.find("remote_command_sessions_active 1"), std::string::npos);
+
+#ifndef _WIN32
+    // The same text over HTTP; a connection that never sends a request does
+    // not hold up the scrape behind it
+    {
+        int idle   = connectRaw(HTTP_PORT);
+        int scrape = connectRaw(HTTP_PORT);
+        ASSERT_GE(idle, 0);
+        ASSERT_GE(scrape, 0);
+        const char get[] = "GET /metrics HTTP/1.0\r\n\r\n";
+        ASSERT_EQ(::send(scrape, get, sizeof(get) - 1, 0), static_cast<ssize_t>(sizeof(get) - 1));
+        std::string reply;
+        char buffer[4096];
+        ssize_t received;
+        while ((received = ::recv(scrape, buffer, sizeof(buffer), 0)) > 0)
+            reply.append(buffer, static_cast<size_t>(received));
+        EXPECT_EQ(reply.compare(0, 15, "HTTP/1.0 200 OK"), 0) << reply;
+        EXPECT_NE(reply.find("remote_command_sessions_active 1"), std::string::npos);
+        ::close(scrape);
+        ::close(idle);
+    }
+#endif
+
+    releaseRemoteCommandClient(client);
+    closeRemoteCommandServer(server);
+
+    // A last dump is written on close
+    text = readFile();
+    EXPECT_NE(text.find("remote_command_request_seconds_count{instruction=\"get_stats\",phase=\"send\"} 1"),
+              std::string::npos);
+    fs::remove(metrics_file, ec);
+}
+
+// ---------------------------------------------------------------------------
+// Recording
+//
+// record_file logs every request in arrival order, with its payloads when
+// record_payloads is set, and marks the end of each session.
+// ---------------------------------------------------------------------------
+TEST(Recording, requestsAreLogged)
+{
+    static constexpr int DISC_PORT = 19093;
+    static constexpr int CMD_PORT  = 19091;
+    static constexpr int STR_PORT  = 19092;
+
+    const fs::path dir  = fs::temp_directory_path() / "rcs_recording";
+    const fs::path file = fs::temp_directory_path() / "rcs_recording.bin";
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+    fs::create_directories(dir, ec);
+    std::ofstream(dir / "local.txt") << "recorded upload";
+    const std::string record_path = file.string();
+    const std::string local_path  = (dir / "local.txt").string();
+
+    RemoteCommandServerOptions options;
+    options.record_file     = record_path.c_str();
+    options.record_payloads = true;
+    RemoteCommandServer* server = openRemoteCommandServer(DISC_PORT, CMD_PORT, STR_PORT, dir.string().c_str(), options);
+    ASSERT_NE(server, nullptr);
+    RemoteCommandClient* client = createRemoteCommandClient(CMD_PORT, STR_PORT);
+    ASSERT_NE(client, nullptr);
+    EXPECT_EQ(runCommandImpl(client, "true"), 0);
+    EXPECT_TRUE(uploadFile(client, local_path.c_str(), "remote.txt"));
+    releaseRemoteCommandClient(client);
+    closeRemoteCommandServer(server);
+
+    std::ifstream in(file, std::ios::binary);
+    RemoteCommandRecordingHeader header;
+    ASSERT_TRUE(in.read(reinterpret_cast<char*>(&header), sizeof(header)));
+    ASSERT_TRUE(header.valid());
+    EXPECT_EQ(header.flags & RECORDING_PAYLOADS, RECORDING_PAYLOADS);
+
+    std::vector<RemoteCommandRecordInner> records;
+    std::vector<std::string>              first_payloads;
+    RemoteCommandRecordInner record;
+    while (in.read(reinterpret_cast<char*>(&record), sizeof(record))) {
+        std::string payloads[4];
+        for (size_t i = 0; i < 4; ++i) {
+            payloads[i].assign(record.payload_length[i], '\0');
+            if (!payloads[i].empty()) {
+                ASSERT_TRUE(in.read(&payloads[i][0], payloads[i].size()));
+            }
+        }
+        records.push_back(record);
+        first_payloads.push_back(payloads[0]);
+    }
+    ASSERT_EQ(records.size(), 4u) << "session id, run, upload, end of session";
+    EXPECT_EQ(records[0].instruction, RemoteCommandInstruction::INSTRUCTION_SESSION_ID);
+    EXPECT_EQ(records[1].instruction, RemoteCommandInstruction::INSTRUCTION_RUN_COMMAND);
+    EXPECT_EQ(first_payloads[1].c_str(), std::string("true"));
+    EXPECT_EQ(records[2].instruction, RemoteCommandInstruction::INSTRUCTION_UPLOAD_FILE);
+    EXPECT_EQ(records[2].payload_length[1], strlen("recorded upload"));
+    EXPECT_EQ(records[3].instruction, RemoteCommandInstruction::INSTRUCTION_EMPTY);
+    for (size_t i = 1; i < records.size(); ++i) {
+        EXPECT_EQ(records[i].session_id, records[0].session_id);
+        EXPECT_GE(records[i].offset_us, records[i - 1].offset_us);
+    }
+
+    in.close();
+    fs::remove(file, ec);
+    fs::remove_all(dir, ec);
+}
+
+// ---------------------------------------------------------------------------
+// Lock statistics (server built with -DREMOTE_COMMAND_LOCK_STATS=ON)
+//
+// A command flooding stdout and stderr at once makes both reader threads
+// fight over the session's stream mutex; GET_STATS shows the fight.
+// ---------------------------------------------------------------------------
+TEST(Metrics, streamLockContention)
+{
+    static constexpr int DISC_PORT = 19083;
+    static constexpr int CMD_PORT  = 19081;
+    static constexpr int STR_PORT  = 19082;
+
+    const fs::path metrics_file = fs::temp_directory_path() / "rcs_lock_metrics.prom";
+    std::error_code ec;
+    fs::remove(metrics_file, ec);
+    const std::string metrics_path = metrics_file.string();
+
+    RemoteCommandServerOptions options;
+    options.metrics_file = metrics_path.c_str();
+    RemoteCommandServer* server = openRemoteCommandServer(DISC_PORT, CMD_PORT, STR_PORT, ".", options);
+    ASSERT_NE(server, nullptr);
+    RemoteCommandClient* client = createRemoteCommandClient(CMD_PORT, STR_PORT);
+    ASSERT_NE(client, nullptr);
+    onRemoteOutput(client, [](const char*) {});
+    onRemoteError(client, [](const char*) {});
+
+    RemoteServerStats before;
+    ASSERT_TRUE(getServerStats(client, before));
+    if (before.locks.empty()) {
+        releaseRemoteCommandClient(client);
+        closeRemoteCommandServer(server);
+        fs::remove(metrics_file, ec);
+        GTEST_SKIP() << "server built without REMOTE_COMMAND_LOCK_STATS";
+    }
+
+#ifdef _WIN32
+    const char* command = "cmd /c \"for /L %i in (1,1,20000) do @(echo out & echo err 1>&2)\"";
+#else
+    const char* command = "(yes out | head -n 200000) & (yes err | head -n 200000 >&2); wait";
+#endif
+    for (int i = 0; i < 4; ++i)
+        EXPECT_EQ(runCommandImpl(client, command), 0);
+
+    RemoteServerStats after;
+    ASSERT_TRUE(getServerStats(client, after));
+    ASSERT_EQ(after.locks.size(), 1u);
+    const RemoteLockStats& lock = after.locks[0];
+    EXPECT_EQ(lock.name, "stream");
+    EXPECT_GT(lock.acquisitions, before.locks[0].acquisitions + 8) << "many frames on both channels";
+    EXPECT_LE(lock.contended, lock.acquisitions);
+    EXPECT_EQ(lock.wait.count, lock.acquisitions);
+    EXPECT_LE(lock.hold.count, lock.acquisitions);
+    EXPECT_LE(lock.hold.p50_us, lock.hold.max_us);
+    std::printf("  stream lock : %llu acquisitions, %llu contended, wait p99 %u us, hold p99 %u us\n",
+                static_cast<unsigned long long>(lock.acquisitions),
+                static_cast<unsigned long long>(lock.contended),
+                lock.wait.p99_us, lock.hold.p99_us);
+    std::fflush(stdout);
+
+    releaseRemoteCommandClient(client);
+    closeRemoteCommandServer(server);
+
+    // The whole lock block reaches the dump written on close
+    std::ifstream f(metrics_file);
+    const std::string text((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    EXPECT_NE(text.find("\nremote_command_lock_acquisitions_total{lock=\"stream\"} "), std::string::npos) << text;
+    EXPECT_NE(text.find("\nremote_command_lock_contended_total{lock=\"stream\"} "), std::string::npos) << text;
+    EXPECT_NE(text.find("\nremote_command_lock_hold_seconds_count{lock=\"stream\"} "), std::string::npos) << text;
+    fs::remove(metrics_file, ec);
+}
+
+// ---------------------------------------------------------------------------
+// In-memory transport: an in_memory server binds nothing, so the same ports
+// refuse TCP while an in-memory client runs commands, streams output and
+// moves files through it.
+// ---------------------------------------------------------------------------
+TEST(InMemory, clientServerWithoutSockets)
+{
+    static constexpr int DISC_PORT = 19203;
+    static constexpr int CMD_PORT  = 19201;
+    static constexpr int STR_PORT  = 19202;
+
+    const fs::path dir = fs::temp_directory_path() / "rcs_in_memory";
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+    fs::create_directories(dir / "remote", ec);
+    const std::string local_path = (dir / "local.bin").string();
+    const std::string back_path  = (dir / "back.bin").string();
+    std::string content(6 * 1024 * 1024, '\0');
+    for (size_t i = 0; i < content.size(); ++i) content[i] = static_cast<char>(i * 31);
+    std::ofstream(local_path, std::ios::binary) << content;
+
+    EXPECT_EQ(createInMemoryRemoteCommandClient(CMD_PORT, STR_PORT), nullptr) << "no server yet";
+
+    RemoteCommandServerOptions options;
+    options.in_memory = true;
+    RemoteCommandServer* server = openRemoteCommandServer(DISC_PORT, CMD_PORT, STR_PORT,
+                                                          (dir / "remote").string().c_str(), options);
+    ASSERT_NE(server, nullptr);
+    EXPECT_EQ(openRemoteCommandServer(DISC_PORT, CMD_PORT, STR_PORT, ".", options), nullptr)
+        << "ports are taken among in-memory servers";
+    EXPECT_EQ(createRemoteCommandClient(CMD_PORT, STR_PORT), nullptr) << "nothing listens on TCP";
+
+    RemoteCommandClient* client = createInMemoryRemoteCommandClient(CMD_PORT, STR_PORT);
+    ASSERT_NE(client, nullptr);
+    EXPECT_STREQ(getRemoteCommandServerAddress(client), "memory");
+    {
+        std::lock_guard<std::mutex> lk(g_buf_mutex);
+        g_stdout_buf.clear();
+    }
+    onRemoteOutput(client, onOutput);
+    onRemoteError(client, onError);
+
+#ifdef _WIN32
+    EXPECT_EQ(runCommandImpl(client, "cmd /c echo in_memory_output"), 0);
+#else
+    EXPECT_EQ(runCommandImpl(client, "echo in_memory_output; true"), 0);
+#endif
+    for (int i = 0; i < 100; ++i) {
+        {
+            std::lock_guard<std::mutex> lk(g_buf_mutex);
+            if (g_stdout_buf.find("in_memory_output") != std::string::npos) break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    {
+        std::lock_guard<std::mutex> lk(g_buf_mutex);
+        EXPECT_NE(g_stdout_buf.find("in_memory_output"), std::string::npos);
+    }
+
+    // Larger than one pipe's buffer in each direction
+    ASSERT_TRUE(uploadFile(client, local_path.c_str(), "copy.bin"));
+    ASSERT_TRUE(downloadFile(client, back_path.c_str(), "copy.bin"));
+    std::ifstream back(back_path, std::ios::binary);
+    std::string received((std::istreambuf_iterator<char>(back)), std::istreambuf_iterator<char>());
+    EXPECT_TRUE(received == content);
+
+    RemoteCommandClient* second = createInMemoryRemoteCommandClient(CMD_PORT, STR_PORT);
+    ASSERT_NE(second, nullptr);
+    EXPECT_TRUE(directoryExists(second, "."));
+    releaseRemoteCommandClient(second);
+
+    releaseRemoteCommandClient(client);
+    closeRemoteCommandServer(server);
+    EXPECT_EQ(createInMemoryRemoteCommandClient(CMD_PORT, STR_PORT), nullptr) << "listeners are gone";
+
+    back.close();
+    fs::remove_all(dir, ec);
+}